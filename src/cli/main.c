@@ -27,7 +27,9 @@
 
 #include "common/collection.h"
 #include "common/darktable.h"
+#include "common/database.h"
 #include "common/debug.h"
+#include "common/dtpthread.h"
 #include "common/exif.h"
 #include "common/film.h"
 #include "common/file_location.h"
@@ -35,6 +37,7 @@
 #include "common/image.h"
 #include "common/image_cache.h"
 #include "common/points.h"
+#include "common/variables.h"
 #include "control/conf.h"
 #include "develop/imageop.h"
 #include "imageio/imageio_common.h"
@@ -59,6 +62,63 @@
 // Make sure it's OK to limit output extension length
 #define DT_MAX_OUTPUT_EXT_LENGTH 5
 
+// state shared by the parallel export workers
+typedef struct _export_job_t
+{
+  dt_imageio_module_storage_t *storage;
+  dt_imageio_module_format_t *format;
+  dt_imageio_module_data_t *sdata, *fdata; // template parameters, copied by each worker
+  int *ids;
+  int *results;
+  int total;
+  int next;                                // next image to export, atomic
+  int omp_threads;
+  int workers;                             // pipes sharing the memory
+  gboolean high_quality, upscale, export_masks;
+  dt_colorspaces_color_profile_type_t icc_type;
+  const gchar *icc_filename;
+  dt_iop_color_intent_t icc_intent;
+} _export_job_t;
+
+static int _export_image(_export_job_t *job,
+                         dt_imageio_module_data_t *sdata,
+                         dt_imageio_module_data_t *fdata,
+                         const int index)
+{
+  dt_export_metadata_t metadata;
+  metadata.flags = dt_lib_export_metadata_default_flags();
+  metadata.list = NULL;
+  // the sequence number is the position in the list, independent of
+  // the order the images are finished in
+  return job->storage->store(job->storage, sdata, job->ids[index], job->format, fdata,
+                             index + 1, job->total, job->high_quality, job->upscale,
+                             job->export_masks, job->icc_type, job->icc_filename,
+                             job->icc_intent, &metadata) != 0;
+}
+
+static void *_export_worker(void *data)
+{
+  _export_job_t *job = (_export_job_t *)data;
+#ifdef _OPENMP
+  omp_set_num_threads(job->omp_threads);
+#endif
+  dt_dev_pixelpipe_set_export_concurrency(job->workers);
+  // private parameters, the format module writes the image size to them
+  dt_imageio_module_data_t *sdata = job->storage->get_params(job->storage);
+  dt_imageio_module_data_t *fdata = job->format->get_params(job->format);
+  if(sdata && fdata)
+  {
+    memcpy(sdata, job->sdata, job->storage->params_size(job->storage));
+    memcpy(fdata, job->fdata, job->format->params_size(job->format));
+    int i;
+    while((i = __sync_fetch_and_add(&job->next, 1)) < job->total)
+      job->results[i] = _export_image(job, sdata, fdata, i);
+  }
+  if(sdata) job->storage->free_params(job->storage, sdata);
+  if(fdata) job->format->free_params(job->format, fdata);
+  return NULL;
+}
+
 static void usage(const char *progname)
 {
 fprintf(stderr, "darktable %s\n"
@@ -86,11 +146,24 @@ fprintf(stderr, "darktable %s\n"
                 "   --width <max width> default: 0 = full resolution\n"
 
                 "   --hq <0|1|false|true> default: true\n"
+                "   --jobs <N> number of images exported in parallel, default: 1\n"
+                "   --server  read export jobs as JSON lines from stdin, e.g.\n"
+                "             {\"id\": 1, \"input\": \"a.raw\", \"xmp\": \"a.xmp\", \"output\": \"out/a.jpg\",\n"
+                "              \"format\": \"jpg\", \"style\": \"name\", \"width\": 1024, \"height\": 1024}\n"
+                "             and answer each with a JSON line with status and timing,\n"
+                "             only with the default in-memory library\n"
+                "   --profile <file> write the time and memory used by each module\n"
+                "                    as a Chrome trace with per-module statistics\n"
                 "   --upscale <0|1|false|true>, default: false\n"
                 "   --style <style name>\n"
                 "   --style-overwrite\n"
                 "   --out-ext <extension>, default from output destination or '.jpg'\n"
                 "                          if specified, takes preference over output\n"
+                "   --out <file>[:<width>x<height>][:<icc type>]\n"
+                "                          write an additional output, can be used multiple\n"
+                "                          times instead of DIR. the image is processed once,\n"
+                "                          only the final scaling and color conversion run\n"
+                "                          per output. --jobs does not apply\n"
                 "   --import <file or dir> specify input file or dir, can be used'\n"
                 "                          multiple times instead of input file\n"
                 "   --icc-type <type> specify icc type, default to NONE\n"
@@ -196,6 +269,412 @@ static dt_iop_color_intent_t get_icc_intent(const char* option)
 }
 #undef ICC_INTENT_FROM_STR
 
+// map a file extension to the name of the format module
+static gchar *_format_name(const char *ext)
+{
+  if(!strcmp(ext, "jpg")) return g_strdup("jpeg");
+  if(!strcmp(ext, "tif")) return g_strdup("tiff");
+  if(!strcmp(ext, "jxl")) return g_strdup("jpegxl");
+  return g_strdup(ext);
+}
+
+// one --out spec: <file>[:<width>x<height>][:<icc type>]
+typedef struct _output_spec_t
+{
+  gchar *pattern; // without extension, may contain variables
+  dt_imageio_module_format_t *format;
+  dt_imageio_module_data_t *fdata;
+  dt_colorspaces_color_profile_type_t icc_type;
+} _output_spec_t;
+
+static void _output_spec_free(_output_spec_t *out)
+{
+  if(out->fdata) out->format->free_params(out->format, out->fdata);
+  g_free(out->pattern);
+}
+
+// the optional fields are split off from the end, so paths may contain ':'
+static gboolean _output_spec_parse(const char *spec,
+                                   const int width,
+                                   const int height,
+                                   const dt_colorspaces_color_profile_type_t icc_type,
+                                   const char *style,
+                                   const gboolean style_overwrite,
+                                   _output_spec_t *out)
+{
+  memset(out, 0, sizeof(_output_spec_t));
+  out->pattern = g_strdup(spec);
+  out->icc_type = icc_type;
+  int max_width = width, max_height = height;
+
+  char *colon = strrchr(out->pattern, ':');
+  if(colon && get_icc_type(colon + 1) < DT_COLORSPACE_LAST)
+  {
+    out->icc_type = get_icc_type(colon + 1);
+    *colon = '\0';
+    colon = strrchr(out->pattern, ':');
+  }
+  int w = 0, h = 0;
+  char end;
+  if(colon && sscanf(colon + 1, "%dx%d%c", &w, &h, &end) == 2)
+  {
+    max_width = MAX(w, 0);
+    max_height = MAX(h, 0);
+    *colon = '\0';
+  }
+
+  char *ext = strrchr(out->pattern, '.');
+  if(!ext || strchr(ext, G_DIR_SEPARATOR) || strlen(ext) <= 1
+     || strlen(ext) > DT_MAX_OUTPUT_EXT_LENGTH)
+  {
+    fprintf(stderr, _("no or too long output file extension in --out '%s'\n"), spec);
+    return FALSE;
+  }
+  *ext = '\0';
+  gchar *format_name = _format_name(ext + 1);
+  out->format = dt_imageio_get_format_by_name(format_name);
+  g_free(format_name);
+  if(!out->format)
+  {
+    fprintf(stderr, _("unknown extension '%s'"), ext + 1);
+    fprintf(stderr, "\n");
+    return FALSE;
+  }
+  out->fdata = out->format->get_params(out->format);
+  if(!out->fdata)
+  {
+    fprintf(stderr, "%s\n", _("failed to get parameters from format module, aborting export ..."));
+    return FALSE;
+  }
+
+  uint32_t fw = 0, fh = 0;
+  out->format->dimension(out->format, out->fdata, &fw, &fh);
+  out->fdata->max_width = (fw != 0 && max_width > fw) ? fw : max_width;
+  out->fdata->max_height = (fh != 0 && max_height > fh) ? fh : max_height;
+  out->fdata->style[0] = '\0';
+  out->fdata->style_append = !style_overwrite;
+  if(style) g_strlcpy(out->fdata->style, style, DT_MAX_STYLE_NAME_LENGTH);
+  return TRUE;
+}
+
+// expands the pattern like the disk storage does and creates the directory,
+// an existing file is not overwritten but gets a number appended
+static gboolean _output_filename(dt_variables_params_t *vp,
+                                 const _output_spec_t *out,
+                                 const dt_imgid_t imgid,
+                                 const int num,
+                                 const int total,
+                                 const gboolean upscale,
+                                 char *filename,
+                                 const size_t size)
+{
+  char input_dir[PATH_MAX] = { 0 };
+  dt_image_full_path(imgid, input_dir, sizeof(input_dir), NULL);
+  // several images must not end up in the same file
+  gchar *pattern = total > 1 && !strchr(out->pattern, '$')
+    ? g_strconcat(out->pattern, "_$(SEQUENCE)", NULL)
+    : g_strdup(out->pattern);
+
+  dt_variables_set_max_width_height(vp, out->fdata->max_width, out->fdata->max_height);
+  dt_variables_set_upscale(vp, upscale);
+  vp->filename = input_dir;
+  vp->jobcode = "export";
+  vp->imgid = imgid;
+  vp->sequence = num;
+  gchar *expanded = dt_variables_expand(vp, pattern, TRUE);
+  g_free(pattern);
+
+  gchar *directory = g_path_get_dirname(expanded);
+  const gboolean ok = !g_mkdir_with_parents(directory, 0755);
+  if(!ok) fprintf(stderr, _("error: could not create directory `%s'\n"), directory);
+  g_free(directory);
+
+  const char *ext = out->format->extension(out->fdata);
+  snprintf(filename, size, "%s.%s", expanded, ext);
+  for(int seq = 1; ok && g_file_test(filename, G_FILE_TEST_EXISTS); seq++)
+    snprintf(filename, size, "%s_%.2d.%s", expanded, seq, ext);
+  g_free(expanded);
+  return ok;
+}
+
+// exports every image to all outputs, the pipe runs only once per image up
+// to the point where the outputs differ. returns 1 if anything failed.
+static int _export_multi(GList *id_list,
+                         _output_spec_t *specs,
+                         const int count,
+                         const gboolean upscale,
+                         const gboolean export_masks,
+                         const gchar *icc_filename,
+                         const dt_iop_color_intent_t icc_intent)
+{
+  dt_variables_params_t *vp = NULL;
+  dt_variables_params_init(&vp);
+  dt_imageio_export_output_t *outputs = g_new0(dt_imageio_export_output_t, count);
+  char (*filenames)[PATH_MAX] = g_malloc(count * sizeof(*filenames));
+  const int total = g_list_length(id_list);
+  int res = 0, num = 1;
+
+  for(GList *iter = id_list; iter; iter = g_list_next(iter), num++)
+  {
+    const dt_imgid_t id = GPOINTER_TO_INT(iter->data);
+    gboolean ok = TRUE;
+    for(int j = 0; j < count && ok; j++)
+    {
+      ok = _output_filename(vp, specs + j, id, num, total, upscale,
+                            filenames[j], sizeof(filenames[j]));
+      outputs[j] = (dt_imageio_export_output_t){ .filename = filenames[j],
+                                                 .format = specs[j].format,
+                                                 .format_params = specs[j].fdata,
+                                                 .icc_type = specs[j].icc_type,
+                                                 .icc_filename = icc_filename,
+                                                 .icc_intent = icc_intent };
+    }
+
+    // the outputs share the default metadata of the cli export
+    dt_export_metadata_t metadata;
+    metadata.flags = dt_lib_export_metadata_default_flags();
+    metadata.list = NULL;
+    if(ok)
+      dt_imageio_export_multi(id, outputs, count, upscale, TRUE, export_masks,
+                              NULL, NULL, num, total, &metadata);
+
+    for(int j = 0; j < count; j++)
+    {
+      if(ok && !outputs[j].failed) continue;
+      char path[PATH_MAX] = { 0 };
+      dt_image_full_path(id, path, sizeof(path), NULL);
+      fprintf(stderr, _("error: export of image %d/%d '%s' to '%s' failed\n"),
+              num, total, path, ok ? filenames[j] : specs[j].pattern);
+      res = 1;
+      if(!ok) break;
+    }
+  }
+
+  g_free(filenames);
+  g_free(outputs);
+  dt_variables_params_destroy(vp);
+  return res;
+}
+
+// settings from the command line, the defaults for all jobs of the server
+typedef struct _server_options_t
+{
+  int width, height;
+  gboolean high_quality, upscale, export_masks, style_overwrite;
+  const char *style;
+  dt_colorspaces_color_profile_type_t icc_type;
+  const gchar *icc_filename;
+  dt_iop_color_intent_t icc_intent;
+} _server_options_t;
+
+static const char *_json_string(JsonObject *obj, const char *name, const char *def)
+{
+  JsonNode *node = json_object_get_member(obj, name);
+  return node && JSON_NODE_HOLDS_VALUE(node) ? json_node_get_string(node) : def;
+}
+
+static gint64 _json_int(JsonObject *obj, const char *name, const gint64 def)
+{
+  JsonNode *node = json_object_get_member(obj, name);
+  return node && JSON_NODE_HOLDS_VALUE(node) ? json_node_get_int(node) : def;
+}
+
+static gboolean _json_bool(JsonObject *obj, const char *name, const gboolean def)
+{
+  JsonNode *node = json_object_get_member(obj, name);
+  return node && JSON_NODE_HOLDS_VALUE(node) ? json_node_get_boolean(node) : def;
+}
+
+// run one export job, returns NULL on success or the error message
+static const char *_server_export(JsonObject *job,
+                                  const _server_options_t *opt,
+                                  double *import_time,
+                                  double *export_time)
+{
+  const char *input = _json_string(job, "input", NULL);
+  const char *output = _json_string(job, "output", NULL);
+  const char *xmp = _json_string(job, "xmp", NULL);
+  if(!input || !output) return "input and output are required";
+
+  // the format is given explicitly or taken from the output name
+  gchar *pattern = g_strdup(output);
+  gchar *ext = g_strdup(_json_string(job, "format", NULL));
+  char *dot = strrchr(pattern, '.');
+  if(dot && (!ext || !strcmp(ext, dot + 1)) && strlen(dot) <= DT_MAX_OUTPUT_EXT_LENGTH && strlen(dot) > 1)
+  {
+    if(!ext) ext = g_strdup(dot + 1);
+    *dot = '\0';
+  }
+  gchar *format_name = _format_name(ext ? ext : "jpg");
+  g_free(ext);
+
+  const char *err = NULL;
+  dt_imageio_module_storage_t *storage = dt_imageio_get_storage_by_name("disk");
+  dt_imageio_module_format_t *format = dt_imageio_get_format_by_name(format_name);
+  g_free(format_name);
+  if(!storage) err = "cannot find disk storage module";
+  else if(!format) err = "unknown output format";
+  if(err)
+  {
+    g_free(pattern);
+    return err;
+  }
+
+  double start = dt_get_wtime();
+  gchar *directory = g_path_get_dirname(input);
+  dt_film_t film;
+  const dt_filmid_t filmid = dt_film_new(&film, directory);
+  const dt_imgid_t id = dt_image_import(filmid, input, TRUE, TRUE);
+  g_free(directory);
+  if(!dt_is_valid_imgid(id))
+  {
+    if(dt_film_is_empty(filmid)) dt_film_remove(filmid);
+    g_free(pattern);
+    return "can't open input file";
+  }
+
+  if(xmp)
+  {
+    dt_image_t *image = dt_image_cache_get(id, 'w');
+    if(dt_exif_xmp_read(image, xmp, 1)) err = "can't open XMP file";
+    // don't write new xmp:
+    dt_image_cache_write_release(image, DT_IMAGE_CACHE_RELAXED);
+  }
+  *import_time = dt_get_wtime() - start;
+
+  dt_imageio_module_data_t *sdata = err ? NULL : storage->get_params(storage);
+  dt_imageio_module_data_t *fdata = sdata ? format->get_params(format) : NULL;
+  if(!err && (!sdata || !fdata)) err = "failed to get export parameters";
+
+  if(!err)
+  {
+    start = dt_get_wtime();
+    g_strlcpy((char *)sdata, pattern, DT_MAX_PATH_FOR_PARAMS);
+
+    uint32_t sw = 0, sh = 0, fw = 0, fh = 0;
+    storage->dimension(storage, sdata, &sw, &sh);
+    format->dimension(format, fdata, &fw, &fh);
+    const uint32_t w = (sw == 0 || fw == 0) ? MAX(sw, fw) : MIN(sw, fw);
+    const uint32_t h = (sh == 0 || fh == 0) ? MAX(sh, fh) : MIN(sh, fh);
+    fdata->max_width = MAX(0, _json_int(job, "width", opt->width));
+    fdata->max_height = MAX(0, _json_int(job, "height", opt->height));
+    if(w && fdata->max_width > w) fdata->max_width = w;
+    if(h && fdata->max_height > h) fdata->max_height = h;
+
+    const char *style = _json_string(job, "style", opt->style);
+    fdata->style[0] = '\0';
+    fdata->style_append = !_json_bool(job, "style_overwrite", opt->style_overwrite);
+    if(style) g_strlcpy(fdata->style, style, DT_MAX_STYLE_NAME_LENGTH);
+
+    dt_export_metadata_t metadata;
+    metadata.flags = dt_lib_export_metadata_default_flags();
+    metadata.list = NULL;
+    if(storage->store(storage, sdata, id, format, fdata, 1, 1,
+                      _json_bool(job, "hq", opt->high_quality),
+                      _json_bool(job, "upscale", opt->upscale),
+                      opt->export_masks, opt->icc_type, opt->icc_filename, opt->icc_intent,
+                      &metadata))
+      err = "export failed";
+    *export_time = dt_get_wtime() - start;
+  }
+
+  if(sdata) storage->free_params(storage, sdata);
+  if(fdata) format->free_params(format, fdata);
+  // forget the image, the next job may come with different history,
+  // and its film roll unless other jobs' images are in the same directory
+  dt_image_remove(id);
+  if(dt_film_is_empty(filmid)) dt_film_remove(filmid);
+  g_free(pattern);
+  return err;
+}
+
+static gboolean _read_line(FILE *in, GString *line)
+{
+  char buf[4096];
+  g_string_truncate(line, 0);
+  while(fgets(buf, sizeof(buf), in))
+  {
+    g_string_append(line, buf);
+    if(line->len && line->str[line->len - 1] == '\n') return TRUE;
+  }
+  return line->len > 0;
+}
+
+// read export jobs as one JSON object per line from stdin and answer each
+// of them with one JSON object per line on reply
+static int _server(FILE *reply, const _server_options_t *opt)
+{
+  GString *line = g_string_new(NULL);
+  JsonParser *parser = json_parser_new();
+  JsonGenerator *generator = json_generator_new();
+  int jobs = 0, failed = 0;
+
+  while(_read_line(stdin, line))
+  {
+    g_strstrip(line->str);
+    if(!line->str[0]) continue;
+
+    const double start = dt_get_wtime();
+    double import_time = 0.0, export_time = 0.0;
+    const char *err = NULL;
+    JsonObject *job = NULL;
+    GError *error = NULL;
+    if(!json_parser_load_from_data(parser, line->str, -1, &error))
+    {
+      err = error->message;
+    }
+    else if(!JSON_NODE_HOLDS_OBJECT(json_parser_get_root(parser)))
+      err = "job is not a JSON object";
+    else
+    {
+      job = json_node_get_object(json_parser_get_root(parser));
+      err = _server_export(job, opt, &import_time, &export_time);
+    }
+
+    JsonBuilder *builder = json_builder_new();
+    json_builder_begin_object(builder);
+    JsonNode *id = job ? json_object_get_member(job, "id") : NULL;
+    if(id)
+    {
+      json_builder_set_member_name(builder, "id");
+      json_builder_add_value(builder, json_node_copy(id));
+    }
+    json_builder_set_member_name(builder, "status");
+    json_builder_add_string_value(builder, err ? "error" : "ok");
+    if(err)
+    {
+      json_builder_set_member_name(builder, "error");
+      json_builder_add_string_value(builder, err);
+    }
+    json_builder_set_member_name(builder, "import_ms");
+    json_builder_add_double_value(builder, 1e3 * import_time);
+    json_builder_set_member_name(builder, "export_ms");
+    json_builder_add_double_value(builder, 1e3 * export_time);
+    json_builder_set_member_name(builder, "total_ms");
+    json_builder_add_double_value(builder, 1e3 * (dt_get_wtime() - start));
+    json_builder_end_object(builder);
+
+    JsonNode *root = json_builder_get_root(builder);
+    json_generator_set_root(generator, root);
+    gchar *answer = json_generator_to_data(generator, NULL);
+    fprintf(reply, "%s\n", answer);
+    fflush(reply);
+    g_free(answer);
+    json_node_free(root);
+    g_object_unref(builder);
+    g_clear_error(&error);
+
+    jobs++;
+    if(err) failed++;
+  }
+
+  fprintf(stderr, _("server: %d jobs, %d failed\n"), jobs, failed);
+  g_object_unref(generator);
+  g_object_unref(parser);
+  g_string_free(line, TRUE);
+  return failed ? 1 : 0;
+}
+
 int main(int argc, char *arg[])
 {
 #ifdef __APPLE__
@@ -216,13 +695,16 @@ int main(int argc, char *arg[])
   gchar *output_filename = NULL;
   gchar *output_ext = NULL;
   char *style = NULL;
+  char *profile_file = NULL;
   int file_counter = 0;
-  int width = 0, height = 0, bpp = 0;
+  int width = 0, height = 0, bpp = 0, jobs = 1;
+  gboolean server = FALSE;
   gboolean verbose = FALSE, high_quality = TRUE, upscale = FALSE,
            style_overwrite = FALSE, custom_presets = TRUE, export_masks = FALSE,
            output_to_dir = FALSE;
 
   GList* inputs = NULL;
+  GList *out_specs = NULL;
 
   dt_colorspaces_color_profile_type_t icc_type = DT_COLORSPACE_NONE;
   gchar *icc_filename = NULL;
@@ -261,6 +743,25 @@ int main(int argc, char *arg[])
         k++;
         height = MAX(atoi(arg[k]), 0);
       }
+      else if(!strcmp(arg[k], "--out") && argc > k + 1)
+      {
+        k++;
+        out_specs = g_list_append(out_specs, g_strdup(arg[k]));
+      }
+      else if(!strcmp(arg[k], "--server"))
+      {
+        server = TRUE;
+      }
+      else if(!strcmp(arg[k], "--profile") && argc > k + 1)
+      {
+        k++;
+        profile_file = arg[k];
+      }
+      else if(!strcmp(arg[k], "--jobs") && argc > k + 1)
+      {
+        k++;
+        jobs = CLAMP(atoi(arg[k]), 1, 64);
+      }
       else if(!strcmp(arg[k], "--bpp") && argc > k + 1)
       {
         k++;
@@ -433,16 +934,77 @@ int main(int argc, char *arg[])
   }
 
   int m_argc = 0;
-  char **m_arg = malloc(sizeof(char *) * (5 + argc - k + 1));
+  char **m_arg = malloc(sizeof(char *) * (7 + argc - k + 1));
   m_arg[m_argc++] = "darktable-cli";
   m_arg[m_argc++] = "--library";
   m_arg[m_argc++] = ":memory:";
   m_arg[m_argc++] = "--conf";
   m_arg[m_argc++] = "write_sidecar_files=never";
+  if(profile_file)
+  {
+    m_arg[m_argc++] = "--profile";
+    m_arg[m_argc++] = profile_file;
+  }
   for(; k < argc; k++) m_arg[m_argc++] = arg[k];
   m_arg[m_argc] = NULL;
 
-  if( (inputs && file_counter < 1) || (!inputs && file_counter < 2) || file_counter > 3)
+  if(server)
+  {
+    // the replies get the real stdout, everything else printed goes to stderr
+    FILE *reply = fdopen(dup(fileno(stdout)), "w");
+    dup2(fileno(stderr), fileno(stdout));
+    if(!reply || dt_init(m_argc, m_arg, FALSE, custom_presets, NULL))
+    {
+      free(m_arg);
+      exit(1);
+    }
+    // every job imports its image and removes it again afterwards, this must
+    // never touch the images and history of a real library
+    if(strcmp(dt_database_get_path(darktable.db), ":memory:"))
+    {
+      fprintf(stderr, _("error: --server can't be used with a library on disk\n"));
+      fclose(reply);
+      dt_cleanup();
+      free(m_arg);
+      exit(1);
+    }
+    const _server_options_t opt = { .width = width,
+                                    .height = height,
+                                    .high_quality = high_quality,
+                                    .upscale = upscale,
+                                    .export_masks = export_masks,
+                                    .style_overwrite = style_overwrite,
+                                    .style = style,
+                                    .icc_type = icc_type,
+                                    .icc_filename = icc_filename,
+                                    .icc_intent = icc_intent };
+    const int res = _server(reply, &opt);
+    fclose(reply);
+    dt_cleanup();
+    free(m_arg);
+    g_free(icc_filename);
+    exit(res);
+  }
+
+  if(out_specs)
+  {
+    // all positional arguments are inputs: IMAGE [XMP], or XMP with --import
+    if(inputs ? file_counter > 1 : (file_counter < 1 || file_counter > 2))
+    {
+      usage(arg[0]);
+      free(m_arg);
+      g_list_free_full(out_specs, g_free);
+      if(inputs)
+        g_list_free_full(inputs, g_free);
+      exit(1);
+    }
+    if(inputs)
+    {
+      xmp_filename = input_filename;
+      input_filename = NULL;
+    }
+  }
+  else if( (inputs && file_counter < 1) || (!inputs && file_counter < 2) || file_counter > 3)
   {
     usage(arg[0]);
     free(m_arg);
@@ -499,7 +1061,7 @@ int main(int argc, char *arg[])
     input_filename = NULL;
   }
 
-  if(g_file_test(output_filename, G_FILE_TEST_IS_DIR))
+  if(output_filename && g_file_test(output_filename, G_FILE_TEST_IS_DIR))
   {
     output_to_dir = TRUE;
     if(!output_ext)
@@ -517,7 +1079,7 @@ int main(int argc, char *arg[])
   }
 
   // the output file already exists, so there will be a sequence number added
-  if(g_file_test(output_filename, G_FILE_TEST_EXISTS) && !output_to_dir)
+  if(output_filename && g_file_test(output_filename, G_FILE_TEST_EXISTS) && !output_to_dir)
   {
     if(!output_ext || (output_ext && g_str_has_suffix(output_filename, output_ext) && !g_strcmp0(output_ext,strrchr(output_filename, '.')+1))){
       //output file exists or there's output ext specified and it's same as file...
@@ -626,6 +1188,33 @@ int main(int argc, char *arg[])
       printf("[%s]\n", _("empty history stack"));
   }
 
+  if(out_specs)
+  {
+    const int count = g_list_length(out_specs);
+    _output_spec_t *specs = g_new0(_output_spec_t, count);
+    gboolean ok = TRUE;
+    int j = 0;
+    for(GList *l = out_specs; l; l = g_list_next(l), j++)
+      ok = ok && _output_spec_parse(l->data, width, height, icc_type, style,
+                                    style_overwrite, specs + j);
+    const int res = ok
+      ? _export_multi(id_list, specs, count, upscale, export_masks,
+                        icc_filename, icc_intent)
+      : 1;
+
+    for(j = 0; j < count; j++)
+      _output_spec_free(specs + j);
+    g_free(specs);
+    g_list_free_full(out_specs, g_free);
+    g_list_free(id_list);
+    g_free(output_filename);
+    g_free(output_ext);
+    g_free(icc_filename);
+    dt_cleanup();
+    free(m_arg);
+    exit(res);
+  }
+
   if(!output_ext)
   {
     // by this point we're sure output is not dir, there's no output ext specified
@@ -660,23 +1249,9 @@ int main(int argc, char *arg[])
     }
   }
 
-  if(!strcmp(output_ext, "jpg"))
-  {
-    g_free(output_ext);
-    output_ext = g_strdup("jpeg");
-  }
-
-  if(!strcmp(output_ext, "tif"))
-  {
-    g_free(output_ext);
-    output_ext = g_strdup("tiff");
-  }
-
-  if(!strcmp(output_ext, "jxl"))
-  {
-    g_free(output_ext);
-    output_ext = g_strdup("jpegxl");
-  }
+  gchar *format_name = _format_name(output_ext);
+  g_free(output_ext);
+  output_ext = format_name;
 
   // init the export data structures
   dt_imageio_module_format_t *format;
@@ -770,18 +1345,58 @@ int main(int argc, char *arg[])
 
   // TODO: add a callback to set the bpp without going through the config
 
-  int num = 1, res = 0;
+  _export_job_t job = { .storage = storage,
+                        .format = format,
+                        .sdata = sdata,
+                        .fdata = fdata,
+                        .ids = g_new(int, total),
+                        .results = g_new(int, total),
+                        .total = total,
+                        .high_quality = high_quality,
+                        .upscale = upscale,
+                        .export_masks = export_masks,
+                        .icc_type = icc_type,
+                        .icc_filename = icc_filename,
+                        .icc_intent = icc_intent };
+  int num = 0;
   for(GList *iter = id_list; iter; iter = g_list_next(iter), num++)
   {
-    const int id = GPOINTER_TO_INT(iter->data);
-    // TODO: have a parameter in command line to get the export presets
-    dt_export_metadata_t metadata;
-    metadata.flags = dt_lib_export_metadata_default_flags();
-    metadata.list = NULL;
-    if(storage->store(storage, sdata, id, format, fdata, num, total, high_quality, upscale, export_masks,
-                      icc_type, icc_filename, icc_intent, &metadata) != 0)
-      res = 1;
+    job.ids[num] = GPOINTER_TO_INT(iter->data);
+    job.results[num] = 1; // failed until exported
+  }
+
+  jobs = MIN(jobs, total);
+  if(jobs > 1)
+  {
+    // each pipe gets its share of the cores and of the memory
+    job.omp_threads = MAX(1, (int)dt_get_num_threads() / jobs);
+    job.workers = jobs;
+    pthread_t *threads = g_new(pthread_t, jobs);
+    int started = 0;
+    for(int j = 0; j < jobs; j++)
+      if(!dt_pthread_create(&threads[started], _export_worker, &job)) started++;
+    if(!started) _export_worker(&job);
+    for(int j = 0; j < started; j++) pthread_join(threads[j], NULL);
+    g_free(threads);
+  }
+  else
+  {
+    for(int i = 0; i < total; i++)
+      job.results[i] = _export_image(&job, sdata, fdata, i);
+  }
+
+  // report failures in list order, whatever order they happened in
+  int res = 0;
+  for(int i = 0; i < total; i++)
+  {
+    if(!job.results[i]) continue;
+    char path[PATH_MAX] = { 0 };
+    dt_image_full_path(job.ids[i], path, sizeof(path), NULL);
+    fprintf(stderr, _("error: export of image %d/%d '%s' failed\n"), i + 1, total, path);
+    res = 1;
   }
+  g_free(job.ids);
+  g_free(job.results);
 
   // cleanup time
   if(storage->finalize_store) storage->finalize_store(storage, sdata);
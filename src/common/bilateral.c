@@ -37,6 +37,8 @@
 // mode (only 1mpix there).
 #define DT_COMMON_BILATERAL_MAX_RES_S 3000
 #define DT_COMMON_BILATERAL_MAX_RES_R 50
+// smallest side in pixels of the blocks splatted at the same time
+#define DT_COMMON_BILATERAL_MIN_BLOCK 32
 
 void dt_bilateral_grid_size(dt_bilateral_t *b,
                             const int width,
@@ -95,7 +97,7 @@ size_t dt_bilateral_memory_use(const int width,     // width of input image
   // OpenCL path needs two buffers
   return 2 * grid_size * sizeof(float);
 #else
-  return (grid_size + 3 * dt_get_num_threads() * b.size_x * b.size_z) * sizeof(float);
+  return grid_size * sizeof(float);
 #endif /* HAVE_OPENCL */
 }
 
@@ -120,7 +122,7 @@ size_t dt_bilateral_singlebuffer_size
   dt_bilateral_t b;
   dt_bilateral_grid_size(&b,width,height,100.0f,sigma_s,sigma_r);
   size_t grid_size = b.size_x * b.size_y * b.size_z;
-  return (grid_size + 3 * dt_get_num_threads() * b.size_x * b.size_z) * sizeof(float);
+  return grid_size * sizeof(float);
 }
 
 #ifndef HAVE_OPENCL
@@ -135,26 +137,6 @@ size_t dt_bilateral_singlebuffer_size2(const int width,
 }
 #endif /* !HAVE_OPENCL */
 
-static size_t image_to_grid(const dt_bilateral_t *const b,
-                            const int i,
-                            const int j,
-                            const float L,
-                            float *xf,
-                            float *yf,
-                            float *zf)
-{
-  float x = CLAMPS(i * b->sigma_s_inv, 0, b->size_x - 1);
-  float y = CLAMPS(j * b->sigma_s_inv, 0, b->size_y - 1);
-  float z = CLAMPS(L * b->sigma_r_inv, 0, b->size_z - 1);
-  const int xi = MIN((int)x, b->size_x - 2);
-  const int yi = MIN((int)y, b->size_y - 2);
-  const int zi = MIN((int)z, b->size_z - 2);
-  *xf = x - xi;
-  *yf = y - yi;
-  *zf = z - zi;
-  return ((xi + yi * b->size_x) * b->size_z) + zi;
-}
-
 static size_t image_to_relgrid(const dt_bilateral_t *const b,
                                const int i,
                                const float L,
@@ -180,10 +162,9 @@ dt_bilateral_t *dt_bilateral_init(const int width,     // width of input image
   dt_bilateral_grid_size(b,width,height,100.0f,sigma_s,sigma_r);
   b->width = width;
   b->height = height;
-  b->numslices = dt_get_num_threads();
-  b->sliceheight = (height + b->numslices - 1) / b->numslices;
-  b->slicerows = (b->size_y + b->numslices - 1) / b->numslices + 2;
-  b->buf = dt_calloc_align_float(b->size_x * b->size_z * b->numslices * b->slicerows);
+  // blocks at least two grid cells apart don't share any, see dt_bilateral_splat()
+  b->block = MAX(DT_COMMON_BILATERAL_MIN_BLOCK, (int)ceilf(2.0f * b->sigma_s));
+  b->buf = dt_calloc_align_float(b->size_x * b->size_y * b->size_z);
   if(!b->buf)
   {
     dt_print(DT_DEBUG_ALWAYS,
@@ -198,94 +179,70 @@ dt_bilateral_t *dt_bilateral_init(const int width,     // width of input image
   return b;
 }
 
+/* the image is splatted in blocks of b->block pixels, in four passes over a 2x2
+   checkerboard of them. the blocks of one pass are a block apart, and as a block
+   spans at least two grid cells they never touch the same cell: all threads add
+   to the grid directly, there are no per-thread grids to merge, and the order
+   of the sums doesn't depend on the number of threads. */
 DT_OMP_DECLARE_SIMD(aligned(in:64))
 void dt_bilateral_splat(const dt_bilateral_t *b, const float *const in)
 {
-  const int ox = b->size_z;
-  const int oy = b->size_x * b->size_z;
-  const int oz = 1;
-  const float sigma_s = b->sigma_s * b->sigma_s;
+  const size_t ox = b->size_z;
+  const size_t oy = b->size_x * b->size_z;
+  const float norm = 100.0f / (b->sigma_s * b->sigma_s);
   float *const buf = b->buf;
+  const int width = b->width;
+  const int height = b->height;
+  const int block = b->block;
+  const int blocks_x = (width + block - 1) / block;
+  const int blocks_y = (height + block - 1) / block;
 
   if(!buf) return;
-  // splat into downsampled grid
-  const int nthreads = dt_get_num_threads();
-  const size_t offsets[8] =
+  for(int pass = 0; pass < 4; pass++)
   {
-    0,
-    ox,
-    oy,
-    ox + oy,
-    oz,
-    oz + ox,
-    oz + oy,
-    oz + oy + ox
-  };
+    const int px = pass & 1;
+    const int py = pass >> 1;
+    const int nx = (blocks_x - px + 1) / 2;
+    const int ny = (blocks_y - py + 1) / 2;
 
-  DT_OMP_FOR()
-  for(int slice = 0; slice < b->numslices; slice++)
-  {
-    const int firstrow = slice * b->sliceheight;
-    const int lastrow = MIN((slice+1)*b->sliceheight,b->height);
-    // compute the first row of the final grid which this slice
-    // splats, and subtract that from the first row the current thread
-    // should use to get an offset
-    const int slice_offset = slice * b->slicerows - (int)(firstrow * b->sigma_s_inv);
-    // now iterate over the rows of the current horizontal slice
-    for(int j = firstrow; j < lastrow; j++)
+    DT_OMP_FOR(collapse(2))
+    for(int by = 0; by < ny; by++)
     {
-      float y = CLAMPS(j * b->sigma_s_inv, 0, b->size_y - 1);
-      const int yi = MIN((int)y, b->size_y - 2);
-      const float yf = y - yi;
-      const size_t base = (size_t)(yi + slice_offset) * oy;
-      for(int i = 0; i < b->width; i++)
+      for(int bx = 0; bx < nx; bx++)
       {
-        size_t index = 4 * (j * b->width + i);
-        float xf, zf;
-        const float L = in[index];
-        // nearest neighbour splatting:
-        const size_t grid_index = base + image_to_relgrid(b, i, L, &xf, &zf);
-        // sum up payload here
-        const dt_aligned_pixel_t contrib =
-        {
-          // precompute the contributions along the first two dimensions:
-          (1.0f - xf) * (1.0f - yf) * 100.0f / sigma_s,
-          xf * (1.0f - yf) * 100.0f / sigma_s,
-          (1.0f - xf) * yf * 100.0f / sigma_s,
-          xf * yf * 100.0f / sigma_s
-        };
-        DT_OMP_SIMD(aligned(buf:64))
-        for(int k = 0; k < 4; k++)
+        const int x0 = (2 * bx + px) * block;
+        const int y0 = (2 * by + py) * block;
+        const int x1 = MIN(x0 + block, width);
+        const int y1 = MIN(y0 + block, height);
+        for(int j = y0; j < y1; j++)
         {
-          buf[grid_index + offsets[k]] += (contrib[k] * (1.0f - zf));
-          buf[grid_index + offsets[k+4]] += (contrib[k] * zf);
+          const float y = CLAMPS(j * b->sigma_s_inv, 0, b->size_y - 1);
+          const int yi = MIN((int)y, b->size_y - 2);
+          const float yf = y - yi;
+          float *const row = buf + (size_t)yi * oy;
+          for(int i = x0; i < x1; i++)
+          {
+            const float L = in[4 * ((size_t)j * width + i)];
+            float xf, zf;
+            const size_t gi = image_to_relgrid(b, i, L, &xf, &zf);
+            // contributions along the first two dimensions
+            const float c00 = (1.0f - xf) * (1.0f - yf) * norm;
+            const float c10 = xf * (1.0f - yf) * norm;
+            const float c01 = (1.0f - xf) * yf * norm;
+            const float c11 = xf * yf * norm;
+            row[gi] += c00 * (1.0f - zf);
+            row[gi + 1] += c00 * zf;
+            row[gi + ox] += c10 * (1.0f - zf);
+            row[gi + ox + 1] += c10 * zf;
+            row[gi + oy] += c01 * (1.0f - zf);
+            row[gi + oy + 1] += c01 * zf;
+            row[gi + ox + oy] += c11 * (1.0f - zf);
+            row[gi + ox + oy + 1] += c11 * zf;
+          }
         }
       }
     }
   }
-
-  // merge the per-thread results into the final result
-  for(int slice = 1 ; slice < nthreads; slice++)
-  {
-    // compute the first row of the final grid which this slice splats
-    const int destrow = (int)(slice * b->sliceheight * b->sigma_s_inv);
-    float *dest = buf + destrow * oy;
-    // now iterate over the grid rows splatted for this slice
-    for(int j = slice * b->slicerows; j < (slice+1)*b->slicerows; j++)
-    {
-      float *src = buf + j * oy;
-      for(int i = 0; i < oy; i++)
-      {
-        dest[i] += src[i];
-      }
-      dest += oy;
-      // clear elements in the part of the buffer which holds the
-      // final result now that we've read the partial result, since
-      // we'll be adding to those locations later
-      if(j < b->size_y)
-        memset(buf + j*oy, '\0', sizeof(float) * oy);
-    }
-  }
 }
 
 DT_OMP_DECLARE_SIMD(aligned(buf:64))
@@ -394,6 +351,26 @@ void dt_bilateral_blur(const dt_bilateral_t *b)
 }
 
 
+// trilinear lookup at gi of the grid row pair starting at row, interpolating
+// along z first where the neighbours are adjacent in memory
+static inline float _slice_lookup(const float *const row,
+                                  const size_t gi,
+                                  const size_t ox,
+                                  const size_t oy,
+                                  const float xf,
+                                  const float yf,
+                                  const float zf)
+{
+  const float *const p = row + gi;
+  const float v00 = p[0] + zf * (p[1] - p[0]);
+  const float v10 = p[ox] + zf * (p[ox + 1] - p[ox]);
+  const float v01 = p[oy] + zf * (p[oy + 1] - p[oy]);
+  const float v11 = p[ox + oy] + zf * (p[ox + oy + 1] - p[ox + oy]);
+  const float v0 = v00 + xf * (v10 - v00);
+  const float v1 = v01 + xf * (v11 - v01);
+  return v0 + yf * (v1 - v0);
+}
+
 DT_OMP_DECLARE_SIMD(aligned(out, in :64))
 void dt_bilateral_slice(const dt_bilateral_t *const b,
                         const float *const in,
@@ -402,36 +379,32 @@ void dt_bilateral_slice(const dt_bilateral_t *const b,
 {
   // detail: 0 is leave as is, -1 is bilateral filtered, +1 is contrast boost
   const float norm = -detail * b->sigma_r * 0.04f;
-  const int ox = b->size_z;
-  const int oy = b->size_x * b->size_z;
-  const int oz = 1;
-  float *const buf = b->buf;
+  const size_t ox = b->size_z;
+  const size_t oy = b->size_x * b->size_z;
+  const float *const buf = b->buf;
   const int width = b->width;
   const int height = b->height;
 
   if(!buf) return;
-  DT_OMP_FOR(collapse(2))
+  DT_OMP_FOR()
   for(int j = 0; j < height; j++)
   {
+    const float y = CLAMPS(j * b->sigma_s_inv, 0, b->size_y - 1);
+    const int yi = MIN((int)y, b->size_y - 2);
+    const float yf = y - yi;
+    const float *const row = buf + (size_t)yi * oy;
+    const float *const rin = in + (size_t)4 * j * width;
+    float *const rout = out + (size_t)4 * j * width;
+
+    // copy color and mask, then update L
+    if(rout != rin) memcpy(rout, rin, sizeof(float) * 4 * width);
+    DT_OMP_SIMD()
     for(int i = 0; i < width; i++)
     {
-      size_t index = 4 * (j * width + i);
-      float xf, yf, zf;
-      const float L = in[index];
-      // trilinear lookup:
-      const size_t gi = image_to_grid(b, i, j, L, &xf, &yf, &zf);
-      const float Lout = fmaxf( 0.0f, L
-                         + norm * (buf[gi] * (1.0f - xf) * (1.0f - yf) * (1.0f - zf)
-                                   + buf[gi + ox] * (xf) * (1.0f - yf) * (1.0f - zf)
-                                   + buf[gi + oy] * (1.0f - xf) * (yf) * (1.0f - zf)
-                                   + buf[gi + ox + oy] * (xf) * (yf) * (1.0f - zf)
-                                   + buf[gi + oz] * (1.0f - xf) * (1.0f - yf) * (zf)
-                                   + buf[gi + ox + oz] * (xf) * (1.0f - yf) * (zf)
-                                   + buf[gi + oy + oz] * (1.0f - xf) * (yf) * (zf)
-                                   + buf[gi + ox + oy + oz] * (xf) * (yf) * (zf)));
-      // copy color and mask, then update L
-      copy_pixel(out + index, in + index);
-      out[index] = Lout;
+      const float L = rin[4 * i];
+      float xf, zf;
+      const size_t gi = image_to_relgrid(b, i, L, &xf, &zf);
+      rout[4 * i] = fmaxf(0.0f, L + norm * _slice_lookup(row, gi, ox, oy, xf, yf, zf));
     }
   }
 }
@@ -444,33 +417,29 @@ void dt_bilateral_slice_to_output(const dt_bilateral_t *const b,
 {
   // detail: 0 is leave as is, -1 is bilateral filtered, +1 is contrast boost
   const float norm = -detail * b->sigma_r * 0.04f;
-  const int ox = b->size_z;
-  const int oy = b->size_x * b->size_z;
-  const int oz = 1;
-  float *const buf = b->buf;
+  const size_t ox = b->size_z;
+  const size_t oy = b->size_x * b->size_z;
+  const float *const buf = b->buf;
   const int width = b->width;
   const int height = b->height;
 
   if(!buf) return;
-  DT_OMP_FOR(collapse(2))
+  DT_OMP_FOR()
   for(int j = 0; j < height; j++)
   {
+    const float y = CLAMPS(j * b->sigma_s_inv, 0, b->size_y - 1);
+    const int yi = MIN((int)y, b->size_y - 2);
+    const float yf = y - yi;
+    const float *const row = buf + (size_t)yi * oy;
+    const float *const rin = in + (size_t)4 * j * width;
+    float *const rout = out + (size_t)4 * j * width;
+
+    DT_OMP_SIMD()
     for(int i = 0; i < width; i++)
     {
-      size_t index = 4 * (j * width + i);
-      float xf, yf, zf;
-      const float L = in[index];
-      // trilinear lookup:
-      const size_t gi = image_to_grid(b, i, j, L, &xf, &yf, &zf);
-      const float Lout = norm * (buf[gi] * (1.0f - xf) * (1.0f - yf) * (1.0f - zf)
-                                 + buf[gi + ox] * (xf) * (1.0f - yf) * (1.0f - zf)
-                                 + buf[gi + oy] * (1.0f - xf) * (yf) * (1.0f - zf)
-                                 + buf[gi + ox + oy] * (xf) * (yf) * (1.0f - zf)
-                                 + buf[gi + oz] * (1.0f - xf) * (1.0f - yf) * (zf)
-                                 + buf[gi + ox + oz] * (xf) * (1.0f - yf) * (zf)
-                                 + buf[gi + oy + oz] * (1.0f - xf) * (yf) * (zf)
-                                 + buf[gi + ox + oy + oz] * (xf) * (yf) * (zf));
-      out[index] = MAX(0.0f, out[index] + Lout);
+      float xf, zf;
+      const size_t gi = image_to_relgrid(b, i, rin[4 * i], &xf, &zf);
+      rout[4 * i] = MAX(0.0f, rout[4 * i] + norm * _slice_lookup(row, gi, ox, oy, xf, yf, zf));
     }
   }
 }
@@ -484,6 +453,7 @@ void dt_bilateral_free(dt_bilateral_t *b)
 
 #undef DT_COMMON_BILATERAL_MAX_RES_S
 #undef DT_COMMON_BILATERAL_MAX_RES_R
+#undef DT_COMMON_BILATERAL_MIN_BLOCK
 
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
@@ -25,54 +25,141 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-// this implements a concurrent LRU cache
+// this implements a concurrent LRU cache. the keys are distributed over
+// a power of two number of segments, each guarded by its own mutex.
 
-void dt_cache_init(dt_cache_t *cache,
-                   const size_t entry_size,
-                   const size_t cost_quota)
+static inline dt_cache_segment_t *_cache_segment(dt_cache_t *cache,
+                                                 const uint32_t key)
+{
+  // image ids are mostly consecutive, so scramble the bits a bit
+  // (fibonacci hashing) before choosing the segment.
+  const uint32_t hash = key * 2654435761u;
+  return cache->segment + ((hash >> 16) & (cache->num_segments - 1));
+}
+
+static inline void _segment_lock(dt_cache_segment_t *seg)
 {
+  if(dt_pthread_mutex_trylock(&seg->lock))
+  {
+    dt_pthread_mutex_lock(&seg->lock);
+    seg->stats_contended++;
+  }
+  seg->stats_locks++;
+}
+
+// lru list handling, all called with the segment lock held
+
+static inline void _lru_remove(dt_cache_segment_t *seg,
+                               dt_cache_entry_t *entry)
+{
+  if(entry->lru_prev)
+    entry->lru_prev->lru_next = entry->lru_next;
+  else
+    seg->lru_head = entry->lru_next;
+
+  if(entry->lru_next)
+    entry->lru_next->lru_prev = entry->lru_prev;
+  else
+    seg->lru_tail = entry->lru_prev;
+
+  entry->lru_prev = entry->lru_next = NULL;
+}
+
+static inline void _lru_append(dt_cache_segment_t *seg,
+                               dt_cache_entry_t *entry)
+{
+  entry->lru_prev = seg->lru_tail;
+  entry->lru_next = NULL;
+  if(seg->lru_tail)
+    seg->lru_tail->lru_next = entry;
+  else
+    seg->lru_head = entry;
+  seg->lru_tail = entry;
+}
+
+// bubble up to the most recently used end
+static inline void _lru_touch(dt_cache_segment_t *seg,
+                              dt_cache_entry_t *entry)
+{
+  if(seg->lru_tail == entry) return;
+  _lru_remove(seg, entry);
+  _lru_append(seg, entry);
+}
+
+void dt_cache_init_segmented(dt_cache_t *cache,
+                             const size_t entry_size,
+                             const size_t cost_quota,
+                             const uint32_t num_segments)
+{
+  uint32_t segments = 1;
+  while(segments < num_segments && segments < DT_CACHE_MAX_SEGMENTS)
+    segments <<= 1;
+
   cache->cost = 0;
-  cache->lru = 0;
   cache->entry_size = entry_size;
   cache->cost_quota = cost_quota;
-  dt_pthread_mutex_init(&cache->lock, 0);
   cache->allocate = 0;
   cache->allocate_data = 0;
   cache->cleanup = 0;
   cache->cleanup_data = 0;
-  cache->hashtable = g_hash_table_new(0, 0);
+  cache->num_segments = segments;
+  cache->gc_cursor = 0;
+  // aligned to cache lines to keep the segment locks from false sharing
+  cache->segment = dt_calloc_align_type(dt_cache_segment_t, segments);
+  for(uint32_t k = 0; k < segments; k++)
+  {
+    dt_cache_segment_t *seg = cache->segment + k;
+    dt_pthread_mutex_init(&seg->lock, 0);
+    seg->cost_quota = cost_quota / segments;
+    seg->hashtable = g_hash_table_new(0, 0);
+  }
+}
+
+void dt_cache_init(dt_cache_t *cache,
+                   const size_t entry_size,
+                   const size_t cost_quota)
+{
+  dt_cache_init_segmented(cache, entry_size, cost_quota, 1);
 }
 
 void dt_cache_cleanup(dt_cache_t *cache)
 {
-  g_hash_table_destroy(cache->hashtable);
-  for(GList *l = cache->lru; l; l = g_list_next(l))
+  for(uint32_t k = 0; k < cache->num_segments; k++)
   {
-    dt_cache_entry_t *entry = l->data;
-
-    if(cache->cleanup)
+    dt_cache_segment_t *seg = cache->segment + k;
+    g_hash_table_destroy(seg->hashtable);
+    dt_cache_entry_t *next = NULL;
+    for(dt_cache_entry_t *entry = seg->lru_head; entry; entry = next)
     {
-      assert(entry->data_size);
-      ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
+      next = entry->lru_next;
 
-      cache->cleanup(cache->cleanup_data, entry);
-    }
-    else
-      dt_free_align(entry->data);
+      if(cache->cleanup)
+      {
+        assert(entry->data_size);
+        ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
 
-    dt_pthread_rwlock_destroy(&entry->lock);
-    g_slice_free1(sizeof(*entry), entry);
+        cache->cleanup(cache->cleanup_data, entry);
+      }
+      else
+        dt_free_align(entry->data);
+
+      dt_pthread_rwlock_destroy(&entry->lock);
+      g_slice_free1(sizeof(*entry), entry);
+    }
+    dt_pthread_mutex_destroy(&seg->lock);
   }
-  g_list_free(cache->lru);
-  dt_pthread_mutex_destroy(&cache->lock);
+  dt_free_align(cache->segment);
+  cache->segment = NULL;
+  cache->num_segments = 0;
 }
 
 gboolean dt_cache_contains(dt_cache_t *cache,
                           const uint32_t key)
 {
-  dt_pthread_mutex_lock(&cache->lock);
-  const gboolean result = g_hash_table_contains(cache->hashtable, GINT_TO_POINTER(key));
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_cache_segment_t *seg = _cache_segment(cache, key);
+  _segment_lock(seg);
+  const gboolean result = g_hash_table_contains(seg->hashtable, GINT_TO_POINTER(key));
+  dt_pthread_mutex_unlock(&seg->lock);
   return result;
 }
 
@@ -83,9 +170,10 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache,
                                    const char mode)
 {
   gpointer orig_key, value;
+  dt_cache_segment_t *seg = _cache_segment(cache, key);
   const double start = dt_get_debug_wtime();
-  dt_pthread_mutex_lock(&cache->lock);
-  const gboolean res = g_hash_table_lookup_extended(cache->hashtable,
+  _segment_lock(seg);
+  const gboolean res = g_hash_table_lookup_extended(seg->hashtable,
                                                     GINT_TO_POINTER(key),
                                                     &orig_key,
                                                     &value);
@@ -99,13 +187,12 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache,
     if(result)
     { // need to give up mutex so other threads have a chance to get in between and
       // free the lock we're trying to acquire:
-      dt_pthread_mutex_unlock(&cache->lock);
+      dt_pthread_mutex_unlock(&seg->lock);
       return NULL;
     }
     // bubble up in lru list:
-    cache->lru = g_list_remove_link(cache->lru, entry->link);
-    cache->lru = g_list_concat(cache->lru, entry->link);
-    dt_pthread_mutex_unlock(&cache->lock);
+    _lru_touch(seg, entry);
+    dt_pthread_mutex_unlock(&seg->lock);
     const double end = dt_get_debug_wtime();
     if(end - start > 0.1)
       dt_print(DT_DEBUG_ALWAYS, "try+ wait time %.06fs mode %c", end - start, mode);
@@ -120,13 +207,65 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache,
 
     return entry;
   }
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&seg->lock);
   const double end = dt_get_debug_wtime();
   if(end - start > 0.1)
     dt_print(DT_DEBUG_ALWAYS, "try- wait time %.06fs", end - start);
   return NULL;
 }
 
+// best-effort garbage collection of one segment, called with the
+// segment lock held. stops as soon as either the segment is below its
+// share of the quota or the whole cache is below the quota, so a busy
+// segment may grow beyond its share as long as the others are idle.
+static void _segment_gc(dt_cache_t *cache,
+                        dt_cache_segment_t *seg,
+                        const float fill_ratio)
+{
+  dt_cache_entry_t *next = NULL;
+  for(dt_cache_entry_t *entry = seg->lru_head; entry; entry = next)
+  {
+    next = entry->lru_next; // we might remove this element, so walk to
+                            // the next one while we still have the
+                            // pointer..
+    if(seg->cost < seg->cost_quota * fill_ratio
+       || cache->cost < cache->cost_quota * fill_ratio)
+      break;
+
+    // if still locked by anyone else give up:
+    if(dt_pthread_rwlock_trywrlock(&entry->lock))
+      continue;
+
+    if(entry->_lock_demoting)
+    {
+      // oops, we are currently demoting (rw -> r) lock to this entry
+      // in some thread. do not touch!
+      dt_pthread_rwlock_unlock(&entry->lock);
+      continue;
+    }
+
+    // delete!
+    g_hash_table_remove(seg->hashtable, GINT_TO_POINTER(entry->key));
+    _lru_remove(seg, entry);
+    seg->cost -= entry->cost;
+    __sync_fetch_and_sub(&cache->cost, entry->cost);
+
+    if(cache->cleanup)
+    {
+      assert(entry->data_size);
+      ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
+
+      cache->cleanup(cache->cleanup_data, entry);
+    }
+    else
+      dt_free_align(entry->data);
+
+    dt_pthread_rwlock_unlock(&entry->lock);
+    dt_pthread_rwlock_destroy(&entry->lock);
+    g_slice_free1(sizeof(*entry), entry);
+  }
+}
+
 // if found, the data void* is returned. if not, it is set to be
 // the given *data and a new hash table entry is created, which can be
 // found using the given key later on.
@@ -137,10 +276,11 @@ dt_cache_entry_t *dt_cache_get_with_caller(dt_cache_t *cache,
                                            const int line)
 {
   gpointer orig_key, value;
+  dt_cache_segment_t *seg = _cache_segment(cache, key);
   const double start = dt_get_debug_wtime();
 restart:
-  dt_pthread_mutex_lock(&cache->lock);
-  const gboolean res = g_hash_table_lookup_extended(cache->hashtable,
+  _segment_lock(seg);
+  const gboolean res = g_hash_table_lookup_extended(seg->hashtable,
                                                     GINT_TO_POINTER(key),
                                                     &orig_key,
                                                     &value);
@@ -153,14 +293,13 @@ restart:
     if(result)
     { // need to give up mutex so other threads have a chance to get in between and
       // free the lock we're trying to acquire:
-      dt_pthread_mutex_unlock(&cache->lock);
+      dt_pthread_mutex_unlock(&seg->lock);
       g_usleep(5);
       goto restart;
     }
     // bubble up in lru list:
-    cache->lru = g_list_remove_link(cache->lru, entry->link);
-    cache->lru = g_list_concat(cache->lru, entry->link);
-    dt_pthread_mutex_unlock(&cache->lock);
+    _lru_touch(seg, entry);
+    dt_pthread_mutex_unlock(&seg->lock);
 
 #ifdef _DEBUG
     const pthread_t writer = dt_pthread_rwlock_get_writer(&entry->lock);
@@ -192,7 +331,22 @@ restart:
   if(cache->cost > 0.8f * cache->cost_quota)
   {
     // need to roll back all the way to get a consistent lock state:
-    dt_cache_gc(cache, 0.8f);
+    _segment_gc(cache, seg, 0.8f);
+
+    // this segment might be within its share while others are not. help
+    // out one of them in round-robin order, but only try-lock it as we
+    // are already holding our own segment lock.
+    if(cache->num_segments > 1 && cache->cost > 0.8f * cache->cost_quota)
+    {
+      const uint32_t k = __sync_fetch_and_add(&cache->gc_cursor, 1) & (cache->num_segments - 1);
+      dt_cache_segment_t *other = cache->segment + k;
+      if(other != seg && !dt_pthread_mutex_trylock(&other->lock))
+      {
+        other->stats_locks++;
+        _segment_gc(cache, other, 0.8f);
+        dt_pthread_mutex_unlock(&other->lock);
+      }
+    }
   }
 
   // here dies your 32-bit system:
@@ -202,11 +356,11 @@ restart:
   entry->data = 0;
   entry->data_size = cache->entry_size;
   entry->cost = 1;
-  entry->link = g_list_append(0, entry);
+  entry->lru_prev = entry->lru_next = NULL;
   entry->key = key;
   entry->_lock_demoting = FALSE;
 
-  g_hash_table_insert(cache->hashtable, GINT_TO_POINTER(key), entry);
+  g_hash_table_insert(seg->hashtable, GINT_TO_POINTER(key), entry);
 
   assert(cache->allocate || entry->data_size);
 
@@ -226,12 +380,13 @@ restart:
   else
     dt_pthread_rwlock_rdlock_with_caller(&entry->lock, file, line);
 
-  cache->cost += entry->cost;
+  seg->cost += entry->cost;
+  __sync_fetch_and_add(&cache->cost, entry->cost);
 
   // put at end of lru list (most recently used):
-  cache->lru = g_list_concat(cache->lru, entry->link);
+  _lru_append(seg, entry);
 
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&seg->lock);
   const double end = dt_get_debug_wtime();
   if(end - start > 0.1)
     dt_print(DT_DEBUG_ALWAYS, "wait time %.06fs", end - start);
@@ -246,23 +401,24 @@ gboolean dt_cache_remove(dt_cache_t *cache,
 {
   dt_cache_entry_t *entry;
   gpointer orig_key, value;
+  dt_cache_segment_t *seg = _cache_segment(cache, key);
 restart:
-  dt_pthread_mutex_lock(&cache->lock);
+  _segment_lock(seg);
 
-  const gboolean res = g_hash_table_lookup_extended(cache->hashtable,
+  const gboolean res = g_hash_table_lookup_extended(seg->hashtable,
                                                     GINT_TO_POINTER(key),
                                                     &orig_key,
                                                     &value);
   entry = (dt_cache_entry_t *)value;
   if(!res)
   { // not found in cache, not deleting.
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&seg->lock);
     return TRUE;
   }
   // need write lock to be able to delete:
   if(dt_pthread_rwlock_trywrlock(&entry->lock))
   {
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&seg->lock);
     g_usleep(5);
     goto restart;
   }
@@ -272,15 +428,15 @@ restart:
     // oops, we are currently demoting (rw -> r) lock to this entry in
     // some thread. do not touch!
     dt_pthread_rwlock_unlock(&entry->lock);
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&seg->lock);
     g_usleep(5);
     goto restart;
   }
 
-  const gboolean removed = g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(key));
+  const gboolean removed = g_hash_table_remove(seg->hashtable, GINT_TO_POINTER(key));
   (void)removed; // make non-assert compile happy
   assert(removed);
-  cache->lru = g_list_delete_link(cache->lru, entry->link);
+  _lru_remove(seg, entry);
 
   if(cache->cleanup)
   {
@@ -294,10 +450,11 @@ restart:
 
   dt_pthread_rwlock_unlock(&entry->lock);
   dt_pthread_rwlock_destroy(&entry->lock);
-  cache->cost -= entry->cost;
+  seg->cost -= entry->cost;
+  __sync_fetch_and_sub(&cache->cost, entry->cost);
   g_slice_free1(sizeof(*entry), entry);
 
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&seg->lock);
   return FALSE;
 }
 
@@ -306,47 +463,25 @@ restart:
 void dt_cache_gc(dt_cache_t *cache,
                  const float fill_ratio)
 {
-  GList *l = cache->lru;
-  while(l)
+  for(uint32_t k = 0; k < cache->num_segments; k++)
   {
-    dt_cache_entry_t *entry = l->data;
-    assert(entry->link->data == entry);
-    l = g_list_next(l); // we might remove this element, so walk to
-                        // the next one while we still have the
-                        // pointer..
-    if(cache->cost < cache->cost_quota * fill_ratio)
-      break;
-
-    // if still locked by anyone else give up:
-    if(dt_pthread_rwlock_trywrlock(&entry->lock))
-      continue;
-
-    if(entry->_lock_demoting)
-    {
-      // oops, we are currently demoting (rw -> r) lock to this entry
-      // in some thread. do not touch!
-      dt_pthread_rwlock_unlock(&entry->lock);
-      continue;
-    }
-
-    // delete!
-    g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(entry->key));
-    cache->lru = g_list_delete_link(cache->lru, entry->link);
-    cache->cost -= entry->cost;
-
-    if(cache->cleanup)
-    {
-      assert(entry->data_size);
-      ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
-
-      cache->cleanup(cache->cleanup_data, entry);
-    }
-    else
-      dt_free_align(entry->data);
+    dt_cache_segment_t *seg = cache->segment + k;
+    _segment_lock(seg);
+    _segment_gc(cache, seg, fill_ratio);
+    dt_pthread_mutex_unlock(&seg->lock);
+  }
+}
 
-    dt_pthread_rwlock_unlock(&entry->lock);
-    dt_pthread_rwlock_destroy(&entry->lock);
-    g_slice_free1(sizeof(*entry), entry);
+void dt_cache_get_contention(dt_cache_t *cache,
+                             uint64_t *locks,
+                             uint64_t *contended)
+{
+  *locks = *contended = 0;
+  for(uint32_t k = 0; k < cache->num_segments; k++)
+  {
+    // racy read, but good enough for statistics
+    *locks += cache->segment[k].stats_locks;
+    *contended += cache->segment[k].stats_contended;
   }
 }
 
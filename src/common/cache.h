@@ -28,7 +28,10 @@ typedef struct dt_cache_entry_t
   void *data;
   size_t data_size;
   size_t cost;
-  GList *link;
+  // intrusive lru list of the owning segment, so touching an entry on
+  // a cache hit is just relinking a few pointers.
+  struct dt_cache_entry_t *lru_prev;
+  struct dt_cache_entry_t *lru_next;
   dt_pthread_rwlock_t lock;
   gboolean _lock_demoting;
   uint32_t key;
@@ -37,16 +40,38 @@ typedef struct dt_cache_entry_t
 typedef void((*dt_cache_allocate_t)(void *userdata, dt_cache_entry_t *entry));
 typedef void((*dt_cache_cleanup_t)(void *userdata, dt_cache_entry_t *entry));
 
-typedef struct dt_cache_t
+// upper bound for the number of independently locked segments of a cache
+#define DT_CACHE_MAX_SEGMENTS 64
+
+// one lock stripe of the cache. keys are distributed over the segments by
+// hash, each segment has its own lock, lru list and cost accounting.
+typedef struct dt_cache_segment_t
 {
-  dt_pthread_mutex_t lock; // big fat lock. we're only expecting a couple hand full of cpu threads to use this concurrently.
+  dt_pthread_mutex_t lock; // protects everything in this segment
+
+  size_t cost;           // user supplied cost of the entries in this segment
+  size_t cost_quota;     // fair share of the global quota
+
+  GHashTable *hashtable; // stores (key, entry) pairs
+  dt_cache_entry_t *lru_head; // least recently used, first to be kicked from the cache
+  dt_cache_entry_t *lru_tail; // most recently used
 
+  // contention statistics, only modified while holding the lock
+  uint64_t stats_locks;     // number of times the lock was taken
+  uint64_t stats_contended; // number of times we had to wait for it
+} dt_cache_segment_t;
+
+typedef struct dt_cache_t
+{
   size_t entry_size; // cache line allocation
-  size_t cost;       // user supplied cost per cache line (bytes?)
+  size_t cost;       // user supplied cost of all segments together (bytes?), updated atomically
   size_t cost_quota; // quota to try and meet. but don't use as hard limit.
 
-  GHashTable *hashtable; // stores (key, entry) pairs
-  GList *lru;            // last element is most recently used, first is about to be kicked from cache.
+  // the segments. a plain cache has just one of them, which gives the old
+  // behaviour of one big fat lock around everything.
+  dt_cache_segment_t *segment;
+  uint32_t num_segments; // always a power of two
+  uint32_t gc_cursor;    // next segment to help out with garbage collection
 
   // callback functions for cache misses/garbage collection
   dt_cache_allocate_t allocate;
@@ -59,6 +84,12 @@ typedef struct dt_cache_t
 void dt_cache_init(dt_cache_t *cache,
                    const size_t entry_size,
                    const size_t cost_quota);
+// same, but split the cache into num_segments independently locked segments
+// (rounded to a power of two). the quota is then only enforced approximately.
+void dt_cache_init_segmented(dt_cache_t *cache,
+                             const size_t entry_size,
+                             const size_t cost_quota,
+                             const uint32_t num_segments);
 void dt_cache_cleanup(dt_cache_t *cache);
 
 static inline void dt_cache_set_allocate_callback(dt_cache_t *cache,
@@ -104,6 +135,11 @@ gboolean dt_cache_remove(dt_cache_t *cache, const uint32_t key);
 void dt_cache_gc(dt_cache_t *cache,
                  const float fill_ratio);
 
+// sums up the lock statistics of all segments
+void dt_cache_get_contention(dt_cache_t *cache,
+                             uint64_t *locks,
+                             uint64_t *contended);
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
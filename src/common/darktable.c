@@ -50,6 +50,7 @@
 #include "common/opencl.h"
 #include "common/points.h"
 #include "common/resource_limits.h"
+#include "common/thread_budget.h"
 #include "common/undo.h"
 #include "common/gimp.h"
 #include "common/pfm.h"
@@ -62,6 +63,7 @@
 #include "control/signal.h"
 #include "develop/blend.h"
 #include "develop/imageop.h"
+#include "develop/pixelpipe_profile.h"
 #include "gui/accelerators.h"
 #include "gui/gtk.h"
 #include "gui/guides.h"
@@ -255,6 +257,10 @@ static int usage(const char *argv0)
          "\n"
          "--dumpdir DIR\n"
          "\n"
+         "--profile FILE\n"
+         "    Record the time and memory used by each module of each pipe run\n"
+         "    and write them to FILE in Chrome trace format when quitting.\n"
+         "\n"
          "-d SIGNAL\n"
          "    Enable debug output to the terminal. Valid signals are:\n\n"
          "    act_on, cache, camctl, camsupport, control, dev, expose,\n"
@@ -932,6 +938,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   darktable.dump_diff_pipe = NULL;
   darktable.tmp_directory = NULL;
   darktable.bench_module = NULL;
+  darktable.profile_file = NULL;
 
   gboolean exclude_opencl = TRUE;
   gboolean print_statistics = FALSE;
@@ -989,6 +996,12 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
         argv[k-1] = NULL;
         argv[k] = NULL;
       }
+      else if(!strcmp(argv[k], "--profile") && argc > k + 1)
+      {
+        darktable.profile_file = argv[++k];
+        argv[k-1] = NULL;
+        argv[k] = NULL;
+      }
       else if(!strcmp(argv[k], "--dump-pipe") && argc > k + 1)
       {
         darktable.dump_pfm_pipe = argv[++k];
@@ -1752,6 +1765,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
   darktable.points = (dt_points_t *)calloc(1, sizeof(dt_points_t));
   dt_points_init(darktable.points, dt_get_num_threads());
+  darktable.thread_budget = dt_thread_budget_new(dt_get_num_threads());
 
   dt_wb_presets_init(NULL);
 
@@ -2085,6 +2099,13 @@ void dt_cleanup()
   dt_lua_finalize();
 #endif
 
+  // no pipe runs any more
+  if(darktable.profile_file)
+  {
+    dt_dev_pixelpipe_profile_write(darktable.profile_file);
+    dt_dev_pixelpipe_profile_cleanup();
+  }
+
   if(init_gui)
   {
     dt_lib_cleanup(darktable.lib);
@@ -2116,6 +2137,8 @@ void dt_cleanup()
   dt_points_cleanup(darktable.points);
   free(darktable.points);
   darktable.points = NULL;
+  dt_thread_budget_free(darktable.thread_budget);
+  darktable.thread_budget = NULL;
   dt_iop_unload_modules_so();
   g_list_free_full(darktable.iop_order_list, free);
   darktable.iop_order_list = NULL;
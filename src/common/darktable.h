@@ -377,6 +377,7 @@ typedef struct darktable_t
   const struct dt_collection_t *collection;
   struct dt_selection_t *selection;
   struct dt_points_t *points;
+  struct dt_thread_budget_t *thread_budget;
   struct dt_imageio_t *imageio;
   struct dt_opencl_t *opencl;
   struct dt_dbus_t *dbus;
@@ -403,6 +404,7 @@ typedef struct darktable_t
   char *dump_diff_pipe;
   char *tmp_directory;
   char *bench_module;
+  char *profile_file;
   dt_lua_state_t lua_state;
   GList *guides;
   double start_wtime;
@@ -196,89 +196,113 @@ error:
 }
 
 
-void dt_gaussian_blur(dt_gaussian_t *g, const float *const in, float *const out)
+// the vertical pass filters strips of DT_GAUSSIAN_STRIP floats side by side,
+// row by row. every step reads a few whole cache lines and the lanes of a strip
+// vectorize, filtering a single column touched one pixel per row instead.
+#define DT_GAUSSIAN_STRIP 64
+
+static void _blur_vertical(const float *const in,
+                           float *const temp,
+                           const size_t width,
+                           const size_t height,
+                           const int ch,
+                           const float *const Labmin,
+                           const float *const Labmax,
+                           const float a0,
+                           const float a1,
+                           const float a2,
+                           const float a3,
+                           const float b1,
+                           const float b2,
+                           const float coefp,
+                           const float coefn)
 {
+  const size_t stride = width * ch;
+  const size_t strips = (stride + DT_GAUSSIAN_STRIP - 1) / DT_GAUSSIAN_STRIP;
 
-  const int width = g->width;
-  const int height = g->height;
-  const int ch = MIN(4, g->channels); // just to appease zealous compiler warnings about stack usage
-
-  float a0, a1, a2, a3, b1, b2, coefp, coefn;
-
-  _compute_gauss_params(g->sigma, g->order, &a0, &a1, &a2, &a3, &b1, &b2, &coefp, &coefn);
-
-  float *temp = g->buf;
-
-  float *Labmax = g->max;
-  float *Labmin = g->min;
-
-// vertical blur column by column
   DT_OMP_FOR()
-  for(int i = 0; i < width; i++)
+  for(size_t s = 0; s < strips; s++)
   {
-    dt_aligned_pixel_t xp = {0.0f};
-    dt_aligned_pixel_t yb = {0.0f};
-    dt_aligned_pixel_t yp = {0.0f};
+    const size_t first = s * DT_GAUSSIAN_STRIP;
+    const size_t n = MIN(DT_GAUSSIAN_STRIP, stride - first);
+
+    float DT_ALIGNED_ARRAY lo[DT_GAUSSIAN_STRIP];
+    float DT_ALIGNED_ARRAY hi[DT_GAUSSIAN_STRIP];
+    float DT_ALIGNED_ARRAY x1[DT_GAUSSIAN_STRIP];
+    float DT_ALIGNED_ARRAY x2[DT_GAUSSIAN_STRIP];
+    float DT_ALIGNED_ARRAY y1[DT_GAUSSIAN_STRIP];
+    float DT_ALIGNED_ARRAY y2[DT_GAUSSIAN_STRIP];
 
     // forward filter
-    for(int k = 0; k < ch; k++)
+    for(size_t l = 0; l < n; l++)
     {
-      xp[k] = CLAMPF(in[(size_t)i * ch + k], Labmin[k], Labmax[k]);
-      yb[k] = xp[k] * coefp;
-      yp[k] = yb[k];
+      lo[l] = Labmin[(first + l) % ch];
+      hi[l] = Labmax[(first + l) % ch];
+      x1[l] = CLAMPF(in[first + l], lo[l], hi[l]);
+      y1[l] = y2[l] = x1[l] * coefp;
     }
 
-    dt_aligned_pixel_t xc = {0.0f};
-    dt_aligned_pixel_t yc = {0.0f};
-    dt_aligned_pixel_t xn = {0.0f};
-    dt_aligned_pixel_t xa = {0.0f};
-    dt_aligned_pixel_t yn = {0.0f};
-    dt_aligned_pixel_t ya = {0.0f};
-    for(int j = 0; j < height; j++)
+    for(size_t j = 0; j < height; j++)
     {
-      size_t offset = ((size_t)j * width + i) * ch;
-
-      for(int k = 0; k < ch; k++)
+      const float *const row = in + j * stride + first;
+      float *const trow = temp + j * stride + first;
+      DT_OMP_SIMD()
+      for(size_t l = 0; l < n; l++)
       {
-        xc[k] = CLAMPF(in[offset + k], Labmin[k], Labmax[k]);
-        yc[k] = (a0 * xc[k]) + (a1 * xp[k]) - (b1 * yp[k]) - (b2 * yb[k]);
-
-        temp[offset + k] = yc[k];
-
-        xp[k] = xc[k];
-        yb[k] = yp[k];
-        yp[k] = yc[k];
+        const float xc = CLAMPF(row[l], lo[l], hi[l]);
+        const float yc = (a0 * xc) + (a1 * x1[l]) - (b1 * y1[l]) - (b2 * y2[l]);
+        trow[l] = yc;
+        x1[l] = xc;
+        y2[l] = y1[l];
+        y1[l] = yc;
       }
     }
 
     // backward filter
-    for(int k = 0; k < ch; k++)
+    const float *const last = in + (height - 1) * stride + first;
+    for(size_t l = 0; l < n; l++)
     {
-      xn[k] = CLAMPF(in[((size_t)(height - 1) * width + i) * ch + k], Labmin[k], Labmax[k]);
-      xa[k] = xn[k];
-      yn[k] = xn[k] * coefn;
-      ya[k] = yn[k];
+      x1[l] = x2[l] = CLAMPF(last[l], lo[l], hi[l]);
+      y1[l] = y2[l] = x1[l] * coefn;
     }
 
-    for(int j = height - 1; j > -1; j--)
+    for(size_t j = height; j > 0; j--)
     {
-      size_t offset = ((size_t)j * width + i) * ch;
-
-      for(int k = 0; k < ch; k++)
+      const float *const row = in + (j - 1) * stride + first;
+      float *const trow = temp + (j - 1) * stride + first;
+      DT_OMP_SIMD()
+      for(size_t l = 0; l < n; l++)
       {
-        xc[k] = CLAMPF(in[offset + k], Labmin[k], Labmax[k]);
-
-        yc[k] = (a2 * xn[k]) + (a3 * xa[k]) - (b1 * yn[k]) - (b2 * ya[k]);
-
-        xa[k] = xn[k];
-        xn[k] = xc[k];
-        ya[k] = yn[k];
-        yn[k] = yc[k];
-
-        temp[offset + k] += yc[k];
+        const float xc = CLAMPF(row[l], lo[l], hi[l]);
+        const float yc = (a2 * x1[l]) + (a3 * x2[l]) - (b1 * y1[l]) - (b2 * y2[l]);
+        x2[l] = x1[l];
+        x1[l] = xc;
+        y2[l] = y1[l];
+        y1[l] = yc;
+        trow[l] += yc;
       }
     }
   }
+}
+
+void dt_gaussian_blur(dt_gaussian_t *g, const float *const in, float *const out)
+{
+
+  const int width = g->width;
+  const int height = g->height;
+  const int ch = MIN(4, g->channels); // just to appease zealous compiler warnings about stack usage
+
+  float a0, a1, a2, a3, b1, b2, coefp, coefn;
+
+  _compute_gauss_params(g->sigma, g->order, &a0, &a1, &a2, &a3, &b1, &b2, &coefp, &coefn);
+
+  float *temp = g->buf;
+
+  float *Labmax = g->max;
+  float *Labmin = g->min;
+
+  _blur_vertical(in, temp, width, height, ch, Labmin, Labmax,
+                 a0, a1, a2, a3, b1, b2, coefp, coefn);
 
 // horizontal blur line by line
   DT_OMP_FOR()
@@ -366,71 +390,8 @@ void dt_gaussian_blur_4c(dt_gaussian_t *g, const float *const in, float *const o
   copy_pixel(Labmin, g->min);
   copy_pixel(Labmax, g->max);
 
-// vertical blur column by column
-  DT_OMP_FOR()
-  for(size_t i = 0; i < width; i++)
-  {
-    // forward filter
-    dt_aligned_pixel_t xp;
-    dt_aligned_pixel_t yb;
-    dt_aligned_pixel_t yp;
-    for_four_channels(k)
-    {
-      xp[k] = CLAMPF(in[4*i + k], Labmin[k], Labmax[k]);
-      yb[k] = xp[k] * coefp;
-      yp[k] = yb[k];
-    }
-
-    dt_aligned_pixel_t xc;
-    dt_aligned_pixel_t xn;
-    dt_aligned_pixel_t xa;
-    for(size_t j = 0; j < height; j++)
-    {
-      size_t offset = 4 * (j * width + i);
-
-      dt_aligned_pixel_t yc;
-      for_four_channels(k)
-      {
-        xc[k] = CLAMPF(in[offset + k], Labmin[k], Labmax[k]);
-        yc[k] = (a0 * xc[k]) + (a1 * xp[k]) - (b1 * yp[k]) - (b2 * yb[k]);
-
-        xp[k] = xc[k];
-        yb[k] = yp[k];
-        yp[k] = yc[k];
-      }
-      copy_pixel(temp + offset, yc);
-    }
-
-    // backward filter
-    dt_aligned_pixel_t yn;
-    dt_aligned_pixel_t ya;
-    for_four_channels(k)
-    {
-      xn[k] = CLAMPF(in[4*((height - 1) * width + i) + k], Labmin[k], Labmax[k]);
-      xa[k] = xn[k];
-      yn[k] = xn[k] * coefn;
-      ya[k] = yn[k];
-    }
-
-    for(size_t j = height; j > 0; j--)
-    {
-      size_t offset = 4 * ((j-1) * width + i);
-
-      dt_aligned_pixel_t yc;
-      for_four_channels(k)
-      {
-        xc[k] = CLAMPF(in[offset + k], Labmin[k], Labmax[k]);
-
-        yc[k] = (a2 * xn[k]) + (a3 * xa[k]) - (b1 * yn[k]) - (b2 * ya[k]);
-
-        xa[k] = xn[k];
-        xn[k] = xc[k];
-        ya[k] = yn[k];
-        yn[k] = yc[k];
-        temp[offset + k] += yc[k];
-      }
-    }
-  }
+  _blur_vertical(in, temp, width, height, 4, Labmin, Labmax,
+                 a0, a1, a2, a3, b1, b2, coefp, coefn);
 
 // horizontal blur line by line
   DT_OMP_FOR()
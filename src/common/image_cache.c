@@ -221,7 +221,7 @@ void dt_image_cache_init()
   //       can we get away with a fixed size?
   const uint32_t max_mem = 50 * 1024 * 1024;
   const uint32_t num = (uint32_t)(1.5f * max_mem / sizeof(dt_image_t));
-  dt_cache_init(&cache->cache, sizeof(dt_image_t), max_mem);
+  dt_cache_init_segmented(&cache->cache, sizeof(dt_image_t), max_mem, 2 * dt_get_num_threads());
   dt_cache_set_allocate_callback(&cache->cache, &_image_cache_allocate, cache);
   dt_cache_set_cleanup_callback(&cache->cache, &_image_cache_deallocate, cache);
 
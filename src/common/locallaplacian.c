@@ -30,6 +30,8 @@
 #define max_levels 30
 // the number of segments for the piecewise linear interpolation
 #define num_gamma 6
+// the number of coarse rows reduced at once from the curved fine rows
+#define ll_strip 16
 
 // downsample width/height to given level
 static inline int dl(int size, const int level)
@@ -160,6 +162,47 @@ static inline void _convolve_14641_vert(dt_aligned_pixel_t conv, const float *in
   }
 }
 
+// blur five fine rows starting at base, store one coarse row without its
+// first and last pixel
+static inline void ll_reduce_row(
+    const float *base,        // first of the five fine rows
+    float *const out,         // coarse row, starting at its second pixel
+    const size_t wd,          // fine width
+    const size_t cw)          // coarse width
+{
+  // prime the vertical axis
+  static const dt_aligned_pixel_t kernel = { 1.0f, 4.0f, 6.0f, 4.0f };
+  dt_aligned_pixel_t left;
+  _convolve_14641_vert(left,base,wd);
+  for(size_t col=0; col<cw-3; col += 2)
+  {
+    // convolve the next four pixel wide vertical slice
+    base += 4;
+    dt_aligned_pixel_t right;
+    _convolve_14641_vert(right,base,wd);
+    // horizontal pass, generate two output values from convolving with 1 4 6 4 1
+    // the first uses pixels 0-4, the second uses 2-6
+    dt_aligned_pixel_t conv;
+    for_four_channels(c)
+      conv[c] = left[c] * kernel[c];
+    out[col] = (conv[0] + conv[1] + conv[2] + conv[3] + right[0]) / 256.0f;
+    out[col+1] = (left[2] + 4*(left[3]+right[1]) + 6.0f*right[0] + right[2]) / 256.0f;
+    // shift to next pair of output columns (four input columns)
+    copy_pixel(left, right);
+  }
+  // handle the left-over pixel if the output size is odd
+  if(cw % 2)
+  {
+    base += 4;
+    // convolve the right-most column
+    float right = base[0] + 4.0f*(base[wd]+base[3*wd]) + 6.0f*base[2*wd] + base[4*wd];
+    dt_aligned_pixel_t conv;
+    for_four_channels(c)
+      conv[c] = left[c] * kernel[c];
+    out[cw-3] = (conv[0] + conv[1] + conv[2] + conv[3] + right) / 256.0f;
+  }
+}
+
 static inline void gauss_reduce(
     const float *const input, // fine input buffer
     float *const coarse,      // coarse scale, blurred input buf
@@ -172,41 +215,7 @@ static inline void gauss_reduce(
   // is greater than the time needed to do it sequentially
   DT_OMP_FOR(if(ch*cw>2000))
   for(size_t j=1;j<ch-1;j++)
-  {
-    const float *base = input + 2*(j-1)*wd;
-    float *const out = coarse + j*cw + 1;
-    // prime the vertical axis
-    static const dt_aligned_pixel_t kernel = { 1.0f, 4.0f, 6.0f, 4.0f };
-    dt_aligned_pixel_t left;
-    _convolve_14641_vert(left,base,wd);
-    for(size_t col=0; col<cw-3; col += 2)
-    {
-      // convolve the next four pixel wide vertical slice
-      base += 4;
-      dt_aligned_pixel_t right;
-      _convolve_14641_vert(right,base,wd);
-      // horizontal pass, generate two output values from convolving with 1 4 6 4 1
-      // the first uses pixels 0-4, the second uses 2-6
-      dt_aligned_pixel_t conv;
-      for_four_channels(c)
-        conv[c] = left[c] * kernel[c];
-      out[col] = (conv[0] + conv[1] + conv[2] + conv[3] + right[0]) / 256.0f;
-      out[col+1] = (left[2] + 4*(left[3]+right[1]) + 6.0f*right[0] + right[2]) / 256.0f;
-      // shift to next pair of output columns (four input columns)
-      copy_pixel(left, right);
-    }
-    // handle the left-over pixel if the output size is odd
-    if(cw % 2)
-    {
-      base += 4;
-      // convolve the right-most column
-      float right = base[0] + 4.0f*(base[wd]+base[3*wd]) + 6.0f*base[2*wd] + base[4*wd];
-      dt_aligned_pixel_t conv;
-      for_four_channels(c)
-        conv[c] = left[c] * kernel[c];
-      out[cw-3] = (conv[0] + conv[1] + conv[2] + conv[3] + right) / 256.0f;
-    }
-  }
+    ll_reduce_row(input + 2*(j-1)*wd, coarse + j*cw + 1, wd, cw);
   dt_omploop_sfence();
   ll_fill_boundary1(coarse, cw, ch);
 }
@@ -299,7 +308,7 @@ static inline float *ll_pad_input(
 
 static inline float ll_laplacian(
     const float *const coarse,   // coarse res gaussian
-    const float *const fine,     // fine res gaussian
+    const float fine,            // fine res gaussian at i,j
     const int i,                 // fine index
     const int j,
     const int wd,                // fine width
@@ -307,7 +316,7 @@ static inline float ll_laplacian(
 {
   const float c = ll_expand_gaussian(coarse,
       CLAMPS(i, 1, ((wd-1)&~1)-1), CLAMPS(j, 1, ((ht-1)&~1)-1), wd, ht);
-  return fine[j*wd+i] - c;
+  return fine - c;
 }
 
 static inline float curve_scalar(
@@ -342,30 +351,67 @@ static inline float curve_scalar(
   return val;
 }
 
-void apply_curve(
+// curves one fine row, the padding is replicated from the curved border
+// pixels and not curved itself (it may come from the preview)
+static inline void ll_curve_row(
     float *const out,
     const float *const in,
-    const uint32_t w,
-    const uint32_t h,
-    const uint32_t padding,
+    const int w,
+    const int padding,
     const float g,
     const float sigma,
     const float shadows,
     const float highlights,
     const float clarity)
 {
-  DT_OMP_FOR()
-  for(uint32_t j=padding;j<h-padding;j++)
-  {
-    const float *in2  = in  + j*w + padding;
-    float *out2 = out + j*w + padding;
-    for(uint32_t i=padding;i<w-padding;i++)
-      (*out2++) = curve_scalar(*(in2++), g, sigma, shadows, highlights, clarity);
-    out2 = out + j*w;
-    for(int i=0;i<padding;i++)   out2[i] = out2[padding];
-    for(int i=w-padding;i<w;i++) out2[i] = out2[w-padding-1];
-  }
-  pad_by_replication(out, w, h, padding);
+  for(int i=padding;i<w-padding;i++)
+    out[i] = curve_scalar(in[i], g, sigma, shadows, highlights, clarity);
+  for(int i=0;i<padding;i++)   out[i] = out[padding];
+  for(int i=w-padding;i<w;i++) out[i] = out[w-padding-1];
+}
+
+// curves the padded input for all gammas and reduces it to the next level
+// right away, so that the full resolution curved images are never stored.
+// every thread curves the 2*ll_strip+3 fine rows under a strip of ll_strip
+// coarse rows into its scratch buffer and reduces them from there.
+// returns FALSE if out of memory.
+static gboolean ll_curve_reduce(
+    float *const coarse[num_gamma], // coarse curved levels, one per gamma
+    const float *const input,       // padded fine input
+    const int w,                    // fine res
+    const int h,
+    const int padding,
+    const float *const gamma,
+    const float sigma,
+    const float shadows,
+    const float highlights,
+    const float clarity)
+{
+  const int cw = (w-1)/2+1, ch = (h-1)/2+1;
+  const int strips = (ch - 2 + ll_strip - 1) / ll_strip;
+  size_t scratch_size;
+  float *const scratch = dt_alloc_perthread_float((size_t)(2*ll_strip+3) * w, &scratch_size);
+  if(!scratch) return FALSE;
+
+  DT_OMP_FOR(collapse(2))
+  for(int k=0;k<num_gamma;k++)
+    for(int s=0;s<strips;s++)
+    {
+      float *const rows = dt_get_perthread(scratch, scratch_size);
+      const int j0 = 1 + s*ll_strip;
+      const int j1 = MIN(j0 + ll_strip, ch-1);
+      // coarse rows j0..j1-1 need the fine rows 2*j0-2..2*j1
+      for(int r=2*j0-2;r<=2*j1;r++)
+        ll_curve_row(rows + (size_t)(r-2*j0+2)*w, input + (size_t)CLAMPS(r, padding, h-padding-1)*w,
+                     w, padding, gamma[k], sigma, shadows, highlights, clarity);
+      for(int j=j0;j<j1;j++)
+        ll_reduce_row(rows + (size_t)2*(j-j0)*w, coarse[k] + (size_t)j*cw + 1, w, cw);
+    }
+
+  dt_free_align(scratch);
+  for(int k=0;k<num_gamma;k++)
+    ll_fill_boundary1(coarse[k], cw, ch);
+  return TRUE;
 }
 
 void local_laplacian_internal(
@@ -445,10 +491,11 @@ void local_laplacian_internal(
   for(int k=0;k<num_gamma;k++) gamma[k] = (k+.5f)/(float)num_gamma;
   // for(int k=0;k<num_gamma;k++) gamma[k] = k/(num_gamma-1.0f);
 
-  // allocate memory for intermediate laplacian pyramids
+  // allocate memory for intermediate laplacian pyramids. the finest level
+  // is the curved input, it is computed again where needed instead.
   float *buf[num_gamma][max_levels] = {{0}};
   for(int k=0;k<num_gamma;k++)
-    for(int l=0;l<=last_level;l++)
+    for(int l=1;l<=last_level;l++)
     {
       buf[k][l] = dt_alloc_align_float((size_t)dl(w,l)*dl(h,l));
       if(!buf[k][l])
@@ -464,14 +511,19 @@ void local_laplacian_internal(
   // the paper says remapping only level 3 not 0 does the trick, too
   // (but i really like the additional octave of sharpness we get,
   // willing to pay the cost).
-  for(int k=0;k<num_gamma;k++)
-  { // process images
-    apply_curve(buf[k][0], padded[0], w, h, max_supp, gamma[k], sigma, shadows, highlights, clarity);
+  float *curved[num_gamma];
+  for(int k=0;k<num_gamma;k++) curved[k] = buf[k][1];
+  if(!ll_curve_reduce(curved, padded[0], w, h, max_supp, gamma, sigma, shadows, highlights, clarity))
+  {
+    for(size_t p = 0; p < (size_t)4 * wd * ht; p++)
+      out[p] = input[p];
+    goto cleanup;
+  }
 
-    // create gaussian pyramids
-    for(int l=1;l<=last_level;l++)
+  // create gaussian pyramids
+  for(int k=0;k<num_gamma;k++)
+    for(int l=2;l<=last_level;l++)
       gauss_reduce(buf[k][l-1], buf[k][l], dl(w,l-1), dl(h,l-1));
-  }
 
   // resample output[last_level] from preview
   // requires to transform from padded/downsampled to full image and then
@@ -548,8 +600,20 @@ void local_laplacian_internal(
       for(;hi<num_gamma-1 && gamma[hi] <= v;hi++);
       int lo = hi-1;
       const float a = CLAMPS((v - gamma[lo])/(gamma[hi]-gamma[lo]), 0.0f, 1.0f);
-      const float l0 = ll_laplacian(buf[lo][l+1], buf[lo][l], i, j, pw, ph);
-      const float l1 = ll_laplacian(buf[hi][l+1], buf[hi][l], i, j, pw, ph);
+      float f0, f1;
+      if(l)
+      {
+        f0 = buf[lo][l][j*pw+i];
+        f1 = buf[hi][l][j*pw+i];
+      }
+      else
+      {
+        const float c = padded[0][CLAMPS(j, max_supp, ph-max_supp-1)*pw + CLAMPS(i, max_supp, pw-max_supp-1)];
+        f0 = curve_scalar(c, gamma[lo], sigma, shadows, highlights, clarity);
+        f1 = curve_scalar(c, gamma[hi], sigma, shadows, highlights, clarity);
+      }
+      const float l0 = ll_laplacian(buf[lo][l+1], f0, i, j, pw, ph);
+      const float l1 = ll_laplacian(buf[hi][l+1], f1, i, j, pw, ph);
       output[l][j*pw+i] += l0 * (1.0f-a) + l1 * a;
       // we could do this to save on memory (no need for finest buf[][]).
       // unfortunately it results in a quite noticeable loss of sharpness, i think
@@ -596,8 +660,11 @@ size_t local_laplacian_memory_use(const int width,     // width of input image
 
   size_t memory_use = 0;
 
+  // the finest curved levels aren't stored
   for(int l=0;l<num_levels;l++)
-    memory_use += sizeof(float) * (2 + num_gamma) * dl(paddwd, l) * dl(paddht, l);
+    memory_use += sizeof(float) * (2 + (l ? num_gamma : 0)) * dl(paddwd, l) * dl(paddht, l);
+  // the fine rows curved by each thread
+  memory_use += sizeof(float) * (2*ll_strip+3) * paddwd * dt_get_num_threads();
 
   return memory_use;
 }
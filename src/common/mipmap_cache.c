@@ -18,12 +18,16 @@
 
 #include "common/mipmap_cache.h"
 #include "common/darktable.h"
+#include "common/database.h"
 #include "common/debug.h"
 #include "common/exif.h"
 #include "common/file_location.h"
 #include "common/grealpath.h"
 #include "common/image_cache.h"
+#include "common/mipmap_pack.h"
+#include "common/outofcore.h"
 #include "control/conf.h"
+#include "control/control.h"
 #include "control/jobs.h"
 #include "develop/imageop_math.h"
 #include "imageio/imageio_common.h"
@@ -63,25 +67,10 @@ typedef enum dt_mipmap_buffer_dsc_flags
 {
   DT_MIPMAP_BUFFER_DSC_FLAG_NONE = 0,
   DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE = 1 << 0,
-  DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE = 1 << 1
+  DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE = 1 << 1,
+  DT_MIPMAP_BUFFER_DSC_FLAG_MAPPED = 1 << 2 // the buffer is mapped from disk, see dt_outofcore_alloc()
 } dt_mipmap_buffer_dsc_flags;
 
-// the embedded Exif data to tag thumbnails as sRGB or AdobeRGB
-static const uint8_t dt_mipmap_cache_exif_data_srgb[] = {
-  0x45, 0x78, 0x69, 0x66, 0x00, 0x00, 0x49, 0x49, 0x2a, 0x00, 0x08, 0x00, 0x00, 0x00, 0x01, 0x00, 0x69,
-  0x87, 0x04, 0x00, 0x01, 0x00, 0x00, 0x00, 0x1a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00,
-  0x01, 0xa0, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
-static const uint8_t dt_mipmap_cache_exif_data_adobergb[] = {
-  0x45, 0x78, 0x69, 0x66, 0x00, 0x00, 0x49, 0x49, 0x2a, 0x00, 0x08, 0x00, 0x00, 0x00, 0x01, 0x00, 0x69,
-  0x87, 0x04, 0x00, 0x01, 0x00, 0x00, 0x00, 0x1a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00,
-  0x01, 0xa0, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
-static const int dt_mipmap_cache_exif_data_srgb_length
-                      = sizeof(dt_mipmap_cache_exif_data_srgb) / sizeof(*dt_mipmap_cache_exif_data_srgb);
-static const int dt_mipmap_cache_exif_data_adobergb_length
-                      = sizeof(dt_mipmap_cache_exif_data_adobergb) / sizeof(*dt_mipmap_cache_exif_data_adobergb);
-
 // Define the static images.  We make the definitions macros so that they can be expanded to either
 // 4-channel 8 bits/channel integer images or 4-channel float images, depending on how __ and XX
 // are defined at the time of use.
@@ -406,16 +395,20 @@ void *dt_mipmap_cache_alloc(dt_mipmap_buffer_t *buf, const dt_image_t *img)
 
   const size_t bpp = dt_iop_buffer_dsc_to_bpp(&img->buf_dsc);
   const size_t buffer_size = (size_t)wd * ht * bpp + sizeof(*dsc);
+  gboolean mapped = dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_MAPPED;
 
   // buf might have been alloc'ed before,
   // so only check size and re-alloc if necessary:
   if(!buf->buf || _is_static_image((void *)dsc) || (entry->data_size < buffer_size))
   {
-    if(!_is_static_image((void *)dsc)) dt_free_align(entry->data);
+    if(!_is_static_image((void *)dsc))
+      dt_outofcore_free(entry->data, entry->data_size, dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_MAPPED);
 
     entry->data_size = 0;
 
-    entry->data = dt_alloc_aligned(buffer_size);
+    // the full image of a huge panorama might have to live on disk if it
+    // can't be allocated
+    entry->data = dt_outofcore_alloc(buffer_size, SIZE_MAX, &mapped);
 
     if(!entry->data)
     {
@@ -438,7 +431,8 @@ void *dt_mipmap_cache_alloc(dt_mipmap_buffer_t *buf, const dt_image_t *img)
   dsc->height = ht;
   dsc->iscale = 1.0f;
   dsc->color_space = DT_COLORSPACE_NONE;
-  dsc->flags = DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE;
+  dsc->flags = DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE
+               | (mapped ? DT_MIPMAP_BUFFER_DSC_FLAG_MAPPED : 0);
   buf->buf = (uint8_t *)(dsc + 1);
 
   // dt_print(DT_DEBUG_ALWAYS, "full buffer allocating img %u %d x %d = %u bytes (%p)", img->id, img->width,
@@ -455,6 +449,27 @@ void *dt_mipmap_cache_alloc(dt_mipmap_buffer_t *buf, const dt_image_t *img)
   return dsc + 1;
 }
 
+// size is the bytes available for the pixels behind dsc
+static gboolean _decode_thumbnail(const dt_mipmap_cache_t *cache,
+                                  const dt_mipmap_size_t mip,
+                                  dt_mipmap_buffer_dsc_t *dsc,
+                                  const size_t size,
+                                  const dt_mipmap_pack_record_t *record,
+                                  const uint8_t *data)
+{
+  if(record->width > cache->max_width[mip]
+     || record->height > cache->max_height[mip]
+     || (size_t)record->width * record->height * 4 > size
+     || !dt_mipmap_pack_decode(record, data, (uint8_t *)(dsc + 1)))
+    return FALSE;
+
+  dsc->width = record->width;
+  dsc->height = record->height;
+  dsc->iscale = 1.0f;
+  dsc->color_space = record->color_space;
+  return TRUE;
+}
+
 // callback for the cache backend to initialize payload pointers
 static void _mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
 {
@@ -522,49 +537,23 @@ static void _mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
                               || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8)))
     {
       // try and load from disk, if successful set flag
-      char filename[PATH_MAX] = {0};
-      snprintf(filename, sizeof(filename), "%s.d/%d/%" PRIu32 ".jpg", cache->cachedir, (int)mip,
-               _get_imgid(entry->key));
-      FILE *f = g_fopen(filename, "rb");
-      if(f)
+      const dt_imgid_t imgid = _get_imgid(entry->key);
+      dt_mipmap_pack_record_t record;
+      uint8_t *blob = dt_mipmap_pack_read(cache->pack[mip], imgid, &record);
+      if(blob
+         && _decode_thumbnail(cache, mip, dsc, entry->data_size - sizeof(*dsc), &record, blob))
       {
-        uint8_t *blob = 0;
-        fseek(f, 0, SEEK_END);
-        const long len = ftell(f);
-        if(len <= 0) goto read_error; // coverity madness
-        blob = (uint8_t *)dt_alloc_aligned(len);
-        if(!blob) goto read_error;
-        fseek(f, 0, SEEK_SET);
-        const int rd = fread(blob, sizeof(uint8_t), len, f);
-        if(rd != len) goto read_error;
-        dt_colorspaces_color_profile_type_t color_space;
-        dt_imageio_jpeg_t jpg;
-        if(dt_imageio_jpeg_decompress_header(blob, len, &jpg)
-           || (jpg.width > cache->max_width[mip] || jpg.height > cache->max_height[mip])
-           || ((color_space = dt_imageio_jpeg_read_color_space(&jpg)) == DT_COLORSPACE_NONE) // pointless test to keep it in the if clause
-           || dt_imageio_jpeg_decompress(&jpg, (uint8_t *)entry->data + sizeof(*dsc)))
-        {
-          dt_print(DT_DEBUG_ALWAYS,
-                   "[mipmap_cache] failed to decompress thumbnail for ID=%d from `%s'!",
-                   _get_imgid(entry->key), filename);
-          goto read_error;
-        }
         dt_print(DT_DEBUG_CACHE,
-                 "[mipmap_cache] grab mip %d for ID=%d from disk cache", mip,
-                 _get_imgid(entry->key));
-        dsc->width = jpg.width;
-        dsc->height = jpg.height;
-        dsc->iscale = 1.0f;
-        dsc->color_space = color_space;
+                 "[mipmap_cache] grab mip %d for ID=%d from disk cache", mip, imgid);
         loaded_from_disk = 1;
-        if(0)
-        {
-read_error:
-          g_unlink(filename);
-        }
-        dt_free_align(blob);
-        fclose(f);
       }
+      else if(dt_mipmap_pack_contains(cache->pack[mip], imgid))
+      {
+        dt_print(DT_DEBUG_ALWAYS,
+                 "[mipmap_cache] failed to decompress thumbnail for ID=%d from disk cache!", imgid);
+        dt_mipmap_pack_remove(cache->pack[mip], imgid);
+      }
+      g_free(blob);
     }
   }
 
@@ -588,15 +577,22 @@ static void _mipmap_cache_unlink_ondisk_thumbnail(void *data,
 {
   dt_mipmap_cache_t *cache = (dt_mipmap_cache_t *)data;
 
-  // also remove jpg backing (always try to do that, in case user just temporarily switched it off,
+  // also remove the disk backing (always try to do that, in case user just temporarily switched it off,
   // to avoid inconsistencies.
   // if(dt_conf_get_bool("cache_disk_backend"))
-  if(cache->cachedir[0])
-  {
-    char filename[PATH_MAX] = { 0 };
-    snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, imgid);
-    g_unlink(filename);
-  }
+  if(mip < DT_MIPMAP_F)
+    dt_mipmap_pack_remove(cache->pack[mip], imgid);
+}
+
+// codec for new thumbnails of this size, the lossless ones are only used up to
+// the size set in preferences as they take a lot more space
+static dt_mipmap_pack_codec_t _mipmap_cache_codec(const dt_mipmap_size_t mip)
+{
+  const dt_mipmap_size_t max_mip =
+    dt_mipmap_cache_get_min_mip_from_pref(dt_conf_get_string_const("cache_disk_codec_mipsize"));
+  if(max_mip == DT_MIPMAP_NONE || mip > max_mip)
+    return DT_MIPMAP_PACK_CODEC_JPEG;
+  return dt_mipmap_pack_codec_from_name(dt_conf_get_string_const("cache_disk_codec"));
 }
 
 static void _mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
@@ -616,64 +612,57 @@ static void _mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry
       else if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
                                      || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8)))
       {
-        // serialize to disk
-        char filename[PATH_MAX] = {0};
-        snprintf(filename, sizeof(filename), "%s.d/%d", cache->cachedir, mip);
-        const int mkd = g_mkdir_with_parents(filename, 0750);
-        if(!mkd)
+        // serialize to disk.
+        // don't overwrite existing thumbnails as both performance and quality (lossy jpg) suffer
+        const dt_imgid_t imgid = _get_imgid(entry->key);
+        if(cache->pack[mip] && !dt_mipmap_pack_contains(cache->pack[mip], imgid))
         {
-          snprintf(filename, sizeof(filename), "%s.d/%d/%" PRIu32 ".jpg", cache->cachedir, (int)mip,
-                   _get_imgid(entry->key));
-          // Don't write existing files as both performance and quality (lossy jpg) suffer
-          FILE *f = NULL;
-          if(!g_file_test(filename, G_FILE_TEST_EXISTS) && (f = g_fopen(filename, "wb")))
+          // first check the disk isn't full
+          char filename[PATH_MAX] = {0};
+          snprintf(filename, sizeof(filename), "%s.d", cache->cachedir);
+          gboolean space = FALSE;
+          struct statvfs vfsbuf;
+          if(!statvfs(filename, &vfsbuf))
           {
-            // first check the disk isn't full
-            struct statvfs vfsbuf;
-            if(!statvfs(filename, &vfsbuf))
-            {
-              const int64_t free_mb = ((vfsbuf.f_frsize * vfsbuf.f_bavail) >> 20);
-              if(free_mb < 100)
-              {
-                dt_print(DT_DEBUG_ALWAYS,
-                         "[mipmap_cache] aborting image write as only %" PRId64 " MB free to write %s",
-                         free_mb, filename);
-                goto write_error;
-              }
-            }
-            else
-            {
+            const int64_t free_mb = ((vfsbuf.f_frsize * vfsbuf.f_bavail) >> 20);
+            if(free_mb < 100)
               dt_print(DT_DEBUG_ALWAYS,
-                       "[mipmap_cache] aborting image write since couldn't determine free space available to write %s",
-                       filename);
-              goto write_error;
-            }
-
-            const int cache_quality = dt_conf_get_int("database_cache_quality");
-            const uint8_t *exif = NULL;
-            int exif_len = 0;
-            if(dsc->color_space == DT_COLORSPACE_SRGB)
-            {
-              exif = dt_mipmap_cache_exif_data_srgb;
-              exif_len = dt_mipmap_cache_exif_data_srgb_length;
-            }
-            else if(dsc->color_space == DT_COLORSPACE_ADOBERGB)
-            {
-              exif = dt_mipmap_cache_exif_data_adobergb;
-              exif_len = dt_mipmap_cache_exif_data_adobergb_length;
-            }
-            if(dt_imageio_jpeg_write(filename, (uint8_t *)entry->data + sizeof(*dsc), dsc->width, dsc->height, MIN(100, MAX(10, cache_quality)), exif, exif_len))
-            {
-write_error:
-              g_unlink(filename);
-            }
+                       "[mipmap_cache] aborting image write as only %" PRId64 " MB free to write %s",
+                       free_mb, filename);
+            else
+              space = TRUE;
           }
-          if(f) fclose(f);
+          else
+          {
+            dt_print(DT_DEBUG_ALWAYS,
+                     "[mipmap_cache] aborting image write since couldn't determine free space available to write %s",
+                     filename);
+          }
+
+          const int cache_quality = dt_conf_get_int("database_cache_quality");
+          const dt_mipmap_pack_codec_t codec = _mipmap_cache_codec(mip);
+          uint32_t len = 0;
+          uint8_t *blob = space
+            ? dt_mipmap_pack_encode(codec, (uint8_t *)entry->data + sizeof(*dsc),
+                                    dsc->width, dsc->height, cache_quality, &len)
+            : NULL;
+          if(blob)
+          {
+            const dt_mipmap_pack_record_t record = { .imgid = imgid,
+                                                     .length = len,
+                                                     .width = dsc->width,
+                                                     .height = dsc->height,
+                                                     .color_space = dsc->color_space,
+                                                     .codec = codec };
+            dt_mipmap_pack_write(cache->pack[mip], &record, blob);
+          }
+          free(blob);
         }
       }
     }
   }
-  dt_free_align(entry->data);
+  const dt_mipmap_buffer_dsc_t *dsc = (dt_mipmap_buffer_dsc_t *)entry->data;
+  dt_outofcore_free(entry->data, entry->data_size, dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_MAPPED);
 }
 
 static uint32_t _nearest_power_of_two(const uint32_t value)
@@ -683,12 +672,100 @@ static uint32_t _nearest_power_of_two(const uint32_t value)
   return rc;
 }
 
+// move the thumbnails of the old one-jpg-per-image layout into the pack.
+// stops when darktable quits, the rest is moved on the next start.
+static void _mipmap_cache_migrate_files(dt_mipmap_cache_t *cache,
+                                        const dt_mipmap_size_t mip)
+{
+  char dirname[PATH_MAX] = { 0 };
+  snprintf(dirname, sizeof(dirname), "%s.d/%d", cache->cachedir, (int)mip);
+  GDir *dir = g_dir_open(dirname, 0, NULL);
+  if(!dir) return;
+
+  int moved = 0;
+  const gchar *name;
+  while(dt_control_running() && (name = g_dir_read_name(dir)))
+  {
+    gchar *filename = g_build_filename(dirname, name, NULL);
+    const dt_imgid_t imgid = atoi(name);
+    gchar *blob = NULL;
+    gsize len = 0;
+    dt_imageio_jpeg_t jpg;
+    if(g_str_has_suffix(name, ".jpg")
+       && dt_is_valid_imgid(imgid)
+       && g_file_get_contents(filename, &blob, &len, NULL)
+       && !dt_imageio_jpeg_decompress_header(blob, len, &jpg))
+    {
+      const dt_mipmap_pack_record_t record = { .imgid = imgid,
+                                               .length = len,
+                                               .width = jpg.width,
+                                               .height = jpg.height,
+                                               .color_space = dt_imageio_jpeg_read_color_space(&jpg),
+                                               .codec = DT_MIPMAP_PACK_CODEC_JPEG };
+      jpeg_destroy_decompress(&jpg.dinfo);
+      if(!dt_mipmap_pack_contains(cache->pack[mip], imgid)
+         && dt_mipmap_pack_write(cache->pack[mip], &record, (const uint8_t *)blob))
+        moved++;
+    }
+    // broken or foreign files are dropped as well, the directory has to go
+    g_unlink(filename);
+    g_free(blob);
+    g_free(filename);
+  }
+  g_dir_close(dir);
+  // fails if we stopped early
+  g_rmdir(dirname);
+
+  dt_print(DT_DEBUG_CACHE, "[mipmap_cache] moved %d thumbnails of mip %d into the disk cache pack",
+           moved, (int)mip);
+}
+
+static int32_t _mipmap_cache_migrate_job_run(dt_job_t *job)
+{
+  dt_mipmap_cache_t *cache = dt_control_job_get_params(job);
+  for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
+    if(cache->pack[mip])
+      _mipmap_cache_migrate_files(cache, mip);
+  return 0;
+}
+
+static void _mipmap_cache_open_packs(dt_mipmap_cache_t *cache)
+{
+  if(!cache->cachedir[0]) return;
+
+  char filename[PATH_MAX] = { 0 };
+  snprintf(filename, sizeof(filename), "%s.d", cache->cachedir);
+  if(g_mkdir_with_parents(filename, 0750)) return;
+
+  gboolean migrate = FALSE;
+  for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
+  {
+    snprintf(filename, sizeof(filename), "%s.d/%d.pack", cache->cachedir, (int)mip);
+    cache->pack[mip] = dt_mipmap_pack_open(filename);
+    snprintf(filename, sizeof(filename), "%s.d/%d", cache->cachedir, (int)mip);
+    migrate |= cache->pack[mip] && g_file_test(filename, G_FILE_TEST_IS_DIR);
+  }
+
+  // moving a large old cache takes a while, thumbnails not moved yet are
+  // generated again meanwhile. without a gui the control threads are not
+  // joined on exit, so the cli tools move them right away.
+  if(migrate)
+  {
+    dt_job_t *job = dt_control_job_create(&_mipmap_cache_migrate_job_run,
+                                          "move thumbnails into disk cache packs");
+    if(!job) return;
+    dt_control_job_set_params(job, cache, NULL);
+    dt_control_add_job(darktable.gui ? DT_JOB_QUEUE_SYSTEM_BG : DT_JOB_QUEUE_SYNCHRONOUS, job);
+  }
+}
+
 void dt_mipmap_cache_init()
 {
   dt_mipmap_cache_t *cache = calloc(1, sizeof(dt_mipmap_cache_t));
   darktable.mipmap_cache = cache;
 
   _mipmap_cache_get_filename(cache->cachedir, sizeof(cache->cachedir));
+  _mipmap_cache_open_packs(cache);
   // make sure static memory is initialized
   dt_mipmap_buffer_dsc_t *dsc = (dt_mipmap_buffer_dsc_t *)_mipmap_cache_static_dead_image;
   _dead_image_f((dt_mipmap_buffer_t *)(dsc + 1));
@@ -744,7 +821,9 @@ void dt_mipmap_cache_init()
   cache->mip_full.stats_fetches = 0;
   cache->mip_full.stats_standin = 0;
 
-  dt_cache_init(&cache->mip_thumbs.cache, 0, max_mem);
+  // the thumbnail cache is hammered by all the lighttable and thumbnail
+  // jobs at once, so split it into independently locked segments.
+  dt_cache_init_segmented(&cache->mip_thumbs.cache, 0, max_mem, 2 * dt_get_num_threads());
   dt_cache_set_allocate_callback(&cache->mip_thumbs.cache, _mipmap_cache_allocate_dynamic, cache);
   dt_cache_set_cleanup_callback(&cache->mip_thumbs.cache, _mipmap_cache_deallocate_dynamic, cache);
 
@@ -776,6 +855,9 @@ void dt_mipmap_cache_cleanup()
   dt_cache_cleanup(&cache->mip_thumbs.cache);
   dt_cache_cleanup(&cache->mip_full.cache);
   dt_cache_cleanup(&cache->mip_f.cache);
+  // after the caches, those write back their thumbnails
+  for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
+    dt_mipmap_pack_close(cache->pack[mip]);
   darktable.mipmap_cache = NULL;
   free(cache);
 }
@@ -795,6 +877,18 @@ void dt_mipmap_cache_print()
            (uint32_t)cache->mip_full.cache.cost, (uint32_t)cache->mip_full.cache.cost_quota,
            100.0f * (float)cache->mip_full.cache.cost / (float)cache->mip_full.cache.cost_quota);
 
+  dt_mipmap_cache_one_t *caches[3] = { &cache->mip_thumbs, &cache->mip_f, &cache->mip_full };
+  const char *names[3] = { "thumb", "float", "full " };
+  dt_print(DT_DEBUG_ALWAYS,"[mipmap_cache] level | segments | lock acquisitions | contended");
+  for(int k = 0; k < 3; k++)
+  {
+    uint64_t locks = 0, contended = 0;
+    dt_cache_get_contention(&caches[k]->cache, &locks, &contended);
+    dt_print(DT_DEBUG_ALWAYS,"[mipmap_cache] %s | %8"PRIu32" | %17"PRIu64" | %9"PRIu64" (%6.2f%%)",
+             names[k], caches[k]->cache.num_segments, locks, contended,
+             locks ? 100.0 * contended / (double)locks : 0.0);
+  }
+
   uint64_t sum = 0;
   uint64_t sum_fetches = 0;
   uint64_t sum_standins = 0;
@@ -911,13 +1005,10 @@ void dt_mipmap_cache_get_with_caller(dt_mipmap_buffer_t *buf,
   else if(flags == DT_MIPMAP_PREFETCH_DISK)
   {
     // only prefetch if the disk cache exists:
-    if(!cache->cachedir[0]) return;
-    if(mip > DT_MIPMAP_FULL || mip < DT_MIPMAP_0)
+    if(mip >= DT_MIPMAP_F || mip < DT_MIPMAP_0)
       return;
-    char filename[PATH_MAX] = {0};
-    snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, key);
     // don't attempt to load if disk cache doesn't exist
-    if(!g_file_test(filename, G_FILE_TEST_EXISTS)) return;
+    if(!dt_mipmap_pack_contains(cache->pack[mip], imgid)) return;
     dt_control_add_job(DT_JOB_QUEUE_SYSTEM_FG, dt_image_load_job_create(imgid, mip));
   }
   else if(flags == DT_MIPMAP_BLOCKING)
@@ -1144,13 +1235,8 @@ void dt_mipmap_cache_get_with_caller(dt_mipmap_buffer_t *buf,
     __sync_fetch_and_add(&(_get_cache(cache, mip)->stats_misses), 1);
     // in case we don't even have a disk cache for our requested thumbnail,
     // prefetch at least mip0, in case we have that in the disk caches:
-    if(cache->cachedir[0])
-    {
-      char filename[PATH_MAX] = {0};
-      snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, key);
-      if(g_file_test(filename, G_FILE_TEST_EXISTS))
-        dt_mipmap_cache_get(0, imgid, DT_MIPMAP_0, DT_MIPMAP_PREFETCH_DISK, 0);
-    }
+    if(mip < DT_MIPMAP_F && dt_mipmap_pack_contains(cache->pack[mip], imgid))
+      dt_mipmap_cache_get(0, imgid, DT_MIPMAP_0, DT_MIPMAP_PREFETCH_DISK, 0);
     // nothing found :(
     buf->buf = NULL;
     buf->imgid = NO_IMGID;
@@ -1620,23 +1706,60 @@ void dt_mipmap_cache_copy_thumbnails(const dt_imgid_t dst_imgid,
   {
     for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
     {
-      // try and load from disk, if successful set flag
-      char srcpath[PATH_MAX] = {0};
-      char dstpath[PATH_MAX] = {0};
-      snprintf(srcpath, sizeof(srcpath), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, src_imgid);
-      snprintf(dstpath, sizeof(dstpath), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, dst_imgid);
-      GFile *src = g_file_new_for_path(srcpath);
-      GFile *dst = g_file_new_for_path(dstpath);
-      GError *gerror = NULL;
-      g_file_copy(src, dst, G_FILE_COPY_NONE, NULL, NULL, NULL, &gerror);
       // ignore errors, we tried what we could.
-      g_object_unref(dst);
-      g_object_unref(src);
-      g_clear_error(&gerror);
+      dt_mipmap_pack_record_t record;
+      uint8_t *blob = dt_mipmap_pack_read(cache->pack[mip], src_imgid, &record);
+      if(blob)
+      {
+        record.imgid = dst_imgid;
+        dt_mipmap_pack_write(cache->pack[mip], &record, blob);
+      }
+      g_free(blob);
     }
   }
 }
 
+int dt_mipmap_cache_purge_disk(const gboolean dryrun)
+{
+  dt_mipmap_cache_t *cache = darktable.mipmap_cache;
+  if(!cache) return 0;
+
+  GHashTable *known = g_hash_table_new(NULL, NULL);
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT id FROM main.images", -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+    g_hash_table_add(known, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
+  sqlite3_finalize(stmt);
+
+  int stale = 0;
+  for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
+  {
+    GArray *ids = dt_mipmap_pack_ids(cache->pack[mip]);
+    for(guint k = 0; k < ids->len; k++)
+    {
+      const uint32_t imgid = g_array_index(ids, uint32_t, k);
+      if(g_hash_table_contains(known, GUINT_TO_POINTER(imgid))) continue;
+
+      dt_print(DT_DEBUG_ALWAYS, "[mipmap_cache] stale thumbnail of ID=%u in mip %d%s",
+               imgid, (int)mip, dryrun ? "" : ", removed");
+      if(!dryrun) dt_mipmap_pack_remove(cache->pack[mip], imgid);
+      stale++;
+    }
+    g_array_free(ids, TRUE);
+  }
+  g_hash_table_destroy(known);
+  return stale;
+}
+
+gboolean dt_mipmap_cache_disk_contains(const dt_imgid_t imgid,
+                                       const dt_mipmap_size_t mip)
+{
+  dt_mipmap_cache_t *cache = darktable.mipmap_cache;
+  if(!cache || mip < DT_MIPMAP_0 || mip >= DT_MIPMAP_F) return FALSE;
+  return dt_mipmap_pack_contains(cache->pack[mip], imgid);
+}
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -102,6 +102,8 @@ typedef struct dt_mipmap_cache_t
   dt_mipmap_cache_one_t mip_f;
   dt_mipmap_cache_one_t mip_full;
   char cachedir[PATH_MAX]; // cached sha1sum filename for faster access
+  // on-disk thumbnails, one packed file per mip level
+  struct dt_mipmap_pack_t *pack[DT_MIPMAP_F];
 } dt_mipmap_cache_t;
 
 // dynamic memory allocation interface for imageio backend: a write locked
@@ -153,6 +155,13 @@ dt_colorspaces_color_profile_type_t dt_mipmap_cache_get_colorspace(void);
 // only copies over the jpg backend on disk, doesn't directly affect the in-memory cache.
 void dt_mipmap_cache_copy_thumbnails(const dt_imgid_t dst_imgid, const dt_imgid_t src_imgid);
 
+// remove the thumbnails of images no longer in the library from the disk cache,
+// only report them with dryrun. returns the number of stale thumbnails.
+int dt_mipmap_cache_purge_disk(const gboolean dryrun);
+
+// return TRUE if a thumbnail of the image at this size is in the disk cache
+gboolean dt_mipmap_cache_disk_contains(const dt_imgid_t imgid, const dt_mipmap_size_t mip);
+
 // return the mipmap corresponding to text value saved in prefs
 dt_mipmap_size_t dt_mipmap_cache_get_min_mip_from_pref(const char *value);
 
@@ -0,0 +1,674 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/mipmap_pack.h"
+#include "common/darktable.h"
+#include "common/dtpthread.h"
+#include "imageio/imageio_jpeg.h"
+
+#define QOI_NO_STDIO
+#include "imageio/qoi.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <unistd.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#define DT_MIPMAP_PACK_MAGIC 0x6b706d64u        // "dmpk"
+#define DT_MIPMAP_PACK_VERSION 1
+#define DT_MIPMAP_PACK_RECORD_MAGIC 0x63726d64u // "dmrc"
+#define DT_MIPMAP_PACK_INDEX_MAGIC 0x78696d64u  // "dmix"
+
+// only compact if there is at least that much garbage
+#define DT_MIPMAP_PACK_MIN_COMPACT (16 << 20)
+// a view maps at least that much of the file, records appended later are
+// mostly found in the views we already have
+#define DT_MIPMAP_PACK_VIEW_SIZE (64 << 20)
+// the headers and huffman tables of a jpeg, tiny thumbnails need more than
+// the raw pixels
+#define DT_MIPMAP_PACK_JPEG_SLACK 4096
+
+#ifdef _WIN32
+#define _pack_seek _fseeki64
+#define _pack_tell _ftelli64
+#define _pack_truncate(F, S) _chsize_s(_fileno(F), S)
+#else
+#define _pack_seek fseeko
+#define _pack_tell ftello
+#define _pack_truncate(F, S) ftruncate(fileno(F), S)
+#endif
+
+typedef struct _pack_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+} _pack_header_t;
+
+// a read-only mapping of a part of the file. views are only added while the
+// pack is open, a record is read through the first view covering all of it.
+typedef struct _pack_view_t
+{
+  uint64_t offset; // page aligned
+  size_t size;
+  uint8_t *base;
+} _pack_view_t;
+
+// index entry, in memory and on disk
+typedef struct _pack_index_t
+{
+  uint32_t imgid;
+  uint32_t length;
+  uint64_t offset;
+} _pack_index_t;
+
+typedef struct _pack_trailer_t
+{
+  uint64_t index_offset;
+  uint32_t count;
+  uint32_t magic;
+} _pack_trailer_t;
+
+struct dt_mipmap_pack_t
+{
+  dt_pthread_rwlock_t lock; // protects everything below
+  gchar *filename;
+  FILE *f;                  // records are appended here
+  GArray *views;            // _pack_view_t, the mapped parts of the file
+  uint64_t end;             // end of the record region
+  uint64_t dead;            // bytes of replaced or removed records
+  GHashTable *index;        // imgid -> _pack_index_t
+};
+
+// records are padded to keep the headers aligned in the mapping
+static inline uint64_t _record_size(const uint32_t length)
+{
+  return sizeof(dt_mipmap_pack_record_t) + (((uint64_t)length + 7) & ~(uint64_t)7);
+}
+
+static void _unmap_views(dt_mipmap_pack_t *pack)
+{
+#ifndef _WIN32
+  for(guint k = 0; k < pack->views->len; k++)
+  {
+    const _pack_view_t *view = &g_array_index(pack->views, _pack_view_t, k);
+    munmap(view->base, view->size);
+  }
+#endif
+  g_array_set_size(pack->views, 0);
+}
+
+#ifndef _WIN32
+// the record of entry if a view covers it
+static const uint8_t *_find_view(dt_mipmap_pack_t *pack,
+                                 const _pack_index_t *entry)
+{
+  const uint64_t end = entry->offset + _record_size(entry->length);
+  for(guint k = pack->views->len; k > 0; k--)
+  {
+    const _pack_view_t *view = &g_array_index(pack->views, _pack_view_t, k - 1);
+    if(entry->offset >= view->offset && end <= view->offset + view->size)
+      return view->base + (entry->offset - view->offset);
+  }
+  return NULL;
+}
+
+// maps a new view starting at the page of the entry. it may reach beyond the
+// end of the file, we only ever read records that have been written.
+static void _add_view(dt_mipmap_pack_t *pack,
+                      const _pack_index_t *entry)
+{
+  const uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+  const uint64_t offset = entry->offset - entry->offset % page;
+  const size_t size = MAX(entry->offset + _record_size(entry->length) - offset,
+                          DT_MIPMAP_PACK_VIEW_SIZE);
+  void *base = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(pack->f), offset);
+  if(base == MAP_FAILED)
+  {
+    dt_print(DT_DEBUG_ALWAYS, "[mipmap_pack] can't map `%s' at %" PRIu64, pack->filename, offset);
+    return;
+  }
+  const _pack_view_t view = { offset, size, base };
+  g_array_append_val(pack->views, view);
+}
+#endif
+
+static gboolean _read_at(dt_mipmap_pack_t *pack,
+                         const uint64_t offset,
+                         void *out,
+                         const size_t size)
+{
+  return !_pack_seek(pack->f, offset, SEEK_SET)
+    && fread(out, 1, size, pack->f) == size;
+}
+
+static inline gboolean _record_matches(const dt_mipmap_pack_record_t *record,
+                                       const _pack_index_t *entry)
+{
+  return record->magic == DT_MIPMAP_PACK_RECORD_MAGIC
+    && record->imgid == entry->imgid
+    && record->length == entry->length;
+}
+
+static void _insert(dt_mipmap_pack_t *pack,
+                    const uint32_t imgid,
+                    const uint32_t length,
+                    const uint64_t offset)
+{
+  _pack_index_t *entry = g_new(_pack_index_t, 1);
+  entry->imgid = imgid;
+  entry->length = length;
+  entry->offset = offset;
+  g_hash_table_insert(pack->index, GUINT_TO_POINTER(imgid), entry);
+}
+
+static uint64_t _live_bytes(dt_mipmap_pack_t *pack)
+{
+  uint64_t live = 0;
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init(&iter, pack->index);
+  while(g_hash_table_iter_next(&iter, NULL, &value))
+    live += _record_size(((_pack_index_t *)value)->length);
+  return live;
+}
+
+static gboolean _read_index(dt_mipmap_pack_t *pack)
+{
+  _pack_trailer_t trailer;
+  if(_pack_seek(pack->f, -(int64_t)sizeof(trailer), SEEK_END)) return FALSE;
+  const int64_t trailer_pos = _pack_tell(pack->f);
+  if(fread(&trailer, sizeof(trailer), 1, pack->f) != 1
+     || trailer.magic != DT_MIPMAP_PACK_INDEX_MAGIC
+     || trailer.index_offset < sizeof(_pack_header_t)
+     || trailer.index_offset + (uint64_t)trailer.count * sizeof(_pack_index_t) != (uint64_t)trailer_pos)
+    return FALSE;
+
+  _pack_index_t *entries = g_new(_pack_index_t, MAX(1, trailer.count));
+  const gboolean ok = !_pack_seek(pack->f, trailer.index_offset, SEEK_SET)
+    && fread(entries, sizeof(_pack_index_t), trailer.count, pack->f) == trailer.count;
+  if(ok)
+  {
+    for(uint32_t k = 0; k < trailer.count; k++)
+      _insert(pack, entries[k].imgid, entries[k].length, entries[k].offset);
+    pack->end = trailer.index_offset;
+  }
+  g_free(entries);
+  return ok;
+}
+
+// recover the index by walking all records, later ones win
+static void _scan_records(dt_mipmap_pack_t *pack)
+{
+  g_hash_table_remove_all(pack->index);
+  _pack_seek(pack->f, 0, SEEK_END);
+  const uint64_t size = _pack_tell(pack->f);
+
+  uint64_t pos = sizeof(_pack_header_t);
+  dt_mipmap_pack_record_t record;
+  while(!_pack_seek(pack->f, pos, SEEK_SET)
+        && fread(&record, sizeof(record), 1, pack->f) == 1
+        && record.magic == DT_MIPMAP_PACK_RECORD_MAGIC
+        && pos + _record_size(record.length) <= size)
+  {
+    if(record.length)
+      _insert(pack, record.imgid, record.length, pos);
+    else
+      g_hash_table_remove(pack->index, GUINT_TO_POINTER(record.imgid));
+    pos += _record_size(record.length);
+  }
+  pack->end = pos;
+
+  dt_print(DT_DEBUG_CACHE, "[mipmap_pack] recovered %u thumbnails in `%s'",
+           g_hash_table_size(pack->index), pack->filename);
+}
+
+static gboolean _write_header(dt_mipmap_pack_t *pack)
+{
+  const _pack_header_t header = { DT_MIPMAP_PACK_MAGIC, DT_MIPMAP_PACK_VERSION };
+  pack->end = sizeof(header);
+  return !_pack_seek(pack->f, 0, SEEK_SET)
+    && fwrite(&header, sizeof(header), 1, pack->f) == 1;
+}
+
+dt_mipmap_pack_t *dt_mipmap_pack_open(const char *filename)
+{
+  FILE *f = g_fopen(filename, "r+b");
+  if(!f) f = g_fopen(filename, "w+b");
+  if(!f)
+  {
+    dt_print(DT_DEBUG_ALWAYS, "[mipmap_pack] can't open `%s'", filename);
+    return NULL;
+  }
+
+  dt_mipmap_pack_t *pack = g_new0(dt_mipmap_pack_t, 1);
+  dt_pthread_rwlock_init(&pack->lock, NULL);
+  pack->filename = g_strdup(filename);
+  pack->f = f;
+  pack->index = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+  pack->views = g_array_new(FALSE, FALSE, sizeof(_pack_view_t));
+
+  _pack_header_t header;
+  gboolean ok = TRUE;
+  if(fread(&header, sizeof(header), 1, f) != 1
+     || header.magic != DT_MIPMAP_PACK_MAGIC
+     || header.version != DT_MIPMAP_PACK_VERSION)
+  {
+    // new or unknown file, start from scratch
+    ok = _write_header(pack);
+  }
+  else if(!_read_index(pack))
+    _scan_records(pack);
+
+  // drop the index, it is written again on close. until then a crash
+  // leaves a file that is recovered by scanning the records.
+  ok = ok && !fflush(f) && !_pack_truncate(f, pack->end);
+  if(!ok)
+  {
+    dt_print(DT_DEBUG_ALWAYS, "[mipmap_pack] can't initialize `%s'", filename);
+    fclose(f);
+    pack->f = NULL;
+    dt_mipmap_pack_close(pack);
+    return NULL;
+  }
+
+  pack->dead = pack->end - sizeof(_pack_header_t) - _live_bytes(pack);
+  return pack;
+}
+
+static gint _offset_cmp(gconstpointer a, gconstpointer b)
+{
+  const _pack_index_t *ea = a;
+  const _pack_index_t *eb = b;
+  return (ea->offset > eb->offset) - (ea->offset < eb->offset);
+}
+
+// rewrite the live records into a new file. only called on close.
+static void _compact(dt_mipmap_pack_t *pack)
+{
+  if(fflush(pack->f)) return;
+
+  gchar *tmpname = g_strdup_printf("%s.tmp", pack->filename);
+  FILE *out = g_fopen(tmpname, "wb");
+  if(!out)
+  {
+    g_free(tmpname);
+    return;
+  }
+
+  const _pack_header_t header = { DT_MIPMAP_PACK_MAGIC, DT_MIPMAP_PACK_VERSION };
+  gboolean ok = fwrite(&header, sizeof(header), 1, out) == 1;
+
+  // keep the order of the records, it's roughly the order they are used in
+  GList *entries = g_list_sort(g_hash_table_get_values(pack->index), _offset_cmp);
+  uint8_t *buf = NULL;
+  size_t bufsize = 0;
+  for(GList *e = entries; e && ok; e = g_list_next(e))
+  {
+    const _pack_index_t *entry = e->data;
+    const uint64_t size = _record_size(entry->length);
+    if(size > bufsize)
+    {
+      g_free(buf);
+      bufsize = size;
+      buf = g_malloc(bufsize);
+    }
+    ok = _read_at(pack, entry->offset, buf, size)
+      && fwrite(buf, 1, size, out) == size;
+  }
+  g_free(buf);
+  ok = !fclose(out) && ok;
+
+  if(ok)
+  {
+    _unmap_views(pack);
+    fclose(pack->f);
+    ok = !g_rename(tmpname, pack->filename);
+    pack->f = g_fopen(pack->filename, "r+b");
+  }
+
+  if(ok)
+  {
+    const uint64_t before = pack->end;
+    uint64_t pos = sizeof(header);
+    for(GList *e = entries; e; e = g_list_next(e))
+    {
+      _pack_index_t *entry = e->data;
+      entry->offset = pos;
+      pos += _record_size(entry->length);
+    }
+    pack->end = pos;
+    pack->dead = 0;
+    dt_print(DT_DEBUG_CACHE, "[mipmap_pack] compacted `%s' from %" PRIu64 " to %" PRIu64 " bytes",
+             pack->filename, before, pos);
+  }
+  else
+    g_unlink(tmpname);
+
+  g_list_free(entries);
+  g_free(tmpname);
+}
+
+static void _write_index(dt_mipmap_pack_t *pack)
+{
+  if(_pack_seek(pack->f, pack->end, SEEK_SET)) return;
+
+  gboolean ok = TRUE;
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init(&iter, pack->index);
+  while(ok && g_hash_table_iter_next(&iter, NULL, &value))
+    ok = fwrite(value, sizeof(_pack_index_t), 1, pack->f) == 1;
+
+  const _pack_trailer_t trailer = { pack->end, g_hash_table_size(pack->index), DT_MIPMAP_PACK_INDEX_MAGIC };
+  ok = ok && fwrite(&trailer, sizeof(trailer), 1, pack->f) == 1;
+  ok = !fflush(pack->f) && ok;
+
+  // a broken index must never be found, we'd rather scan
+  if(!ok) _pack_truncate(pack->f, pack->end);
+}
+
+void dt_mipmap_pack_close(dt_mipmap_pack_t *pack)
+{
+  if(!pack) return;
+
+  if(pack->f
+     && pack->dead > DT_MIPMAP_PACK_MIN_COMPACT
+     && pack->dead * 3 > pack->end)
+    _compact(pack);
+
+  if(pack->f)
+  {
+    _write_index(pack);
+    fclose(pack->f);
+  }
+  _unmap_views(pack);
+  g_array_free(pack->views, TRUE);
+  g_hash_table_destroy(pack->index);
+  dt_pthread_rwlock_destroy(&pack->lock);
+  g_free(pack->filename);
+  g_free(pack);
+}
+
+gboolean dt_mipmap_pack_contains(dt_mipmap_pack_t *pack,
+                                 const uint32_t imgid)
+{
+  if(!pack) return FALSE;
+  dt_pthread_rwlock_rdlock(&pack->lock);
+  const gboolean found = g_hash_table_contains(pack->index, GUINT_TO_POINTER(imgid));
+  dt_pthread_rwlock_unlock(&pack->lock);
+  return found;
+}
+
+static inline const _pack_index_t *_lookup(dt_mipmap_pack_t *pack,
+                                           const uint32_t imgid)
+{
+  return g_hash_table_lookup(pack->index, GUINT_TO_POINTER(imgid));
+}
+
+uint8_t *dt_mipmap_pack_read(dt_mipmap_pack_t *pack,
+                             const uint32_t imgid,
+                             dt_mipmap_pack_record_t *record)
+{
+  if(!pack) return NULL;
+
+  uint8_t *data = NULL;
+#ifdef _WIN32
+  // no views, reading moves the shared file position
+  dt_pthread_rwlock_wrlock(&pack->lock);
+  const _pack_index_t *entry = _lookup(pack, imgid);
+  if(entry
+     && _read_at(pack, entry->offset, record, sizeof(*record))
+     && _record_matches(record, entry))
+  {
+    data = g_malloc(entry->length);
+    if(fread(data, 1, entry->length, pack->f) != entry->length)
+    {
+      g_free(data);
+      data = NULL;
+    }
+  }
+#else
+  dt_pthread_rwlock_rdlock(&pack->lock);
+  const _pack_index_t *entry = _lookup(pack, imgid);
+  const uint8_t *src = entry ? _find_view(pack, entry) : NULL;
+  if(entry && !src)
+  {
+    // appended behind the views we have
+    dt_pthread_rwlock_unlock(&pack->lock);
+    dt_pthread_rwlock_wrlock(&pack->lock);
+    entry = _lookup(pack, imgid);
+    if(entry && !_find_view(pack, entry)) _add_view(pack, entry);
+    dt_pthread_rwlock_unlock(&pack->lock);
+    dt_pthread_rwlock_rdlock(&pack->lock);
+    entry = _lookup(pack, imgid);
+    src = entry ? _find_view(pack, entry) : NULL;
+  }
+
+  // only copy the record here, the caller decodes it without holding the lock
+  if(src && _record_matches((const dt_mipmap_pack_record_t *)src, entry))
+  {
+    memcpy(record, src, sizeof(*record));
+    data = g_malloc(entry->length);
+    memcpy(data, src + sizeof(*record), entry->length);
+  }
+#endif
+  dt_pthread_rwlock_unlock(&pack->lock);
+  return data;
+}
+
+GArray *dt_mipmap_pack_ids(dt_mipmap_pack_t *pack)
+{
+  GArray *ids = g_array_new(FALSE, FALSE, sizeof(uint32_t));
+  if(!pack) return ids;
+  dt_pthread_rwlock_rdlock(&pack->lock);
+  GHashTableIter iter;
+  gpointer key;
+  g_hash_table_iter_init(&iter, pack->index);
+  while(g_hash_table_iter_next(&iter, &key, NULL))
+  {
+    const uint32_t imgid = GPOINTER_TO_UINT(key);
+    g_array_append_val(ids, imgid);
+  }
+  dt_pthread_rwlock_unlock(&pack->lock);
+  return ids;
+}
+
+// called with the write lock held
+static gboolean _append(dt_mipmap_pack_t *pack,
+                        const dt_mipmap_pack_record_t *record,
+                        const uint8_t *data)
+{
+  static const uint8_t zeros[8] = { 0 };
+  dt_mipmap_pack_record_t rec = *record;
+  rec.magic = DT_MIPMAP_PACK_RECORD_MAGIC;
+  const size_t padding = _record_size(rec.length) - sizeof(rec) - rec.length;
+
+  const gboolean ok = pack->f
+    && !_pack_seek(pack->f, pack->end, SEEK_SET)
+    && fwrite(&rec, sizeof(rec), 1, pack->f) == 1
+    && (!rec.length || fwrite(data, 1, rec.length, pack->f) == rec.length)
+    && (!padding || fwrite(zeros, 1, padding, pack->f) == padding)
+    && !fflush(pack->f);
+
+  if(!ok)
+  {
+    // don't leave a partial record behind
+    if(pack->f) _pack_truncate(pack->f, pack->end);
+    return FALSE;
+  }
+
+  const _pack_index_t *old = g_hash_table_lookup(pack->index, GUINT_TO_POINTER(rec.imgid));
+  if(old) pack->dead += _record_size(old->length);
+
+  if(rec.length)
+    _insert(pack, rec.imgid, rec.length, pack->end);
+  else
+  {
+    g_hash_table_remove(pack->index, GUINT_TO_POINTER(rec.imgid));
+    pack->dead += _record_size(0);
+  }
+  pack->end += _record_size(rec.length);
+  return TRUE;
+}
+
+gboolean dt_mipmap_pack_write(dt_mipmap_pack_t *pack,
+                              const dt_mipmap_pack_record_t *record,
+                              const uint8_t *data)
+{
+  if(!pack || !record->length) return FALSE;
+  dt_pthread_rwlock_wrlock(&pack->lock);
+  const gboolean ok = _append(pack, record, data);
+  dt_pthread_rwlock_unlock(&pack->lock);
+  return ok;
+}
+
+void dt_mipmap_pack_remove(dt_mipmap_pack_t *pack,
+                           const uint32_t imgid)
+{
+  if(!pack) return;
+  dt_pthread_rwlock_wrlock(&pack->lock);
+  // the removal has to be recorded, otherwise a recovery scan would revive it
+  if(g_hash_table_contains(pack->index, GUINT_TO_POINTER(imgid)))
+  {
+    const dt_mipmap_pack_record_t tombstone = { .imgid = imgid, .length = 0 };
+    _append(pack, &tombstone, NULL);
+  }
+  dt_pthread_rwlock_unlock(&pack->lock);
+}
+
+void dt_mipmap_pack_stats(dt_mipmap_pack_t *pack,
+                          uint32_t *count,
+                          uint64_t *live,
+                          uint64_t *dead)
+{
+  *count = 0;
+  *live = *dead = 0;
+  if(!pack) return;
+  dt_pthread_rwlock_rdlock(&pack->lock);
+  *count = g_hash_table_size(pack->index);
+  *live = _live_bytes(pack);
+  *dead = pack->dead;
+  dt_pthread_rwlock_unlock(&pack->lock);
+}
+
+uint8_t *dt_mipmap_pack_encode(const dt_mipmap_pack_codec_t codec,
+                               const uint8_t *in,
+                               const uint32_t width,
+                               const uint32_t height,
+                               const int quality,
+                               uint32_t *length)
+{
+  const size_t npixels = (size_t)width * height;
+  *length = 0;
+  if(!npixels) return NULL;
+
+  if(codec == DT_MIPMAP_PACK_CODEC_QOI)
+  {
+    // drop the padding byte, it's not necessarily constant and would
+    // spoil the run length encoding
+    uint8_t *rgb = malloc(npixels * 3);
+    if(!rgb) return NULL;
+    for(size_t k = 0; k < npixels; k++)
+    {
+      rgb[3 * k + 0] = in[4 * k + 0];
+      rgb[3 * k + 1] = in[4 * k + 1];
+      rgb[3 * k + 2] = in[4 * k + 2];
+    }
+    const qoi_desc desc = { .width = width, .height = height, .channels = 3, .colorspace = QOI_SRGB };
+    int len = 0;
+    uint8_t *out = qoi_encode(rgb, &desc, &len);
+    free(rgb);
+    if(out) *length = len;
+    return out;
+  }
+  else if(codec == DT_MIPMAP_PACK_CODEC_RAW)
+  {
+    uint8_t *out = malloc(npixels * 4);
+    if(!out) return NULL;
+    memcpy(out, in, npixels * 4);
+    *length = npixels * 4;
+    return out;
+  }
+
+  // jpeg never gets larger than the raw pixels plus its tables
+  const size_t size = npixels * 4 + DT_MIPMAP_PACK_JPEG_SLACK;
+  uint8_t *out = malloc(size);
+  if(!out) return NULL;
+  const int len = dt_imageio_jpeg_compress(in, out, size, width, height, MIN(100, MAX(10, quality)));
+  if(len <= 1)
+  {
+    free(out);
+    return NULL;
+  }
+  *length = len;
+  return out;
+}
+
+gboolean dt_mipmap_pack_decode(const dt_mipmap_pack_record_t *record,
+                               const uint8_t *data,
+                               uint8_t *out)
+{
+  const size_t size = (size_t)record->width * record->height * 4;
+
+  if(record->codec == DT_MIPMAP_PACK_CODEC_QOI)
+  {
+    qoi_desc desc;
+    uint8_t *pixels = qoi_decode(data, record->length, &desc, 4);
+    if(!pixels) return FALSE;
+    const gboolean ok = desc.width == record->width && desc.height == record->height;
+    if(ok) memcpy(out, pixels, size);
+    free(pixels);
+    return ok;
+  }
+  else if(record->codec == DT_MIPMAP_PACK_CODEC_RAW)
+  {
+    if(record->length != size) return FALSE;
+    memcpy(out, data, size);
+    return TRUE;
+  }
+  else if(record->codec == DT_MIPMAP_PACK_CODEC_JPEG)
+  {
+    dt_imageio_jpeg_t jpg;
+    if(dt_imageio_jpeg_decompress_header(data, record->length, &jpg))
+      return FALSE;
+    if(jpg.width != record->width || jpg.height != record->height)
+    {
+      jpeg_destroy_decompress(&jpg.dinfo);
+      return FALSE;
+    }
+    return !dt_imageio_jpeg_decompress(&jpg, out);
+  }
+  return FALSE;
+}
+
+dt_mipmap_pack_codec_t dt_mipmap_pack_codec_from_name(const char *name)
+{
+  if(!g_strcmp0(name, "QOI")) return DT_MIPMAP_PACK_CODEC_QOI;
+  if(!g_strcmp0(name, "uncompressed")) return DT_MIPMAP_PACK_CODEC_RAW;
+  return DT_MIPMAP_PACK_CODEC_JPEG;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,105 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <inttypes.h>
+
+G_BEGIN_DECLS
+
+/**
+ * packed on-disk store for the thumbnails of one mipmap level.
+ *
+ * a single file holds a small header followed by an append-only region of
+ * records (record header + encoded thumbnail). replacing or removing a
+ * thumbnail appends a new record, the space of the old one is reclaimed by
+ * compaction. on a clean close an index of the live records and a trailer
+ * are appended, so the next open only has to read the index. if that is
+ * missing (crash) the records are scanned once to rebuild it.
+ *
+ * the file is memory mapped for reading in views of a few MB, which are
+ * only added for records appended behind them. fetching a thumbnail is a
+ * hash lookup and a copy out of the mapping without any file system calls.
+ */
+
+typedef enum dt_mipmap_pack_codec_t
+{
+  DT_MIPMAP_PACK_CODEC_JPEG = 0, // lossy, smallest
+  DT_MIPMAP_PACK_CODEC_QOI = 1,  // lossless, several times faster to decode than jpeg
+  DT_MIPMAP_PACK_CODEC_RAW = 2,  // plain pixels, no decoding at all
+  DT_MIPMAP_PACK_CODEC_LAST
+} dt_mipmap_pack_codec_t;
+
+typedef struct dt_mipmap_pack_record_t
+{
+  uint32_t magic;       // set by dt_mipmap_pack_write()
+  uint32_t imgid;
+  uint32_t length;      // bytes of encoded data following the record, 0 marks a removal
+  uint32_t width;
+  uint32_t height;
+  uint8_t color_space;  // dt_colorspaces_color_profile_type_t
+  uint8_t codec;        // dt_mipmap_pack_codec_t
+  uint8_t reserved[2];
+} dt_mipmap_pack_record_t;
+
+typedef struct dt_mipmap_pack_t dt_mipmap_pack_t;
+
+/** opens or creates the pack file, returns NULL if that's not possible. */
+dt_mipmap_pack_t *dt_mipmap_pack_open(const char *filename);
+/** compacts the file if worthwhile, writes the index and frees the pack. */
+void dt_mipmap_pack_close(dt_mipmap_pack_t *pack);
+
+gboolean dt_mipmap_pack_contains(dt_mipmap_pack_t *pack, const uint32_t imgid);
+/** looks up imgid, fills record and returns a copy of its encoded data to be g_free()d,
+ *  NULL if not found. the pack isn't locked any more when it returns. */
+uint8_t *dt_mipmap_pack_read(dt_mipmap_pack_t *pack,
+                             const uint32_t imgid,
+                             dt_mipmap_pack_record_t *record);
+/** the imgids of all live records, to be freed with g_array_free(). */
+GArray *dt_mipmap_pack_ids(dt_mipmap_pack_t *pack);
+/** appends a record (replacing an older one with the same imgid), returns TRUE on success. */
+gboolean dt_mipmap_pack_write(dt_mipmap_pack_t *pack,
+                              const dt_mipmap_pack_record_t *record,
+                              const uint8_t *data);
+void dt_mipmap_pack_remove(dt_mipmap_pack_t *pack, const uint32_t imgid);
+/** number of live records and the bytes used by live and dead records. */
+void dt_mipmap_pack_stats(dt_mipmap_pack_t *pack, uint32_t *count, uint64_t *live, uint64_t *dead);
+
+/** encodes a 4 bytes per pixel (RGB + padding) thumbnail, quality is only used by jpeg.
+ *  returns the encoded data to be free()d and its size in length, or NULL on failure. */
+uint8_t *dt_mipmap_pack_encode(const dt_mipmap_pack_codec_t codec,
+                               const uint8_t *in,
+                               const uint32_t width,
+                               const uint32_t height,
+                               const int quality,
+                               uint32_t *length);
+/** decodes the record into out, which must hold width * height * 4 bytes. */
+gboolean dt_mipmap_pack_decode(const dt_mipmap_pack_record_t *record,
+                               const uint8_t *data,
+                               uint8_t *out);
+/** parses a codec name as used in the preferences, JPEG if unknown. */
+dt_mipmap_pack_codec_t dt_mipmap_pack_codec_from_name(const char *name);
+
+G_END_DECLS
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
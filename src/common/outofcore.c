@@ -0,0 +1,142 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/outofcore.h"
+#include "common/darktable.h"
+#include "common/file_location.h"
+#include "control/conf.h"
+
+#include <glib/gstdio.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static void *_map(const size_t size)
+{
+#ifdef _WIN32
+  return NULL;
+#else
+  // not the temporary directory, that is often kept in memory
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  gchar *path = g_build_filename(cachedir, "outofcore_XXXXXX", NULL);
+  const int fd = g_mkstemp(path);
+  if(fd < 0)
+  {
+    dt_print(DT_DEBUG_MEMORY, "[outofcore] can't create a file in %s", cachedir);
+    g_free(path);
+    return NULL;
+  }
+  // the file lives as long as the mapping
+  g_unlink(path);
+  g_free(path);
+
+  // reserve the disk space right away, running out of it later on would
+  // kill us on the first write to the mapping
+#ifdef __APPLE__
+  const gboolean reserved = ftruncate(fd, size) == 0;
+#else
+  const gboolean reserved = posix_fallocate(fd, 0, size) == 0;
+#endif
+  void *mem = reserved
+    ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+    : MAP_FAILED;
+  close(fd);
+
+  if(mem == MAP_FAILED)
+  {
+    dt_print(DT_DEBUG_MEMORY, "[outofcore] can't map %zu MB from disk", size >> 20);
+    return NULL;
+  }
+
+  dt_print(DT_DEBUG_MEMORY, "[outofcore] mapped %zu MB from disk", size >> 20);
+  return mem;
+#endif
+}
+
+void *dt_outofcore_alloc(const size_t size,
+                         const size_t budget,
+                         gboolean *mapped)
+{
+  *mapped = FALSE;
+  if(!dt_conf_get_bool("outofcore_buffers"))
+    return dt_alloc_aligned(size);
+
+  // with overcommit a regular allocation beyond the budget hardly ever fails,
+  // the system starts swapping instead. so those go to disk right away.
+  if(size > budget)
+  {
+    void *mem = _map(size);
+    if(mem)
+    {
+      *mapped = TRUE;
+      return mem;
+    }
+  }
+
+  void *mem = dt_alloc_aligned(size);
+  if(!mem && size && size <= budget)
+  {
+    mem = _map(size);
+    *mapped = mem != NULL;
+  }
+  return mem;
+}
+
+void dt_outofcore_free(void *mem,
+                       const size_t size,
+                       const gboolean mapped)
+{
+  if(!mem) return;
+#ifndef _WIN32
+  if(mapped)
+  {
+    munmap(mem, size);
+    return;
+  }
+#endif
+  dt_free_align(mem);
+}
+
+void dt_outofcore_advise(const void *mem,
+                         const gboolean mapped,
+                         const size_t offset,
+                         const size_t size,
+                         const dt_outofcore_advice_t advice)
+{
+#ifndef _WIN32
+  if(!mapped || !size) return;
+
+  // madvise() wants a page aligned start, the mapping itself is page aligned.
+  // dropping pages shared with other parts is fine, the file keeps their data.
+  const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  const uintptr_t start = (uintptr_t)mem + offset;
+  const uintptr_t begin = start - start % page;
+  madvise((void *)begin, start + size - begin,
+          advice == DT_OUTOFCORE_WILLNEED ? MADV_WILLNEED : MADV_DONTNEED);
+#endif
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
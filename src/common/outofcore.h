@@ -0,0 +1,74 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <stddef.h>
+
+G_BEGIN_DECLS
+
+/**
+ * out-of-core image buffers.
+ *
+ * tiling keeps the working memory of a module small, but the input and
+ * output buffers of the pipe still had to be held in memory completely, so
+ * exporting a huge panorama failed as soon as a single buffer did not fit.
+ *
+ * buffers larger than the memory the caller may still use, or which the
+ * regular allocation fails for, are backed by a memory mapped, already
+ * unlinked file in the cache directory instead. the kernel pages
+ * them in and out as needed, code using them sees plain memory. tiling
+ * gives hints about the parts it is about to read and the parts it is done
+ * with, see dt_outofcore_advise().
+ */
+
+typedef enum dt_outofcore_advice_t
+{
+  DT_OUTOFCORE_WILLNEED = 0, // about to be accessed, read ahead
+  DT_OUTOFCORE_DONTNEED = 1  // done for now, may leave memory
+} dt_outofcore_advice_t;
+
+/** allocates size bytes aligned like dt_alloc_aligned(). with the out-of-core
+ *  mode enabled, the buffer is mapped from disk if size exceeds budget or the
+ *  regular allocation fails. mapped tells the caller which, keep it for
+ *  dt_outofcore_free() and dt_outofcore_advise(). */
+void *dt_outofcore_alloc(const size_t size,
+                         const size_t budget,
+                         gboolean *mapped);
+
+/** frees size bytes of dt_outofcore_alloc() or memory of dt_alloc_aligned() if not mapped. */
+void dt_outofcore_free(void *mem,
+                       const size_t size,
+                       const gboolean mapped);
+
+/** hints the kernel about the use of size bytes at offset of mem. does
+ *  nothing for memory which isn't mapped. */
+void dt_outofcore_advise(const void *mem,
+                         const gboolean mapped,
+                         const size_t offset,
+                         const size_t size,
+                         const dt_outofcore_advice_t advice);
+
+G_END_DECLS
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
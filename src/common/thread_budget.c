@@ -0,0 +1,115 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/thread_budget.h"
+#include "common/atomic.h"
+#include "common/darktable.h"
+
+// background work gets this fraction of the threads while interactive work runs
+#define DT_THREAD_BUDGET_BACKGROUND_SHARE 4
+
+struct dt_thread_budget_t
+{
+  int threads;
+  dt_atomic_int active[DT_THREAD_BUDGET_PRIORITY_LAST]; // threads in a section per priority
+};
+
+// the section of the calling thread, see dt_thread_budget_enter()
+typedef struct _thread_budget_section_t
+{
+  dt_thread_budget_t *budget;
+  dt_thread_budget_priority_t priority;
+  int limit; // the thread's OpenMP team size when entering
+  int depth; // nested sections, the outermost one sets the priority
+} _thread_budget_section_t;
+
+static __thread _thread_budget_section_t _section = { NULL, DT_THREAD_BUDGET_PRIORITY_INTERACTIVE, 0, 0 };
+
+dt_thread_budget_t *dt_thread_budget_new(const int threads)
+{
+  dt_thread_budget_t *budget = calloc(1, sizeof(dt_thread_budget_t));
+  if(!budget) return NULL;
+  budget->threads = MAX(1, threads);
+  for(int p = 0; p < DT_THREAD_BUDGET_PRIORITY_LAST; p++)
+    dt_atomic_set_int(&budget->active[p], 0);
+
+  dt_print(DT_DEBUG_DEV, "[thread_budget] budget of %d threads", budget->threads);
+  return budget;
+}
+
+void dt_thread_budget_free(dt_thread_budget_t *budget)
+{
+  free(budget);
+}
+
+int dt_thread_budget_threads(const dt_thread_budget_t *budget)
+{
+  return budget ? budget->threads : 1;
+}
+
+void dt_thread_budget_enter(dt_thread_budget_t *budget, const dt_thread_budget_priority_t priority)
+{
+  if(!budget) return;
+  if(_section.budget)
+  {
+    if(_section.budget == budget) _section.depth++;
+    return;
+  }
+  _section.budget = budget;
+  _section.depth = 1;
+  _section.priority = priority;
+#ifdef _OPENMP
+  _section.limit = omp_get_max_threads();
+#else
+  _section.limit = dt_thread_budget_threads(budget);
+#endif
+  dt_atomic_add_int(&budget->active[priority], 1);
+}
+
+void dt_thread_budget_leave(dt_thread_budget_t *budget)
+{
+  if(!budget || _section.budget != budget || --_section.depth > 0) return;
+  dt_atomic_sub_int(&budget->active[_section.priority], 1);
+#ifdef _OPENMP
+  // the budget might have shrunk the team
+  omp_set_num_threads(_section.limit);
+#endif
+  _section.budget = NULL;
+  _section.priority = DT_THREAD_BUDGET_PRIORITY_INTERACTIVE;
+}
+
+int dt_thread_budget_available(dt_thread_budget_t *budget)
+{
+  if(!budget) return 1;
+  const int threads = dt_thread_budget_threads(budget);
+  if(_section.budget != budget) return threads;
+  if(_section.priority == DT_THREAD_BUDGET_PRIORITY_INTERACTIVE)
+    return MAX(1, MIN(threads, _section.limit));
+
+  // background work shares what interactive work leaves
+  const int interactive = dt_atomic_get_int(&budget->active[DT_THREAD_BUDGET_PRIORITY_INTERACTIVE]);
+  const int background = MAX(1, dt_atomic_get_int(&budget->active[DT_THREAD_BUDGET_PRIORITY_BACKGROUND]));
+  const int share = interactive ? threads / DT_THREAD_BUDGET_BACKGROUND_SHARE : threads;
+  return MAX(1, MIN(share / background, _section.limit));
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,69 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * shared core budget for the data parallel work of all pipes.
+ *
+ * every pipe used to run its loops with a full OpenMP team of its own, so
+ * a darkroom pipe running next to a few thumbnail pipes oversubscribed the
+ * cores. the budget counts the threads working on pipes per priority and
+ * hands out the cores accordingly: interactive pipes may use all of them,
+ * background pipes share what is left while interactive work runs.
+ *
+ * threads announce their priority with dt_thread_budget_enter(). the budget
+ * only sizes the OpenMP teams of the existing DT_OMP_FOR loops, see
+ * dt_thread_budget_available(), it has no threads of its own.
+ */
+
+typedef enum dt_thread_budget_priority_t
+{
+  DT_THREAD_BUDGET_PRIORITY_BACKGROUND = 0,  // thumbnails, exports
+  DT_THREAD_BUDGET_PRIORITY_INTERACTIVE = 1, // darkroom pipes
+  DT_THREAD_BUDGET_PRIORITY_LAST
+} dt_thread_budget_priority_t;
+
+typedef struct dt_thread_budget_t dt_thread_budget_t;
+
+/** creates the budget for threads cores. */
+dt_thread_budget_t *dt_thread_budget_new(const int threads);
+void dt_thread_budget_free(dt_thread_budget_t *budget);
+int dt_thread_budget_threads(const dt_thread_budget_t *budget);
+
+/** sets the priority of the calling thread's parallel work until
+ *  dt_thread_budget_leave(). sections nest, the outermost one keeps its priority,
+ *  so a job can run a darkroom type pipe as background work. */
+void dt_thread_budget_enter(dt_thread_budget_t *budget, const dt_thread_budget_priority_t priority);
+void dt_thread_budget_leave(dt_thread_budget_t *budget);
+
+/** number of threads the calling thread may use right now: all of them for
+ *  interactive work, a share of what interactive work leaves for background work. */
+int dt_thread_budget_available(dt_thread_budget_t *budget);
+
+G_END_DECLS
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -231,6 +231,7 @@ void dt_control_init(const gboolean withgui)
   s->toast_message_timeout_id = 0;
 
   pthread_cond_init(&s->cond, NULL);
+  pthread_cond_init(&s->work_cond, NULL);
   dt_pthread_mutex_init(&s->cond_mutex, NULL);
   dt_pthread_mutex_init(&s->queue_mutex, NULL);
   dt_pthread_mutex_init(&s->res_mutex, NULL);
@@ -337,6 +338,7 @@ void dt_control_shutdown()
   dt_pthread_mutex_lock(&s->cond_mutex);
   const gboolean cleanup = dt_atomic_exch_int(&s->running, DT_CONTROL_STATE_DISABLED) == DT_CONTROL_STATE_CLEANUP;
   pthread_cond_broadcast(&s->cond);
+  pthread_cond_broadcast(&s->work_cond);
   dt_pthread_mutex_unlock(&s->cond_mutex);
 
   int err = 0; // collect all joining errors
@@ -350,10 +352,6 @@ void dt_control_shutdown()
 
   dt_print(DT_DEBUG_CONTROL, "[dt_control_shutdown] closing control threads");
 
-  /* then wait for kick_on_workers_thread */
-  err = dt_pthread_join(s->kick_on_workers_thread);
-  dt_print(DT_DEBUG_CONTROL, "[dt_control_shutdown] joined kicker%s", err ? ", error" : "");
-
   for(int k = 0; k < s->num_threads-1; k++)
   {
     err = dt_pthread_join(s->thread[k]);
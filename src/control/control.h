@@ -183,15 +183,23 @@ typedef struct dt_control_t
   dt_atomic_int quitting;
   dt_atomic_int pending_jobs;
   gboolean cups_started;
-  gboolean export_scheduled;
-  dt_pthread_mutex_t queue_mutex, cond_mutex;
-  pthread_cond_t cond;
+  dt_atomic_int export_scheduled;
+  // cond wakes the reserved workers, work_cond the others
+  dt_pthread_mutex_t cond_mutex;
+  pthread_cond_t cond, work_cond;
   int32_t num_threads;
-  pthread_t *thread, kick_on_workers_thread, update_gphoto_thread;
-  dt_job_t **job;
-
-  GList *queues[DT_JOB_QUEUE_MAX];
-  size_t queue_length[DT_JOB_QUEUE_MAX];
+  pthread_t *thread, update_gphoto_thread;
+
+  // every worker has its own queues and steals from the others when they
+  // run empty. work_epoch counts added jobs so sleeping workers don't miss one.
+  struct dt_control_worker_queues_t *worker_queues;
+  dt_atomic_int next_worker_queues, fg_queued, work_epoch, sleeping_workers;
+  // queued and running DT_JOB_QUEUE_SYSTEM_FG jobs to drop duplicates,
+  // protected by queue_mutex
+  dt_pthread_mutex_t queue_mutex;
+  GHashTable *system_fg_jobs;
+  dt_atomic_int system_fg_length;
+  uint32_t system_fg_added;
 
   dt_pthread_mutex_t res_mutex;
   dt_job_t *job_res[DT_CTL_WORKER_RESERVED];
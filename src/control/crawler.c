@@ -1024,14 +1024,12 @@ void dt_update_thumbs_thread(void *p)
 
   int updated = 0;
 
-  // return if any thumbcache dir is not writable
+  // return if any thumbcache file is not usable
   for(dt_mipmap_size_t k = DT_MIPMAP_1; k <= DT_MIPMAP_7; k++)
   {
-    char dirname[PATH_MAX] = { 0 };
-    snprintf(dirname, sizeof(dirname), "%s.d/%d", darktable.mipmap_cache->cachedir, k);
-    if(g_mkdir_with_parents(dirname, 0750))
+    if(!darktable.mipmap_cache->pack[k])
     {
-      dt_print(DT_DEBUG_CACHE, "[thumb crawler] can't create mipmap dir '%s'", dirname);
+      dt_print(DT_DEBUG_CACHE, "[thumb crawler] can't open mipmap cache for mip %d", k);
       return;
     }
   }
@@ -22,10 +22,18 @@
 #define DT_CONTROL_FG_PRIORITY 4
 #define DT_CONTROL_MAX_JOBS 30
 
-/* the queue can have scheduled jobs but all
-    the workers are sleeping, so this kicks the workers
-    on timed interval.
+/* the job queues of one worker. jobs added by a worker go to its own
+   queues, jobs from other threads are spread round robin. a worker takes
+   from its own queues first and steals from the others when it runs out,
+   so adding and scheduling jobs don't serialize on one mutex.
 */
+typedef struct dt_control_worker_queues_t
+{
+  dt_pthread_mutex_t mutex;
+  GQueue queue[DT_JOB_QUEUE_MAX];
+  dt_atomic_int length; // all queues, read without the mutex to skip empty ones
+} dt_control_worker_queues_t;
+
 typedef struct worker_thread_parameters_t
 {
   dt_control_t *self;
@@ -54,27 +62,48 @@ typedef struct _dt_job_t
   char description[DT_CONTROL_DESCRIPTION_LEN];
   dt_view_type_flags_t view_creator;
   gboolean is_synchronous;
+  int32_t worker_queues; // index of the worker queues it was added to
+  uint32_t added;        // order of adding to DT_JOB_QUEUE_SYSTEM_FG, the oldest is discarded first
 } _dt_job_t;
 
 /** check if two jobs are to be considered equal. a simple memcmp won't work since the mutexes probably won't
    match
     we don't want to compare result, priority or state since these will change during the course of
    processing.
+    jobs with params are compared by their params, others by their description. _control_job_hash()
+   must hash exactly the fields compared here.
     NOTE: maybe allow to pass a comparator for params.
  */
 static inline gboolean _control_job_equal(_dt_job_t *j1, _dt_job_t *j2)
 {
   if(!j1 || !j2) return FALSE;
-  if(j1->params_size != 0
-      && j1->params_size == j2->params_size)
-    return (j1->execute == j2->execute
-            && j1->state_changed_cb == j2->state_changed_cb
-            && j1->queue == j2->queue
-            && (memcmp(j1->params, j2->params, j1->params_size) == 0));
-  return (j1->execute == j2->execute
-          && j1->state_changed_cb == j2->state_changed_cb
-          && j1->queue == j2->queue
-          && (g_strcmp0(j1->description, j2->description) == 0));
+  if(j1->execute != j2->execute
+     || j1->state_changed_cb != j2->state_changed_cb
+     || j1->queue != j2->queue
+     || j1->params_size != j2->params_size)
+    return FALSE;
+  return j1->params_size != 0
+    ? memcmp(j1->params, j2->params, j1->params_size) == 0
+    : g_strcmp0(j1->description, j2->description) == 0;
+}
+
+static guint _control_job_hash(gconstpointer key)
+{
+  const _dt_job_t *job = key;
+  dt_hash_t hash = dt_hash(DT_INITHASH, &job->execute, sizeof(job->execute));
+  hash = dt_hash(hash, &job->state_changed_cb, sizeof(job->state_changed_cb));
+  hash = dt_hash(hash, &job->queue, sizeof(job->queue));
+  hash = dt_hash(hash, &job->params_size, sizeof(job->params_size));
+  if(job->params_size != 0)
+    hash = dt_hash(hash, job->params, job->params_size);
+  else
+    hash = dt_hash(hash, job->description, strlen(job->description));
+  return (guint)hash;
+}
+
+static gboolean _control_job_hash_equal(gconstpointer a, gconstpointer b)
+{
+  return _control_job_equal((_dt_job_t *)a, (_dt_job_t *)b);
 }
 
 static void _control_job_set_state(_dt_job_t *job,
@@ -197,6 +226,8 @@ static void _control_job_print(_dt_job_t *job, const char *info, const char *err
 
 
 static __thread int32_t threadid = -1;
+// index of the worker queues, only set for the (not reserved) workers
+static __thread int32_t worker_id = -1;
 // As threadid is `per thread` we don't have to use atomics
 static inline int32_t _control_get_threadid()
 {
@@ -248,7 +279,21 @@ static gboolean _control_run_job_res(dt_control_t *control, int32_t res)
   return FALSE;
 }
 
-static _dt_job_t *_control_schedule_job(dt_control_t *control)
+// wake one sleeping worker after adding work
+static void _control_wake_worker(dt_control_t *control)
+{
+  dt_atomic_add_int(&control->work_epoch, 1);
+  if(dt_atomic_get_int(&control->sleeping_workers) > 0)
+  {
+    dt_pthread_mutex_lock(&control->cond_mutex);
+    pthread_cond_signal(&control->work_cond);
+    dt_pthread_mutex_unlock(&control->cond_mutex);
+  }
+}
+
+static _dt_job_t *_control_pick_job(dt_control_t *control,
+                                    dt_control_worker_queues_t *wq,
+                                    const int min_priority)
 {
   /*
    * job scheduling works like this:
@@ -259,54 +304,79 @@ static _dt_job_t *_control_schedule_job(dt_control_t *control)
    *   * user background
    *   * system background
    * - the jobs that didn't get picked this round get their priority incremented
+   *
+   * this is done per worker queues, jobs below min_priority are left alone.
    */
+  if(dt_atomic_get_int(&wq->length) == 0) return NULL;
 
-  dt_pthread_mutex_lock(&control->queue_mutex);
+  dt_pthread_mutex_lock(&wq->mutex);
 
-  // find the job
   _dt_job_t *job = NULL;
   int winner_queue = DT_JOB_QUEUE_MAX;
-  int max_priority = -1;
-  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+  gboolean skip_export = dt_atomic_get_int(&control->export_scheduled);
+  while(TRUE)
   {
-    if(control->queues[i] == NULL) continue;
-    if(control->export_scheduled && i == DT_JOB_QUEUE_USER_EXPORT) continue;
-    _dt_job_t *_job = (_dt_job_t *)control->queues[i]->data;
-    if(_job->priority > max_priority)
+    int max_priority = min_priority - 1;
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
     {
-      max_priority = _job->priority;
-      job = _job;
-      winner_queue = i;
+      if(skip_export && i == DT_JOB_QUEUE_USER_EXPORT) continue;
+      _dt_job_t *_job = g_queue_peek_head(&wq->queue[i]);
+      if(_job && _job->priority > max_priority)
+      {
+        max_priority = _job->priority;
+        job = _job;
+        winner_queue = i;
+      }
     }
+
+    // only one export runs at a time, another worker might have won the race
+    int no_export = 0;
+    if(!job
+       || winner_queue != DT_JOB_QUEUE_USER_EXPORT
+       || dt_atomic_CAS_int(&control->export_scheduled, &no_export, 1))
+      break;
+    skip_export = TRUE;
+    job = NULL;
   }
 
-  if(!job)
+  if(job)
   {
-    dt_pthread_mutex_unlock(&control->queue_mutex);
-    return NULL;
+    g_queue_pop_head(&wq->queue[winner_queue]);
+    dt_atomic_sub_int(&wq->length, 1);
+    if(winner_queue <= DT_JOB_QUEUE_SYSTEM_FG)
+      dt_atomic_sub_int(&control->fg_queued, 1);
+    if(winner_queue == DT_JOB_QUEUE_SYSTEM_FG)
+      dt_atomic_sub_int(&control->system_fg_length, 1);
+
+    // increment the priorities of the others
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+    {
+      _dt_job_t *_job = i == winner_queue ? NULL : g_queue_peek_head(&wq->queue[i]);
+      if(_job) _job->priority++;
+    }
   }
 
-  // the order of the queues in control->queues matches our priority, and we only update job when the priority
-  // is strictly bigger
-  // invariant -> job is the one we are looking for
+  dt_pthread_mutex_unlock(&wq->mutex);
 
-  // remove the to be scheduled job from its queue
-  GList **queue = &control->queues[winner_queue];
-  *queue = g_list_delete_link(*queue, *queue);
-  control->queue_length[winner_queue]--;
-  if(winner_queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = TRUE;
+  return job;
+}
 
-  // and place it in scheduled job array (for job deduping)
-  control->job[_control_get_threadid()] = job;
+static _dt_job_t *_control_schedule_job(dt_control_t *control)
+{
+  const int n = control->num_threads;
+  const int self = MAX(worker_id, 0);
+  _dt_job_t *job = NULL;
 
-  // increment the priorities of the others
-  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
-  {
-    if(i == winner_queue || control->queues[i] == NULL) continue;
-    ((_dt_job_t *)control->queues[i]->data)->priority++;
-  }
+  // foreground jobs (and background ones that waited long enough) anywhere
+  // come before our own background work
+  if(dt_atomic_get_int(&control->fg_queued) > 0)
+    for(int k = 0; k < n && !job; k++)
+      job = _control_pick_job(control, &control->worker_queues[(self + k) % n],
+                              DT_CONTROL_FG_PRIORITY);
 
-  dt_pthread_mutex_unlock(&control->queue_mutex);
+  // own queues first, then steal
+  for(int k = 0; k < n && !job; k++)
+    job = _control_pick_job(control, &control->worker_queues[(self + k) % n], 0);
 
   return job;
 }
@@ -337,11 +407,20 @@ static gboolean _control_run_job(dt_control_t *control)
 
   dt_pthread_mutex_unlock(&job->wait_mutex);
 
-  // remove the job from scheduled job array (for job deduping)
-  dt_pthread_mutex_lock(&control->queue_mutex);
-  control->job[_control_get_threadid()] = NULL;
-  if(job->queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = FALSE;
-  dt_pthread_mutex_unlock(&control->queue_mutex);
+  // the job may be added again from now on
+  if(job->queue == DT_JOB_QUEUE_SYSTEM_FG)
+  {
+    dt_pthread_mutex_lock(&control->queue_mutex);
+    g_hash_table_remove(control->system_fg_jobs, job);
+    dt_pthread_mutex_unlock(&control->queue_mutex);
+  }
+
+  // a waiting export may run now
+  if(job->queue == DT_JOB_QUEUE_USER_EXPORT)
+  {
+    dt_atomic_set_int(&control->export_scheduled, 0);
+    _control_wake_worker(control);
+  }
 
   // and free it
   dt_control_job_dispose(job);
@@ -384,6 +463,42 @@ gboolean dt_control_add_job_res(_dt_job_t *job, const int32_t res)
   return FALSE;
 }
 
+// called with queue_mutex held, which keeps other DT_JOB_QUEUE_SYSTEM_FG jobs
+// from being added. the oldest job is at the tail of one of the worker queues.
+static _dt_job_t *_control_remove_oldest_fg_job(dt_control_t *control)
+{
+  int oldest = -1;
+  uint32_t added = 0;
+  for(int k = 0; k < control->num_threads; k++)
+  {
+    dt_control_worker_queues_t *wq = &control->worker_queues[k];
+    dt_pthread_mutex_lock(&wq->mutex);
+    const _dt_job_t *tail = g_queue_peek_tail(&wq->queue[DT_JOB_QUEUE_SYSTEM_FG]);
+    if(tail && (oldest < 0 || (int32_t)(tail->added - added) < 0))
+    {
+      oldest = k;
+      added = tail->added;
+    }
+    dt_pthread_mutex_unlock(&wq->mutex);
+  }
+  if(oldest < 0) return NULL;
+
+  // a worker might have taken it meanwhile, the next one is old enough then
+  dt_control_worker_queues_t *wq = &control->worker_queues[oldest];
+  dt_pthread_mutex_lock(&wq->mutex);
+  _dt_job_t *job = g_queue_pop_tail(&wq->queue[DT_JOB_QUEUE_SYSTEM_FG]);
+  if(job)
+  {
+    dt_atomic_sub_int(&wq->length, 1);
+    dt_atomic_sub_int(&control->fg_queued, 1);
+    dt_atomic_sub_int(&control->system_fg_length, 1);
+    g_hash_table_remove(control->system_fg_jobs, job);
+    dt_atomic_sub_int(&control->pending_jobs, 1);
+  }
+  dt_pthread_mutex_unlock(&wq->mutex);
+  return job;
+}
+
 gboolean dt_control_add_job(dt_job_queue_t queue_id, _dt_job_t *job)
 {
   dt_control_t *control = darktable.control;
@@ -409,12 +524,14 @@ gboolean dt_control_add_job(dt_job_queue_t queue_id, _dt_job_t *job)
 
   _dt_job_t *job_for_disposal = NULL;
 
-  dt_pthread_mutex_lock(&control->queue_mutex);
+  // our own queues if we are a worker, round robin otherwise
+  const int target = worker_id >= 0
+    ? worker_id
+    : (int)((unsigned int)dt_atomic_add_int(&control->next_worker_queues, 1)
+            % (unsigned int)control->num_threads);
+  dt_control_worker_queues_t *wq = &control->worker_queues[target];
 
-  GList **queue = &control->queues[queue_id];
-  size_t length = control->queue_length[queue_id];
-
-  _control_job_print(job, "add_job", "", (int32_t)length);
+  _control_job_print(job, "add_job", "", (int32_t)dt_atomic_get_int(&wq->length));
 
   dt_atomic_add_int(&control->pending_jobs, 1);
   if(queue_id == DT_JOB_QUEUE_SYSTEM_FG)
@@ -422,59 +539,54 @@ gboolean dt_control_add_job(dt_job_queue_t queue_id, _dt_job_t *job)
     // this is a stack with limited size and bubble up and all that stuff
     job->priority = DT_CONTROL_FG_PRIORITY;
 
-    // check if we have already scheduled the job
-    for(int k = 0; k < control->num_threads; k++)
-    {
-      _dt_job_t *other_job = control->job[k];
-      if(_control_job_equal(job, other_job))
-      {
-        _control_job_print(other_job, "add_job", "found job already in scheduled:", -1);
-
-        dt_pthread_mutex_unlock(&control->queue_mutex);
-
-        _control_job_set_state(job, DT_JOB_STATE_DISCARDED);
-        dt_control_job_dispose(job);
-        dt_atomic_sub_int(&control->pending_jobs, 1);
+    dt_pthread_mutex_lock(&control->queue_mutex);
 
-        return 0; // there can't be any further copy
-      }
-    }
-
-    // if the job is already in the queue -> move it to the top
-    for(GList *iter = *queue; iter; iter = g_list_next(iter))
+    // check if we have already queued or scheduled the job
+    _dt_job_t *other_job = g_hash_table_lookup(control->system_fg_jobs, job);
+    if(other_job)
     {
-      _dt_job_t *other_job = iter->data;
-      if(_control_job_equal(job, other_job))
+      // if the job is still queued -> move it to the top
+      dt_control_worker_queues_t *owq = &control->worker_queues[other_job->worker_queues];
+      dt_pthread_mutex_lock(&owq->mutex);
+      GQueue *queue = &owq->queue[DT_JOB_QUEUE_SYSTEM_FG];
+      const gboolean queued = g_queue_remove(queue, other_job);
+      if(queued)
       {
-        _control_job_print(other_job, "add_job", "found job already in queue", -1);
+        other_job->added = control->system_fg_added++;
+        g_queue_push_head(queue, other_job);
+      }
+      dt_pthread_mutex_unlock(&owq->mutex);
+      dt_pthread_mutex_unlock(&control->queue_mutex);
 
-        *queue = g_list_delete_link(*queue, iter);
-        length--;
-        dt_atomic_sub_int(&control->pending_jobs, 1);
+      _control_job_print(other_job, "add_job",
+                         queued ? "found job already in queue" : "found job already in scheduled:", -1);
 
-        job_for_disposal = job;
+      _control_job_set_state(job, DT_JOB_STATE_DISCARDED);
+      dt_control_job_dispose(job);
+      dt_atomic_sub_int(&control->pending_jobs, 1);
 
-        job = other_job;
-        break; // there can't be any further copy in the list
-      }
+      if(queued) _control_wake_worker(control);
+      return FALSE; // there can't be any further copy
     }
 
-    // now we can add the new job to the list
-    *queue = g_list_prepend(*queue, job);
-    length++;
+    // now we can add the new job to the stack
+    job->worker_queues = target;
+    job->added = control->system_fg_added++;
+    g_hash_table_add(control->system_fg_jobs, job);
+    _control_job_set_state(job, DT_JOB_STATE_QUEUED);
 
-    // and take care of the maximal queue size
-    if(length > DT_CONTROL_MAX_JOBS)
-    {
-      GList *last = g_list_last(*queue);
-      _control_job_set_state(last->data, DT_JOB_STATE_DISCARDED);
-      dt_control_job_dispose(last->data);
-      *queue = g_list_delete_link(*queue, last);
-      length--;
-      dt_atomic_sub_int(&control->pending_jobs, 1);
-    }
+    dt_pthread_mutex_lock(&wq->mutex);
+    g_queue_push_head(&wq->queue[queue_id], job);
+    dt_atomic_add_int(&wq->length, 1);
+    dt_atomic_add_int(&control->fg_queued, 1);
+    dt_pthread_mutex_unlock(&wq->mutex);
 
-    control->queue_length[queue_id] = length;
+    // and take care of the maximal number of queued jobs over all workers,
+    // the oldest one makes room
+    if(dt_atomic_add_int(&control->system_fg_length, 1) >= DT_CONTROL_MAX_JOBS)
+      job_for_disposal = _control_remove_oldest_fg_job(control);
+
+    dt_pthread_mutex_unlock(&control->queue_mutex);
   }
   else
   {
@@ -485,16 +597,19 @@ gboolean dt_control_add_job(dt_job_queue_t queue_id, _dt_job_t *job)
       job->priority = 0;
     else
       job->priority = DT_CONTROL_FG_PRIORITY;
-    *queue = g_list_append(*queue, job);
-    control->queue_length[queue_id]++;
+    job->worker_queues = target;
+    _control_job_set_state(job, DT_JOB_STATE_QUEUED);
+
+    dt_pthread_mutex_lock(&wq->mutex);
+    g_queue_push_tail(&wq->queue[queue_id], job);
+    dt_atomic_add_int(&wq->length, 1);
+    if(queue_id == DT_JOB_QUEUE_USER_FG)
+      dt_atomic_add_int(&control->fg_queued, 1);
+    dt_pthread_mutex_unlock(&wq->mutex);
   }
-  _control_job_set_state(job, DT_JOB_STATE_QUEUED);
-  dt_pthread_mutex_unlock(&control->queue_mutex);
 
   // notify workers
-  dt_pthread_mutex_lock(&control->cond_mutex);
-  pthread_cond_broadcast(&control->cond);
-  dt_pthread_mutex_unlock(&control->cond_mutex);
+  _control_wake_worker(control);
 
   // dispose of dropped job, if any
   _control_job_set_state(job_for_disposal, DT_JOB_STATE_DISCARDED);
@@ -521,11 +636,15 @@ static void *_control_work_res(void *ptr)
     // dt_print(DT_DEBUG_CONTROL, "[control_work] %d", threadid_res);
     if(_control_run_job_res(s, threadid_res))
     {
-      // wait for a new job.
+      // wait for a new job, checking under cond_mutex so the wakeup can't be missed
       int old;
       pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old);
       dt_pthread_mutex_lock(&s->cond_mutex);
-      dt_pthread_cond_wait(&s->cond, &s->cond_mutex);
+      dt_pthread_mutex_lock(&s->res_mutex);
+      const gboolean new_job = s->new_res[threadid_res];
+      dt_pthread_mutex_unlock(&s->res_mutex);
+      if(!new_job && dt_control_running())
+        dt_pthread_cond_wait(&s->cond, &s->cond_mutex);
       dt_pthread_mutex_unlock(&s->cond_mutex);
       int tmp;
       pthread_setcancelstate(old, &tmp);
@@ -534,20 +653,6 @@ static void *_control_work_res(void *ptr)
   return NULL;
 }
 
-static void *_control_worker_kicker(void *ptr)
-{
-  dt_control_t *control = (dt_control_t *)ptr;
-  dt_pthread_setname("kicker");
-  while(dt_control_running())
-  {
-    sleep(2);
-    dt_pthread_mutex_lock(&control->cond_mutex);
-    pthread_cond_broadcast(&control->cond);
-    dt_pthread_mutex_unlock(&control->cond_mutex);
-  }
-  return NULL;
-}
-
 static void *_control_work(void *ptr)
 {
 #ifdef _OPENMP // need to do this in every thread
@@ -555,7 +660,7 @@ static void *_control_work(void *ptr)
 #endif
   worker_thread_parameters_t *params = (worker_thread_parameters_t *)ptr;
   dt_control_t *control = params->self;
-  threadid = params->threadid;
+  threadid = worker_id = params->threadid;
   char name[16] = {0};
   snprintf(name, sizeof(name), "worker %d", threadid);
   dt_pthread_setname(name);
@@ -563,11 +668,16 @@ static void *_control_work(void *ptr)
 
   while(dt_control_running())
   {
+    const int epoch = dt_atomic_get_int(&control->work_epoch);
     if(_control_run_job(control))
     {
-      // wait for a new job.
+      // wait for a new job. a job added since we looked has changed the
+      // epoch, and adders only signal if someone sleeps.
       dt_pthread_mutex_lock(&control->cond_mutex);
-      dt_pthread_cond_wait(&control->cond, &control->cond_mutex);
+      dt_atomic_add_int(&control->sleeping_workers, 1);
+      if(dt_control_running() && dt_atomic_get_int(&control->work_epoch) == epoch)
+        dt_pthread_cond_wait(&control->work_cond, &control->cond_mutex);
+      dt_atomic_sub_int(&control->sleeping_workers, 1);
       dt_pthread_mutex_unlock(&control->cond_mutex);
     }
   }
@@ -610,7 +720,14 @@ void dt_control_jobs_init()
   // start threads
   control->num_threads = dt_worker_threads();
   control->thread = (pthread_t *)calloc(control->num_threads, sizeof(pthread_t));
-  control->job = (dt_job_t **)calloc(control->num_threads, sizeof(dt_job_t *));
+  control->worker_queues = calloc(control->num_threads, sizeof(dt_control_worker_queues_t));
+  for(int k = 0; k < control->num_threads; k++)
+  {
+    dt_pthread_mutex_init(&control->worker_queues[k].mutex, NULL);
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+      g_queue_init(&control->worker_queues[k].queue[i]);
+  }
+  control->system_fg_jobs = g_hash_table_new(_control_job_hash, _control_job_hash_equal);
 
   g_atomic_int_set(&control->running, DT_CONTROL_STATE_RUNNING);
 
@@ -624,9 +741,6 @@ void dt_control_jobs_init()
     err |= dt_pthread_create(&control->thread[k], _control_work, params);
   }
 
-  /* create queue kicker thread */
-  err |= dt_pthread_create(&control->kick_on_workers_thread, _control_worker_kicker, control);
-
   for(int k = 0; k < DT_CTL_WORKER_RESERVED; k++)
   {
     control->job_res[k] = NULL;
@@ -647,8 +761,16 @@ void dt_control_jobs_init()
 void dt_control_jobs_cleanup()
 {
   dt_control_t *control = darktable.control;
-  free(control->job);
-  control->job = NULL;
+  for(int k = 0; k < control->num_threads; k++)
+  {
+    dt_pthread_mutex_destroy(&control->worker_queues[k].mutex);
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+      g_queue_clear(&control->worker_queues[k].queue[i]);
+  }
+  free(control->worker_queues);
+  control->worker_queues = NULL;
+  g_hash_table_destroy(control->system_fg_jobs);
+  control->system_fg_jobs = NULL;
   free(control->thread);
   control->thread = NULL;
 }
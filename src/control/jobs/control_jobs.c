@@ -38,6 +38,7 @@
 #include "common/overlay.h"
 #include "control/conf.h"
 #include "develop/imageop_math.h"
+#include "develop/pixelpipe_hb.h"
 #include "imageio/imageio_common.h"
 #include "imageio/imageio_dng.h"
 #include "imageio/imageio_module.h"
@@ -72,6 +73,8 @@
 #define PROGRESS_UPDATE_INTERVAL 0.5
 // How lon in seconds between issuing a collection-query update?
 #define COLLECTION_UPDATE_INTERVAL 3.0
+// How many images of an export may be loaded ahead at most?
+#define DT_EXPORT_PREFETCH_MAX 4
 
 typedef struct dt_control_datetime_t
 {
@@ -1796,6 +1799,227 @@ static int32_t _control_apply_styles_job_run(dt_job_t *job)
   return 0;
 }
 
+// state shared by the workers of one export job
+typedef struct _export_state_t
+{
+  dt_job_t *job;
+  dt_control_export_t *settings;
+  dt_imageio_module_format_t *format;
+  dt_imageio_module_storage_t *storage;
+  dt_imageio_module_data_t *sdata;       // shared by all workers
+  dt_imageio_module_data_t *fdata;       // template, copied by each worker
+  dt_export_metadata_t *metadata;
+  guint tagid, etagid;
+  int omp_threads;                       // 0 to keep the default
+  int workers;                           // pipes sharing the memory
+  double start;
+
+  // protected by lock
+  dt_pthread_mutex_t lock;
+  pthread_cond_t mem_cond;               // signalled when an image is done
+  GList *next;                           // next image to export
+  guint num, total;                      // sequence number of the last image started
+  guint done;
+  int active;
+  size_t mem_budget, mem_used;
+  gboolean tag_change;
+  double prev_time;
+
+  // decode-ahead of the following images into the full mipmap cache
+  int prefetch;                          // images to load ahead, 0 to disable
+  GList *prefetch_next;                  // next image to load ahead
+  guint prefetch_num;                    // sequence number of the last image loaded ahead
+  size_t prefetch_mem;                   // input buffers loaded ahead but not started yet
+  size_t prefetch_size[DT_EXPORT_PREFETCH_MAX];
+} _export_state_t;
+
+// size of the full input buffer of an image in float4
+static size_t _export_input_estimate(const dt_image_t *image)
+{
+  return (size_t)image->width * image->height * 4 * sizeof(float);
+}
+
+// rough upper bound of the memory a pipe needs for an image: the full
+// input buffer and the two cachelines of the export pipe
+static size_t _export_mem_estimate(const dt_image_t *image)
+{
+  return 3 * _export_input_estimate(image);
+}
+
+// called with the lock held after image num was taken: starts loading
+// the images following it into the full mipmap cache by background
+// jobs, as long as they fit into the memory budget next to the running
+// pipes. the pipe of that image then finds its input decoded already.
+static void _export_prefetch(_export_state_t *state, const guint num)
+{
+  // the input of image num is part of its pipe's memory from now on
+  if(num <= state->prefetch_num)
+  {
+    const int slot = num % DT_EXPORT_PREFETCH_MAX;
+    state->prefetch_mem -= state->prefetch_size[slot];
+    state->prefetch_size[slot] = 0;
+  }
+
+  GList *l = state->prefetch_next;
+  guint n = state->prefetch_num + 1;
+  if(n <= num)
+  {
+    // loading ahead fell behind the workers, restart after image num
+    l = state->next;
+    n = num + 1;
+  }
+
+  for(; l && n <= num + state->prefetch; l = g_list_next(l), n++)
+  {
+    const dt_imgid_t imgid = GPOINTER_TO_INT(l->data);
+    const dt_image_t *image = dt_image_cache_get(imgid, 'r');
+    const size_t size = image ? _export_input_estimate(image) : 0;
+    dt_image_cache_read_release(image);
+    if(state->mem_used + state->prefetch_mem + size > state->mem_budget) break;
+
+    dt_mipmap_cache_get(NULL, imgid, DT_MIPMAP_FULL, DT_MIPMAP_PREFETCH, 'r');
+    state->prefetch_size[n % DT_EXPORT_PREFETCH_MAX] = size;
+    state->prefetch_mem += size;
+    state->prefetch_num = n;
+  }
+  state->prefetch_next = l;
+}
+
+static void _export_image(_export_state_t *state,
+                          dt_imageio_module_data_t *fdata,
+                          const dt_imgid_t imgid,
+                          const guint num)
+{
+  dt_control_export_t *settings = state->settings;
+  dt_job_t *job = state->job;
+
+  // check if image still exists:
+  const dt_image_t *image = dt_image_cache_get(imgid, 'r');
+  if(!image) return;
+
+  char imgfilename[PATH_MAX] = { 0 };
+  gboolean from_cache = TRUE;
+  dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
+  if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR))
+  {
+    dt_control_log(_("image `%s' is currently unavailable"), image->filename);
+    dt_print(DT_DEBUG_ALWAYS, "image `%s' is currently unavailable", imgfilename);
+    // dt_image_remove(imgid);
+    dt_image_cache_read_release(image);
+    return;
+  }
+  const size_t mem = _export_mem_estimate(image);
+  dt_image_cache_read_release(image);
+
+  // only start another pipe while the running ones leave enough memory,
+  // a single one always runs and tiles if needed
+  dt_pthread_mutex_lock(&state->lock);
+  while(state->active > 0
+        && state->mem_used + mem > state->mem_budget
+        && !_job_cancelled(job))
+    dt_pthread_cond_wait(&state->mem_cond, &state->lock);
+  const gboolean cancelled = _job_cancelled(job);
+  if(!cancelled)
+  {
+    state->active++;
+    state->mem_used += mem;
+  }
+  dt_pthread_mutex_unlock(&state->lock);
+  if(cancelled) return;
+
+  const gboolean failed =
+    state->storage->store(state->storage, state->sdata, imgid, state->format, fdata,
+                          num, state->total, settings->high_quality, settings->upscale,
+                          settings->export_masks, settings->icc_type,
+                          settings->icc_filename, settings->icc_intent,
+                          state->metadata) != 0;
+
+  dt_pthread_mutex_lock(&state->lock);
+  state->active--;
+  state->mem_used -= mem;
+  pthread_cond_broadcast(&state->mem_cond);
+  if(failed)
+    dt_control_job_cancel(job);
+  else
+  {
+    // remove 'changed' tag from image
+    if(dt_tag_detach(state->tagid, imgid, FALSE, FALSE)) state->tag_change = TRUE;
+
+    // make sure the 'exported' tag is set on the image
+    if(dt_tag_attach(state->etagid, imgid, FALSE, FALSE)) state->tag_change = TRUE;
+
+    /* register export timestamp in cache */
+    dt_image_cache_set_export_timestamp(imgid);
+  }
+  dt_pthread_mutex_unlock(&state->lock);
+}
+
+static void *_export_worker(void *data)
+{
+  _export_state_t *state = (_export_state_t *)data;
+  dt_job_t *job = state->job;
+  dt_imageio_module_format_t *mformat = state->format;
+
+  // the workers' own thread-safe fdata struct (one jpeg struct per
+  // thread etc), the format writes the image size to it
+  dt_imageio_module_data_t *fdata = state->fdata;
+#ifdef _OPENMP
+  const int omp_threads = omp_get_max_threads();
+#endif
+  if(state->omp_threads)
+  {
+    fdata = mformat->get_params(mformat);
+    if(!fdata) return NULL;
+    memcpy(fdata, state->fdata, mformat->params_size(mformat));
+#ifdef _OPENMP
+    omp_set_num_threads(state->omp_threads);
+#endif
+    dt_dev_pixelpipe_set_export_concurrency(state->workers);
+  }
+
+  dt_pthread_mutex_lock(&state->lock);
+  while(state->next && !_job_cancelled(job))
+  {
+    // the sequence number is the position in the list, independent of
+    // the order the images are finished in
+    const dt_imgid_t imgid = GPOINTER_TO_INT(state->next->data);
+    state->next = g_list_next(state->next);
+    const guint num = ++state->num;
+    if(state->prefetch) _export_prefetch(state, num);
+
+    // progress message, with the throughput once images are done
+    char message[512] = { 0 };
+    const double elapsed = dt_get_wtime() - state->start;
+    if(state->done > 0 && elapsed > 0.0)
+      snprintf(message, sizeof(message), _("exporting %d / %d to %s (%.1f images/s)"),
+               num, state->total, state->storage->name(state->storage), state->done / elapsed);
+    else
+      snprintf(message, sizeof(message), _("exporting %d / %d to %s"),
+               num, state->total, state->storage->name(state->storage));
+    // update the message. initialize_store() might have changed the number of images
+    dt_control_job_set_progress_message(job, message);
+    dt_pthread_mutex_unlock(&state->lock);
+
+    _export_image(state, fdata, imgid, num);
+
+    dt_pthread_mutex_lock(&state->lock);
+    state->done++;
+    _update_progress(job, (double)state->done / state->total, &state->prev_time);
+  }
+  dt_pthread_mutex_unlock(&state->lock);
+
+  if(state->omp_threads)
+  {
+    mformat->free_params(mformat, fdata);
+    // the job's own worker thread goes on with other jobs
+#ifdef _OPENMP
+    omp_set_num_threads(omp_threads);
+#endif
+    dt_dev_pixelpipe_set_export_concurrency(0);
+  }
+  return NULL;
+}
+
 static int32_t _control_export_job_run(dt_job_t *job)
 {
   dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
@@ -1846,8 +2070,6 @@ static int32_t _control_export_job_run(dt_job_t *job)
   else
     dt_control_log(_("no image to export"));
 
-  double fraction = 0;
-
   fdata->max_width =
     (settings->max_width != 0 && w != 0)
     ? MIN(w, settings->max_width)
@@ -1884,61 +2106,52 @@ static int32_t _control_export_job_run(dt_job_t *job)
     metadata.list = g_list_remove(metadata.list, metadata.list->data);
   }
 
-  double prev_time = 0;
-
-  while(t && !_job_cancelled(job))
-  {
-    const dt_imgid_t imgid = GPOINTER_TO_INT(t->data);
-    t = g_list_next(t);
-    const guint num = total - g_list_length(t);
-
-    // progress message
-    char message[512] = { 0 };
-    snprintf(message, sizeof(message), _("exporting %d / %d to %s"),
-             num, total, mstorage->name(mstorage));
-    // update the message. initialize_store() might have changed the number of images
-    dt_control_job_set_progress_message(job, message);
-
-    // check if image still exists:
-    const dt_image_t *image = dt_image_cache_get(imgid, 'r');
-    if(image)
-    {
-      char imgfilename[PATH_MAX] = { 0 };
-      gboolean from_cache = TRUE;
-      dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
-      if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR))
-      {
-        dt_control_log(_("image `%s' is currently unavailable"), image->filename);
-        dt_print(DT_DEBUG_ALWAYS, "image `%s' is currently unavailable", imgfilename);
-        // dt_image_remove(imgid);
-        dt_image_cache_read_release(image);
-      }
-      else
-      {
-        dt_image_cache_read_release(image);
-        if(mstorage->store(mstorage, sdata, imgid, mformat, fdata,
-                           num, total, settings->high_quality, settings->upscale,
-                           settings->export_masks, settings->icc_type,
-                           settings->icc_filename, settings->icc_intent,
-                           &metadata) != 0)
-          dt_control_job_cancel(job);
-        else
-        {
-          // remove 'changed' tag from image
-          if(dt_tag_detach(tagid, imgid, FALSE, FALSE)) tag_change = TRUE;
+  _export_state_t state = { .job = job,
+                            .settings = settings,
+                            .format = mformat,
+                            .storage = mstorage,
+                            .sdata = sdata,
+                            .fdata = fdata,
+                            .metadata = &metadata,
+                            .next = t,
+                            .total = total,
+                            .tagid = tagid,
+                            .etagid = etagid,
+                            .mem_budget = dt_get_available_mem(),
+                            .start = dt_get_wtime(),
+                            .prefetch = CLAMP(dt_conf_get_int("plugins/lighttable/export/prefetch"),
+                                              0, DT_EXPORT_PREFETCH_MAX) };
+  dt_pthread_mutex_init(&state.lock, NULL);
+  pthread_cond_init(&state.mem_cond, NULL);
+
+  // storages which can't handle concurrent images export one at a time
+  int workers = 1;
+  if(mstorage->parallel_store && mstorage->parallel_store(mstorage))
+    workers = MIN(total, CLAMP(dt_conf_get_int("plugins/lighttable/export/concurrency"), 1, 16));
+
+  if(workers > 1)
+  {
+    // each pipe gets its share of the cores and of the memory
+    state.omp_threads = MAX(1, (int)dt_get_num_threads() / workers);
+    state.workers = workers;
+    pthread_t *threads = g_new(pthread_t, workers - 1);
+    int started = 0;
+    for(int k = 0; k < workers - 1; k++)
+      if(!dt_pthread_create(&threads[started], _export_worker, &state)) started++;
+    // the job's own thread is a worker too
+    _export_worker(&state);
+    for(int k = 0; k < started; k++) pthread_join(threads[k], NULL);
+    g_free(threads);
+  }
+  else
+    _export_worker(&state);
 
-          // make sure the 'exported' tag is set on the image
-          if(dt_tag_attach(etagid, imgid, FALSE, FALSE)) tag_change = TRUE;
+  dt_print(DT_DEBUG_PERF, "[export_job] %u images with %d workers in %.3fs",
+           state.done, workers, dt_get_wtime() - state.start);
+  pthread_cond_destroy(&state.mem_cond);
+  dt_pthread_mutex_destroy(&state.lock);
+  tag_change = state.tag_change;
 
-          /* register export timestamp in cache */
-          dt_image_cache_set_export_timestamp(imgid);
-        }
-      }
-    }
-
-    fraction += 1.0 / total;
-    _update_progress(job, fraction, &prev_time);
-  }
   g_list_free_full(metadata.list, g_free);
 
   if(mstorage->finalize_store) mstorage->finalize_store(mstorage, sdata);
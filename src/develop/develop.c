@@ -51,6 +51,9 @@
 #endif
 
 #define DT_DEV_AVERAGE_DELAY_COUNT 5
+// render a coarse version of the main view first if the pipe usually takes longer (ms)
+#define DT_DEV_PROGRESSIVE_DELAY 150
+#define DT_DEV_PROGRESSIVE_SCALE 0.5f
 
 void dt_dev_init(dt_develop_t *dev,
                  const gboolean gui_attached)
@@ -439,7 +442,42 @@ restart:
 
   dt_get_times(&start);
 
-  if(dt_dev_pixelpipe_process(pipe, dev, x, y, wd, ht, scale, devid))
+  // a slow darkroom main view shows a result at reduced scale first and
+  // refines it afterwards, the preview is only shown until then. offscreen
+  // renders of other devs only want the final result.
+  const float coarse = DT_DEV_PROGRESSIVE_SCALE;
+  const gboolean progressive = dev == darktable.develop
+    && dev->gui_attached
+    && port == &dev->full
+    && pipe->average_delay > DT_DEV_PROGRESSIVE_DELAY
+    && wd * coarse >= 64 && ht * coarse >= 64
+    && dt_conf_get_bool("darkroom/ui/progressive");
+
+  gboolean failed = FALSE;
+  if(progressive)
+  {
+    // the coarse run keeps the state for incremental processing of the full one
+    pipe->coarse = TRUE;
+    failed = dt_dev_pixelpipe_process(pipe, dev, x * coarse, y * coarse,
+                                      wd * coarse, ht * coarse, scale * coarse, devid);
+    pipe->coarse = FALSE;
+    if(!failed)
+    {
+      _dev_average_delay_update(&start, &pipe->first_delay);
+      dt_print_pipe(DT_DEBUG_PIPE, "progressive coarse done",
+                    pipe, NULL, devid, NULL, NULL, "scale=%.3f", scale * coarse);
+      if(port->widget) dt_control_queue_redraw_widget(port->widget);
+
+      // no need to refine an outdated result
+      if(pipe->changed != DT_DEV_PIPE_UNCHANGED)
+      {
+        dt_atomic_set_int(&pipe->shutdown, DT_DEV_PIXELPIPE_STOP_NO);
+        goto restart;
+      }
+    }
+  }
+
+  if(failed || dt_dev_pixelpipe_process(pipe, dev, x, y, wd, ht, scale, devid))
   {
     const gboolean img_changed = dev->image_force_reload || pipe->loading || pipe->input_changed;
     // As image_force_reload could be set while we are restarting we clear it and possibly flush the cache too.
@@ -478,6 +516,12 @@ restart:
                   "[dev_process_image] pixel pipeline", "processing `%s'",
                   dev->image_storage.filename);
   _dev_average_delay_update(&start, &pipe->average_delay);
+  if(!progressive)
+    _dev_average_delay_update(&start, &pipe->first_delay);
+  if(port == &dev->full)
+    dt_print(DT_DEBUG_PERF,
+             "[dev_process_image] average time to first pixels %ums, to final %ums%s",
+             pipe->first_delay, pipe->average_delay, progressive ? " (progressive)" : "");
 
   // maybe we got zoomed/panned in the meantime?
   if(port && pipe->changed != DT_DEV_PIPE_UNCHANGED)
@@ -3500,20 +3544,23 @@ void dt_dev_undo_end_record(dt_develop_t *dev)
     DT_CONTROL_SIGNAL_RAISE(DT_SIGNAL_DEVELOP_HISTORY_CHANGE);
 }
 
-void dt_dev_image(const dt_imgid_t imgid,
-                  const size_t width,
-                  const size_t height,
-                  const int history_end,
-                  uint8_t **buf,
-                  float *scale,
-                  size_t *buf_width,
-                  size_t *buf_height,
-                  float *zoom_x,
-                  float *zoom_y,
-                  const int snapshot_id,
-                  GList *module_filter_out,
-                  const int devid,
-                  const gboolean finalscale)
+void dt_dev_image_ext(const dt_imgid_t imgid,
+                      const size_t width,
+                      const size_t height,
+                      const int history_end,
+                      uint8_t **buf,
+                      float *scale,
+                      size_t *buf_width,
+                      size_t *buf_height,
+                      float *zoom_x,
+                      float *zoom_y,
+                      const int snapshot_id,
+                      GList *module_filter_out,
+                      const int devid,
+                      const gboolean finalscale,
+                      const dt_dev_viewport_t *port,
+                      dt_dev_image_callback_t running,
+                      gpointer user_data)
 {
   dt_develop_t dev;
   dt_dev_init(&dev, TRUE);
@@ -3530,8 +3577,10 @@ void dt_dev_image(const dt_imgid_t imgid,
   if(history_end != -1 && snapshot_id == -1)
     dt_dev_pop_history_items_ext(&dev, history_end);
 
-  dev.full = darktable.develop->full;
+  dev.full = port ? *port : darktable.develop->full;
   dev.full.pipe = pipe;
+  // rendered offscreen, don't redraw the darkroom's center view
+  dev.full.widget = NULL;
 
   if(!zoom_x && !zoom_y)
   {
@@ -3546,10 +3595,20 @@ void dt_dev_image(const dt_imgid_t imgid,
 
   dev.module_filter_out = module_filter_out;
 
+  if(running) running(&dev, user_data);
   dt_dev_process_image_job(&dev, &dev.full, pipe, -1, devid);
+  if(running) running(NULL, user_data);
 
   // record resulting image and dimensions
 
+  if(dev.gui_leaving)
+  {
+    // stopped by the caller
+    *buf = NULL;
+    dt_dev_cleanup(&dev);
+    return;
+  }
+
   const uint32_t bufsize =
     sizeof(uint32_t) * pipe->backbuf_width * pipe->backbuf_height;
   *buf = dt_alloc_aligned(bufsize);
@@ -3564,6 +3623,26 @@ void dt_dev_image(const dt_imgid_t imgid,
   dt_dev_cleanup(&dev);
 }
 
+void dt_dev_image(const dt_imgid_t imgid,
+                  const size_t width,
+                  const size_t height,
+                  const int history_end,
+                  uint8_t **buf,
+                  float *scale,
+                  size_t *buf_width,
+                  size_t *buf_height,
+                  float *zoom_x,
+                  float *zoom_y,
+                  const int snapshot_id,
+                  GList *module_filter_out,
+                  const int devid,
+                  const gboolean finalscale)
+{
+  dt_dev_image_ext(imgid, width, height, history_end, buf, scale,
+                   buf_width, buf_height, zoom_x, zoom_y, snapshot_id,
+                   module_filter_out, devid, finalscale, NULL, NULL, NULL);
+}
+
 gboolean dt_dev_equal_chroma(const float *f, const double *d)
 {
   return feqf(f[0], (float)d[0], 0.00001)
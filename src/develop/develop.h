@@ -616,6 +616,35 @@ void dt_dev_image(const dt_imgid_t imgid,
                   const int devid,
                   const gboolean finalscale);
 
+/*
+ * called with the develop right before dt_dev_image_ext() processes it and
+ * with NULL once it is done. the caller may stop the processing meanwhile by
+ * setting gui_leaving and the shutdown of dev->full.pipe, *buf is NULL then.
+ */
+typedef void (*dt_dev_image_callback_t)(dt_develop_t *dev, gpointer user_data);
+
+/*
+ * as dt_dev_image(), processed in port instead of the darkroom's viewport if
+ * given, which must not be read outside the gui thread.
+ */
+void dt_dev_image_ext(const dt_imgid_t imgid,
+                      const size_t width,
+                      const size_t height,
+                      const int history_end,
+                      uint8_t **buf,
+                      float *scale,
+                      size_t *buf_width,
+                      size_t *buf_height,
+                      float *zoom_x,
+                      float *zoom_y,
+                      const int32_t snapshot_id,
+                      GList *module_filter_out,
+                      const int devid,
+                      const gboolean finalscale,
+                      const dt_dev_viewport_t *port,
+                      dt_dev_image_callback_t running,
+                      gpointer user_data);
+
 
 gboolean dt_dev_equal_chroma(const float *f, const double *d);
 gboolean dt_dev_is_D65_chroma(const dt_develop_t *dev);
@@ -2173,12 +2173,14 @@ void dt_iop_commit_params(dt_iop_module_t *module,
   module->commit_params(module, params, pipe, piece);
 
   dt_hash_t phash = DT_INVALID_HASH;
+  dt_hash_t params_hash = DT_INVALID_HASH;
   // 2. compute the hash only if piece is enabled
   if(piece->enabled)
   {
     phash = dt_hash(DT_INITHASH, &module->so->op, strlen(module->so->op));
     phash = dt_hash(phash, &module->instance, sizeof(int32_t));
     phash = dt_hash(phash, module->params, module->params_size);
+    params_hash = phash;
 
     /* We have to take blending parameters into account for the hash if
         a) there is some blending active detected via the mask_mode or
@@ -2191,6 +2193,8 @@ void dt_iop_commit_params(dt_iop_module_t *module,
     {
       phash = dt_hash(phash, blendop_params, sizeof(dt_develop_blend_params_t));
 
+      // the drawn shapes are tracked separately for incremental processing
+      params_hash = phash;
       dt_masks_form_t *grp = dt_masks_get_from_id(darktable.develop, blendop_params->mask_id);
       if(grp)
       {
@@ -2202,6 +2206,7 @@ void dt_iop_commit_params(dt_iop_module_t *module,
     }
   }
   piece->hash = phash;
+  piece->params_hash = params_hash;
 }
 
 void dt_iop_gui_cleanup_module(dt_iop_module_t *module)
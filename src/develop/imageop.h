@@ -103,7 +103,8 @@ typedef enum dt_iop_flags_t
   IOP_FLAGS_CROP_EXPOSER = 1 << 16,      // offers crop exposing
   IOP_FLAGS_EXPAND_ROI_IN = 1 << 17,     // we might have to take special care about roi expansion
   IOP_FLAGS_WRITE_DETAILS = 1 << 18,     // provides the scharr mask used by details
-  IOP_FLAGS_WRITE_RASTER = 1 << 19       // modules not supporting blending might still advertise a raster mask
+  IOP_FLAGS_WRITE_RASTER = 1 << 19,      // modules not supporting blending might still advertise a raster mask
+  IOP_FLAGS_TILING_PARALLEL = 1 << 20    // process() may run on several tiles at once, it doesn't touch pipe->dsc
 } dt_iop_flags_t;
 
 /** status of a module*/
@@ -17,10 +17,15 @@
 */
 
 #include "develop/pixelpipe_cache.h"
+#include "common/file_location.h"
+#include "common/outofcore.h"
+#include "control/conf.h"
+#include "control/jobs.h"
 #include "develop/format.h"
 #include "develop/pixelpipe.h"
 #include "libs/lib.h"
 #include "libs/colorpicker.h"
+#include <glib/gstdio.h>
 #include <stdlib.h>
 
 static inline int _to_mb(size_t m)
@@ -28,6 +33,85 @@ static inline int _to_mb(size_t m)
   return (int)((m + 0x80000lu) / 0x400lu / 0x400lu);
 }
 
+// the index only holds valid hashes of the lines >= DT_PIPECACHE_MIN,
+// keys are pointers into cache->hash so they have to be removed before
+// the hash of a line changes.
+static void _set_hash(const dt_dev_pixelpipe_cache_t *cache,
+                      const int k,
+                      const dt_hash_t hash)
+{
+  if(k < DT_PIPECACHE_MIN)
+  {
+    cache->hash[k] = hash;
+    return;
+  }
+
+  if(cache->hash[k] != DT_INVALID_HASH)
+    g_hash_table_remove(cache->index, &cache->hash[k]);
+
+  cache->hash[k] = hash;
+  cache->cost[k] = 0.0f;
+  if(hash == DT_INVALID_HASH) return;
+
+  // there must only be one line per hash, an older one is of no use any more
+  gpointer old;
+  if(g_hash_table_lookup_extended(cache->index, &hash, NULL, &old))
+  {
+    const int j = GPOINTER_TO_INT(old);
+    g_hash_table_remove(cache->index, &cache->hash[j]);
+    cache->hash[j] = DT_INVALID_HASH;
+    cache->ioporder[j] = 0;
+  }
+  g_hash_table_insert(cache->index, &cache->hash[k], GINT_TO_POINTER(k));
+}
+
+static inline int _lookup_hash(const dt_dev_pixelpipe_cache_t *cache,
+                               const dt_hash_t hash)
+{
+  gpointer line;
+  return g_hash_table_lookup_extended(cache->index, &hash, NULL, &line)
+    ? GPOINTER_TO_INT(line)
+    : -1;
+}
+
+// the per module stats are only reported with -d pipe, don't pay for
+// the name formatting and the lookup on every cache access otherwise
+static dt_dev_pixelpipe_cache_stats_t *_module_stats(const dt_dev_pixelpipe_cache_t *cache,
+                                                     const dt_iop_module_t *module)
+{
+  if(!module || !(darktable.unmuted & DT_DEBUG_PIPE)) return NULL;
+
+  char name[128];
+  snprintf(name, sizeof(name), "%s%s", module->op, dt_iop_get_instance_id(module));
+  dt_dev_pixelpipe_cache_stats_t *stats = g_hash_table_lookup(cache->modstats, name);
+  if(!stats)
+  {
+    stats = g_new0(dt_dev_pixelpipe_cache_stats_t, 1);
+    g_hash_table_insert(cache->modstats, g_strdup(name), stats);
+  }
+  return stats;
+}
+
+// buffers of pipes nobody waits for interactively may be mapped from disk,
+// up front if they don't fit into what is left of the memory budget
+static void *_alloc_cacheline(const dt_dev_pixelpipe_t *pipe,
+                              const size_t size,
+                              gboolean *mapped)
+{
+  *mapped = FALSE;
+  if(!(pipe->type & (DT_DEV_PIXELPIPE_EXPORT | DT_DEV_PIXELPIPE_THUMBNAIL)))
+    return dt_alloc_aligned(size);
+
+  const size_t available = dt_get_available_mem();
+  const size_t used = pipe->cache.allmem;
+  return dt_outofcore_alloc(size, available > used ? available - used : 0, mapped);
+}
+
+static inline void _free_cachedata(const dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  dt_outofcore_free(cache->data[k], cache->size[k], cache->mapped[k]);
+}
+
 gboolean dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_t *pipe,
                                      const int entries,
                                      const size_t size,
@@ -39,13 +123,21 @@ gboolean dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_t *pipe,
   cache->allmem = cache->hits = cache->calls = cache->tests = 0;
   cache->memlimit = limit;
 
-  const size_t csize = sizeof(void *) + sizeof(size_t) + sizeof(dt_iop_buffer_dsc_t) + 2*sizeof(int32_t) + sizeof(uint64_t);
+  const size_t csize = sizeof(void *) + sizeof(size_t) + sizeof(dt_iop_buffer_dsc_t) + 2*sizeof(int32_t) + sizeof(uint64_t)
+                       + sizeof(float) + sizeof(gboolean);
   cache->data = (void **) calloc(entries, csize);
   cache->size = (size_t *)((void *)cache->data + entries * sizeof(void *));
   cache->dsc = (dt_iop_buffer_dsc_t *)((void *)cache->size + entries * sizeof(size_t));
   cache->hash = (dt_hash_t *)((void *)cache->dsc + entries * sizeof(dt_iop_buffer_dsc_t));
   cache->used = (int32_t *)((void *)cache->hash + entries * sizeof(dt_hash_t));
   cache->ioporder = (int32_t *)((void *)cache->used + entries * sizeof(int32_t));
+  cache->cost = (float *)((void *)cache->ioporder + entries * sizeof(int32_t));
+  cache->mapped = (gboolean *)((void *)cache->cost + entries * sizeof(float));
+  cache->index = g_hash_table_new(g_int64_hash, g_int64_equal);
+  cache->disk_imgid = NO_IMGID;
+  cache->disk_path = NULL;
+  cache->disk_source = DT_INVALID_HASH;
+  cache->modstats = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
 
   for(int k = 0; k < entries; k++)
   {
@@ -54,11 +146,13 @@ gboolean dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_t *pipe,
   }
   if(!size) return TRUE;
 
-  // some pixelpipes use preallocated cachelines, following code is special for those
-  for(int k = 0; k < entries; k++)
+  // some pixelpipes use preallocated cachelines, following code is special for those.
+  // Only the two swapping lines are preallocated, any further lines of such a pipe
+  // are allocated by dt_dev_pixelpipe_cache_get() once they are used.
+  for(int k = 0; k < MIN(entries, DT_PIPECACHE_MIN); k++)
   {
     cache->size[k] = size;
-    cache->data[k] = (void *)dt_alloc_aligned(size);
+    cache->data[k] = _alloc_cacheline(pipe, size, &cache->mapped[k]);
     if(!cache->data[k])
       goto alloc_memory_fail;
 
@@ -72,7 +166,7 @@ gboolean dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_t *pipe,
   // but will only fail to generate thumbnails for example.
   for(int k = 0; k < cache->entries; k++)
   {
-    dt_free_align(cache->data[k]);
+    _free_cachedata(cache, k);
     cache->size[k] = 0;
     cache->data[k] = NULL;
   }
@@ -93,11 +187,17 @@ void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_t *pipe)
 
   for(int k = 0; k < cache->entries; k++)
   {
-    dt_free_align(cache->data[k]);
+    _free_cachedata(cache, k);
     cache->data[k] = NULL;
   }
   free(cache->data);
   cache->data = NULL;
+  g_hash_table_destroy(cache->index);
+  cache->index = NULL;
+  g_hash_table_destroy(cache->modstats);
+  cache->modstats = NULL;
+  g_free(cache->disk_path);
+  cache->disk_path = NULL;
 }
 
 static dt_hash_t _dev_pixelpipe_cache_basichash(dt_dev_pixelpipe_t *pipe,
@@ -169,40 +269,19 @@ dt_hash_t dt_dev_pixelpipe_cache_hash(const dt_iop_roi_t *roi,
   return hash;
 }
 
-gboolean dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_t *pipe,
-                                          const dt_hash_t hash,
-                                          const size_t size)
-{
-  if(pipe->mask_display
-     || pipe->nocache
-     || (hash == DT_INVALID_HASH))
-    return FALSE;
-
-  dt_dev_pixelpipe_cache_t *cache = &pipe->cache;
-  cache->tests++;
-  // search for hash in cache and make the sizes are identical
-  for(int k = DT_PIPECACHE_MIN; k < cache->entries; k++)
-  {
-    if((cache->size[k] == size) && (cache->hash[k] == hash))
-    {
-      cache->hits++;
-      return TRUE;
-    }
-  }
-  return FALSE;
-}
-
 // While looking for the oldest cacheline we always ignore the first two lines as they are used
-// for swapping buffers while in entries==DT_PIPECACHE_MIN or masking mode
+// for swapping buffers while in entries==DT_PIPECACHE_MIN or masking mode.
+// The age is weighted by the recompute cost per megabyte so lines from expensive
+// modules survive longer than cheap intermediate lines of the same size.
 static int _get_oldest_cacheline(dt_dev_pixelpipe_cache_t *cache,
                                  const dt_dev_pixelpipe_cache_test_t mode)
 {
   // we never want the latest used cacheline! It was <= 0 and the weight has increased just now
-  int age = 1;
+  float score = 0.0f;
   int id = 0;
   for(int k = DT_PIPECACHE_MIN; k < cache->entries; k++)
   {
-    gboolean older = (cache->used[k] > age) && (k != cache->lastline);
+    gboolean older = (cache->used[k] > 1) && (k != cache->lastline);
     if(older)
     {
       if(mode == DT_CACHETEST_USED)         older = cache->data[k] != NULL;
@@ -210,8 +289,15 @@ static int _get_oldest_cacheline(dt_dev_pixelpipe_cache_t *cache,
       else if(mode == DT_CACHETEST_INVALID) older = cache->hash[k] == DT_INVALID_HASH;
       if(older)
       {
-        age = cache->used[k];
-        id = k;
+        // milliseconds of processing per megabyte of cacheline
+        const float mb = fmaxf(1.0f, (float)cache->size[k] / (1024.0f * 1024.0f));
+        const float weight = 1.0f + 1000.0f * cache->cost[k] / mb;
+        const float kscore = (float)cache->used[k] / weight;
+        if(kscore > score)
+        {
+          score = kscore;
+          id = k;
+        }
       }
     }
   }
@@ -252,36 +338,33 @@ static gboolean _get_by_hash(dt_dev_pixelpipe_t *pipe,
                              dt_iop_buffer_dsc_t **dsc)
 {
   dt_dev_pixelpipe_cache_t *cache = &pipe->cache;
-  for(int k = DT_PIPECACHE_MIN; k < cache->entries; k++)
+  const int k = _lookup_hash(cache, hash);
+  if(k < 0) return FALSE;
+
+  if(cache->size[k] != size)
   {
-    if(cache->hash[k] == hash)
-    {
-      if(cache->size[k] != size)
-      {
-        /* We check for situation with a hash identity but buffer sizes don't match.
-           This could happen because of "hash overlaps" or other situations where the hash
-           doesn't reflect the complete status.
-           Anyway this has to be accepted as a dt bug so we always report
-        */
-        cache->hash[k] = DT_INVALID_HASH;
-        dt_print_pipe(DT_DEBUG_ALWAYS, "CACHELINE_SIZE ERROR",
-          pipe, module, DT_DEVICE_NONE, NULL, NULL);
-      }
-      else if(pipe->mask_display || pipe->nocache)
-      {
-        // this should not happen but we make sure
-        cache->hash[k] = DT_INVALID_HASH;
-      }
-      else
-      {
-        // we have a proper hit
-        *data = cache->data[k];
-        *dsc = &cache->dsc[k];
-        // in case of a hit it's always good to further keep the cacheline as important
-        cache->used[k] = -cache->entries;
-        return TRUE;
-      }
-    }
+    /* We check for situation with a hash identity but buffer sizes don't match.
+       This could happen because of "hash overlaps" or other situations where the hash
+       doesn't reflect the complete status.
+       Anyway this has to be accepted as a dt bug so we always report
+    */
+    _set_hash(cache, k, DT_INVALID_HASH);
+    dt_print_pipe(DT_DEBUG_ALWAYS, "CACHELINE_SIZE ERROR",
+      pipe, module, DT_DEVICE_NONE, NULL, NULL);
+  }
+  else if(pipe->mask_display || pipe->nocache)
+  {
+    // this should not happen but we make sure
+    _set_hash(cache, k, DT_INVALID_HASH);
+  }
+  else
+  {
+    // we have a proper hit
+    *data = cache->data[k];
+    *dsc = &cache->dsc[k];
+    // in case of a hit it's always good to further keep the cacheline as important
+    cache->used[k] = -cache->entries;
+    return TRUE;
   }
   return FALSE;
 }
@@ -304,6 +387,8 @@ gboolean dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_t *pipe,
      && (hash != DT_INVALID_HASH)
      && _get_by_hash(pipe, module, hash, size, data, dsc))
   {
+    dt_dev_pixelpipe_cache_stats_t *stats = _module_stats(cache, module);
+    if(stats) stats->hits++;
     const dt_iop_buffer_dsc_t *cdsc = *dsc;
     dt_print_pipe(DT_DEBUG_PIPE, "cache HIT",
           pipe, module, DT_DEVICE_NONE, NULL, NULL,
@@ -318,14 +403,17 @@ gboolean dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_t *pipe,
   //
   // Otherwise, get an old/free cacheline and allocate required size.
   // Check both for free and non-matching (and grow or shrink buffer).
+  dt_dev_pixelpipe_cache_stats_t *stats = _module_stats(cache, module);
+  if(stats) stats->misses++;
+
   const int cline = _get_cacheline(pipe);
 
   if(((cache->entries == DT_PIPECACHE_MIN) && (cache->size[cline] < size))
      || ((cache->entries > DT_PIPECACHE_MIN) && (cache->size[cline] != size)))
   {
-    dt_free_align(cache->data[cline]);
+    _free_cachedata(cache, cline);
     cache->allmem -= cache->size[cline];
-    cache->data[cline] = (void *)dt_alloc_aligned(size);
+    cache->data[cline] = _alloc_cacheline(pipe, size, &cache->mapped[cline]);
     if(cache->data[cline])
     {
       cache->size[cline] = size;
@@ -344,7 +432,7 @@ gboolean dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_t *pipe,
   *dsc = &cache->dsc[cline];
 
   const gboolean masking = pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE;
-  cache->hash[cline]      = masking ? DT_INVALID_HASH : hash;
+  _set_hash(cache, cline, masking ? DT_INVALID_HASH : hash);
 
   const dt_iop_buffer_dsc_t *cdsc = *dsc;
   dt_print_pipe(DT_DEBUG_PIPE | DT_DEBUG_VERBOSE, "pipe cache get",
@@ -363,10 +451,471 @@ gboolean dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_t *pipe,
 
 static void _mark_invalid_cacheline(const dt_dev_pixelpipe_cache_t *cache, const int k)
 {
-  cache->hash[k] = DT_INVALID_HASH;
+  _set_hash(cache, k, DT_INVALID_HASH);
   cache->ioporder[k] = 0;
 }
 
+/* The optional disk tier. Expensive cachelines of the full pipe are written to
+   <cachedir>/pipecache/<key>.dtpc and read back when the same hash is requested in a
+   later session. The key includes the identity of the source file as the pipe hash
+   only knows the imgid. Lines are copied and written by a background job so the pipe
+   never waits for the disk. The directory is kept below cache_disk_pipe_size MB by
+   removing the least recently used files.
+   The keys of the files are kept in memory, so looking for a line only touches the
+   disk if it is there.
+*/
+#define DT_PIPECACHE_DISK_MAGIC 0x63707464u // "dtpc"
+#define DT_PIPECACHE_DISK_VERSION 2
+// lines computed faster than this are cheaper to recompute than to write and read back
+#define DT_PIPECACHE_DISK_MINTIME 0.25f
+
+typedef struct _disk_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+  dt_hash_t hash;
+  dt_hash_t source;
+  uint64_t size;
+  int32_t ioporder;
+  float cost;
+  dt_iop_buffer_dsc_t dsc;
+} _disk_header_t;
+
+typedef struct _disk_file_t
+{
+  gchar *path;
+  dt_hash_t key;
+  gint64 mtime;
+  gint64 size;
+} _disk_file_t;
+
+// shared by all pipes, protects _disk_used, _disk_index and the trimming of the directory
+static GMutex _disk_lock;
+static gint64 _disk_used = -1;        // bytes in the disk tier, -1 until first scanned
+static GHashTable *_disk_index = NULL; // keys of the files in the disk tier
+
+static inline gboolean _disk_enabled(const dt_dev_pixelpipe_t *pipe)
+{
+  return (pipe->type & DT_DEV_PIXELPIPE_FULL)
+    && pipe->cache.entries > DT_PIPECACHE_MIN
+    && dt_conf_get_bool("cache_disk_pipe");
+}
+
+static void _disk_dirname(char *dirname, const size_t size)
+{
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  snprintf(dirname, size, "%s/pipecache", cachedir);
+}
+
+// identifies the source file of the pipe's image by its path, modification time and size.
+// imgids are reused after an image has been removed and differ between libraries.
+// returns DT_INVALID_HASH if the file can't be found.
+static dt_hash_t _disk_source(dt_dev_pixelpipe_t *pipe)
+{
+  dt_dev_pixelpipe_cache_t *cache = &pipe->cache;
+  const dt_imgid_t imgid = pipe->image.id;
+  if(!dt_is_valid_imgid(imgid)) return DT_INVALID_HASH;
+  if(!cache->disk_path || cache->disk_imgid != imgid)
+  {
+    char path[PATH_MAX] = { 0 };
+    gboolean from_cache = FALSE;
+    dt_image_full_path(imgid, path, sizeof(path), &from_cache);
+    g_free(cache->disk_path);
+    cache->disk_path = g_strdup(path);
+    cache->disk_imgid = imgid;
+  }
+
+  GStatBuf st;
+  if(!cache->disk_path[0] || g_stat(cache->disk_path, &st))
+    return DT_INVALID_HASH;
+  const int64_t stamp[2] = { st.st_mtime, st.st_size };
+  const dt_hash_t hash = dt_hash(DT_INITHASH, cache->disk_path, strlen(cache->disk_path));
+  return dt_hash(hash, stamp, sizeof(stamp));
+}
+
+void dt_dev_pixelpipe_cache_disk_source(dt_dev_pixelpipe_t *pipe)
+{
+  pipe->cache.disk_source = _disk_enabled(pipe) ? _disk_source(pipe) : DT_INVALID_HASH;
+}
+
+static dt_hash_t _disk_key(const dt_hash_t hash, const dt_hash_t source)
+{
+  // results of other darktable versions or source files must never be used
+  const dt_hash_t key = dt_hash(hash, darktable_package_string, strlen(darktable_package_string));
+  return dt_hash(key, &source, sizeof(source));
+}
+
+static void _disk_filename(char *filename, const size_t size, const dt_hash_t key)
+{
+  char dirname[PATH_MAX] = { 0 };
+  _disk_dirname(dirname, sizeof(dirname));
+  snprintf(filename, size, "%s/%016" PRIx64 ".dtpc", dirname, key);
+}
+
+// the key of a file in the disk tier, FALSE if the name is none of ours
+static gboolean _disk_file_key(const gchar *name, dt_hash_t *key)
+{
+  gchar *end = NULL;
+  *key = g_ascii_strtoull(name, &end, 16);
+  return end == name + 16 && !g_strcmp0(end, ".dtpc");
+}
+
+// called with _disk_lock held
+static void _disk_index_add(const dt_hash_t key)
+{
+  dt_hash_t *k = g_new(dt_hash_t, 1);
+  *k = key;
+  g_hash_table_add(_disk_index, k);
+}
+
+static gint _disk_file_older(gconstpointer a, gconstpointer b)
+{
+  const _disk_file_t *fa = a;
+  const _disk_file_t *fb = b;
+  return (fa->mtime > fb->mtime) - (fa->mtime < fb->mtime);
+}
+
+static void _disk_file_free(gpointer data)
+{
+  _disk_file_t *file = data;
+  g_free(file->path);
+  g_free(file);
+}
+
+// called with _disk_lock held. returns the bytes used and rebuilds the index,
+// if limit is given the oldest files are removed until we are below 90% of it.
+static gint64 _disk_trim(const gint64 limit)
+{
+  if(_disk_index)
+    g_hash_table_remove_all(_disk_index);
+  else
+    _disk_index = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+
+  char dirname[PATH_MAX] = { 0 };
+  _disk_dirname(dirname, sizeof(dirname));
+  GDir *dir = g_dir_open(dirname, 0, NULL);
+  if(!dir) return 0;
+
+  GList *files = NULL;
+  gint64 used = 0;
+  const gchar *name;
+  while((name = g_dir_read_name(dir)))
+  {
+    dt_hash_t key;
+    if(!_disk_file_key(name, &key)) continue;
+    gchar *path = g_build_filename(dirname, name, NULL);
+    GStatBuf st;
+    if(!g_stat(path, &st))
+    {
+      _disk_file_t *file = g_new(_disk_file_t, 1);
+      file->path = path;
+      file->key = key;
+      file->mtime = st.st_mtime;
+      file->size = st.st_size;
+      files = g_list_prepend(files, file);
+      used += st.st_size;
+      _disk_index_add(key);
+    }
+    else
+      g_free(path);
+  }
+  g_dir_close(dir);
+
+  if(limit && used > limit)
+  {
+    files = g_list_sort(files, _disk_file_older);
+    int removed = 0;
+    for(GList *f = files; f && used > 0.9 * limit; f = g_list_next(f))
+    {
+      const _disk_file_t *file = f->data;
+      if(!g_unlink(file->path))
+      {
+        g_hash_table_remove(_disk_index, &file->key);
+        used -= file->size;
+        removed++;
+      }
+    }
+    dt_print(DT_DEBUG_PIPE | DT_DEBUG_CACHE,
+             "[pixelpipe_cache] disk tier: removed %i files, using %iMB of %iMB",
+             removed, _to_mb(used), _to_mb(limit));
+  }
+  g_list_free_full(files, _disk_file_free);
+  return used;
+}
+
+// TRUE if the disk tier has a file for the key, scans the directory on first use
+static gboolean _disk_indexed(const dt_hash_t key)
+{
+  g_mutex_lock(&_disk_lock);
+  if(_disk_used < 0) _disk_used = _disk_trim(0);
+  const gboolean found = g_hash_table_contains(_disk_index, &key);
+  g_mutex_unlock(&_disk_lock);
+  return found;
+}
+
+static void _disk_unindex(const dt_hash_t key)
+{
+  g_mutex_lock(&_disk_lock);
+  if(_disk_index) g_hash_table_remove(_disk_index, &key);
+  g_mutex_unlock(&_disk_lock);
+}
+
+typedef struct _disk_store_t
+{
+  gchar *filename;
+  dt_hash_t key;
+  _disk_header_t header;
+  void *data;
+} _disk_store_t;
+
+static void _disk_store_free(gpointer data)
+{
+  _disk_store_t *store = data;
+  g_free(store->filename);
+  dt_free_align(store->data);
+  g_free(store);
+}
+
+static int32_t _disk_store_job_run(dt_job_t *job)
+{
+  const _disk_store_t *store = dt_control_job_get_params(job);
+  const size_t size = store->header.size;
+  if(g_file_test(store->filename, G_FILE_TEST_EXISTS)) return 0;
+
+  char dirname[PATH_MAX] = { 0 };
+  _disk_dirname(dirname, sizeof(dirname));
+  if(g_mkdir_with_parents(dirname, 0750)) return 1;
+
+  const double start = dt_get_wtime();
+  // write to a temporary file first so readers never see partial lines,
+  // made unique as the same line might be queued by several pipes.
+  gchar *tmpname = g_strdup_printf("%s.%p.tmp", store->filename, (void *)job);
+  FILE *f = g_fopen(tmpname, "wb");
+  gboolean ok = f != NULL;
+  if(f)
+  {
+    ok = fwrite(&store->header, sizeof(store->header), 1, f) == 1
+      && fwrite(store->data, 1, size, f) == size;
+    ok = !fclose(f) && ok;
+  }
+  if(ok) ok = !g_rename(tmpname, store->filename);
+  if(!ok) g_unlink(tmpname);
+  g_free(tmpname);
+  if(!ok) return 1;
+
+  const gint64 limit = (gint64)MAX(256, dt_conf_get_int("cache_disk_pipe_size")) << 20;
+  g_mutex_lock(&_disk_lock);
+  if(_disk_used < 0) _disk_used = _disk_trim(0);
+  else
+  {
+    _disk_used += sizeof(store->header) + size;
+    _disk_index_add(store->key);
+  }
+  if(_disk_used > limit) _disk_used = _disk_trim(limit);
+  g_mutex_unlock(&_disk_lock);
+
+  dt_print(DT_DEBUG_PIPE,
+           "[pipe cache disk store] %iMB in %.3fs (processing took %.3fs), hash=%" PRIx64,
+           _to_mb(size), dt_get_wtime() - start, store->header.cost, store->header.hash);
+  return 0;
+}
+
+void dt_dev_pixelpipe_cache_disk_store(dt_dev_pixelpipe_t *pipe,
+                                       const dt_hash_t hash,
+                                       const void *data,
+                                       const size_t size,
+                                       const dt_iop_buffer_dsc_t *dsc,
+                                       const dt_iop_module_t *module,
+                                       const float seconds)
+{
+  if(!data
+     || hash == DT_INVALID_HASH
+     || seconds < DT_PIPECACHE_DISK_MINTIME
+     || pipe->mask_display
+     || pipe->nocache
+     || !_disk_enabled(pipe))
+    return;
+
+  // make sure the line has not been invalidated meanwhile
+  const dt_dev_pixelpipe_cache_t *cache = &pipe->cache;
+  const int k = _lookup_hash(cache, hash);
+  if(k < 0 || cache->data[k] != data || cache->size[k] != size) return;
+
+  // a single line must never flush most of the tier
+  const gint64 limit = (gint64)MAX(256, dt_conf_get_int("cache_disk_pipe_size")) << 20;
+  if(size > limit / 4) return;
+
+  const dt_hash_t source = pipe->cache.disk_source;
+  if(source == DT_INVALID_HASH) return;
+
+  const dt_hash_t key = _disk_key(hash, source);
+  if(_disk_indexed(key)) return;
+
+  // the pipe goes on with the line, the job writes a copy
+  void *copy = dt_alloc_aligned(size);
+  if(!copy) return;
+  memcpy(copy, data, size);
+
+  dt_job_t *job = dt_control_job_create(&_disk_store_job_run, "store pipe cache line");
+  if(!job)
+  {
+    dt_free_align(copy);
+    return;
+  }
+  char filename[PATH_MAX] = { 0 };
+  _disk_filename(filename, sizeof(filename), key);
+  _disk_store_t *store = g_new(_disk_store_t, 1);
+  store->filename = g_strdup(filename);
+  store->key = key;
+  store->data = copy;
+  store->header = (_disk_header_t){ .magic = DT_PIPECACHE_DISK_MAGIC,
+                                    .version = DT_PIPECACHE_DISK_VERSION,
+                                    .hash = hash,
+                                    .source = source,
+                                    .size = size,
+                                    .ioporder = module ? module->iop_order : 0,
+                                    .cost = seconds,
+                                    .dsc = *dsc };
+  dt_control_job_set_params(job, store, _disk_store_free);
+  dt_control_add_job(DT_JOB_QUEUE_SYSTEM_BG, job);
+
+  dt_print_pipe(DT_DEBUG_PIPE, "pipe cache disk queue",
+    pipe, module, DT_DEVICE_NONE, NULL, NULL,
+    "%iMB (processing took %.3fs), hash=%" PRIx64,
+    _to_mb(size), seconds, hash);
+}
+
+// try to restore a cacheline from the disk tier, returns TRUE if the
+// line is now available in memory.
+static gboolean _disk_load(dt_dev_pixelpipe_t *pipe,
+                           const dt_hash_t hash,
+                           const size_t size)
+{
+  const dt_hash_t source = pipe->cache.disk_source;
+  if(source == DT_INVALID_HASH) return FALSE;
+
+  const dt_hash_t key = _disk_key(hash, source);
+  if(!_disk_indexed(key)) return FALSE;
+
+  char filename[PATH_MAX] = { 0 };
+  _disk_filename(filename, sizeof(filename), key);
+  FILE *f = g_fopen(filename, "rb");
+  if(!f)
+  {
+    _disk_unindex(key);
+    return FALSE;
+  }
+
+  const double start = dt_get_wtime();
+  dt_dev_pixelpipe_cache_t *cache = &pipe->cache;
+  _disk_header_t header;
+  if(fread(&header, sizeof(header), 1, f) != 1
+     || header.magic != DT_PIPECACHE_DISK_MAGIC
+     || header.version != DT_PIPECACHE_DISK_VERSION
+     || header.hash != hash
+     || header.source != source
+     || header.size != size)
+  {
+    // never ours to use, don't try again
+    fclose(f);
+    g_unlink(filename);
+    _disk_unindex(key);
+    return FALSE;
+  }
+
+  const int cline = _get_cacheline(pipe);
+  if(cline < DT_PIPECACHE_MIN)
+  {
+    fclose(f);
+    return FALSE;
+  }
+
+  if(cache->size[cline] != size)
+  {
+    _free_cachedata(cache, cline);
+    cache->allmem -= cache->size[cline];
+    cache->data[cline] = _alloc_cacheline(pipe, size, &cache->mapped[cline]);
+    cache->size[cline] = cache->data[cline] ? size : 0;
+    cache->allmem += cache->size[cline];
+  }
+
+  const gboolean ok = cache->data[cline]
+    && fread(cache->data[cline], 1, size, f) == size;
+  fclose(f);
+
+  if(!ok)
+  {
+    _mark_invalid_cacheline(cache, cline);
+    g_unlink(filename);
+    _disk_unindex(key);
+    return FALSE;
+  }
+
+  cache->dsc[cline] = header.dsc;
+  _set_hash(cache, cline, hash);
+  cache->cost[cline] = header.cost;
+  cache->ioporder[cline] = header.ioporder;
+  cache->used[cline] = 0;
+
+  // keep it fresh for the lru trimming
+  g_utime(filename, NULL);
+
+  dt_print_pipe(DT_DEBUG_PIPE, "pipe cache disk load",
+    pipe, NULL, DT_DEVICE_NONE, NULL, NULL,
+    "line%3i %iMB in %.3fs (processing took %.3fs), hash=%" PRIx64,
+    cline, _to_mb(size), dt_get_wtime() - start, header.cost, hash);
+  return TRUE;
+}
+
+gboolean dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_t *pipe,
+                                          const dt_hash_t hash,
+                                          const size_t size)
+{
+  if(pipe->mask_display
+     || pipe->nocache
+     || (hash == DT_INVALID_HASH))
+    return FALSE;
+
+  dt_dev_pixelpipe_cache_t *cache = &pipe->cache;
+  cache->tests++;
+  // search for hash in cache and make the sizes are identical
+  const int k = _lookup_hash(cache, hash);
+  if(k >= 0 && cache->size[k] == size)
+  {
+    cache->hits++;
+    return TRUE;
+  }
+
+  // not in memory, but maybe we have it from an earlier session
+  if(k < 0 && _disk_enabled(pipe) && _disk_load(pipe, hash, size))
+  {
+    cache->hits++;
+    return TRUE;
+  }
+  return FALSE;
+}
+
+void *dt_dev_pixelpipe_cache_peek(dt_dev_pixelpipe_t *pipe,
+                                  const dt_hash_t hash,
+                                  const size_t size,
+                                  const dt_iop_buffer_dsc_t **dsc)
+{
+  if(pipe->mask_display
+     || pipe->nocache
+     || (hash == DT_INVALID_HASH))
+    return NULL;
+
+  dt_dev_pixelpipe_cache_t *cache = &pipe->cache;
+  const int k = _lookup_hash(cache, hash);
+  if(k < 0 || cache->size[k] != size || !cache->data[k])
+    return NULL;
+
+  cache->used[k] = -cache->entries;
+  *dsc = &cache->dsc[k];
+  return cache->data[k];
+}
+
 void dt_dev_pixelpipe_cache_invalidate_later(dt_dev_pixelpipe_t *pipe,
                                              const int32_t order)
 {
@@ -411,6 +960,21 @@ void dt_dev_pixelpipe_important_cacheline(const dt_dev_pixelpipe_t *pipe,
   }
 }
 
+void dt_dev_pixelpipe_cache_set_cost(const dt_dev_pixelpipe_t *pipe,
+                                     const void *data,
+                                     const float seconds,
+                                     const dt_iop_module_t *module)
+{
+  const dt_dev_pixelpipe_cache_t *cache = &pipe->cache;
+  for(int k = DT_PIPECACHE_MIN; k < cache->entries; k++)
+  {
+    if((cache->data[k] == data) && (cache->hash[k] != DT_INVALID_HASH))
+      cache->cost[k] = seconds;
+  }
+  dt_dev_pixelpipe_cache_stats_t *stats = _module_stats(cache, module);
+  if(stats) stats->cost += seconds;
+}
+
 void dt_dev_pixelpipe_invalidate_cacheline(const dt_dev_pixelpipe_t *pipe,
                                            const void *data)
 {
@@ -425,7 +989,7 @@ static size_t _free_cacheline(dt_dev_pixelpipe_cache_t *cache, const int k)
 {
   const size_t removed = cache->size[k];
 
-  dt_free_align(cache->data[k]);
+  _free_cachedata(cache, k);
   cache->allmem -= removed;
   cache->size[k] = 0;
   cache->data[k] = NULL;
@@ -476,6 +1040,14 @@ void dt_dev_pixelpipe_cache_checkmem(dt_dev_pixelpipe_t *pipe)
     _to_mb(freed_invalid), _to_mb(freed), _to_mb(cache->allmem), _to_mb(cache->memlimit));
 }
 
+gboolean dt_dev_pixelpipe_cache_mapped(const dt_dev_pixelpipe_t *pipe, const void *data)
+{
+  const dt_dev_pixelpipe_cache_t *cache = &pipe->cache;
+  for(int k = 0; k < cache->entries; k++)
+    if(cache->data[k] == data) return cache->mapped[k];
+  return FALSE;
+}
+
 void dt_dev_pixelpipe_cache_report(dt_dev_pixelpipe_t *pipe)
 {
   dt_dev_pixelpipe_cache_t *cache = &pipe->cache;
@@ -487,6 +1059,21 @@ void dt_dev_pixelpipe_cache_report(dt_dev_pixelpipe_t *pipe)
     _to_mb(cache->allmem), _to_mb(cache->memlimit),
     (double)(cache->hits) / fmax(1.0, pipe->runs),
     (double)(cache->hits) / fmax(1.0, cache->tests));
+
+  if(!(darktable.unmuted & DT_DEBUG_PIPE)) return;
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, cache->modstats);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+  {
+    const dt_dev_pixelpipe_cache_stats_t *stats = value;
+    const uint64_t requests = stats->hits + stats->misses;
+    dt_print_pipe(DT_DEBUG_PIPE, "cache module stats", pipe, NULL, DT_DEVICE_NONE, NULL, NULL,
+      "%-20s hits=%" PRIu64 "/%" PRIu64 " (%.1f%%), processing %.3fs",
+      (const char *)key, stats->hits, requests,
+      100.0 * (double)stats->hits / fmax(1.0, requests), stats->cost);
+  }
 }
 
 // clang-format off
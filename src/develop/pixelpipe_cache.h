@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include <glib.h>
 #include <inttypes.h>
 
 struct dt_dev_pixelpipe_t;
@@ -41,6 +42,9 @@ typedef struct dt_dev_pixelpipe_cache_t
   dt_hash_t *hash;
   int32_t *used;
   int32_t *ioporder;
+  float *cost;          // seconds it took to compute the cacheline
+  gboolean *mapped;     // the cacheline is mapped from disk, see dt_outofcore_alloc()
+  GHashTable *index;    // hash -> cacheline, only valid lines >= DT_PIPECACHE_MIN
   uint64_t calls;
   int32_t lastline;
   // profiling & stats:
@@ -49,8 +53,19 @@ typedef struct dt_dev_pixelpipe_cache_t
   uint32_t lused;
   uint32_t linvalid;
   uint32_t limportant;
+  GHashTable *modstats; // module instance name -> dt_dev_pixelpipe_cache_stats_t
+  int32_t disk_imgid;   // image whose source file is disk_path, for the disk tier
+  gchar *disk_path;
+  dt_hash_t disk_source; // identity of disk_path, see dt_dev_pixelpipe_cache_disk_source()
 } dt_dev_pixelpipe_cache_t;
 
+typedef struct dt_dev_pixelpipe_cache_stats_t
+{
+  uint64_t hits;
+  uint64_t misses;
+  double cost;          // accumulated processing time for the misses
+} dt_dev_pixelpipe_cache_stats_t;
+
 typedef enum dt_dev_pixelpipe_cache_test_t
 {
   DT_CACHETEST_PLAIN = 0,
@@ -80,6 +95,11 @@ gboolean dt_dev_pixelpipe_cache_get(struct dt_dev_pixelpipe_t *pipe, const dt_ha
 /** test availability of a cache line without destroying another, if it is not found. */
 gboolean dt_dev_pixelpipe_cache_available(struct dt_dev_pixelpipe_t *pipe, const dt_hash_t hash, const size_t size);
 
+/** returns the buffer of a valid cacheline for hash or NULL, without aging the cache.
+    The line is kept important so the next dt_dev_pixelpipe_cache_get() doesn't reuse it. */
+void *dt_dev_pixelpipe_cache_peek(struct dt_dev_pixelpipe_t *pipe, const dt_hash_t hash,
+                                  const size_t size, const struct dt_iop_buffer_dsc_t **dsc);
+
 /** invalidates all cachelines. */
 void dt_dev_pixelpipe_cache_flush(struct dt_dev_pixelpipe_t *pipe);
 
@@ -89,6 +109,21 @@ void dt_dev_pixelpipe_cache_invalidate_later(struct dt_dev_pixelpipe_t *pipe, co
 /** makes this buffer very important after it has been pulled from the cache. */
 void dt_dev_pixelpipe_important_cacheline(const struct dt_dev_pixelpipe_t *pipe, const void *data, const size_t size);
 
+/** record the time it took to compute the cacheline holding data, used to weigh eviction */
+void dt_dev_pixelpipe_cache_set_cost(const struct dt_dev_pixelpipe_t *pipe, const void *data, const float seconds,
+                                     const struct dt_iop_module_t *module);
+
+/** identifies the source file of the pipe's image for the disk tier. done once per run
+    so looking for a cacheline doesn't touch the disk. */
+void dt_dev_pixelpipe_cache_disk_source(struct dt_dev_pixelpipe_t *pipe);
+
+/** queue an expensive cacheline for the optional disk tier so it can be restored in a later session.
+    data must be the host buffer of a valid cacheline for hash, it is copied and written by a background job. */
+void dt_dev_pixelpipe_cache_disk_store(struct dt_dev_pixelpipe_t *pipe, const dt_hash_t hash,
+                                       const void *data, const size_t size,
+                                       const struct dt_iop_buffer_dsc_t *dsc,
+                                       const struct dt_iop_module_t *module, const float seconds);
+
 /** mark the given cache line as invalid or to be ignored */
 void dt_dev_pixelpipe_invalidate_cacheline(const struct dt_dev_pixelpipe_t *pipe, const void *data);
 
@@ -96,6 +131,9 @@ void dt_dev_pixelpipe_invalidate_cacheline(const struct dt_dev_pixelpipe_t *pipe
 void dt_dev_pixelpipe_cache_report(struct dt_dev_pixelpipe_t *pipe);
 void dt_dev_pixelpipe_cache_checkmem(struct dt_dev_pixelpipe_t *pipe);
 
+/** TRUE if data is a cacheline of the pipe which is mapped from disk */
+gboolean dt_dev_pixelpipe_cache_mapped(const struct dt_dev_pixelpipe_t *pipe, const void *data);
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
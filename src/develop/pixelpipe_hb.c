@@ -22,6 +22,7 @@
 #include "common/opencl.h"
 #include "common/iop_order.h"
 #include "common/imagebuf.h"
+#include "common/thread_budget.h"
 #include "control/control.h"
 #include "control/signal.h"
 #include "develop/blend.h"
@@ -30,6 +31,7 @@
 #include "develop/develop.h"
 #include "develop/tiling.h"
 #include "develop/masks.h"
+#include "develop/pixelpipe_profile.h"
 #include "gui/gtk.h"
 #include "imageio/imageio_common.h"
 #include "libs/colorpicker.h"
@@ -165,18 +167,32 @@ void dt_print_pipe_ext(const char *title,
                vtit, dev, pname, vmod, order, roi, roo, masking, vbuf);
 }
 
+// set by the threads of a parallel export for their own pipes
+static __thread int _export_concurrency = 0;
+
+void dt_dev_pixelpipe_set_export_concurrency(const int pipes)
+{
+  _export_concurrency = pipes;
+}
+
 gboolean dt_dev_pixelpipe_init_export(dt_dev_pixelpipe_t *pipe,
                                       const int32_t width,
                                       const int32_t height,
                                       const int levels,
-                                      const gboolean store_masks)
+                                      const gboolean store_masks,
+                                      const int outputs)
 {
+  // several outputs need cachelines for the colorout and finalscale
+  // inputs plus some to work with
+  const gboolean branched = outputs > 1;
   const gboolean res =
     dt_dev_pixelpipe_init_cached(pipe, sizeof(float) * 4 * width * height,
-                                 DT_PIPECACHE_MIN, 0);
+                                 branched ? DT_PIPECACHE_MIN + 4 : DT_PIPECACHE_MIN, 0);
   pipe->type = DT_DEV_PIXELPIPE_EXPORT;
   pipe->levels = levels;
   pipe->store_all_raster_masks = store_masks;
+  pipe->keep_branch_inputs = branched;
+  pipe->concurrent = _export_concurrency;
   return res;
 }
 
@@ -253,6 +269,7 @@ gboolean dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe,
 
   memset(&pipe->scharr, 0, sizeof(dt_dev_detail_mask_t));
   pipe->want_detail_mask = FALSE;
+  memset(&pipe->dirty, 0, sizeof(dt_dev_pixelpipe_dirty_t));
 
   pipe->processing = FALSE;
   dt_atomic_set_int(&pipe->shutdown, DT_DEV_PIXELPIPE_STOP_NO);
@@ -272,10 +289,15 @@ gboolean dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe,
   pipe->iop_order_list = NULL;
   pipe->forms = NULL;
   pipe->store_all_raster_masks = FALSE;
+  pipe->keep_branch_inputs = FALSE;
+  pipe->concurrent = 0;
   pipe->work_profile_info = NULL;
   pipe->input_profile_info = NULL;
   pipe->output_profile_info = NULL;
   pipe->runs = 0;
+  pipe->average_delay = DT_DEV_AVERAGE_DELAY_START;
+  pipe->first_delay = DT_DEV_AVERAGE_DELAY_START;
+  pipe->coarse = FALSE;
   pipe->bcache_data = NULL;
   pipe->bcache_hash = DT_INVALID_HASH;
   return dt_dev_pixelpipe_cache_init(pipe, entries, size, memlimit);
@@ -283,7 +305,8 @@ gboolean dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe,
 
 size_t dt_get_available_pipe_mem(const dt_dev_pixelpipe_t *pipe)
 {
-  size_t allmem = dt_get_available_mem();
+  // concurrent pipes (parallel exports) split the budget
+  const size_t allmem = dt_get_available_mem() / MAX(1, pipe->concurrent);
   return MAX(1lu * 1024lu * 1024lu,
              allmem / (pipe->type & DT_DEV_PIXELPIPE_THUMBNAIL ? 3 : 1));
 }
@@ -319,6 +342,7 @@ void dt_dev_pixelpipe_set_input(dt_dev_pixelpipe_t *pipe,
   pipe->input = input;
   pipe->image = dev->image_storage;
   get_output_format(NULL, pipe, NULL, dev, &pipe->dsc);
+  dt_dev_pixelpipe_cache_disk_source(pipe);
 }
 
 void dt_dev_pixelpipe_set_icc(dt_dev_pixelpipe_t *pipe,
@@ -386,6 +410,8 @@ void dt_dev_pixelpipe_cleanup_nodes(dt_dev_pixelpipe_t *pipe)
     piece->histogram = NULL;
     g_hash_table_destroy(piece->raster_masks);
     piece->raster_masks = NULL;
+    if(piece->inc_shapes) g_hash_table_destroy(piece->inc_shapes);
+    piece->inc_shapes = NULL;
     free(piece);
   }
   g_list_free(pipe->nodes);
@@ -452,6 +478,7 @@ void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe,
     piece->pipe = pipe;
     piece->data = NULL;
     piece->hash = DT_INVALID_HASH;
+    piece->inc_hash = DT_INVALID_HASH;
     piece->process_cl_ready = FALSE;
     piece->process_tiling_ready = FALSE;
     piece->raster_masks = g_hash_table_new_full(g_direct_hash,
@@ -1243,6 +1270,12 @@ static gboolean _pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe,
   if(dt_pipe_shutdown(pipe))
     return TRUE;
 
+#ifdef _OPENMP
+  // size the module's OpenMP team by the current core budget of the pipe,
+  // a background pipe shrinks while darkroom pipes are running
+  omp_set_num_threads(dt_thread_budget_available(darktable.thread_budget));
+#endif
+
   // the data buffers must always have an alignment to DT_CACHELINE_BYTES
   if(!dt_check_aligned(input) || !dt_check_aligned(*output))
   {
@@ -1526,6 +1559,366 @@ static inline gboolean _skip_piece_on_tags(const dt_dev_pixelpipe_iop_t *piece)
           && (piece->pipe->type & DT_DEV_PIXELPIPE_BASIC);
 }
 
+// the input of colorout and finalscale is where the outputs of a
+// multi-output export branch off
+static inline gboolean _keep_branch_input(const dt_dev_pixelpipe_t *pipe,
+                                          const dt_iop_module_t *module)
+{
+  return pipe->keep_branch_inputs
+    && pipe->mask_display == DT_DEV_PIXELPIPE_DISPLAY_NONE
+    && module
+    && (dt_iop_module_is(module->so, "colorout")
+        || dt_iop_module_is(module->so, "finalscale"));
+}
+
+/* Incremental processing
+
+  Moving a drawn shape only changes the blend mask of its module around the
+  old and new position of the shape. Each piece remembers the state of its
+  last processing: the cachelines of input and output and the drawn shapes it
+  blended with. When it is processed again and its input and params are the
+  same except for some shapes, its new output only differs from the old
+  cacheline inside the area of those shapes. pipe->dirty passes this area on
+  to the next module, local modules which allow tiling only spread a change
+  of their input by their tiling overlap.
+
+  If the old output is still in the cache, the piece copies it and reprocesses
+  a crop of the dirty area only, on the CPU, patching the result into the copy.
+*/
+
+typedef struct _inc_shape_t
+{
+  dt_hash_t hash;
+  int x, y, width, height; // area in pixels of the pipe input
+} _inc_shape_t;
+
+static inline gboolean _dirty_empty(const dt_dev_pixelpipe_dirty_t *d)
+{
+  return d->width <= 0 || d->height <= 0;
+}
+
+static void _dirty_add(dt_dev_pixelpipe_dirty_t *d,
+                       const int x,
+                       const int y,
+                       const int width,
+                       const int height)
+{
+  if(width <= 0 || height <= 0) return;
+  if(_dirty_empty(d))
+  {
+    d->x = x;
+    d->y = y;
+    d->width = width;
+    d->height = height;
+    return;
+  }
+  const int x1 = MAX(d->x + d->width, x + width);
+  const int y1 = MAX(d->y + d->height, y + height);
+  d->x = MIN(d->x, x);
+  d->y = MIN(d->y, y);
+  d->width = x1 - d->x;
+  d->height = y1 - d->y;
+}
+
+static void _dirty_grow(dt_dev_pixelpipe_dirty_t *d,
+                        const int margin,
+                        const dt_iop_roi_t *roi)
+{
+  if(_dirty_empty(d)) return;
+  const int x0 = MAX(0, d->x - margin);
+  const int y0 = MAX(0, d->y - margin);
+  const int x1 = MIN(roi->width, d->x + d->width + margin);
+  const int y1 = MIN(roi->height, d->y + d->height + margin);
+  d->x = x0;
+  d->y = y0;
+  d->width = x1 - x0;
+  d->height = y1 - y0;
+}
+
+// modules which compute each output pixel from its neighbourhood, like tiling expects
+static inline gboolean _piece_is_local(const dt_dev_pixelpipe_iop_t *piece)
+{
+  const dt_iop_module_t *module = piece->module;
+  return (module->flags() & IOP_FLAGS_ALLOW_TILING)
+    && !(module->flags() & IOP_FLAGS_TILING_FULL_ROI)
+    && !(module->operation_tags() & IOP_TAG_DISTORT);
+}
+
+// the piece renders the drawn shapes of its mask group into the blend mask only
+static inline gboolean _piece_blends_shapes(const dt_dev_pixelpipe_iop_t *piece)
+{
+  const dt_develop_blend_params_t *bp = piece->blendop_data;
+  return bp
+    && (bp->mask_mode & DEVELOP_MASK_ENABLED)
+    && (bp->mask_mode & DEVELOP_MASK_MASK)
+    && !(piece->module->flags() & IOP_FLAGS_NO_MASKS);
+}
+
+// how far the post processing of the blend mask spreads a change, in pixels of roi
+static int _blend_margin(const dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi)
+{
+  const dt_develop_blend_params_t *bp = piece->blendop_data;
+  if(!bp
+     || !(bp->mask_mode & DEVELOP_MASK_ENABLED)
+     || bp->mask_mode == DEVELOP_MASK_ENABLED)
+    return 0;
+
+  const float scale = roi->scale / piece->iscale;
+  int margin = 1;
+  // the guided filter uses two box filters of this width
+  if(bp->feathering_radius > 0.1f)
+    margin += 2 * MAX(1, (int)(2.0f * bp->feathering_radius * scale + 0.5f));
+  if(bp->blur_radius > 0.1f)
+    margin += (int)ceilf(4.0f * bp->blur_radius * scale);
+  return margin;
+}
+
+// collects hash and area of the drawn shapes the piece blends with, areas of
+// unchanged shapes are taken from the last processing if reuse is set.
+// returns NULL if a shape can't be located.
+static GHashTable *_piece_collect_shapes(dt_dev_pixelpipe_iop_t *piece,
+                                         const gboolean reuse)
+{
+  const dt_develop_blend_params_t *bp = piece->blendop_data;
+  dt_masks_form_t *grp = dt_masks_get_from_id_ext(piece->pipe->forms, bp->mask_id);
+  if(!grp || !(grp->type & DT_MASKS_GROUP)) return NULL;
+
+  GHashTable *shapes = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+  for(const GList *l = grp->points; l; l = g_list_next(l))
+  {
+    const dt_masks_point_group_t *grpt = l->data;
+    dt_masks_form_t *form = dt_masks_get_from_id_ext(piece->pipe->forms, grpt->formid);
+    if(!form || (form->type & DT_MASKS_GROUP))
+    {
+      g_hash_table_destroy(shapes);
+      return NULL;
+    }
+
+    dt_hash_t hash = dt_masks_group_hash(DT_INITHASH, form);
+    hash = dt_hash(hash, &grpt->state, sizeof(grpt->state));
+    hash = dt_hash(hash, &grpt->opacity, sizeof(grpt->opacity));
+
+    const _inc_shape_t *old = reuse && piece->inc_shapes
+      ? g_hash_table_lookup(piece->inc_shapes, GINT_TO_POINTER(form->formid))
+      : NULL;
+
+    _inc_shape_t *shape = g_new(_inc_shape_t, 1);
+    if(old && old->hash == hash)
+      *shape = *old;
+    else
+    {
+      shape->hash = hash;
+      if(!dt_masks_get_area(piece->module, piece, form,
+                            &shape->width, &shape->height, &shape->x, &shape->y))
+      {
+        g_free(shape);
+        g_hash_table_destroy(shapes);
+        return NULL;
+      }
+    }
+    g_hash_table_insert(shapes, GINT_TO_POINTER(form->formid), shape);
+  }
+  return shapes;
+}
+
+static void _dirty_add_shape(dt_dev_pixelpipe_dirty_t *d,
+                             const _inc_shape_t *shape,
+                             const dt_iop_roi_t *roi)
+{
+  const int x0 = floorf(shape->x * roi->scale) - roi->x;
+  const int y0 = floorf(shape->y * roi->scale) - roi->y;
+  const int x1 = ceilf((shape->x + shape->width) * roi->scale) - roi->x;
+  const int y1 = ceilf((shape->y + shape->height) * roi->scale) - roi->y;
+  // only the part inside the roi matters
+  const int cx0 = CLAMP(x0, 0, roi->width);
+  const int cy0 = CLAMP(y0, 0, roi->height);
+  const int cx1 = CLAMP(x1, 0, roi->width);
+  const int cy1 = CLAMP(y1, 0, roi->height);
+  _dirty_add(d, cx0, cy0, cx1 - cx0, cy1 - cy0);
+}
+
+// adds the areas of the shapes which changed between the tables, the old and
+// the new position of moved shapes and those which were added or removed
+static void _dirty_add_changed_shapes(dt_dev_pixelpipe_dirty_t *d,
+                                      GHashTable *old_shapes,
+                                      GHashTable *new_shapes,
+                                      const dt_iop_roi_t *roi)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, new_shapes);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+  {
+    const _inc_shape_t *shape = value;
+    const _inc_shape_t *old = g_hash_table_lookup(old_shapes, key);
+    if(!old || old->hash != shape->hash)
+    {
+      _dirty_add_shape(d, shape, roi);
+      if(old) _dirty_add_shape(d, old, roi);
+    }
+  }
+  g_hash_table_iter_init(&iter, old_shapes);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+  {
+    if(!g_hash_table_contains(new_shapes, key))
+      _dirty_add_shape(d, value, roi);
+  }
+}
+
+// can the piece be processed on a crop of its roi, with the rest taken from its old output?
+static gboolean _piece_may_patch(dt_dev_pixelpipe_t *pipe,
+                                 dt_develop_t *dev,
+                                 dt_dev_pixelpipe_iop_t *piece,
+                                 const void *cl_mem_input)
+{
+  dt_iop_module_t *module = piece->module;
+  const dt_develop_blend_params_t *bp = piece->blendop_data;
+  return !cl_mem_input
+    && _piece_is_local(piece)
+    && _piece_may_tile(piece)
+    && !(piece->request_histogram & DT_REQUEST_ON)
+    && !_request_color_pick(pipe, dev, module)
+    && !_piece_fast_blend(piece, module)
+    && !_keep_branch_input(pipe, module)
+    && !(bp && (bp->mask_mode & DEVELOP_MASK_ENABLED)
+         && ((bp->mask_mode & DEVELOP_MASK_RASTER) || bp->details != 0.0f))
+    && !pipe->store_all_raster_masks
+    && g_hash_table_size(module->raster_mask.source.users) == 0;
+}
+
+static void _copy_rect(void *dst,
+                       const int dst_width,
+                       const int dst_x,
+                       const int dst_y,
+                       const void *src,
+                       const int src_width,
+                       const int src_x,
+                       const int src_y,
+                       const int width,
+                       const int height,
+                       const size_t bpp)
+{
+  DT_OMP_FOR()
+  for(int j = 0; j < height; j++)
+    memcpy((char *)dst + bpp * ((size_t)(dst_y + j) * dst_width + dst_x),
+           (const char *)src + bpp * ((size_t)(src_y + j) * src_width + src_x),
+           bpp * width);
+}
+
+// takes the output from the old cacheline and reprocesses the dirty part of it,
+// falls back to processing everything if that isn't possible.
+static gboolean _pixelpipe_patch_on_CPU(dt_dev_pixelpipe_t *pipe,
+                                        dt_develop_t *dev,
+                                        float *input,
+                                        dt_iop_buffer_dsc_t *input_format,
+                                        const dt_iop_roi_t *roi_in,
+                                        void **output,
+                                        dt_iop_buffer_dsc_t **out_format,
+                                        const dt_iop_roi_t *roi_out,
+                                        dt_iop_module_t *module,
+                                        dt_dev_pixelpipe_iop_t *piece,
+                                        dt_develop_tiling_t *tiling,
+                                        dt_pixelpipe_flow_t *pixelpipe_flow,
+                                        const int position,
+                                        const void *old,
+                                        const dt_iop_buffer_dsc_t *old_format,
+                                        const dt_dev_pixelpipe_dirty_t *dirty,
+                                        const int spread)
+{
+  const size_t in_bpp = dt_iop_buffer_dsc_to_bpp(input_format);
+  const size_t bpp = dt_iop_buffer_dsc_to_bpp(*out_format);
+
+  // the crop needs the neighbourhood of the dirty pixels
+  dt_dev_pixelpipe_dirty_t crop = *dirty;
+  _dirty_grow(&crop, spread, roi_out);
+
+  dt_iop_roi_t roi = *roi_out;
+  roi.x += crop.x;
+  roi.y += crop.y;
+  roi.width = crop.width;
+  roi.height = crop.height;
+
+  void *in = _dirty_empty(dirty) ? NULL : dt_alloc_aligned(in_bpp * crop.width * crop.height);
+  void *out = _dirty_empty(dirty) ? NULL : dt_alloc_aligned(bpp * crop.width * crop.height);
+  gboolean patched = _dirty_empty(dirty);
+  if(in && out)
+  {
+    _copy_rect(in, crop.width, 0, 0, input, roi_in->width, crop.x, crop.y,
+               crop.width, crop.height, in_bpp);
+    // the cacheline of the input keeps its colorspace
+    dt_iop_buffer_dsc_t in_format = *input_format;
+    if(_pixelpipe_process_on_CPU(pipe, dev, in, &in_format, &roi, &out, out_format, &roi,
+                                 module, piece, tiling, pixelpipe_flow, position))
+    {
+      dt_free_align(in);
+      dt_free_align(out);
+      return TRUE;
+    }
+    patched = pipe->dsc.cst == old_format->cst;
+  }
+
+  if(patched)
+  {
+    dt_print_pipe(DT_DEBUG_PIPE,
+                  "patch", pipe, module, DT_DEVICE_CPU, roi_in, roi_out,
+                  "dirty %dx%d at %d,%d", dirty->width, dirty->height, dirty->x, dirty->y);
+    memcpy(*output, old, bpp * roi_out->width * roi_out->height);
+    if(!_dirty_empty(dirty))
+      _copy_rect(*output, roi_out->width, dirty->x, dirty->y,
+                 out, crop.width, dirty->x - crop.x, dirty->y - crop.y,
+                 dirty->width, dirty->height, bpp);
+    pipe->dsc.cst = old_format->cst;
+  }
+  dt_free_align(in);
+  dt_free_align(out);
+  if(patched) return dt_pipe_shutdown(pipe);
+
+  return _pixelpipe_process_on_CPU(pipe, dev, input, input_format, roi_in, output,
+                                   out_format, roi_out, module, piece, tiling,
+                                   pixelpipe_flow, position);
+}
+
+// start times are taken for -d perf and for --profile
+static inline void _get_times(dt_times_t *t)
+{
+  if(dt_dev_pixelpipe_profile_enabled())
+    dt_get_times(t);
+  else
+    dt_get_perf_times(t);
+}
+
+static void _profile_record(const dt_dev_pixelpipe_t *pipe,
+                            const dt_iop_module_t *module,
+                            const dt_dev_pixelpipe_profile_kind_t kind,
+                            const dt_iop_roi_t *roi,
+                            const dt_times_t *start,
+                            const size_t memory,
+                            const dt_pixelpipe_flow_t flow)
+{
+  if(!dt_dev_pixelpipe_profile_enabled()) return;
+
+  dt_times_t end;
+  dt_get_times(&end);
+  dt_dev_pixelpipe_profile_event_t event =
+    { .kind = kind,
+      .pipe = dt_dev_pixelpipe_type_to_str(pipe->type),
+      .imgid = pipe->image.id,
+      .width = roi->width,
+      .height = roi->height,
+      .start = start->clock,
+      .wall = end.clock - start->clock,
+      .cpu = end.user - start->user,
+      .memory = memory,
+      .tiling = (flow & PIXELPIPE_FLOW_PROCESSED_WITH_TILING) != 0,
+      .gpu = (flow & PIXELPIPE_FLOW_PROCESSED_ON_GPU) != 0 };
+  if(module)
+    snprintf(event.module, sizeof(event.module), "%s%s", module->op, dt_iop_get_instance_id(module));
+  else
+    g_strlcpy(event.module, kind == DT_DEV_PIXELPIPE_PROFILE_PIPE ? "pipe" : "input",
+              sizeof(event.module));
+  dt_dev_pixelpipe_profile_record(&event);
+}
+
 // recursive helper for process, returns TRUE in case of unfinished work or error
 static gboolean _dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
                                            dt_develop_t *dev,
@@ -1614,12 +2007,17 @@ static gboolean _dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
 
   if(cache_available)
   {
+    dt_times_t start;
+    _get_times(&start);
     dt_dev_pixelpipe_cache_get(pipe, hash, bufsize,
                                output, out_format, module, TRUE);
 
     if(dt_pipe_shutdown(pipe))
       return TRUE;
 
+    _profile_record(pipe, module, DT_DEV_PIXELPIPE_PROFILE_CACHE_HIT, roi_out, &start,
+                    bufsize, PIXELPIPE_FLOW_NONE);
+
     dt_print_pipe(DT_DEBUG_PIPE,
                   "pipe data: from cache",
                   pipe, module, DT_DEVICE_NONE, &roi_in, NULL);
@@ -1649,7 +2047,7 @@ static gboolean _dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
       return TRUE;
 
     dt_times_t start;
-    dt_get_perf_times(&start);
+    _get_times(&start);
 
     const gboolean aligned_input = dt_check_aligned(pipe->input);
     // we're looking for the full buffer
@@ -1730,6 +2128,8 @@ static gboolean _dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
 
     dt_show_times_f(&start, "[dev_pixelpipe]",
                     "initing base buffer [%s]", dt_dev_pixelpipe_type_to_str(pipe->type));
+    _profile_record(pipe, NULL, DT_DEV_PIXELPIPE_PROFILE_INPUT, roi_out, &start,
+                    *output == pipe->input ? 0 : bufsize, PIXELPIPE_FLOW_NONE);
 
     return dt_pipe_shutdown(pipe);
   }
@@ -1774,10 +2174,74 @@ static gboolean _dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
 
   const size_t out_bpp = dt_iop_buffer_dsc_to_bpp(*out_format);
 
-  // reserve new cache line: output
   if(dt_pipe_shutdown(pipe))
     return TRUE;
 
+  // find out what changed since the last processing of the piece,
+  // see "Incremental processing" above
+  const dt_hash_t input_hash = dt_dev_pixelpipe_cache_hash(&roi_in, pipe, pos - 1);
+  const dt_hash_t old_hash = piece->inc_hash;
+  const gboolean tracking = (pipe->type & DT_DEV_PIXELPIPE_BASIC)
+    && pipe->mask_display == DT_DEV_PIXELPIPE_DISPLAY_NONE
+    && !pipe->nocache
+    && !pipe->coarse;
+  const gboolean incremental = tracking
+    && old_hash != DT_INVALID_HASH
+    && old_hash != hash
+    && !memcmp(&piece->inc_roi, roi_out, sizeof(dt_iop_roi_t))
+    && !memcmp(&roi_in, roi_out, sizeof(dt_iop_roi_t));
+
+  dt_dev_pixelpipe_dirty_t input_dirty = { 0 };
+  gboolean known = incremental && input_hash == piece->inc_input_hash;
+  if(incremental
+     && !known
+     && pipe->dirty.to == input_hash
+     && pipe->dirty.from == piece->inc_input_hash
+     && _piece_is_local(piece))
+  {
+    known = TRUE;
+    input_dirty = pipe->dirty;
+  }
+
+  GHashTable *shapes = tracking && _piece_blends_shapes(piece)
+    ? _piece_collect_shapes(piece, known)
+    : NULL;
+
+  dt_dev_pixelpipe_dirty_t shapes_dirty = { 0 };
+  if(known && piece->hash != piece->inc_piece_hash)
+  {
+    // only a change of the drawn shapes can be located. retouch and spots
+    // render their own shapes (IOP_FLAGS_NO_MASKS) and keep per shape
+    // settings in their params, editing a stroke always reprocesses them.
+    const dt_develop_blend_params_t *bp = piece->blendop_data;
+    if(piece->params_hash != piece->inc_params_hash
+       || piece->params_hash == DT_INVALID_HASH
+       || (module->flags() & IOP_FLAGS_NO_MASKS))
+      known = FALSE;
+    else if(_piece_blends_shapes(piece))
+    {
+      if(shapes && piece->inc_shapes && bp->details == 0.0f)
+        _dirty_add_changed_shapes(&shapes_dirty, piece->inc_shapes, shapes, roi_out);
+      else
+        known = FALSE;
+    }
+  }
+
+  // protect the old output from being reused for the new one
+  const dt_iop_buffer_dsc_t *old_format = NULL;
+  const void *old_output = known && _piece_may_patch(pipe, dev, piece, cl_mem_input)
+    ? dt_dev_pixelpipe_cache_peek(pipe, old_hash, bufsize, &old_format)
+    : NULL;
+
+  // the state is only valid again if the processing finishes
+  if(tracking)
+  {
+    piece->inc_hash = DT_INVALID_HASH;
+    if(piece->inc_shapes) g_hash_table_destroy(piece->inc_shapes);
+    piece->inc_shapes = shapes;
+  }
+
+  // reserve new cache line: output
   const gboolean important = module
       && (pipe->mask_display == DT_DEV_PIXELPIPE_DISPLAY_NONE)
       && (((pipe->type & DT_DEV_PIXELPIPE_PREVIEW)
@@ -1794,7 +2258,9 @@ static gboolean _dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
   gboolean important_cl = FALSE;
 
   dt_times_t start;
-  dt_get_perf_times(&start);
+  _get_times(&start);
+  // processing time is always taken, the pipe cache uses it to weigh eviction
+  const double process_start = dt_get_wtime();
 
   dt_pixelpipe_flow_t pixelpipe_flow =
     (PIXELPIPE_FLOW_NONE | PIXELPIPE_FLOW_HISTOGRAM_NONE);
@@ -1874,6 +2340,19 @@ static gboolean _dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
 
   piece->module->position = pos;
 
+  // the dirty part of the output, the module spreads changes of its input
+  // by the overlap it needs for tiling
+  const int spread = tiling.overlap + _blend_margin(piece, roi_out);
+  dt_dev_pixelpipe_dirty_t dirty = input_dirty;
+  _dirty_grow(&dirty, spread, roi_out);
+  _dirty_grow(&shapes_dirty, _blend_margin(piece, roi_out), roi_out);
+  _dirty_add(&dirty, shapes_dirty.x, shapes_dirty.y, shapes_dirty.width, shapes_dirty.height);
+
+  // patching most of the output isn't worth it
+  if(old_output
+     && (size_t)dirty.width * dirty.height * 2 > (size_t)roi_out->width * roi_out->height)
+    old_output = NULL;
+
 #ifdef HAVE_OPENCL
 
   // Fetch RGB working profile
@@ -1884,8 +2363,9 @@ static gboolean _dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
     ? dt_ioppr_get_pipe_work_profile_info(pipe)
     : NULL;
 
-  /* do we have opencl at all? did user tell us to use it? did we get a resource? */
-  if(_opencl_pipe_isok(pipe))
+  /* do we have opencl at all? did user tell us to use it? did we get a resource?
+     patching the old output is done on the CPU */
+  if(_opencl_pipe_isok(pipe) && !old_output)
   {
     gboolean success_opencl = TRUE;
     dt_iop_colorspace_type_t input_cst_cl = input_format->cst;
@@ -2547,7 +3027,8 @@ static gboolean _dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
            && ((module == dt_dev_gui_module())
                 || darktable.develop->history_last_module == module
                 || dt_iop_module_is(module->so, "colorout")
-                || dt_iop_module_is(module->so, "finalscale"));
+                || dt_iop_module_is(module->so, "finalscale"))
+           || _keep_branch_input(pipe, module);
 
         if(important_cl)
         {
@@ -2687,15 +3168,25 @@ static gboolean _dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
     /* opencl is not inited or not enabled or we got no
      * resource/device -> everything runs on cpu */
 
-    if(_pixelpipe_process_on_CPU(pipe, dev, input, input_format, &roi_in,
+    if(old_output
+       ? _pixelpipe_patch_on_CPU(pipe, dev, input, input_format, &roi_in,
                                  output, out_format, roi_out,
-                                 module, piece, &tiling, &pixelpipe_flow, pos))
+                                 module, piece, &tiling, &pixelpipe_flow, pos,
+                                 old_output, old_format, &dirty, spread)
+       : _pixelpipe_process_on_CPU(pipe, dev, input, input_format, &roi_in,
+                                   output, out_format, roi_out,
+                                   module, piece, &tiling, &pixelpipe_flow, pos))
       return TRUE;
   }
 #else // HAVE_OPENCL
-  if(_pixelpipe_process_on_CPU(pipe, dev, input, input_format, &roi_in,
+  if(old_output
+     ? _pixelpipe_patch_on_CPU(pipe, dev, input, input_format, &roi_in,
                                output, out_format, roi_out,
-                               module, piece, &tiling, &pixelpipe_flow, pos))
+                               module, piece, &tiling, &pixelpipe_flow, pos,
+                               old_output, old_format, &dirty, spread)
+     : _pixelpipe_process_on_CPU(pipe, dev, input, input_format, &roi_in,
+                                 output, out_format, roi_out,
+                                 module, piece, &tiling, &pixelpipe_flow, pos))
     return TRUE;
 #endif // HAVE_OPENCL
 
@@ -2727,6 +3218,34 @@ static gboolean _dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
           ? "GPU"
           : pixelpipe_flow & PIXELPIPE_FLOW_BLENDED_ON_CPU ? "CPU" : "");
 
+  // the output and what the module says it needs next to it
+  const size_t working = tiling.factor
+    * MAX(roi_in.width, roi_out->width) * MAX(roi_in.height, roi_out->height)
+    * MAX(in_bpp, out_bpp) + tiling.overhead;
+  _profile_record(pipe, module, DT_DEV_PIXELPIPE_PROFILE_PROCESS, roi_out, &start,
+                  bufsize + working, pixelpipe_flow);
+
+  const float process_time = dt_get_wtime() - process_start;
+  dt_dev_pixelpipe_cache_set_cost(pipe, *output, process_time, module);
+
+  // remember the state for the next run and tell the next module what changed
+  if(tracking)
+  {
+    piece->inc_hash = hash;
+    piece->inc_input_hash = input_hash;
+    piece->inc_piece_hash = piece->hash;
+    piece->inc_params_hash = piece->params_hash;
+    piece->inc_roi = *roi_out;
+  }
+  if(known)
+  {
+    pipe->dirty = dirty;
+    pipe->dirty.from = old_hash;
+    pipe->dirty.to = hash;
+  }
+  else
+    memset(&pipe->dirty, 0, sizeof(pipe->dirty));
+
   // in case we get this buffer from the cache in the future, cache some stuff:
   **out_format = piece->dsc_out = pipe->dsc;
 
@@ -2767,6 +3286,19 @@ static gboolean _dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
     }
   }
 
+  // further outputs of a multi-output export restart from here
+  if(_keep_branch_input(pipe, module))
+    dt_dev_pixelpipe_important_cacheline(pipe, input,
+                                         roi_in.width * roi_in.height * in_bpp);
+
+  // expensive lines might be kept on disk for later sessions,
+  // only possible if the data is available on the host.
+#ifdef HAVE_OPENCL
+  if(*cl_mem_output == NULL)
+#endif
+    dt_dev_pixelpipe_cache_disk_store(pipe, hash, *output, bufsize, *out_format,
+                                      module, process_time);
+
   // warn on NaN or infinity
   if((darktable.unmuted & DT_DEBUG_NAN)
      && !dt_iop_module_is(module->so, "gamma"))
@@ -2985,6 +3517,12 @@ gboolean dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe,
   pipe->processing = TRUE;
   pipe->nocache = (pipe->type & DT_DEV_PIXELPIPE_IMAGE) != 0;
   pipe->runs++;
+  dt_times_t pipe_start;
+  _get_times(&pipe_start);
+  dt_thread_budget_enter(darktable.thread_budget,
+                         (pipe->type & DT_DEV_PIXELPIPE_SCREEN)
+                         ? DT_THREAD_BUDGET_PRIORITY_INTERACTIVE
+                         : DT_THREAD_BUDGET_PRIORITY_BACKGROUND);
   pipe->opencl_enabled = dt_opencl_running();
 
   // if devid is a valid CL device we don't lock it as the caller has done so already
@@ -3127,6 +3665,7 @@ restart:
   // ... and in case of other errors ...
   if(err)
   {
+    dt_thread_budget_leave(darktable.thread_budget);
     pipe->processing = FALSE;
     return TRUE;
   }
@@ -3167,7 +3706,10 @@ restart:
                 pipe, NULL, old_devid, &roi, &roi, "ID=%i",
                 pipe->image.id);
   dt_print_mem_usage("after pixelpipe process");
+  _profile_record(pipe, NULL, DT_DEV_PIXELPIPE_PROFILE_PIPE, &roi, &pipe_start,
+                  pipe->cache.allmem, PIXELPIPE_FLOW_NONE);
 
+  dt_thread_budget_leave(darktable.thread_budget);
   pipe->processing = FALSE;
   return FALSE;
 }
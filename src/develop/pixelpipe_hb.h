@@ -48,6 +48,7 @@ typedef struct dt_dev_pixelpipe_iop_t
   float iscale;                   // input actually just downscaled buffer? iscale*iwidth = actual width
   int iwidth, iheight;            // width and height of input buffer
   dt_hash_t hash;                 // hash of params and enabled.
+  dt_hash_t params_hash;          // same as hash but without the drawn shapes of the mask
   int bpc;                        // bits per channel, 32 means float
   int colors;                     // how many colors per pixel
   dt_iop_roi_t buf_in;            // theoretical full buffer regions of interest, as passed through modify_roi_out
@@ -62,6 +63,15 @@ typedef struct dt_dev_pixelpipe_iop_t
   dt_iop_buffer_dsc_t dsc_out;
 
   GHashTable *raster_masks;
+
+  // state of the last processing, used to reprocess only what a change
+  // of a drawn shape affects, see _dev_pixelpipe_process_rec()
+  dt_hash_t inc_hash;             // cacheline of the output
+  dt_hash_t inc_input_hash;       // cacheline of the input
+  dt_hash_t inc_piece_hash;       // hash and params_hash of the piece
+  dt_hash_t inc_params_hash;
+  dt_iop_roi_t inc_roi;
+  GHashTable *inc_shapes;         // formid -> hash and area of the drawn shapes
 } dt_dev_pixelpipe_iop_t;
 
 typedef enum dt_dev_pixelpipe_change_t
@@ -90,6 +100,14 @@ typedef enum dt_dev_pixelpipe_stopper_t
   DT_DEV_PIXELPIPE_STOP_LAST = 2,
 } dt_dev_pixelpipe_stopper_t;
 
+// the buffer of cacheline 'to' only differs from the one of cacheline 'from'
+// inside the rectangle, in pixels of the buffer
+typedef struct dt_dev_pixelpipe_dirty_t
+{
+  dt_hash_t from, to;
+  int x, y, width, height;
+} dt_dev_pixelpipe_dirty_t;
+
 typedef struct dt_dev_detail_mask_t
 {
   dt_iop_roi_t roi;
@@ -181,6 +199,10 @@ typedef struct dt_dev_pixelpipe_t
   // input data based on this timestamp:
   int input_timestamp;
   uint32_t average_delay;
+  // average time until a first, possibly coarse result is shown
+  uint32_t first_delay;
+  // rendering the coarse first result of a progressive run, see dt_dev_process_image_job()
+  gboolean coarse;
   dt_dev_pixelpipe_type_t type;
   // the final output pixel format this pixelpipe will be converted to
   dt_imageio_levels_t levels;
@@ -200,9 +222,16 @@ typedef struct dt_dev_pixelpipe_t
   GList *forms;
   // the masks generated in the pipe for later reusal are inside dt_dev_pixelpipe_iop_t
   gboolean store_all_raster_masks;
+  // exports with several outputs keep the inputs of colorout and finalscale
+  // in the cache, further outputs only reprocess the pipe from there.
+  gboolean keep_branch_inputs;
+  // export pipes running in parallel share the memory, 0 for a pipe of its own
+  int concurrent;
   // module blending cache
   float *bcache_data;
   dt_hash_t bcache_hash;
+  // what changed in the output of the last processed module
+  dt_dev_pixelpipe_dirty_t dirty;
 } dt_dev_pixelpipe_t;
 
 struct dt_develop_t;
@@ -226,7 +255,11 @@ gboolean dt_dev_pixelpipe_init_export(dt_dev_pixelpipe_t *pipe,
                                       const int32_t width,
                                       const int32_t height,
                                       const int levels,
-                                      const gboolean store_masks);
+                                      const gboolean store_masks,
+                                      const int outputs);
+// export pipes initialized by the calling thread from now on share the memory
+// with the other pipes of a parallel export, 0 for none
+void dt_dev_pixelpipe_set_export_concurrency(const int pipes);
 // inits the pixelpipe with settings optimized for thumbnail export
 // (no history stack cache)
 gboolean dt_dev_pixelpipe_init_thumbnail(dt_dev_pixelpipe_t *pipe,
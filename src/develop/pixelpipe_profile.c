@@ -0,0 +1,227 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/pixelpipe_profile.h"
+
+// keep a long batch export from eating all memory, an event takes ~150 bytes
+#define DT_PROFILE_MAX_EVENTS (1 << 20)
+
+typedef struct _profile_event_t
+{
+  dt_dev_pixelpipe_profile_event_t event;
+  int tid;
+} _profile_event_t;
+
+// statistics of one module in one pipe type
+typedef struct _profile_stats_t
+{
+  const char *pipe;
+  const char *module;
+  int runs;
+  int cache_hits;
+  int tiled;
+  double wall;
+  double cpu;
+  size_t max_memory;
+} _profile_stats_t;
+
+static GMutex _lock;
+static GArray *_events = NULL;
+static size_t _dropped = 0;
+static gint _threads = 0;
+
+// trace viewers want a small number per thread
+static __thread int _tid = 0;
+
+static const char *_kind_name[] = { "pipe", "input", "process", "cache" };
+
+void dt_dev_pixelpipe_profile_record(const dt_dev_pixelpipe_profile_event_t *event)
+{
+  if(_tid == 0) _tid = g_atomic_int_add(&_threads, 1) + 1;
+  const _profile_event_t e = { .event = *event, .tid = _tid };
+
+  g_mutex_lock(&_lock);
+  if(!_events) _events = g_array_new(FALSE, FALSE, sizeof(_profile_event_t));
+  if(_events->len < DT_PROFILE_MAX_EVENTS)
+    g_array_append_val(_events, e);
+  else
+    _dropped++;
+  g_mutex_unlock(&_lock);
+}
+
+static void _add_trace_event(JsonBuilder *builder, const _profile_event_t *e)
+{
+  const dt_dev_pixelpipe_profile_event_t *ev = &e->event;
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "name");
+  json_builder_add_string_value(builder, ev->module);
+  json_builder_set_member_name(builder, "cat");
+  json_builder_add_string_value(builder, _kind_name[ev->kind]);
+  json_builder_set_member_name(builder, "ph");
+  json_builder_add_string_value(builder, "X");
+  json_builder_set_member_name(builder, "ts");
+  json_builder_add_double_value(builder, 1e6 * (ev->start - darktable.start_wtime));
+  json_builder_set_member_name(builder, "dur");
+  json_builder_add_double_value(builder, 1e6 * ev->wall);
+  json_builder_set_member_name(builder, "pid");
+  json_builder_add_int_value(builder, 1);
+  json_builder_set_member_name(builder, "tid");
+  json_builder_add_int_value(builder, e->tid);
+
+  json_builder_set_member_name(builder, "args");
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "pipe");
+  json_builder_add_string_value(builder, ev->pipe);
+  json_builder_set_member_name(builder, "imgid");
+  json_builder_add_int_value(builder, ev->imgid);
+  json_builder_set_member_name(builder, "width");
+  json_builder_add_int_value(builder, ev->width);
+  json_builder_set_member_name(builder, "height");
+  json_builder_add_int_value(builder, ev->height);
+  json_builder_set_member_name(builder, "cpu_ms");
+  json_builder_add_double_value(builder, 1e3 * ev->cpu);
+  json_builder_set_member_name(builder, "memory");
+  json_builder_add_int_value(builder, ev->memory);
+  if(ev->kind == DT_DEV_PIXELPIPE_PROFILE_PROCESS)
+  {
+    json_builder_set_member_name(builder, "device");
+    json_builder_add_string_value(builder, ev->gpu ? "GPU" : "CPU");
+    json_builder_set_member_name(builder, "tiling");
+    json_builder_add_boolean_value(builder, ev->tiling);
+  }
+  json_builder_end_object(builder);
+
+  json_builder_end_object(builder);
+}
+
+static void _add_stats(JsonBuilder *builder, const _profile_stats_t *s)
+{
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "pipe");
+  json_builder_add_string_value(builder, s->pipe);
+  json_builder_set_member_name(builder, "module");
+  json_builder_add_string_value(builder, s->module);
+  json_builder_set_member_name(builder, "runs");
+  json_builder_add_int_value(builder, s->runs);
+  json_builder_set_member_name(builder, "cache_hits");
+  json_builder_add_int_value(builder, s->cache_hits);
+  json_builder_set_member_name(builder, "tiled");
+  json_builder_add_int_value(builder, s->tiled);
+  json_builder_set_member_name(builder, "wall_ms");
+  json_builder_add_double_value(builder, 1e3 * s->wall);
+  json_builder_set_member_name(builder, "cpu_ms");
+  json_builder_add_double_value(builder, 1e3 * s->cpu);
+  json_builder_set_member_name(builder, "max_memory");
+  json_builder_add_int_value(builder, s->max_memory);
+  json_builder_end_object(builder);
+}
+
+gboolean dt_dev_pixelpipe_profile_write(const char *filename)
+{
+  if(!filename) return TRUE;
+
+  JsonBuilder *builder = json_builder_new();
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "displayTimeUnit");
+  json_builder_add_string_value(builder, "ms");
+
+  // statistics per pipe type and module, in the order of their first run
+  GHashTable *index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  GPtrArray *stats = g_ptr_array_new_with_free_func(g_free);
+
+  g_mutex_lock(&_lock);
+  const guint count = _events ? _events->len : 0;
+
+  json_builder_set_member_name(builder, "traceEvents");
+  json_builder_begin_array(builder);
+  for(guint k = 0; k < count; k++)
+  {
+    const _profile_event_t *e = &g_array_index(_events, _profile_event_t, k);
+    const dt_dev_pixelpipe_profile_event_t *ev = &e->event;
+    _add_trace_event(builder, e);
+
+    gchar *key = g_strdup_printf("%s\t%s", ev->pipe, ev->module);
+    _profile_stats_t *s = g_hash_table_lookup(index, key);
+    if(!s)
+    {
+      s = g_new0(_profile_stats_t, 1);
+      s->pipe = ev->pipe;
+      s->module = ev->module;
+      g_ptr_array_add(stats, s);
+      g_hash_table_insert(index, key, s);
+    }
+    else
+      g_free(key);
+
+    s->runs++;
+    if(ev->kind == DT_DEV_PIXELPIPE_PROFILE_CACHE_HIT) s->cache_hits++;
+    if(ev->tiling) s->tiled++;
+    s->wall += ev->wall;
+    s->cpu += ev->cpu;
+    s->max_memory = MAX(s->max_memory, ev->memory);
+  }
+  json_builder_end_array(builder);
+
+  json_builder_set_member_name(builder, "modules");
+  json_builder_begin_array(builder);
+  for(guint k = 0; k < stats->len; k++)
+    _add_stats(builder, g_ptr_array_index(stats, k));
+  json_builder_end_array(builder);
+
+  json_builder_set_member_name(builder, "dropped");
+  json_builder_add_int_value(builder, _dropped);
+  g_mutex_unlock(&_lock);
+
+  json_builder_end_object(builder);
+
+  JsonGenerator *generator = json_generator_new();
+  JsonNode *root = json_builder_get_root(builder);
+  json_generator_set_root(generator, root);
+  GError *error = NULL;
+  const gboolean failed = !json_generator_to_file(generator, filename, &error);
+  if(failed)
+  {
+    dt_print(DT_DEBUG_ALWAYS, "[pixelpipe profile] can't write %s: %s",
+             filename, error ? error->message : "unknown error");
+    g_clear_error(&error);
+  }
+  else
+    dt_print(DT_DEBUG_PERF, "[pixelpipe profile] %u events written to %s", count, filename);
+
+  json_node_free(root);
+  g_object_unref(generator);
+  g_object_unref(builder);
+  g_ptr_array_free(stats, TRUE);
+  g_hash_table_destroy(index);
+  return failed;
+}
+
+void dt_dev_pixelpipe_profile_cleanup(void)
+{
+  g_mutex_lock(&_lock);
+  if(_events) g_array_free(_events, TRUE);
+  _events = NULL;
+  _dropped = 0;
+  g_mutex_unlock(&_lock);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,81 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/darktable.h"
+
+G_BEGIN_DECLS
+
+/**
+ * structured profile of the pixelpipe runs.
+ *
+ * with --profile FILE every module run of every pipe is recorded with its
+ * wall and CPU time, the memory it needs, the cache result and the tiling
+ * decision. the file is written when darktable quits, as a Chrome trace
+ * (load it in chrome://tracing or ui.perfetto.dev) whose "modules" member
+ * holds the statistics per pipe type and module for scripts comparing
+ * runs. trace viewers ignore that member.
+ *
+ * the CPU time is the one of the whole process, it includes the work of
+ * other pipes running at the same time.
+ */
+
+typedef enum dt_dev_pixelpipe_profile_kind_t
+{
+  DT_DEV_PIXELPIPE_PROFILE_PIPE = 0,   // a whole run of the pipe
+  DT_DEV_PIXELPIPE_PROFILE_INPUT,      // preparing the input buffer
+  DT_DEV_PIXELPIPE_PROFILE_PROCESS,    // a module processed its input
+  DT_DEV_PIXELPIPE_PROFILE_CACHE_HIT,  // a module output was taken from the cache
+} dt_dev_pixelpipe_profile_kind_t;
+
+typedef struct dt_dev_pixelpipe_profile_event_t
+{
+  dt_dev_pixelpipe_profile_kind_t kind;
+  const char *pipe;    // static name of the pipe type
+  char module[64];     // operation and instance name
+  dt_imgid_t imgid;
+  int width, height;   // of the output
+  double start;        // wall time in seconds
+  double wall;         // seconds
+  double cpu;          // seconds
+  size_t memory;       // output buffer plus the working memory of the module
+  gboolean tiling;
+  gboolean gpu;
+} dt_dev_pixelpipe_profile_event_t;
+
+static inline gboolean dt_dev_pixelpipe_profile_enabled(void)
+{
+  return darktable.profile_file != NULL;
+}
+
+/** keeps a copy of the event, thread safe. */
+void dt_dev_pixelpipe_profile_record(const dt_dev_pixelpipe_profile_event_t *event);
+
+/** writes the events recorded so far, returns TRUE on error. */
+gboolean dt_dev_pixelpipe_profile_write(const char *filename);
+
+void dt_dev_pixelpipe_profile_cleanup(void);
+
+G_END_DECLS
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
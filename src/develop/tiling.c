@@ -18,6 +18,7 @@
 
 #include "develop/tiling.h"
 #include "common/opencl.h"
+#include "common/outofcore.h"
 #include "control/control.h"
 #include "develop/blend.h"
 #include "develop/pixelpipe.h"
@@ -563,6 +564,212 @@ static int _fit_output_to_input_roi(dt_iop_module_t *self,
 }
 
 
+/* modules flagged IOP_FLAGS_TILING_PARALLEL get several tiles processed at the same time,
+   each by a slice of the threads of at least DT_TILING_MIN_THREADS and with its own tile
+   buffers. the tiles are made smaller accordingly, so all of them together stay within
+   the memory a single tile could use. */
+#define DT_TILING_MIN_THREADS 4
+#define DT_TILING_MAX_PARALLEL 8
+
+typedef struct _tiling_tile_t
+{
+  dt_iop_roi_t iroi; // input of process()
+  dt_iop_roi_t oroi; // output of process()
+  dt_iop_roi_t good; // part of oroi stored into the output buffer
+} _tiling_tile_t;
+
+/* number of tiles to process at the same time, as long as the smaller tiles are not
+   dominated by their overlap */
+static int _parallel_tiles(dt_iop_module_t *self,
+                           const float singlebuffer,
+                           const float max_bpp,
+                           const float maxbuf,
+                           const int overlap)
+{
+  int parallel = 1;
+#ifdef _OPENMP
+  if(self->flags() & IOP_FLAGS_TILING_PARALLEL)
+    parallel = CLAMP(omp_get_max_threads() / DT_TILING_MIN_THREADS, 1, DT_TILING_MAX_PARALLEL);
+#endif
+  const float min_side = 8.0f * overlap + 256.0f;
+  while(parallel > 1 && singlebuffer / parallel / (max_bpp * maxbuf) < min_side * min_side)
+    parallel--;
+  return parallel;
+}
+
+static void _tile_process(dt_iop_module_t *self,
+                          dt_dev_pixelpipe_iop_t *piece,
+                          const void *const ivoid,
+                          void *const ovoid,
+                          const dt_iop_roi_t *const roi_in,
+                          const dt_iop_roi_t *const roi_out,
+                          const int in_bpp,
+                          const int out_bpp,
+                          const _tiling_tile_t *tile,
+                          void *input,
+                          void *output)
+{
+  const size_t ipitch = (size_t)roi_in->width * in_bpp;
+  const size_t opitch = (size_t)roi_out->width * out_bpp;
+  const dt_iop_roi_t *iroi = &tile->iroi;
+  const dt_iop_roi_t *oroi = &tile->oroi;
+  const dt_iop_roi_t *good = &tile->good;
+
+  /* offsets of tile into ivoid and ovoid */
+  const size_t ioffs = ((size_t)iroi->y - roi_in->y) * ipitch + ((size_t)iroi->x - roi_in->x) * in_bpp;
+  const size_t ooffs = ((size_t)good->y - roi_out->y) * opitch + ((size_t)good->x - roi_out->x) * out_bpp;
+
+  /* rows of ivoid and ovoid covered by the tile, for buffers mapped from disk */
+  const size_t isize = iroi->height > 0 ? (iroi->height - 1) * ipitch + (size_t)iroi->width * in_bpp : 0;
+  const size_t osize = good->height > 0 ? (good->height - 1) * opitch + (size_t)good->width * out_bpp : 0;
+  const gboolean imapped = dt_dev_pixelpipe_cache_mapped(piece->pipe, ivoid);
+  const gboolean omapped = dt_dev_pixelpipe_cache_mapped(piece->pipe, ovoid);
+
+  /* prepare input tile buffer */
+  dt_outofcore_advise(ivoid, imapped, ioffs, isize, DT_OUTOFCORE_WILLNEED);
+  DT_OMP_FOR()
+  for(size_t j = 0; j < iroi->height; j++)
+    memcpy((char *)input + j * iroi->width * in_bpp, (char *)ivoid + ioffs + j * ipitch,
+           (size_t)iroi->width * in_bpp);
+  dt_outofcore_advise(ivoid, imapped, ioffs, isize, DT_OUTOFCORE_DONTNEED);
+
+  /* call process() of module */
+  self->process(self, piece, input, output, iroi, oroi);
+
+  /* copy "good" part of tile to output buffer */
+  const size_t origin_x = good->x - oroi->x;
+  const size_t origin_y = good->y - oroi->y;
+  DT_OMP_FOR()
+  for(size_t j = 0; j < good->height; j++)
+    memcpy((char *)ovoid + ooffs + j * opitch,
+           (char *)output + ((j + origin_y) * oroi->width + origin_x) * out_bpp,
+           (size_t)good->width * out_bpp);
+
+  /* written back to disk on demand, keeps the resident memory at a few tiles */
+  dt_outofcore_advise(ovoid, omapped, ooffs, osize, DT_OUTOFCORE_DONTNEED);
+}
+
+/* processes the tiles, up to parallel of them at the same time. returns FALSE if
+   not even the buffers for one tile could be allocated. */
+static gboolean _process_tiles(dt_iop_module_t *self,
+                               dt_dev_pixelpipe_iop_t *piece,
+                               const void *const ivoid,
+                               void *const ovoid,
+                               const dt_iop_roi_t *const roi_in,
+                               const dt_iop_roi_t *const roi_out,
+                               const int in_bpp,
+                               const int out_bpp,
+                               const _tiling_tile_t *tiles,
+                               const int num_tiles,
+                               int parallel,
+                               const char *label)
+{
+  size_t isize = 0, osize = 0;
+  for(int t = 0; t < num_tiles; t++)
+  {
+    isize = MAX(isize, (size_t)tiles[t].iroi.width * tiles[t].iroi.height * in_bpp);
+    osize = MAX(osize, (size_t)tiles[t].oroi.width * tiles[t].oroi.height * out_bpp);
+  }
+
+  /* reserve input and output buffers for the tiles processed at the same time */
+  void *input[DT_TILING_MAX_PARALLEL] = { NULL };
+  void *output[DT_TILING_MAX_PARALLEL] = { NULL };
+  parallel = CLAMP(MIN(parallel, num_tiles), 1, DT_TILING_MAX_PARALLEL);
+  int buffers = 0;
+  for(; buffers < parallel; buffers++)
+  {
+    input[buffers] = dt_alloc_aligned(isize);
+    output[buffers] = dt_alloc_aligned(osize);
+    if(!input[buffers] || !output[buffers])
+    {
+      dt_free_align(input[buffers]);
+      dt_free_align(output[buffers]);
+      break;
+    }
+  }
+  if(buffers == 0)
+  {
+    dt_print(DT_DEBUG_TILING,
+             "[%s] [%s] could not alloc tile buffers for module '%s%s'",
+             label, dt_dev_pixelpipe_type_to_str(piece->pipe->type), self->op, dt_iop_get_instance_id(self));
+    return FALSE;
+  }
+  parallel = buffers;
+
+  piece->pipe->tiling = TRUE;
+
+  if(parallel == 1)
+  {
+    /* store processed_maximum to be re-used and aggregated */
+    dt_aligned_pixel_t processed_maximum_saved;
+    dt_aligned_pixel_t processed_maximum_new = { 1.0f };
+    for_four_channels(k) processed_maximum_saved[k] = piece->pipe->dsc.processed_maximum[k];
+
+    for(int t = 0; t < num_tiles; t++)
+    {
+      dt_print(DT_DEBUG_TILING,
+               "[%s] [%s] process tile %d size %dx%d at origin [%d,%d]",
+               label, dt_dev_pixelpipe_type_to_str(piece->pipe->type), t,
+               tiles[t].iroi.width, tiles[t].iroi.height, tiles[t].iroi.x, tiles[t].iroi.y);
+
+      /* take original processed_maximum as starting point */
+      for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
+
+      _tile_process(self, piece, ivoid, ovoid, roi_in, roi_out, in_bpp, out_bpp,
+                    &tiles[t], input[0], output[0]);
+
+      /* aggregate resulting processed_maximum */
+      /* TODO: check if there really can be differences between tiles and take
+               appropriate action (calculate minimum, maximum, average, ...?) */
+      for(int k = 0; k < 4; k++)
+      {
+        if(t > 0 && fabs(processed_maximum_new[k] - piece->pipe->dsc.processed_maximum[k]) > 1.0e-6f)
+          dt_print(DT_DEBUG_TILING,
+                   "[%s] [%s] processed_maximum[%d] differs between tiles in module '%s%s'",
+                   label, dt_dev_pixelpipe_type_to_str(piece->pipe->type), k,
+                   self->op, dt_iop_get_instance_id(self));
+        processed_maximum_new[k] = piece->pipe->dsc.processed_maximum[k];
+      }
+    }
+
+    /* copy back final processed_maximum */
+    for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
+  }
+#ifdef _OPENMP
+  else
+  {
+    /* modules allowing parallel tiles leave processed_maximum alone */
+    const int slice = MAX(1, omp_get_max_threads() / parallel);
+    const int max_levels = omp_get_max_active_levels();
+    omp_set_max_active_levels(MAX(max_levels, 2));
+
+    dt_print(DT_DEBUG_TILING,
+             "[%s] [%s] %d tiles of module '%s%s' at the same time with %d threads each",
+             label, dt_dev_pixelpipe_type_to_str(piece->pipe->type), parallel,
+             self->op, dt_iop_get_instance_id(self), slice);
+
+    DT_OMP_PRAGMA(parallel for schedule(dynamic, 1) num_threads(parallel) default(shared))
+    for(int t = 0; t < num_tiles; t++)
+    {
+      const int thread = omp_get_thread_num();
+      omp_set_num_threads(slice);
+      _tile_process(self, piece, ivoid, ovoid, roi_in, roi_out, in_bpp, out_bpp,
+                    &tiles[t], input[thread], output[thread]);
+    }
+
+    omp_set_max_active_levels(max_levels);
+  }
+#endif
+
+  for(int k = 0; k < buffers; k++)
+  {
+    dt_free_align(input[k]);
+    dt_free_align(output[k]);
+  }
+  piece->pipe->tiling = FALSE;
+  return TRUE;
+}
+
 /* simple tiling algorithm for roi_in == roi_out, i.e. for pixel to pixel modules/operations */
 static void _default_process_tiling_ptp(dt_iop_module_t *self,
                                         dt_dev_pixelpipe_iop_t *piece,
@@ -572,15 +779,12 @@ static void _default_process_tiling_ptp(dt_iop_module_t *self,
                                         const dt_iop_roi_t *const roi_out,
                                         const int in_bpp)
 {
-  void *input = NULL;
-  void *output = NULL;
+  _tiling_tile_t *tiles = NULL;
 
   dt_iop_buffer_dsc_t dsc;
   self->output_format(self, piece->pipe, piece, &dsc);
   const int out_bpp = dt_iop_buffer_dsc_to_bpp(&dsc);
 
-  const int ipitch = roi_in->width * in_bpp;
-  const int opitch = roi_out->width * out_bpp;
   const int max_bpp = MAX(in_bpp, out_bpp);
 
   /* get tiling requirements of module */
@@ -618,6 +822,10 @@ static void _default_process_tiling_ptp(dt_iop_module_t *self,
   const float maxbuf = fmaxf(tiling.maxbuf, 1.0f);
   singlebuffer = fmaxf(available / factor, singlebuffer);
 
+  /* share it among the tiles processed at the same time */
+  const int parallel = _parallel_tiles(self, singlebuffer, max_bpp, maxbuf, tiling.overlap);
+  singlebuffer /= parallel;
+
   int width = roi_in->width;
   int height = roi_in->height;
 
@@ -695,116 +903,65 @@ static void _default_process_tiling_ptp(dt_iop_module_t *self,
            "[default_process_tiling_ptp] [%s] (%dx%d) tiles with max dimensions %dx%d and overlap %d",
            dt_dev_pixelpipe_type_to_str(piece->pipe->type), tiles_x, tiles_y, width, height, overlap);
 
-  /* reserve input and output buffers for tiles */
-  input = dt_alloc_aligned((size_t)width * height * in_bpp);
-  if(input == NULL)
-  {
-    dt_print(DT_DEBUG_TILING,
-             "[default_process_tiling_ptp] [%s] could not alloc input buffer for module '%s%s'",
-             dt_dev_pixelpipe_type_to_str(piece->pipe->type), self->op, dt_iop_get_instance_id(self));
-    goto error;
-  }
-  output = dt_alloc_aligned((size_t)width * height * out_bpp);
-  if(output == NULL)
+  tiles = g_try_malloc_n((size_t)tiles_x * tiles_y, sizeof(_tiling_tile_t));
+  if(tiles == NULL)
   {
     dt_print(DT_DEBUG_TILING,
-             "[default_process_tiling_ptp] [%s]  could not alloc output buffer for module '%s%s'",
+             "[default_process_tiling_ptp] [%s] could not alloc tiles for module '%s%s'",
              dt_dev_pixelpipe_type_to_str(piece->pipe->type), self->op, dt_iop_get_instance_id(self));
     goto error;
   }
 
-  /* store processed_maximum to be re-used and aggregated */
-  dt_aligned_pixel_t processed_maximum_saved;
-  dt_aligned_pixel_t processed_maximum_new = { 1.0f };
-  for_four_channels(k) processed_maximum_saved[k] = piece->pipe->dsc.processed_maximum[k];
-
   dt_print_pipe(DT_DEBUG_PIPE | DT_DEBUG_TILING,
                         "process *tiled* ptp", piece->pipe, piece->module, DT_DEVICE_CPU, roi_in, roi_out,
                         "%dx%d tiles, size=%dx%d",
                         tiles_x, tiles_y, tile_wd, tile_ht);
 
-  /* iterate over tiles */
+  /* collect the tiles */
+  int num_tiles = 0;
   for(size_t tx = 0; tx < tiles_x; tx++)
   {
     const size_t wd = tx * tile_wd + width > roi_in->width ? roi_in->width - tx * tile_wd : width;
+    /* the next column of tiles exists unless it is a skipped end-tile, see below */
+    const gboolean right = tx + 1 < tiles_x && (int)(roi_in->width - (tx + 1) * tile_wd) > 2 * overlap;
     for(size_t ty = 0; ty < tiles_y; ty++)
     {
-      piece->pipe->tiling = TRUE;
-
       const size_t ht = ty * tile_ht + height > roi_in->height ? roi_in->height - ty * tile_ht : height;
+      const gboolean below = ty + 1 < tiles_y && (int)(roi_in->height - (ty + 1) * tile_ht) > 2 * overlap;
 
       /* no need to process end-tiles that are smaller than the total overlap area */
       if((wd <= 2 * overlap && tx > 0) || (ht <= 2 * overlap && ty > 0)) continue;
 
-      /* origin and region of effective part of tile, which we want to store later */
-      size_t origin[] = { 0, 0, 0 };
-      size_t region[] = { wd, ht, 1 };
-
-      /* roi_in and roi_out for process_cl on subbuffer */
-      dt_iop_roi_t iroi = { roi_in->x + tx * tile_wd, roi_in->y + ty * tile_ht, wd, ht, roi_in->scale };
-      dt_iop_roi_t oroi = { roi_out->x + tx * tile_wd, roi_out->y + ty * tile_ht, wd, ht, roi_out->scale };
-
-      /* offsets of tile into ivoid and ovoid */
-      const size_t ioffs = (ty * tile_ht) * ipitch + (tx * tile_wd) * in_bpp;
-      size_t ooffs = (ty * tile_ht) * opitch + (tx * tile_wd) * out_bpp;
-
-      dt_print(DT_DEBUG_TILING,
-               "[default_process_tiling_ptp] [%s] tile (%zu,%zu) with %zux%zu at origin [%zu,%zu]",
-               dt_dev_pixelpipe_type_to_str(piece->pipe->type), tx, ty, wd, ht, tx * tile_wd, ty * tile_ht);
-
-/* prepare input tile buffer */
-      DT_OMP_FOR()
-      for(size_t j = 0; j < ht; j++)
-        memcpy((char *)input + j * wd * in_bpp, (char *)ivoid + ioffs + j * ipitch, (size_t)wd * in_bpp);
-
-      /* take original processed_maximum as starting point */
-      for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
-
-      /* call process() of module */
-      self->process(self, piece, input, output, &iroi, &oroi);
-
-      /* aggregate resulting processed_maximum */
-      /* TODO: check if there really can be differences between tiles and take
-               appropriate action (calculate minimum, maximum, average, ...?) */
-      for(int k = 0; k < 4; k++)
-      {
-        if(tx + ty > 0 && fabs(processed_maximum_new[k] - piece->pipe->dsc.processed_maximum[k]) > 1.0e-6f)
-          dt_print(DT_DEBUG_TILING,
-                   "[default_process_tiling_ptp] [%s] processed_maximum[%d] differs between tiles in module '%s%s'",
-                   dt_dev_pixelpipe_type_to_str(piece->pipe->type), k,
-                   self->op, dt_iop_get_instance_id(self));
-        processed_maximum_new[k] = piece->pipe->dsc.processed_maximum[k];
-      }
+      /* roi_in and roi_out for process() on the tile */
+      _tiling_tile_t *tile = &tiles[num_tiles++];
+      tile->iroi = (dt_iop_roi_t){ roi_in->x + tx * tile_wd, roi_in->y + ty * tile_ht, wd, ht, roi_in->scale };
+      tile->oroi = (dt_iop_roi_t){ roi_out->x + tx * tile_wd, roi_out->y + ty * tile_ht, wd, ht, roi_out->scale };
 
-      /* correct origin and region of tile for overlap.
-         make sure that we only copy back the "good" part. */
+      /* correct the effective part of the tile for overlap.
+         make sure that we only copy back the "good" part. the good parts of
+         neighbouring tiles must not overlap, parallel tiles are written back
+         in any order. */
+      tile->good = tile->oroi;
       if(tx > 0)
       {
-        origin[0] += overlap;
-        region[0] -= overlap;
-        ooffs += (size_t)overlap * out_bpp;
+        tile->good.x += overlap;
+        tile->good.width -= overlap;
       }
+      if(right) tile->good.width -= overlap;
       if(ty > 0)
       {
-        origin[1] += overlap;
-        region[1] -= overlap;
-        ooffs += (size_t)overlap * opitch;
+        tile->good.y += overlap;
+        tile->good.height -= overlap;
       }
-
-/* copy "good" part of tile to output buffer */
-      DT_OMP_FOR(shared(origin, region))
-      for(size_t j = 0; j < region[1]; j++)
-        memcpy((char *)ovoid + ooffs + j * opitch,
-               (char *)output + ((j + origin[1]) * wd + origin[0]) * out_bpp, (size_t)region[0] * out_bpp);
+      if(below) tile->good.height -= overlap;
     }
   }
 
-  /* copy back final processed_maximum */
-  for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
+  if(!_process_tiles(self, piece, ivoid, ovoid, roi_in, roi_out, in_bpp, out_bpp,
+                     tiles, num_tiles, parallel, "default_process_tiling_ptp"))
+    goto error;
 
-  dt_free_align(input);
-  dt_free_align(output);
-  piece->pipe->tiling = FALSE;
+  g_free(tiles);
   return;
 
 error:
@@ -812,8 +969,7 @@ error:
 // fall through
 
 fallback:
-  dt_free_align(input);
-  dt_free_align(output);
+  g_free(tiles);
   piece->pipe->tiling = FALSE;
   dt_print(DT_DEBUG_TILING,
            "[default_process_tiling_ptp] [%s] fall back to standard processing for module '%s%s'",
@@ -834,15 +990,12 @@ static void _default_process_tiling_roi(dt_iop_module_t *self,
                                         const dt_iop_roi_t *const roi_out,
                                         const int in_bpp)
 {
-  void *input = NULL;
-  void *output = NULL;
+  _tiling_tile_t *tiles = NULL;
 
   dt_iop_buffer_dsc_t dsc;
   self->output_format(self, piece->pipe, piece, &dsc);
   const int out_bpp = dt_iop_buffer_dsc_to_bpp(&dsc);
 
-  const int ipitch = roi_in->width * in_bpp;
-  const int opitch = roi_out->width * out_bpp;
   const int max_bpp = MAX(in_bpp, out_bpp);
 
   float fullscale = fmaxf(roi_in->scale / roi_out->scale, sqrtf(((float)roi_in->width * roi_in->height)
@@ -888,6 +1041,10 @@ static void _default_process_tiling_roi(dt_iop_module_t *self,
   const float maxbuf = fmaxf(tiling.maxbuf, 1.0f);
   singlebuffer = fmaxf(available / factor, singlebuffer);
 
+  /* share it among the tiles processed at the same time */
+  const int parallel = _parallel_tiles(self, singlebuffer, max_bpp, maxbuf, tiling.overlap);
+  singlebuffer /= parallel;
+
   int width = MAX(roi_in->width, roi_out->width);
   int height = MAX(roi_in->height, roi_out->height);
 
@@ -983,17 +1140,20 @@ static void _default_process_tiling_roi(dt_iop_module_t *self,
                         "%dx%d tiles, size=%dx%d",
                         tiles_x, tiles_y, tile_wd, tile_ht);
 
-  /* store processed_maximum to be re-used and aggregated */
-  dt_aligned_pixel_t processed_maximum_saved;
-  dt_aligned_pixel_t processed_maximum_new = { 1.0f };
-  for_four_channels(k) processed_maximum_saved[k] = piece->pipe->dsc.processed_maximum[k];
+  tiles = g_try_malloc_n((size_t)tiles_x * tiles_y, sizeof(_tiling_tile_t));
+  if(tiles == NULL)
+  {
+    dt_print(DT_DEBUG_TILING,
+             "[default_process_tiling_roi] [%s] could not alloc tiles for module '%s%s'",
+             dt_dev_pixelpipe_type_to_str(piece->pipe->type), self->op, dt_iop_get_instance_id(self));
+    goto error;
+  }
 
-  /* iterate over tiles */
+  /* collect the tiles */
+  int num_tiles = 0;
   for(size_t tx = 0; tx < tiles_x; tx++)
     for(size_t ty = 0; ty < tiles_y; ty++)
     {
-      piece->pipe->tiling = TRUE;
-
       /* the output dimensions of the good part of this specific tile */
       const size_t wd = (tx + 1) * tile_wd > roi_out->width ? (size_t)roi_out->width - tx * tile_wd : tile_wd;
       const size_t ht = (ty + 1) * tile_ht > roi_out->height ? (size_t)roi_out->height - ty * tile_ht : tile_ht;
@@ -1075,76 +1235,19 @@ static void _default_process_tiling_roi(dt_iop_module_t *self,
       _print_roi(&iroi_full, "tile iroi_full final");
       _print_roi(&oroi_full, "tile oroi_full final");
 
-      /* offsets of tile into ivoid and ovoid */
-      const size_t ioffs = ((size_t)iroi_full.y - roi_in->y)  * ipitch + ((size_t)iroi_full.x - roi_in->x) * in_bpp;
-            size_t ooffs = ((size_t)oroi_good.y - roi_out->y) * opitch + ((size_t)oroi_good.x - roi_out->x) * out_bpp;
-
       dt_print(DT_DEBUG_TILING,
-               "[default_process_tiling_roi] [%s] process tile (%zu,%zu) size %dx%d at origin [%d,%d]",
+               "[default_process_tiling_roi] [%s] tile (%zu,%zu) size %dx%d at origin [%d,%d]",
                dt_dev_pixelpipe_type_to_str(piece->pipe->type), tx, ty,
                iroi_full.width, iroi_full.height, iroi_full.x, iroi_full.y);
 
-      /* prepare input tile buffer */
-      input = dt_alloc_aligned((size_t)iroi_full.width * iroi_full.height * in_bpp);
-      if(input == NULL)
-      {
-        dt_print(DT_DEBUG_TILING,
-                 "[default_process_tiling_roi] [%s] could not alloc input buffer for module '%s%s'",
-                 dt_dev_pixelpipe_type_to_str(piece->pipe->type), self->op, dt_iop_get_instance_id(self));
-        goto error;
-      }
-      output = dt_alloc_aligned((size_t)oroi_full.width * oroi_full.height * out_bpp);
-      if(output == NULL)
-      {
-        dt_print(DT_DEBUG_TILING,
-                 "[default_process_tiling_roi] [%s] could not alloc output buffer for module '%s%s'",
-                 dt_dev_pixelpipe_type_to_str(piece->pipe->type), self->op, dt_iop_get_instance_id(self));
-        goto error;
-      }
-
-      DT_OMP_FOR(shared(iroi_full))
-      for(size_t j = 0; j < iroi_full.height; j++)
-        memcpy((char *)input + j * iroi_full.width * in_bpp, (char *)ivoid + ioffs + j * ipitch,
-               (size_t)iroi_full.width * in_bpp);
-
-      /* take original processed_maximum as starting point */
-      for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
-
-      /* call process() of module */
-      self->process(self, piece, input, output, &iroi_full, &oroi_full);
-
-      /* aggregate resulting processed_maximum */
-      /* TODO: check if there really can be differences between tiles and take
-               appropriate action (calculate minimum, maximum, average, ...?) */
-      for(int k = 0; k < 4; k++)
-      {
-        if(tx + ty > 0 && fabs(processed_maximum_new[k] - piece->pipe->dsc.processed_maximum[k]) > 1.0e-6f)
-          dt_print(DT_DEBUG_TILING,
-                   "[default_process_tiling_roi] processed_maximum[%d] differs between tiles in module '%s%s'",
-                   k, self->op, dt_iop_get_instance_id(self));
-        processed_maximum_new[k] = piece->pipe->dsc.processed_maximum[k];
-      }
-
-      /* copy "good" part of tile to output buffer */
-      const int origin_x = oroi_good.x - oroi_full.x;
-      const int origin_y = oroi_good.y - oroi_full.y;
-      DT_OMP_FOR(shared(oroi_good, oroi_full))
-      for(size_t j = 0; j < oroi_good.height; j++)
-        memcpy((char *)ovoid + ooffs + j * opitch,
-               (char *)output + ((j + origin_y) * oroi_full.width + origin_x) * out_bpp,
-               (size_t)oroi_good.width * out_bpp);
-
-      dt_free_align(input);
-      dt_free_align(output);
-      input = output = NULL;
+      tiles[num_tiles++] = (_tiling_tile_t){ .iroi = iroi_full, .oroi = oroi_full, .good = oroi_good };
     }
 
-  /* copy back final processed_maximum */
-  for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
+  if(!_process_tiles(self, piece, ivoid, ovoid, roi_in, roi_out, in_bpp, out_bpp,
+                     tiles, num_tiles, parallel, "default_process_tiling_roi"))
+    goto error;
 
-  dt_free_align(input);
-  dt_free_align(output);
-  piece->pipe->tiling = FALSE;
+  g_free(tiles);
   return;
 
 error:
@@ -1152,8 +1255,7 @@ error:
 // fall through
 
 fallback:
-  dt_free_align(input);
-  dt_free_align(output);
+  g_free(tiles);
   piece->pipe->tiling = FALSE;
   dt_print(DT_DEBUG_TILING,
            "[default_process_tiling_roi] [%s] fall back to standard processing for module '%s%s'",
@@ -16,7 +16,8 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <glib.h>    // for g_mkdir_with_parents, _
+#include <glib.h>    // for g_strdup_printf, _
+#include <glib/gstdio.h> // for g_fopen, g_rename, g_unlink
 #include <gtk/gtk.h> // for gtk_init_check
 #include <libintl.h> // for bind_textdomain_codeset, etc
 #include <limits.h>  // for PATH_MAX
@@ -29,6 +30,7 @@
 #include <unistd.h>  // for access, R_OK
 
 #include "common/darktable.h"    // for darktable, darktable_t, dt_cleanup, etc
+#include "common/dtpthread.h"    // for dt_pthread_create
 #include "common/database.h"     // for dt_database_get
 #include "common/debug.h"        // for DT_DEBUG_SQLITE3_PREPARE_V2
 #include "common/mipmap_cache.h" // for dt_mipmap_size_t, etc
@@ -44,84 +46,206 @@
 #include "win/main_wrapper.h"
 #endif
 
-static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip, const dt_imgid_t min_imgid, const int32_t max_imgid)
+typedef struct _generate_queue_t
 {
-  fprintf(stderr, _("creating cache directories\n"));
-  for(dt_mipmap_size_t k = min_mip; k <= max_mip; k++)
+  dt_pthread_mutex_t lock;
+  dt_imgid_t *ids;       // all images to work on, in ascending order
+  gchar **filenames;
+  gboolean *done;
+  size_t count;
+  size_t next;           // next image to hand out, atomic
+  size_t finished;
+  size_t watermark;      // all images before this one are finished
+  dt_mipmap_size_t min_mip, max_mip;
+  int32_t max_imgid;
+  int omp_threads;       // per worker
+  gchar *checkpoint;
+  double start, last_checkpoint;
+} _generate_queue_t;
+
+// the checkpoint records the last id up to which all images are done
+static void _write_checkpoint(_generate_queue_t *q)
+{
+  if(!q->watermark) return;
+  gchar *tmp = g_strdup_printf("%s.tmp", q->checkpoint);
+  FILE *f = g_fopen(tmp, "wb");
+  if(f)
   {
-    char dirname[PATH_MAX] = { 0 };
-    snprintf(dirname, sizeof(dirname), "%s.d/%d", darktable.mipmap_cache->cachedir, k);
+    fprintf(f, "%d %d %d %d\n", (int)q->min_mip, (int)q->max_mip, q->max_imgid, q->ids[q->watermark - 1]);
+    if(!fclose(f)) g_rename(tmp, q->checkpoint);
+  }
+  g_free(tmp);
+}
 
-    fprintf(stderr, _("creating cache directory '%s'\n"), dirname);
-    if(g_mkdir_with_parents(dirname, 0750))
-    {
-      fprintf(stderr, _("could not create directory '%s'!\n"), dirname);
-      return 1;
-    }
+static dt_imgid_t _read_checkpoint(const gchar *checkpoint,
+                                   const dt_mipmap_size_t min_mip,
+                                   const dt_mipmap_size_t max_mip,
+                                   const int32_t max_imgid)
+{
+  FILE *f = g_fopen(checkpoint, "rb");
+  if(!f) return NO_IMGID;
+  int cmin = -1, cmax = -1, cmax_imgid = -1, last = NO_IMGID;
+  const gboolean ok = fscanf(f, "%d %d %d %d", &cmin, &cmax, &cmax_imgid, &last) == 4;
+  fclose(f);
+  // only resume the very same run
+  if(!ok || cmin != min_mip || cmax != max_mip || cmax_imgid != max_imgid) return NO_IMGID;
+  return last;
+}
+
+static void _generate_image(const dt_imgid_t imgid,
+                            const dt_mipmap_size_t min_mip,
+                            const dt_mipmap_size_t max_mip)
+{
+  // largest first, the smaller ones are then downsampled from it
+  // instead of decoding the image again
+  for(int k = max_mip; k >= min_mip && k >= 0; k--)
+  {
+    // if a thumbnail is already on disc - do nothing
+    if(dt_mipmap_cache_disk_contains(imgid, k)) continue;
+
+    // else, generate thumbnail and store in mipmap cache.
+    dt_mipmap_buffer_t buf;
+    dt_mipmap_cache_get(&buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
+    dt_mipmap_cache_release(&buf);
   }
 
-  // some progress counter
-  sqlite3_stmt *stmt;
-  size_t image_count = 0, counter = 0;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT COUNT(*) FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
+  // and immediately write thumbs to disc and remove from mipmap cache.
+  dt_mipmap_cache_evict(imgid);
+  // thumbnail in sync with image
+  dt_history_hash_set_mipmap(imgid);
+}
+
+static void _finish_image(_generate_queue_t *q, const size_t i)
+{
+  dt_pthread_mutex_lock(&q->lock);
+  q->done[i] = TRUE;
+  q->finished++;
+  while(q->watermark < q->count && q->done[q->watermark]) q->watermark++;
+
+  const double now = dt_get_wtime();
+  fprintf(stderr, "image %zu/%zu (%.02f%%) (id:%d, file=%s) %.2f images/s\n",
+          q->finished, q->count, 100.0 * q->finished / (float)q->count, q->ids[i], q->filenames[i],
+          q->finished / MAX(now - q->start, 1e-3));
+
+  if(now - q->last_checkpoint > 5.0)
   {
-    image_count = sqlite3_column_int(stmt, 0);
-    sqlite3_finalize(stmt);
+    _write_checkpoint(q);
+    q->last_checkpoint = now;
   }
-  else
+  dt_pthread_mutex_unlock(&q->lock);
+}
+
+static void *_generate_worker(void *data)
+{
+  _generate_queue_t *q = (_generate_queue_t *)data;
+#ifdef _OPENMP
+  // share the cores between the workers instead of oversubscribing them
+  omp_set_num_threads(q->omp_threads);
+#endif
+  while(TRUE)
   {
-    return 1;
+    const size_t i = __sync_fetch_and_add(&q->next, 1);
+    if(i >= q->count) break;
+    _generate_image(q->ids[i], q->min_mip, q->max_mip);
+    _finish_image(q, i);
   }
+  return NULL;
+}
 
-  if(!image_count)
+static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip,
+                                    const dt_mipmap_size_t max_mip,
+                                    dt_imgid_t min_imgid,
+                                    const int32_t max_imgid,
+                                    const int threads,
+                                    const gboolean resume)
+{
+  for(dt_mipmap_size_t k = min_mip; k <= max_mip; k++)
   {
-    fprintf(stderr, _("warning: no images are matching the requested image id range\n"));
-    if(min_imgid > max_imgid)
+    if(!darktable.mipmap_cache->pack[k])
     {
-      fprintf(stderr, _("warning: did you want to swap these boundaries?\n"));
+      fprintf(stderr, _("could not open the thumbnail cache '%s.d/%d.pack'!\n"),
+              darktable.mipmap_cache->cachedir, k);
+      return 1;
+    }
+  }
+
+  _generate_queue_t q = { 0 };
+  q.min_mip = min_mip;
+  q.max_mip = max_mip;
+  q.max_imgid = max_imgid;
+  q.checkpoint = g_strdup_printf("%s.d/generate-cache.checkpoint", darktable.mipmap_cache->cachedir);
+
+  if(resume)
+  {
+    const dt_imgid_t last = _read_checkpoint(q.checkpoint, min_mip, max_mip, max_imgid);
+    if(dt_is_valid_imgid(last) && last >= min_imgid)
+    {
+      fprintf(stderr, _("resuming interrupted run after image id %d\n"), last);
+      min_imgid = last + 1;
     }
   }
 
-  // go through all images:
+  // collect all images first, workers then pull them from the queue
+  sqlite3_stmt *stmt;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT id, filename FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
+                              "SELECT id, filename FROM main.images WHERE id >= ?1 AND id <= ?2 ORDER BY id",
+                              -1, &stmt, 0);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
+  GArray *ids = g_array_new(FALSE, FALSE, sizeof(dt_imgid_t));
+  GPtrArray *filenames = g_ptr_array_new_with_free_func(g_free);
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
     const dt_imgid_t imgid = sqlite3_column_int(stmt, 0);
-    const char *imgfilename = (const char*)sqlite3_column_text(stmt, 1);
-
-    counter++;
-    fprintf(stderr, "image %zu/%zu (%.02f%%) (id:%d, file=%s)\n", counter, image_count, 100.0 * counter / (float)image_count, imgid, imgfilename);
+    g_array_append_val(ids, imgid);
+    g_ptr_array_add(filenames, g_strdup((const char *)sqlite3_column_text(stmt, 1)));
+  }
+  sqlite3_finalize(stmt);
 
-    for(int k = max_mip; k >= min_mip && k >= 0; k--)
+  q.count = ids->len;
+  if(!q.count)
+  {
+    fprintf(stderr, _("warning: no images are matching the requested image id range\n"));
+    if(min_imgid > max_imgid)
     {
-      char filename[PATH_MAX] = { 0 };
-      snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", darktable.mipmap_cache->cachedir, k, imgid);
-
-      // if a valid thumbnail file is already on disc - do nothing
-      if(dt_util_test_image_file(filename)) continue;
-
-      // else, generate thumbnail and store in mipmap cache.
-      dt_mipmap_buffer_t buf;
-      dt_mipmap_cache_get(&buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
-      dt_mipmap_cache_release(&buf);
+      fprintf(stderr, _("warning: did you want to swap these boundaries?\n"));
     }
+  }
+
+  q.ids = (dt_imgid_t *)ids->data;
+  q.filenames = (gchar **)filenames->pdata;
+  q.done = g_new0(gboolean, MAX(q.count, 1));
+  q.omp_threads = MAX(1, (int)dt_get_num_threads() / threads);
+  q.start = q.last_checkpoint = dt_get_wtime();
+  dt_pthread_mutex_init(&q.lock, NULL);
 
-    // and immediately write thumbs to disc and remove from mipmap cache.
-    dt_mipmap_cache_evict(imgid);
-    // thumbnail in sync with image
-    dt_history_hash_set_mipmap(imgid);
+  const int workers = MIN(threads, MAX(q.count, 1));
+  if(workers > 1)
+  {
+    pthread_t *thread = g_new(pthread_t, workers);
+    int started = 0;
+    for(int k = 0; k < workers; k++)
+      if(!dt_pthread_create(&thread[started], _generate_worker, &q)) started++;
+    // run in this thread as well if not even one worker could be started
+    if(!started) _generate_worker(&q);
+    for(int k = 0; k < started; k++) pthread_join(thread[k], NULL);
+    g_free(thread);
   }
+  else
+    _generate_worker(&q);
 
-  sqlite3_finalize(stmt);
-  fprintf(stderr, "done\n");
+  const double elapsed = dt_get_wtime() - q.start;
+  fprintf(stderr, "done, %zu images in %.1fs (%.2f images/s)\n",
+          q.count, elapsed, q.count / MAX(elapsed, 1e-3));
+
+  // the run is complete, nothing to resume
+  g_unlink(q.checkpoint);
 
+  dt_pthread_mutex_destroy(&q.lock);
+  g_free(q.done);
+  g_free(q.checkpoint);
+  g_array_free(ids, TRUE);
+  g_ptr_array_free(filenames, TRUE);
   return 0;
 }
 
@@ -131,13 +255,22 @@ static void usage(const char *progname)
           "usage: %s [-h, --help; --version]\n"
           "  [--min-mip <0-8> (default = 0)] [-m, --max-mip <0-8> (default = 2)]\n"
           "  [--min-imgid <N>] [--max-imgid <N>]\n"
+          "  [-j, --threads <N> (default = 1)] [--restart]\n"
+          "  [--purge [--dry-run]]\n"
           "  [--core <darktable options>]\n"
           "\n"
           "When multiple mipmap sizes are requested, the biggest one is computed\n"
           "while the rest are quickly downsampled.\n"
           "\n"
           "The --min-imgid and --max-imgid specify the range of internal image ID\n"
-          "numbers to work on.\n",
+          "numbers to work on.\n"
+          "\n"
+          "With --threads several images are processed at once. The progress\n"
+          "is checkpointed, an interrupted run with the same mipmap sizes and\n"
+          "--max-imgid continues where it stopped unless --restart is given.\n"
+          "\n"
+          "--purge removes the thumbnails of images that are no longer in the\n"
+          "library from the disk cache instead, --dry-run only lists them.\n",
           progname);
 }
 
@@ -163,6 +296,10 @@ int main(int argc, char *arg[])
   dt_mipmap_size_t max_mip = DT_MIPMAP_2;
   dt_imgid_t min_imgid = NO_IMGID;
   int32_t max_imgid = INT32_MAX;
+  int threads = 1;
+  gboolean resume = TRUE;
+  gboolean purge = FALSE;
+  gboolean dryrun = FALSE;
 
   int k;
   for(k = 1; k < argc; k++)
@@ -198,6 +335,23 @@ int main(int argc, char *arg[])
       k++;
       max_imgid = (int32_t)MIN(MAX(atoi(arg[k]), 0), INT32_MAX);
     }
+    else if((!strcmp(arg[k], "-j") || !strcmp(arg[k], "--threads")) && argc > k + 1)
+    {
+      k++;
+      threads = MIN(MAX(atoi(arg[k]), 1), 256);
+    }
+    else if(!strcmp(arg[k], "--restart"))
+    {
+      resume = FALSE;
+    }
+    else if(!strcmp(arg[k], "--purge"))
+    {
+      purge = TRUE;
+    }
+    else if(!strcmp(arg[k], "--dry-run"))
+    {
+      dryrun = TRUE;
+    }
     else if(!strcmp(arg[k], "--core"))
     {
       // everything from here on should be passed to the core
@@ -221,6 +375,18 @@ int main(int argc, char *arg[])
     exit(EXIT_FAILURE);
   }
 
+  if(purge)
+  {
+    const int stale = dt_mipmap_cache_purge_disk(dryrun);
+    if(dryrun)
+      fprintf(stderr, _("%d stale thumbnails found\n"), stale);
+    else
+      fprintf(stderr, _("%d stale thumbnails removed\n"), stale);
+    dt_cleanup();
+    free(m_arg);
+    exit(EXIT_SUCCESS);
+  }
+
   if(!dt_conf_get_bool("cache_disk_backend"))
   {
     fprintf(stderr, _("warning: disk backend for thumbnail cache is disabled (cache_disk_backend).\nif you want "
@@ -251,7 +417,7 @@ int main(int argc, char *arg[])
 
   fprintf(stderr, _("creating complete lighttable thumbnail cache\n"));
 
-  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid))
+  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid, threads, resume))
   {
     free(m_arg);
     exit(EXIT_FAILURE);
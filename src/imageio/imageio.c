@@ -1024,31 +1024,35 @@ static double _get_pipescale(dt_dev_pixelpipe_t *pipe,
   return fmin(scalex, scaley);
 }
 
-// internal function: to avoid exif blob reading + 8-bit byteorder
-// flag + high-quality override
-gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
-                                      const char *filename,
-                                      dt_imageio_module_format_t *format,
-                                      dt_imageio_module_data_t *format_params,
-                                      const gboolean ignore_exif,
-                                      const gboolean display_byteorder,
-                                      const gboolean high_quality,
-                                      const gboolean upscale,
-                                      const gboolean is_scaling,
-                                      const gboolean thumbnail_export,
-                                      const char *filter,
-                                      const gboolean copy_metadata,
-                                      const gboolean export_masks,
-                                      const dt_colorspaces_color_profile_type_t icc_type,
-                                      const gchar *icc_filename,
-                                      const dt_iop_color_intent_t icc_intent,
-                                      dt_imageio_module_storage_t *storage,
-                                      dt_imageio_module_data_t *storage_params,
-                                      int num,
-                                      const int total,
-                                      dt_export_metadata_t *metadata,
-                                      const int history_end)
+// processes the image once and writes all outputs. the pipe and the style
+// are set up from the first output, with several outputs the pipe branches
+// off at colorout/finalscale for each of them. a failing output stops the
+// export, returns TRUE in that case and outputs[].failed tells which were
+// not written.
+static gboolean _export_outputs(const dt_imgid_t imgid,
+                                dt_imageio_export_output_t *outputs,
+                                const int count,
+                                const gboolean ignore_exif,
+                                const gboolean display_byteorder,
+                                const gboolean high_quality,
+                                const gboolean upscale,
+                                const gboolean is_scaling,
+                                const gboolean thumbnail_export,
+                                const char *filter,
+                                const gboolean copy_metadata,
+                                const gboolean export_masks,
+                                dt_imageio_module_storage_t *storage,
+                                dt_imageio_module_data_t *storage_params,
+                                int num,
+                                const int total,
+                                dt_export_metadata_t *metadata,
+                                const int history_end)
 {
+  for(int idx = 0; idx < count; idx++)
+    outputs[idx].failed = TRUE;
+
+  dt_imageio_module_data_t *style_params = outputs[0].format_params;
+
   dt_develop_t dev;
   dt_dev_init(&dev, FALSE);
   dt_dev_load_image(&dev, imgid);
@@ -1073,7 +1077,7 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
     {
       dt_print(DT_DEBUG_ALWAYS,
                "[dt_imageio_export_with_flags] mipmap allocation for `%s' failed (status %d)",
-               filename,img->load_status);
+               outputs[0].filename, img->load_status);
       dt_control_log(_("unable to load image `%s'!"), img->filename);
     }
     else
@@ -1090,7 +1094,8 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
   gboolean res = thumbnail_export
     ? dt_dev_pixelpipe_init_thumbnail(&pipe, wd, ht)
     : dt_dev_pixelpipe_init_export(&pipe, wd, ht,
-                                   format->levels(format_params), export_masks);
+                                   outputs[0].format->levels(outputs[0].format_params),
+                                   export_masks, count);
   if(!res)
   {
     dt_control_log(
@@ -1101,20 +1106,20 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
   }
 
   const int final_history_end = history_end == -1 ? dev.history_end : history_end;
-  const gboolean use_style = !thumbnail_export && format_params->style[0] != '\0';
-  const gboolean appending = format_params->style_append != FALSE;
+  const gboolean use_style = !thumbnail_export && style_params->style[0] != '\0';
+  const gboolean appending = style_params->style_append != FALSE;
   //  If a style is to be applied during export, add the iop params into the history
   if(use_style)
   {
-    GList *style_items = dt_styles_get_item_list(format_params->style, FALSE, -1, TRUE);
+    GList *style_items = dt_styles_get_item_list(style_params->style, FALSE, -1, TRUE);
     if(!style_items)
     {
       dt_print(DT_DEBUG_ALWAYS,
                "[imageio] cannot find the style '%s' to apply during export",
-               format_params->style);
+               style_params->style);
       if(darktable.gui)
         dt_control_log(_("cannot find the style '%s' to apply during export"),
-                       format_params->style);
+                       style_params->style);
       else
         dt_print(DT_DEBUG_ALWAYS,
                  "[imageio] please check that you have imported this style into darktable"
@@ -1171,7 +1176,8 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
 
   dt_ioppr_resync_modules_order(&dev);
 
-  dt_dev_pixelpipe_set_icc(&pipe, icc_type, icc_filename, icc_intent);
+  dt_dev_pixelpipe_set_icc(&pipe, outputs[0].icc_type,
+                           outputs[0].icc_filename, outputs[0].icc_intent);
   dt_dev_pixelpipe_set_input(&pipe, &dev, (float *)buf.buf,
                              buf.width, buf.height, buf.iscale);
   dt_dev_pixelpipe_create_nodes(&pipe, &dev);
@@ -1196,7 +1202,7 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
              use_style && appending      ? "append style history " : "",
              use_style && !appending     ? "replace style history " : "",
              use_style                   ? "`" : "",
-             use_style && format_params  ? format_params->style : "",
+             use_style && style_params   ? style_params->style : "",
              use_style                   ? "'." : "",
              mbuf);
   }
@@ -1215,284 +1221,317 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
 
   dt_show_times(&start, "[export] creating pixelpipe");
 
-  // find output color profile for this image:
-  gboolean sRGB = TRUE;
-  if(icc_type == DT_COLORSPACE_SRGB) { }
-  else if(icc_type == DT_COLORSPACE_NONE)
-  {
-    dt_iop_module_t *colorout = NULL;
-    for(GList *modules = dev.iop; modules; modules = g_list_next(modules))
-    {
-      colorout = (dt_iop_module_t *)modules->data;
-      if(colorout->get_p && strcmp(colorout->op, "colorout") == 0)
-      {
-        const dt_colorspaces_color_profile_type_t *type =
-          colorout->get_p(colorout->params, "type");
-        sRGB = (!type || *type == DT_COLORSPACE_SRGB);
-        break; // colorout can't have > 1 instance
-      }
-    }
-  }
-  else
-    sRGB = FALSE;
-
   // get only once at the beginning, in case the user changes it on the way:
   const gboolean high_quality_processing = high_quality;
 
-  int width = MAX(format_params->max_width, 0);
-  int height = MAX(format_params->max_height, 0);
-
-  if(!thumbnail_export && width == 0 && height == 0)
+  for(int idx = 0; idx < count; idx++)
   {
-    width = pipe.processed_width;
-    height = pipe.processed_height;
-  }
-
-  // note: not perfect but a reasonable good guess looking at overall pixelpipe requirements
-  // and specific stuff in finalscale.
-  const double max_possible_scale = fmin(100.0, fmax(1.0, // keep maximum allowed scale as we had in 4.6
-      (double)dt_get_available_pipe_mem(&pipe) / (double)(1 + 64 * sizeof(float) * pipe.processed_width * pipe.processed_height)));
-
-  const gboolean doscale = upscale && ((width > 0 || height > 0) || is_scaling);
-  const double max_scale = doscale ? max_possible_scale : 1.00;
-
-  double scale = _get_pipescale(&pipe, width, height, max_scale);
-  float origin[2] = { 0.0f, 0.0f };
-
-  if(dt_dev_distort_backtransform_plus(&dev, &pipe, 0.0,
-                                       DT_DEV_TRANSFORM_DIR_ALL, origin, 1))
-  {
-    if(width == 0) width = pipe.processed_width;
-    if(height == 0) height = pipe.processed_height;
-    scale = _get_pipescale(&pipe, width, height, max_scale);
+    const char *filename = outputs[idx].filename;
+    dt_imageio_module_format_t *format = outputs[idx].format;
+    dt_imageio_module_data_t *format_params = outputs[idx].format_params;
+    const dt_colorspaces_color_profile_type_t icc_type = outputs[idx].icc_type;
+    const gchar *icc_filename = outputs[idx].icc_filename;
+    const dt_iop_color_intent_t icc_intent = outputs[idx].icc_intent;
+
+    if(idx > 0)
+    {
+      // everything up to colorout stays cached, a changed profile only
+      // invalidates the pipe from colorout on
+      dt_dev_pixelpipe_set_icc(&pipe, icc_type, icc_filename, icc_intent);
+      dt_dev_pixelpipe_synch_all(&pipe, &dev);
+      pipe.levels = format->levels(format_params);
+    }
 
-    if(is_scaling)
+    // find output color profile for this image:
+    gboolean sRGB = TRUE;
+    if(icc_type == DT_COLORSPACE_SRGB) { }
+    else if(icc_type == DT_COLORSPACE_NONE)
     {
-      // scaling
-      double _num, _denum;
-      dt_imageio_resizing_factor_get_and_parsing(&_num, &_denum);
-      const double scale_factor = _num / _denum;
-      if(!thumbnail_export)
+      dt_iop_module_t *colorout = NULL;
+      for(GList *modules = dev.iop; modules; modules = g_list_next(modules))
       {
-        scale = fmin(scale_factor, max_scale);
+        colorout = (dt_iop_module_t *)modules->data;
+        if(colorout->get_p && strcmp(colorout->op, "colorout") == 0)
+        {
+          const dt_colorspaces_color_profile_type_t *type =
+            colorout->get_p(colorout->params, "type");
+          sRGB = (!type || *type == DT_COLORSPACE_SRGB);
+          break; // colorout can't have > 1 instance
+        }
       }
     }
-  }
+    else
+      sRGB = FALSE;
 
-  const int processed_width = floor(scale * pipe.processed_width);
-  const int processed_height = floor(scale * pipe.processed_height);
-  const gboolean size_warning = processed_width < 1 || processed_height < 1;
-  dt_print(DT_DEBUG_IMAGEIO,
-           "[dt_imageio_export] %s%s imgid %d, %ix%i --> %ix%i (scale=%.4f, maxscale=%.4f)."
-           " upscale=%s, hq=%s",
-           size_warning ? "**missing size** " : "",
-           thumbnail_export ? "thumbnail" : "export", imgid,
-           pipe.processed_width, pipe.processed_height,
-           processed_width, processed_height, scale, max_scale,
-           upscale ? "yes" : "no",
-           high_quality_processing || scale > 1.0f ? "yes" : "no");
+    int width = MAX(format_params->max_width, 0);
+    int height = MAX(format_params->max_height, 0);
+
+    if(!thumbnail_export && width == 0 && height == 0)
+    {
+      width = pipe.processed_width;
+      height = pipe.processed_height;
+    }
 
-  const int bpp = format->bpp(format_params);
+    // note: not perfect but a reasonable good guess looking at overall pixelpipe requirements
+    // and specific stuff in finalscale.
+    const double max_possible_scale = fmin(100.0, fmax(1.0, // keep maximum allowed scale as we had in 4.6
+        (double)dt_get_available_pipe_mem(&pipe) / (double)(1 + 64 * sizeof(float) * pipe.processed_width * pipe.processed_height)));
 
-  dt_get_perf_times(&start);
-  const gboolean hq_process = high_quality_processing || scale > 1.0f;
-  if(hq_process)
-  {
-    /*
-     * if high quality processing was requested, downsampling will be done
-     * at the very end of the pipe (just before border and watermark)
-     */
-    dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0,
-                                      processed_width, processed_height, scale);
-  }
-  else
-  {
-    // else, downsampling will be right after demosaic
+    const gboolean doscale = upscale && ((width > 0 || height > 0) || is_scaling);
+    const double max_scale = doscale ? max_possible_scale : 1.00;
 
-    // so we need to turn temporarily disable in-pipe late downsampling iop.
+    double scale = _get_pipescale(&pipe, width, height, max_scale);
+    float origin[2] = { 0.0f, 0.0f };
 
-    // find the finalscale module
-    dt_dev_pixelpipe_iop_t *finalscale = NULL;
+    if(dt_dev_distort_backtransform_plus(&dev, &pipe, 0.0,
+                                         DT_DEV_TRANSFORM_DIR_ALL, origin, 1))
     {
-      for(const GList *nodes = g_list_last(pipe.nodes);
-          nodes;
-          nodes = g_list_previous(nodes))
+      if(width == 0) width = pipe.processed_width;
+      if(height == 0) height = pipe.processed_height;
+      scale = _get_pipescale(&pipe, width, height, max_scale);
+
+      if(is_scaling)
       {
-        dt_dev_pixelpipe_iop_t *node = nodes->data;
-        if(dt_iop_module_is(node->module->so, "finalscale"))
+        // scaling
+        double _num, _denum;
+        dt_imageio_resizing_factor_get_and_parsing(&_num, &_denum);
+        const double scale_factor = _num / _denum;
+        if(!thumbnail_export)
         {
-          finalscale = node;
-          break;
+          scale = fmin(scale_factor, max_scale);
         }
       }
     }
 
-    if(finalscale) finalscale->enabled = FALSE;
-
-    // do the processing (8-bit with special treatment, to make sure
-    // we can use openmp further down):
-    if(bpp == 8)
-      dt_dev_pixelpipe_process(&pipe, &dev, 0, 0,
-                               processed_width, processed_height, scale, DT_DEVICE_NONE);
-    else
+    const int processed_width = floor(scale * pipe.processed_width);
+    const int processed_height = floor(scale * pipe.processed_height);
+    const gboolean size_warning = processed_width < 1 || processed_height < 1;
+    dt_print(DT_DEBUG_IMAGEIO,
+             "[dt_imageio_export] %s%s imgid %d, %ix%i --> %ix%i (scale=%.4f, maxscale=%.4f)."
+             " upscale=%s, hq=%s",
+             size_warning ? "**missing size** " : "",
+             thumbnail_export ? "thumbnail" : "export", imgid,
+             pipe.processed_width, pipe.processed_height,
+             processed_width, processed_height, scale, max_scale,
+             upscale ? "yes" : "no",
+             high_quality_processing || scale > 1.0f ? "yes" : "no");
+
+    const int bpp = format->bpp(format_params);
+
+    dt_get_perf_times(&start);
+    // branching off needs the full resolution data in front of finalscale
+    const gboolean hq_process = high_quality_processing || scale > 1.0f || count > 1;
+    if(hq_process)
+    {
+      /*
+       * if high quality processing was requested, downsampling will be done
+       * at the very end of the pipe (just before border and watermark)
+       */
       dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0,
                                         processed_width, processed_height, scale);
+    }
+    else
+    {
+      // else, downsampling will be right after demosaic
 
-    if(finalscale) finalscale->enabled = TRUE;
-  }
-  dt_show_times(&start,
-                thumbnail_export
-                  ? "[dev_process_thumbnail] pixel pipeline processing"
-                  : "[dev_process_export] pixel pipeline processing");
-
-  uint8_t *outbuf = pipe.backbuf;
-  if(outbuf == NULL)
-  {
-    dt_print(DT_DEBUG_IMAGEIO,
-             "[dt_imageio_export_with_flags] no valid output buffer");
-    goto error;
-  }
+      // so we need to turn temporarily disable in-pipe late downsampling iop.
 
-  // downconversion to low-precision formats:
-  if(bpp == 8)
-  {
-    if(display_byteorder)
-    {
-      if(hq_process)
+      // find the finalscale module
+      dt_dev_pixelpipe_iop_t *finalscale = NULL;
       {
-        const float *const inbuf = (float *)outbuf;
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
+        for(const GList *nodes = g_list_last(pipe.nodes);
+            nodes;
+            nodes = g_list_previous(nodes))
         {
-          // convert in place, this is unfortunately very serial..
-          const uint8_t r = roundf(CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff));
-          const uint8_t g = roundf(CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff));
-          const uint8_t b = roundf(CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff));
-          outbuf[4 * k + 0] = r;
-          outbuf[4 * k + 1] = g;
-          outbuf[4 * k + 2] = b;
+          dt_dev_pixelpipe_iop_t *node = nodes->data;
+          if(dt_iop_module_is(node->module->so, "finalscale"))
+          {
+            finalscale = node;
+            break;
+          }
         }
       }
-      // else processing output was 8-bit already, and no need to swap order
+
+      if(finalscale) finalscale->enabled = FALSE;
+
+      // do the processing (8-bit with special treatment, to make sure
+      // we can use openmp further down):
+      if(bpp == 8)
+        dt_dev_pixelpipe_process(&pipe, &dev, 0, 0,
+                                 processed_width, processed_height, scale, DT_DEVICE_NONE);
+      else
+        dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0,
+                                          processed_width, processed_height, scale);
+
+      if(finalscale) finalscale->enabled = TRUE;
+    }
+    dt_show_times(&start,
+                  thumbnail_export
+                    ? "[dev_process_thumbnail] pixel pipeline processing"
+                    : "[dev_process_export] pixel pipeline processing");
+
+    uint8_t *outbuf = pipe.backbuf;
+    if(outbuf == NULL)
+    {
+      dt_print(DT_DEBUG_IMAGEIO,
+               "[dt_imageio_export_with_flags] no valid output buffer");
+      goto error;
     }
-    else // need to flip
+
+    // downconversion to low-precision formats:
+    if(bpp == 8)
     {
-      // ldr output: char
-      if(hq_process)
+      if(display_byteorder)
       {
-        const float *const inbuf = (float *)outbuf;
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
+        if(hq_process)
         {
-          // convert in place, this is unfortunately very serial..
-          const uint8_t r = roundf(CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff));
-          const uint8_t g = roundf(CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff));
-          const uint8_t b = roundf(CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff));
-          outbuf[4 * k + 0] = r;
-          outbuf[4 * k + 1] = g;
-          outbuf[4 * k + 2] = b;
+          const float *const inbuf = (float *)outbuf;
+          for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
+          {
+            // convert in place, this is unfortunately very serial..
+            const uint8_t r = roundf(CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff));
+            const uint8_t g = roundf(CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff));
+            const uint8_t b = roundf(CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff));
+            outbuf[4 * k + 0] = r;
+            outbuf[4 * k + 1] = g;
+            outbuf[4 * k + 2] = b;
+          }
         }
+        // else processing output was 8-bit already, and no need to swap order
       }
-      else
-      { // !display_byteorder, need to swap:
-        uint8_t *const buf8 = pipe.backbuf;
-        DT_OMP_FOR()
-        // just flip byte order
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
+      else // need to flip
+      {
+        // ldr output: char
+        if(hq_process)
         {
-          uint8_t tmp = buf8[4 * k + 0];
-          buf8[4 * k + 0] = buf8[4 * k + 2];
-          buf8[4 * k + 2] = tmp;
+          const float *const inbuf = (float *)outbuf;
+          for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
+          {
+            // convert in place, this is unfortunately very serial..
+            const uint8_t r = roundf(CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff));
+            const uint8_t g = roundf(CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff));
+            const uint8_t b = roundf(CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff));
+            outbuf[4 * k + 0] = r;
+            outbuf[4 * k + 1] = g;
+            outbuf[4 * k + 2] = b;
+          }
+        }
+        else
+        { // !display_byteorder, need to swap:
+          uint8_t *const buf8 = pipe.backbuf;
+          DT_OMP_FOR()
+          // just flip byte order
+          for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
+          {
+            uint8_t tmp = buf8[4 * k + 0];
+            buf8[4 * k + 0] = buf8[4 * k + 2];
+            buf8[4 * k + 2] = tmp;
+          }
         }
       }
     }
-  }
-  else if(bpp == 16)
-  {
-    // uint16_t per color channel
-    float *buff = (float *)outbuf;
-    uint16_t *buf16 = (uint16_t *)outbuf;
-    for(int y = 0; y < processed_height; y++)
-      for(int x = 0; x < processed_width; x++)
-      {
-        // convert in place
-        const size_t k = (size_t)processed_width * y + x;
-        for(int i = 0; i < 3; i++)
-          buf16[4 * k + i] = roundf(CLAMP(buff[4 * k + i] * 0xffff, 0, 0xffff));
-      }
-  }
-  // else output float, no further harm done to the pixels :)
-
-  format_params->width = processed_width;
-  format_params->height = processed_height;
-
-  // Check if all the metadata export flags are set for AVIF/EXR/JPEG XL/XCF (opt-in)
-  //
-  // TODO: this is a workaround as these formats do not support fine
-  // grained metadata control through dt_exif_xmp_attach_export()
-  // below due to lack of exiv2 write support
-  //
-  // Note: that this is done only when we do not ignore_exif, so we have a proper filename
-  //       otherwise the export is done in a memory buffer.
-  gboolean md_flags_set = TRUE;
-  if(!ignore_exif
-     && (!strcmp(format->mime(NULL), "image/avif")
-         || !strcmp(format->mime(NULL), "image/x-exr")
-         || !strcmp(format->mime(NULL), "image/jxl")
-         || !strcmp(format->mime(NULL), "image/x-xcf")))
-  {
-    const int32_t meta_all =
-      DT_META_EXIF | DT_META_METADATA | DT_META_GEOTAG | DT_META_TAG
-      | DT_META_HIERARCHICAL_TAG | DT_META_DT_HISTORY | DT_META_PRIVATE_TAG
-      | DT_META_SYNONYMS_TAG | DT_META_OMIT_HIERARCHY;
-    md_flags_set = metadata ? (metadata->flags & meta_all) == meta_all : FALSE;
-  }
+    else if(bpp == 16)
+    {
+      // uint16_t per color channel
+      float *buff = (float *)outbuf;
+      uint16_t *buf16 = (uint16_t *)outbuf;
+      for(int y = 0; y < processed_height; y++)
+        for(int x = 0; x < processed_width; x++)
+        {
+          // convert in place
+          const size_t k = (size_t)processed_width * y + x;
+          for(int i = 0; i < 3; i++)
+            buf16[4 * k + i] = roundf(CLAMP(buff[4 * k + i] * 0xffff, 0, 0xffff));
+        }
+    }
+    // else output float, no further harm done to the pixels :)
+
+    format_params->width = processed_width;
+    format_params->height = processed_height;
+
+    // Check if all the metadata export flags are set for AVIF/EXR/JPEG XL/XCF (opt-in)
+    //
+    // TODO: this is a workaround as these formats do not support fine
+    // grained metadata control through dt_exif_xmp_attach_export()
+    // below due to lack of exiv2 write support
+    //
+    // Note: that this is done only when we do not ignore_exif, so we have a proper filename
+    //       otherwise the export is done in a memory buffer.
+    gboolean md_flags_set = TRUE;
+    if(!ignore_exif
+       && (!strcmp(format->mime(NULL), "image/avif")
+           || !strcmp(format->mime(NULL), "image/x-exr")
+           || !strcmp(format->mime(NULL), "image/jxl")
+           || !strcmp(format->mime(NULL), "image/x-xcf")))
+    {
+      const int32_t meta_all =
+        DT_META_EXIF | DT_META_METADATA | DT_META_GEOTAG | DT_META_TAG
+        | DT_META_HIERARCHICAL_TAG | DT_META_DT_HISTORY | DT_META_PRIVATE_TAG
+        | DT_META_SYNONYMS_TAG | DT_META_OMIT_HIERARCHY;
+      md_flags_set = metadata ? (metadata->flags & meta_all) == meta_all : FALSE;
+    }
 
-  if(!ignore_exif && md_flags_set)
-  {
-    uint8_t *exif_profile = NULL; // Exif data should be 65536 bytes
-                                  // max, but if original size is
-                                  // close to that, adding new tags
-                                  // could make it go over that... so
-                                  // let it be and see what happens
-                                  // when we write the image
-    char pathname[PATH_MAX] = { 0 };
-    gboolean from_cache = TRUE;
-    dt_image_full_path(imgid, pathname, sizeof(pathname), &from_cache);
-
-    // last param is dng mode, it's false here
-    const int length = dt_exif_read_blob(&exif_profile, pathname, imgid, sRGB,
-                                         processed_width, processed_height, FALSE);
-
-    res = (format->write_image(format_params, filename, outbuf, icc_type,
-                              icc_filename, exif_profile, length, imgid,
-                              num, total, &pipe, export_masks)) != 0;
-
-    free(exif_profile);
-  }
-  else
-  {
-    res = (format->write_image(format_params, filename, outbuf, icc_type,
-                              icc_filename, NULL, 0, imgid, num, total,
-                              &pipe, export_masks)) != 0;
-  }
+    if(!ignore_exif && md_flags_set)
+    {
+      uint8_t *exif_profile = NULL; // Exif data should be 65536 bytes
+                                    // max, but if original size is
+                                    // close to that, adding new tags
+                                    // could make it go over that... so
+                                    // let it be and see what happens
+                                    // when we write the image
+      char pathname[PATH_MAX] = { 0 };
+      gboolean from_cache = TRUE;
+      dt_image_full_path(imgid, pathname, sizeof(pathname), &from_cache);
+
+      // last param is dng mode, it's false here
+      const int length = dt_exif_read_blob(&exif_profile, pathname, imgid, sRGB,
+                                           processed_width, processed_height, FALSE);
+
+      res = (format->write_image(format_params, filename, outbuf, icc_type,
+                                icc_filename, exif_profile, length, imgid,
+                                num, total, &pipe, export_masks)) != 0;
+
+      free(exif_profile);
+    }
+    else
+    {
+      res = (format->write_image(format_params, filename, outbuf, icc_type,
+                                icc_filename, NULL, 0, imgid, num, total,
+                                &pipe, export_masks)) != 0;
+    }
 
-  if(res)
-    goto error;
+    // the buffer was converted in place, a further output must not pick it up
+    if(count > 1)
+      dt_dev_pixelpipe_invalidate_cacheline(&pipe, outbuf);
 
-  /* now write xmp into that container, if possible */
-  if(copy_metadata
-     && (format->flags(format_params) & FORMAT_FLAGS_SUPPORT_XMP))
-  {
-    dt_exif_xmp_attach_export(imgid, filename, metadata, &dev, &pipe);
-    // no need to cancel the export if this fail
+    if(res)
+      goto error;
+    outputs[idx].failed = FALSE;
+
+    /* now write xmp into that container, if possible */
+    if(copy_metadata
+       && (format->flags(format_params) & FORMAT_FLAGS_SUPPORT_XMP))
+    {
+      dt_exif_xmp_attach_export(imgid, filename, metadata, &dev, &pipe);
+      // no need to cancel the export if this fail
+    }
   }
 
   dt_dev_pixelpipe_cleanup(&pipe);
   dt_dev_cleanup(&dev);
   dt_mipmap_cache_release(&buf);
 
-  if(!thumbnail_export && strcmp(format->mime(format_params), "memory")
-    && !(format->flags(format_params) & FORMAT_FLAGS_NO_TMPFILE))
+  for(int idx = 0; idx < count; idx++)
   {
+    const char *filename = outputs[idx].filename;
+    dt_imageio_module_format_t *format = outputs[idx].format;
+    dt_imageio_module_data_t *format_params = outputs[idx].format_params;
+    if(outputs[idx].failed
+       || thumbnail_export
+       || !strcmp(format->mime(format_params), "memory")
+       || (format->flags(format_params) & FORMAT_FLAGS_NO_TMPFILE))
+      continue;
+
 #ifdef USE_LUA
     //Synchronous calling of lua intermediate-export-image events
     dt_lua_lock();
@@ -1519,9 +1558,13 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
                             format_params, storage, storage_params);
   }
 
+  gboolean failed = FALSE;
+  for(int idx = 0; idx < count; idx++)
+    failed |= outputs[idx].failed;
+
   if(!thumbnail_export)
     dt_set_backthumb_time(5.0);
-  return FALSE; // success
+  return failed;
 
 error:
   dt_dev_pixelpipe_cleanup(&pipe);
@@ -1535,6 +1578,95 @@ error_early:
 }
 
 
+// internal function: to avoid exif blob reading + 8-bit byteorder
+// flag + high-quality override
+gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
+                                      const char *filename,
+                                      dt_imageio_module_format_t *format,
+                                      dt_imageio_module_data_t *format_params,
+                                      const gboolean ignore_exif,
+                                      const gboolean display_byteorder,
+                                      const gboolean high_quality,
+                                      const gboolean upscale,
+                                      const gboolean is_scaling,
+                                      const gboolean thumbnail_export,
+                                      const char *filter,
+                                      const gboolean copy_metadata,
+                                      const gboolean export_masks,
+                                      const dt_colorspaces_color_profile_type_t icc_type,
+                                      const gchar *icc_filename,
+                                      const dt_iop_color_intent_t icc_intent,
+                                      dt_imageio_module_storage_t *storage,
+                                      dt_imageio_module_data_t *storage_params,
+                                      int num,
+                                      const int total,
+                                      dt_export_metadata_t *metadata,
+                                      const int history_end)
+{
+  dt_imageio_export_output_t output =
+    { .filename = filename,
+      .format = format,
+      .format_params = format_params,
+      .icc_type = icc_type,
+      .icc_filename = icc_filename,
+      .icc_intent = icc_intent };
+
+  return _export_outputs(imgid, &output, 1, ignore_exif, display_byteorder,
+                         high_quality, upscale, is_scaling, thumbnail_export,
+                         filter, copy_metadata, export_masks, storage,
+                         storage_params, num, total, metadata, history_end);
+}
+
+gboolean dt_imageio_export_multi(const dt_imgid_t imgid,
+                                 dt_imageio_export_output_t *outputs,
+                                 const int count,
+                                 const gboolean upscale,
+                                 const gboolean copy_metadata,
+                                 const gboolean export_masks,
+                                 dt_imageio_module_storage_t *storage,
+                                 dt_imageio_module_data_t *storage_params,
+                                 const int num,
+                                 const int total,
+                                 dt_export_metadata_t *metadata)
+{
+  // plain copies don't need the pipe
+  dt_imageio_export_output_t *processed = g_new(dt_imageio_export_output_t, count);
+  int processed_count = 0;
+  for(int k = 0; k < count; k++)
+  {
+    dt_imageio_export_output_t *out = outputs + k;
+    if(strcmp(out->format->mime(out->format_params), "x-copy") == 0)
+      out->failed = (out->format->write_image(out->format_params, out->filename,
+                                              NULL, out->icc_type, out->icc_filename,
+                                              NULL, 0, imgid, num, total, NULL,
+                                              export_masks)) != 0;
+    else
+      processed[processed_count++] = *out;
+  }
+
+  gboolean failed = FALSE;
+  if(processed_count)
+  {
+    const gboolean is_scaling =
+      dt_conf_is_equal("plugins/lighttable/export/resizing", "scaling");
+
+    // high quality processing is implied, the outputs branch off the full
+    // resolution pipe in front of finalscale
+    _export_outputs(imgid, processed, processed_count, FALSE, FALSE, TRUE,
+                    upscale, is_scaling, FALSE, NULL, copy_metadata, export_masks,
+                    storage, storage_params, num, total, metadata, -1);
+  }
+
+  for(int k = 0, p = 0; k < count; k++)
+  {
+    if(strcmp(outputs[k].format->mime(outputs[k].format_params), "x-copy") != 0)
+      outputs[k].failed = processed[p++].failed;
+    failed |= outputs[k].failed;
+  }
+  g_free(processed);
+  return failed;
+}
+
 // fallback read method in case file could not be opened yet.
 // use GraphicsMagick (if supported) to read exotic LDRs
 dt_imageio_retval_t dt_imageio_open_exotic(dt_image_t *img,
@@ -102,6 +102,33 @@ gboolean dt_imageio_export(const dt_imgid_t imgid,
                       const int total,
                       dt_export_metadata_t *metadata);
 
+/** one output of dt_imageio_export_multi() */
+typedef struct dt_imageio_export_output_t
+{
+  const char *filename;
+  struct dt_imageio_module_format_t *format;
+  struct dt_imageio_module_data_t *format_params;
+  dt_colorspaces_color_profile_type_t icc_type;
+  const gchar *icc_filename;
+  dt_iop_color_intent_t icc_intent;
+  gboolean failed; // set by the export
+} dt_imageio_export_output_t;
+
+/** exports one image to several outputs (size, profile, format) while
+    processing the pipe only once up to colorout/finalscale. the style of the
+    first output is used for all of them. returns TRUE if any output failed. */
+gboolean dt_imageio_export_multi(const dt_imgid_t imgid,
+                                 dt_imageio_export_output_t *outputs,
+                                 const int count,
+                                 const gboolean upscale,
+                                 const gboolean copy_metadata,
+                                 const gboolean export_masks,
+                                 struct dt_imageio_module_storage_t *storage,
+                                 struct dt_imageio_module_data_t *storage_params,
+                                 const int num,
+                                 const int total,
+                                 dt_export_metadata_t *metadata);
+
 gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid, const char *filename,
                                  struct dt_imageio_module_format_t *format,
                                  struct dt_imageio_module_data_t *format_params,
@@ -259,6 +259,7 @@ int dt_imageio_jpeg_decompress(dt_imageio_jpeg_t *jpg, uint8_t *out)
 
 int dt_imageio_jpeg_compress(const uint8_t *in,
                              uint8_t *out,
+                             const size_t out_size,
                              const int width,
                              const int height,
                              const int quality)
@@ -269,7 +270,7 @@ int dt_imageio_jpeg_compress(const uint8_t *in,
   jpg.dest.empty_output_buffer = dt_imageio_jpeg_empty_output_buffer;
   jpg.dest.term_destination = dt_imageio_jpeg_term_destination;
   jpg.dest.next_output_byte = (JOCTET *)out;
-  jpg.dest.free_in_buffer = sizeof(uint8_t) * 4 * width * height;
+  jpg.dest.free_in_buffer = out_size;
 
   jpg.cinfo.err = jpeg_std_error(&jerr.pub);
   jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
@@ -304,7 +305,7 @@ int dt_imageio_jpeg_compress(const uint8_t *in,
   jpeg_finish_compress(&(jpg.cinfo));
   dt_free_align(row);
   jpeg_destroy_compress(&(jpg.cinfo));
-  return sizeof(uint8_t) * 4 * width * height - jpg.dest.free_in_buffer;
+  return out_size - jpg.dest.free_in_buffer;
 }
 
 
@@ -48,10 +48,10 @@ typedef struct dt_imageio_jpeg_t
 int dt_imageio_jpeg_decompress_header(const void *in, size_t length, dt_imageio_jpeg_t *jpg);
 /** reads the whole image to the out buffer, which has to be large enough. */
 int dt_imageio_jpeg_decompress(dt_imageio_jpeg_t *jpg, uint8_t *out);
-/** compresses in to out buffer with given quality (0..100). out buffer must be large enough. returns actual
- * data length. */
-int dt_imageio_jpeg_compress(const uint8_t *in, uint8_t *out, const int width, const int height,
-                             const int quality);
+/** compresses in to out buffer of out_size bytes with given quality (0..100). returns actual
+ * data length, 1 if the buffer was too small. */
+int dt_imageio_jpeg_compress(const uint8_t *in, uint8_t *out, const size_t out_size, const int width,
+                             const int height, const int quality);
 
 /** write jpeg to file, with exif if not NULL. */
 int dt_imageio_jpeg_write(const char *filename, const uint8_t *in, const int width, const int height,
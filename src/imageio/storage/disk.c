@@ -336,14 +336,15 @@ int store(dt_imageio_module_storage_t *self,
   char pattern[DT_MAX_PATH_FOR_PARAMS];
   g_strlcpy(pattern, d->filename, sizeof(pattern));
   dt_image_full_path(imgid, input_dir, sizeof(input_dir), NULL);
-  // set variable values to expand them afterwards in darktable variables
-  dt_variables_set_max_width_height(d->vp, fdata->max_width, fdata->max_height);
-  dt_variables_set_upscale(d->vp, upscale);
 
   gboolean fail = FALSE;
   // we're potentially called in parallel. have sequence number synchronized:
   dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
   {
+    // set variable values to expand them afterwards in darktable variables
+    dt_variables_set_max_width_height(d->vp, fdata->max_width, fdata->max_height);
+    dt_variables_set_upscale(d->vp, upscale);
+
 try_again:
     // avoid braindead export which is bound to overwrite at random:
     if(total > 1 && !g_strrstr(pattern, "$"))
@@ -436,6 +437,10 @@ try_again:
         snprintf(c, filename_free_space, "_%.2d.%s", seq, ext);
         seq++;
       }
+
+      // claim the name, a concurrent store must not pick it before we have written it
+      FILE *claim = g_fopen(filename, "wb");
+      if(claim) fclose(claim);
     }
 
     // conflict handling option: skip
@@ -494,6 +499,7 @@ try_again:
              "[imageio_storage_disk] could not export to file: `%s'!",
              filename);
     dt_control_log(_("could not export to file `%s'!"), filename);
+    if(d->onsave_action == DT_EXPORT_ONCONFLICT_UNIQUEFILENAME) g_unlink(filename);
     return 1;
   }
 
@@ -508,6 +514,11 @@ size_t params_size(dt_imageio_module_storage_t *self)
   return sizeof(dt_imageio_disk_t) - sizeof(void *);
 }
 
+gboolean parallel_store(dt_imageio_module_storage_t *self)
+{
+  return TRUE;
+}
+
 void init(dt_imageio_module_storage_t *self)
 {
 #ifdef USE_LUA
@@ -192,8 +192,10 @@ int store(dt_imageio_module_storage_t *self,
   dt_control_log(ngettext("%d/%d exported to `%s'", "%d/%d exported to `%s'", num),
                  num, total, attachment->file);
 
-  DT_OMP_PRAGMA(critical) // store can be called in parallel, so synch access to shared memory
+  // store can be called in parallel, so synch access to shared memory
+  dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
   d->images = g_list_append(d->images, attachment);
+  dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
 
   g_free(filename);
 
@@ -205,6 +207,11 @@ size_t params_size(dt_imageio_module_storage_t *self)
   return sizeof(dt_imageio_email_t) - sizeof(GList *);
 }
 
+gboolean parallel_store(dt_imageio_module_storage_t *self)
+{
+  return TRUE;
+}
+
 void init(dt_imageio_module_storage_t *self)
 {
 }
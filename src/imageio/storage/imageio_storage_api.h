@@ -95,6 +95,10 @@ OPTIONAL(gboolean, export_enabled, struct dt_imageio_module_storage_t *self);
 /* for storage modules which require a login */
 OPTIONAL(gboolean, storage_login, struct dt_imageio_module_storage_t *self);
 
+/* TRUE if store() may be called for several images at the same time,
+   sharing the storage data but with one format data per thread */
+OPTIONAL(gboolean, parallel_store, struct dt_imageio_module_storage_t *self);
+
 #ifdef FULL_API_H
 
 #pragma GCC visibility pop
@@ -121,32 +121,23 @@ static int generate_cache(lua_State *L)
   const int min = luaL_checkinteger(L, 3);
   const int max = luaL_checkinteger(L, 4);
 
+  // the disk cache files are created on startup, only check they are usable
   if(create_dirs)
   {
-    for(dt_mipmap_size_t k = min; k <= max; k++)
+    for(dt_mipmap_size_t k = MAX(min, DT_MIPMAP_0); k <= max && k < DT_MIPMAP_F; k++)
     {
-      char dirname[PATH_MAX] = { 0 };
-      snprintf(dirname, sizeof(dirname), "%s.d/%d", darktable.mipmap_cache->cachedir, k);
-
-      if(!dt_util_test_writable_dir(dirname))
+      if(!darktable.mipmap_cache->pack[k])
       {
-        if(g_mkdir_with_parents(dirname, 0750))
-        {
-          dt_print(DT_DEBUG_ALWAYS, "[lua] could not create directory '%s'!", dirname);
-          return 1;
-        }
+        dt_print(DT_DEBUG_ALWAYS, "[lua] thumbnail cache for mip %d is not available!", k);
+        return 1;
       }
     }
   }
 
   for(int k = max; k >= min && k >= 0; k--)
   {
-    char filename[PATH_MAX] = { 0 };
-    snprintf(filename, sizeof(filename),
-             "%s.d/%d/%d.jpg", darktable.mipmap_cache->cachedir, k, imgid);
-
-    // if a valid thumbnail file is already on disc - do nothing
-    if(dt_util_test_image_file(filename)) continue;
+    // if a thumbnail is already on disc - do nothing
+    if(dt_mipmap_cache_disk_contains(imgid, k)) continue;
     // else, generate thumbnail and store in mipmap cache.
     dt_mipmap_buffer_t buf;
     dt_mipmap_cache_get(&buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
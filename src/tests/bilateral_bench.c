@@ -0,0 +1,237 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// benchmark for the splat and slice of the bilateral grid against the former
+// implementation, which splatted into a private grid per thread and merged
+// them afterwards. reports Mpix/s for growing numbers of threads and the
+// largest difference of the sliced results.
+//
+// usage: darktable-bench-bilateral [width] [height] [sigma_s] [sigma_r]
+
+#include "common/bilateral.h"
+#include "common/darktable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+#define RUNS 5
+
+// the former implementation, kept for comparison
+typedef struct legacy_grid_t
+{
+  dt_bilateral_t b;
+  int numslices, sliceheight, slicerows;
+  float *buf;
+} legacy_grid_t;
+
+static size_t _relgrid(const dt_bilateral_t *b, const int i, const float L, float *xf, float *zf)
+{
+  const float x = CLAMPS(i * b->sigma_s_inv, 0, b->size_x - 1);
+  const float z = CLAMPS(L * b->sigma_r_inv, 0, b->size_z - 1);
+  const int xi = MIN((int)x, b->size_x - 2);
+  const int zi = MIN((int)z, b->size_z - 2);
+  *xf = x - xi;
+  *zf = z - zi;
+  return (xi * b->size_z) + zi;
+}
+
+static void _legacy_init(legacy_grid_t *g, const int width, const int height,
+                         const float sigma_s, const float sigma_r, const int threads)
+{
+  dt_bilateral_grid_size(&g->b, width, height, 100.0f, sigma_s, sigma_r);
+  g->b.width = width;
+  g->b.height = height;
+  g->numslices = threads;
+  g->sliceheight = (height + g->numslices - 1) / g->numslices;
+  g->slicerows = (g->b.size_y + g->numslices - 1) / g->numslices + 2;
+  g->buf = dt_calloc_align_float(g->b.size_x * g->b.size_z * g->numslices * g->slicerows);
+}
+
+static void _legacy_splat(legacy_grid_t *g, const float *const in)
+{
+  const dt_bilateral_t *b = &g->b;
+  const size_t ox = b->size_z;
+  const size_t oy = b->size_x * b->size_z;
+  const float norm = 100.0f / (b->sigma_s * b->sigma_s);
+  float *const buf = g->buf;
+  const size_t offsets[8] = { 0, ox, oy, ox + oy, 1, 1 + ox, 1 + oy, 1 + oy + ox };
+
+  DT_OMP_PRAGMA(parallel for schedule(static) num_threads(g->numslices))
+  for(int slice = 0; slice < g->numslices; slice++)
+  {
+    const int firstrow = slice * g->sliceheight;
+    const int lastrow = MIN((slice + 1) * g->sliceheight, b->height);
+    const int slice_offset = slice * g->slicerows - (int)(firstrow * b->sigma_s_inv);
+    for(int j = firstrow; j < lastrow; j++)
+    {
+      const float y = CLAMPS(j * b->sigma_s_inv, 0, b->size_y - 1);
+      const int yi = MIN((int)y, b->size_y - 2);
+      const float yf = y - yi;
+      const size_t base = (size_t)(yi + slice_offset) * oy;
+      for(int i = 0; i < b->width; i++)
+      {
+        float xf, zf;
+        const float L = in[4 * ((size_t)j * b->width + i)];
+        const size_t gi = base + _relgrid(b, i, L, &xf, &zf);
+        const dt_aligned_pixel_t contrib = { (1.0f - xf) * (1.0f - yf) * norm,
+                                             xf * (1.0f - yf) * norm,
+                                             (1.0f - xf) * yf * norm,
+                                             xf * yf * norm };
+        for(int k = 0; k < 4; k++)
+        {
+          buf[gi + offsets[k]] += contrib[k] * (1.0f - zf);
+          buf[gi + offsets[k + 4]] += contrib[k] * zf;
+        }
+      }
+    }
+  }
+
+  for(int slice = 1; slice < g->numslices; slice++)
+  {
+    const int destrow = (int)(slice * g->sliceheight * b->sigma_s_inv);
+    float *dest = buf + destrow * oy;
+    for(int j = slice * g->slicerows; j < (slice + 1) * g->slicerows; j++)
+    {
+      float *src = buf + j * oy;
+      for(int i = 0; i < oy; i++) dest[i] += src[i];
+      dest += oy;
+      if(j < b->size_y) memset(buf + j * oy, 0, sizeof(float) * oy);
+    }
+  }
+}
+
+static void _legacy_slice(const legacy_grid_t *g, const float *const in, float *out, const float detail)
+{
+  const dt_bilateral_t *b = &g->b;
+  const float norm = -detail * b->sigma_r * 0.04f;
+  const size_t ox = b->size_z;
+  const size_t oy = b->size_x * b->size_z;
+  const float *const buf = g->buf;
+
+  DT_OMP_PRAGMA(parallel for collapse(2) schedule(static))
+  for(int j = 0; j < b->height; j++)
+    for(int i = 0; i < b->width; i++)
+    {
+      const size_t index = 4 * ((size_t)j * b->width + i);
+      const float L = in[index];
+      const float y = CLAMPS(j * b->sigma_s_inv, 0, b->size_y - 1);
+      const int yi = MIN((int)y, b->size_y - 2);
+      const float yf = y - yi;
+      float xf, zf;
+      const size_t gi = yi * oy + _relgrid(b, i, L, &xf, &zf);
+      const float Lout = fmaxf(0.0f, L
+                               + norm * (buf[gi] * (1.0f - xf) * (1.0f - yf) * (1.0f - zf)
+                                         + buf[gi + ox] * xf * (1.0f - yf) * (1.0f - zf)
+                                         + buf[gi + oy] * (1.0f - xf) * yf * (1.0f - zf)
+                                         + buf[gi + ox + oy] * xf * yf * (1.0f - zf)
+                                         + buf[gi + 1] * (1.0f - xf) * (1.0f - yf) * zf
+                                         + buf[gi + ox + 1] * xf * (1.0f - yf) * zf
+                                         + buf[gi + oy + 1] * (1.0f - xf) * yf * zf
+                                         + buf[gi + ox + oy + 1] * xf * yf * zf));
+      copy_pixel(out + index, in + index);
+      out[index] = Lout;
+    }
+}
+
+static void _run(const int width, const int height, const float sigma_s, const float sigma_r,
+                 const int threads, const float *const in, float *const out_legacy, float *const out)
+{
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#endif
+  const double mpix = 1e-6 * width * height * RUNS;
+
+  double splat_legacy = 0.0, slice_legacy = 0.0;
+  for(int r = 0; r < RUNS; r++)
+  {
+    legacy_grid_t g;
+    _legacy_init(&g, width, height, sigma_s, sigma_r, threads);
+    const double t0 = dt_get_wtime();
+    _legacy_splat(&g, in);
+    const double t1 = dt_get_wtime();
+    _legacy_slice(&g, in, out_legacy, -1.0f);
+    slice_legacy += dt_get_wtime() - t1;
+    splat_legacy += t1 - t0;
+    dt_free_align(g.buf);
+  }
+
+  double splat = 0.0, slice = 0.0;
+  for(int r = 0; r < RUNS; r++)
+  {
+    dt_bilateral_t *b = dt_bilateral_init(width, height, sigma_s, sigma_r);
+    if(!b) return;
+    const double t0 = dt_get_wtime();
+    dt_bilateral_splat(b, in);
+    const double t1 = dt_get_wtime();
+    dt_bilateral_slice(b, in, out, -1.0f);
+    slice += dt_get_wtime() - t1;
+    splat += t1 - t0;
+    dt_bilateral_free(b);
+  }
+
+  float diff = 0.0f;
+  for(size_t k = 0; k < (size_t)width * height * 4; k++)
+    diff = fmaxf(diff, fabsf(out[k] - out_legacy[k]));
+
+  printf("%7d %12.1f %12.1f %12.1f %12.1f %10.2g\n", threads,
+         mpix / splat_legacy, mpix / splat, mpix / slice_legacy, mpix / slice, diff);
+}
+
+int main(int argc, char *argv[])
+{
+  const int width = argc > 1 ? MAX(16, atoi(argv[1])) : 6000;
+  const int height = argc > 2 ? MAX(16, atoi(argv[2])) : 4000;
+  const float sigma_s = argc > 3 ? MAX(0.5f, atof(argv[3])) : 50.0f;
+  const float sigma_r = argc > 4 ? MAX(0.5f, atof(argv[4])) : 10.0f;
+
+  const size_t nfloats = (size_t)width * height * 4;
+  float *in = dt_alloc_align_float(nfloats);
+  float *out_legacy = dt_alloc_align_float(nfloats);
+  float *out = dt_alloc_align_float(nfloats);
+  if(!in || !out_legacy || !out)
+  {
+    fprintf(stderr, "can't allocate %dx%d buffers\n", width, height);
+    return 1;
+  }
+  // smooth L gradients with some texture, the other channels don't matter
+  for(size_t k = 0; k < nfloats; k++)
+    in[k] = 50.0f + 45.0f * sinf(0.0013f * k) * cosf(0.00007f * k);
+
+  const int max_threads = omp_get_max_threads();
+  printf("%dx%d, sigma_s %g, sigma_r %g\n", width, height, sigma_s, sigma_r);
+  printf("                     splat Mpix/s               slice Mpix/s\n");
+  printf("threads       legacy         grid       legacy         grid   max diff\n");
+  for(int threads = 1; threads < max_threads; threads *= 2)
+    _run(width, height, sigma_s, sigma_r, threads, in, out_legacy, out);
+  _run(width, height, sigma_s, sigma_r, max_threads, in, out_legacy, out);
+
+  dt_free_align(in);
+  dt_free_align(out_legacy);
+  dt_free_align(out);
+  return 0;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,127 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// micro-benchmark for dt_cache_t: many reader threads doing get/release
+// on a preloaded set of keys, reports the throughput and lock contention.
+//
+// usage: darktable-bench-cache [threads] [keys] [segments] [seconds]
+
+#include "common/cache.h"
+#include "common/darktable.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+typedef struct bench_thread_t
+{
+  pthread_t thread;
+  dt_cache_t *cache;
+  uint32_t keys;
+  uint32_t seed;
+  double stop;
+  uint64_t ops;
+} bench_thread_t;
+
+static void *_reader(void *data)
+{
+  bench_thread_t *t = (bench_thread_t *)data;
+  uint32_t state = t->seed;
+  uint64_t ops = 0;
+  while(dt_get_wtime() < t->stop)
+  {
+    // check the clock only every now and then
+    for(int k = 0; k < 1024; k++)
+    {
+      // xorshift, deterministic per thread
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      dt_cache_entry_t *entry = dt_cache_get(t->cache, state % t->keys, 'r');
+      dt_cache_release(t->cache, entry);
+    }
+    ops += 1024;
+  }
+  t->ops = ops;
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  const int threads = argc > 1 ? MAX(1, atoi(argv[1])) : 16;
+  const uint32_t keys = argc > 2 ? MAX(1, atoi(argv[2])) : 50000;
+  const uint32_t segments = argc > 3 ? MAX(1, atoi(argv[3])) : 1;
+  const double seconds = argc > 4 ? MAX(0.1, atof(argv[4])) : 5.0;
+
+  // quota large enough to keep all keys, we measure hits only
+  dt_cache_t cache;
+  dt_cache_init_segmented(&cache, 64, 2 * (size_t)keys, segments);
+
+  for(uint32_t k = 0; k < keys; k++)
+  {
+    dt_cache_entry_t *entry = dt_cache_get(&cache, k, 'w');
+    dt_cache_release(&cache, entry);
+  }
+
+  uint64_t locks_before = 0, contended_before = 0;
+  dt_cache_get_contention(&cache, &locks_before, &contended_before);
+
+  bench_thread_t *t = calloc(threads, sizeof(bench_thread_t));
+  const double start = dt_get_wtime();
+  for(int k = 0; k < threads; k++)
+  {
+    t[k].cache = &cache;
+    t[k].keys = keys;
+    t[k].seed = 0x9e3779b9u * (k + 1);
+    t[k].stop = start + seconds;
+    pthread_create(&t[k].thread, NULL, _reader, t + k);
+  }
+
+  uint64_t ops = 0;
+  for(int k = 0; k < threads; k++)
+  {
+    pthread_join(t[k].thread, NULL);
+    ops += t[k].ops;
+  }
+  const double elapsed = dt_get_wtime() - start;
+
+  uint64_t locks = 0, contended = 0;
+  dt_cache_get_contention(&cache, &locks, &contended);
+  locks -= locks_before;
+  contended -= contended_before;
+
+  printf("threads %d, keys %u, segments %u\n", threads, keys, cache.num_segments);
+  printf("%.3f Mops/s get+release (%" PRIu64 " ops in %.2fs)\n",
+         ops / elapsed * 1e-6, ops, elapsed);
+  printf("lock acquisitions %" PRIu64 ", contended %" PRIu64 " (%.2f%%)\n",
+         locks, contended, locks ? 100.0 * contended / (double)locks : 0.0);
+
+  free(t);
+  dt_cache_cleanup(&cache);
+  return 0;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,105 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// throughput benchmark for the recursive gaussian blur of 1 and 4 channel
+// images at several sigmas, reports Mpix/s of dt_gaussian_blur() and
+// dt_gaussian_blur_4c().
+//
+// usage: darktable-bench-gaussian [width] [height] [runs]
+
+#include "common/darktable.h"
+#include "common/gaussian.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+static const float sigmas[] = { 1.0f, 4.0f, 16.0f, 64.0f };
+
+static double _run(const int width,
+                   const int height,
+                   const int channels,
+                   const float sigma,
+                   const int runs,
+                   const float *const in,
+                   float *const out)
+{
+  const dt_aligned_pixel_t max = { 1.0f, 1.0f, 1.0f, 1.0f };
+  const dt_aligned_pixel_t min = { 0.0f, 0.0f, 0.0f, 0.0f };
+  dt_gaussian_t *g = dt_gaussian_init(width, height, channels, max, min, sigma, DT_IOP_GAUSSIAN_ZERO);
+  if(!g) return 0.0;
+
+  // warm up the caches and the threads
+  if(channels == 4)
+    dt_gaussian_blur_4c(g, in, out);
+  else
+    dt_gaussian_blur(g, in, out);
+
+  const double start = dt_get_wtime();
+  for(int r = 0; r < runs; r++)
+  {
+    if(channels == 4)
+      dt_gaussian_blur_4c(g, in, out);
+    else
+      dt_gaussian_blur(g, in, out);
+  }
+  const double elapsed = dt_get_wtime() - start;
+
+  dt_gaussian_free(g);
+  return 1e-6 * width * height * runs / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+  const int width = argc > 1 ? MAX(16, atoi(argv[1])) : 6000;
+  const int height = argc > 2 ? MAX(16, atoi(argv[2])) : 4000;
+  const int runs = argc > 3 ? MAX(1, atoi(argv[3])) : 5;
+
+  const size_t nfloats = (size_t)width * height * 4;
+  float *in = dt_alloc_align_float(nfloats);
+  float *out = dt_alloc_align_float(nfloats);
+  if(!in || !out)
+  {
+    fprintf(stderr, "can't allocate %dx%d buffers\n", width, height);
+    return 1;
+  }
+  for(size_t k = 0; k < nfloats; k++) in[k] = (float)(k % 251) / 251.0f;
+
+  printf("%dx%d, %d runs, %d threads\n", width, height, runs, omp_get_max_threads());
+  printf("channels    sigma    Mpix/s\n");
+  for(int c = 0; c < 2; c++)
+  {
+    const int channels = c ? 4 : 1;
+    for(int s = 0; s < sizeof(sigmas) / sizeof(sigmas[0]); s++)
+      printf("%8d %8.1f %9.1f\n", channels, sigmas[s],
+             _run(width, height, channels, sigmas[s], runs, in, out));
+  }
+
+  dt_free_align(in);
+  dt_free_align(out);
+  return 0;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
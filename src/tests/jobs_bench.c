@@ -0,0 +1,160 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// stress benchmark for the job scheduler: producer threads flood the
+// control with tiny jobs on all queues, half of the jobs add a follow-up job
+// from the worker. reports the throughput and the dispatch latency, the time
+// from adding a job until a worker starts it.
+//
+// usage: darktable-bench-jobs [jobs] [producers]
+
+#include "common/darktable.h"
+#include "control/control.h"
+#include "control/jobs.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+typedef struct bench_job_t
+{
+  double queued;
+  int index;
+  gboolean spawn;
+} bench_job_t;
+
+static double *_latency = NULL;
+static dt_atomic_int _executed;
+static dt_atomic_int _next_index;
+
+static const dt_job_queue_t _queues[] = { DT_JOB_QUEUE_USER_FG, DT_JOB_QUEUE_SYSTEM_FG,
+                                          DT_JOB_QUEUE_USER_BG, DT_JOB_QUEUE_SYSTEM_BG };
+
+static void _add_job(const int index, const gboolean spawn);
+
+static int32_t _bench_job_run(dt_job_t *job)
+{
+  const bench_job_t *params = dt_control_job_get_params(job);
+  _latency[params->index] = dt_get_wtime() - params->queued;
+  dt_atomic_add_int(&_executed, 1);
+  if(params->spawn)
+    _add_job(dt_atomic_add_int(&_next_index, 1), FALSE);
+  return 0;
+}
+
+static void _add_job(const int index, const gboolean spawn)
+{
+  bench_job_t *params = malloc(sizeof(bench_job_t));
+  params->index = index;
+  params->spawn = spawn;
+  // unique descriptions, system foreground jobs are not deduplicated
+  dt_job_t *job = dt_control_job_create(_bench_job_run, "bench %d", index);
+  if(!job)
+  {
+    free(params);
+    return;
+  }
+  dt_control_job_set_params(job, params, free);
+  params->queued = dt_get_wtime();
+  dt_control_add_job(_queues[index % G_N_ELEMENTS(_queues)], job);
+}
+
+typedef struct bench_producer_t
+{
+  pthread_t thread;
+  int first, count;
+} bench_producer_t;
+
+static void *_producer(void *data)
+{
+  const bench_producer_t *p = (bench_producer_t *)data;
+  for(int k = 0; k < p->count; k++)
+    _add_job(p->first + k, (k & 1) == 0);
+  return NULL;
+}
+
+static int _compare_double(const void *a, const void *b)
+{
+  const double da = *(const double *)a, db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+int main(int argc, char *argv[])
+{
+  const int jobs = argc > 1 ? MAX(1, atoi(argv[1])) : 100000;
+  const int producers = argc > 2 ? MAX(1, atoi(argv[2])) : 4;
+
+  char *argv_override[] = { "darktable-bench-jobs", "--library", ":memory:",
+                            "--conf", "write_sidecar_files=never", NULL };
+  const int argc_override = sizeof(argv_override) / sizeof(*argv_override) - 1;
+  if(dt_init(argc_override, argv_override, FALSE, FALSE, NULL)) exit(1);
+
+  // every second job adds another one from the worker
+  const int produced = jobs / producers * producers;
+  const int total = produced + (produced + 1) / 2;
+  _latency = calloc(total, sizeof(double));
+  dt_atomic_set_int(&_executed, 0);
+  dt_atomic_set_int(&_next_index, produced);
+
+  bench_producer_t *p = calloc(producers, sizeof(bench_producer_t));
+  const double start = dt_get_wtime();
+  for(int k = 0; k < producers; k++)
+  {
+    p[k].first = k * (produced / producers);
+    p[k].count = produced / producers;
+    pthread_create(&p[k].thread, NULL, _producer, p + k);
+  }
+  for(int k = 0; k < producers; k++)
+    pthread_join(p[k].thread, NULL);
+
+  while(dt_control_jobs_pending() > 0)
+    g_usleep(100);
+  const double elapsed = dt_get_wtime() - start;
+
+  // system foreground jobs beyond the queue limit are dropped, they have no latency
+  const int executed = dt_atomic_get_int(&_executed);
+  double *latency = calloc(executed, sizeof(double));
+  int n = 0;
+  for(int k = 0; k < total && n < executed; k++)
+    if(_latency[k] > 0.0) latency[n++] = _latency[k];
+  qsort(latency, n, sizeof(double), _compare_double);
+
+  printf("workers %d, producers %d, %d jobs added, %d executed, %d dropped\n",
+         darktable.control->num_threads, producers, dt_atomic_get_int(&_next_index),
+         executed, dt_atomic_get_int(&_next_index) - executed);
+  printf("%.0f jobs/s (%.2fs)\n", executed / elapsed, elapsed);
+  if(n)
+    printf("dispatch latency us: p50 %.1f  p99 %.1f  max %.1f\n",
+           1e6 * latency[n / 2], 1e6 * latency[(int)(0.99 * (n - 1))], 1e6 * latency[n - 1]);
+
+  free(latency);
+  free(_latency);
+  free(p);
+  dt_cleanup();
+  return 0;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
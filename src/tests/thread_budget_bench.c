@@ -0,0 +1,194 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// latency benchmark for the shared thread budget: an interactive
+// thread repeatedly blurs a screen sized image while background threads blur
+// large images, like a darkroom pipe next to thumbnail pipes. reports the
+// latency of the interactive work and the background throughput with OpenMP
+// teams sized by dt_thread_budget_available() before each blur, as the pixelpipe does
+// before each module, and with a full OpenMP team per thread.
+//
+// usage: darktable-bench-thread-budget [background threads] [seconds]
+
+#include "common/darktable.h"
+#include "common/thread_budget.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+#define INTERACTIVE_WIDTH 1920
+#define INTERACTIVE_HEIGHT 1080
+#define BACKGROUND_WIDTH 4000
+#define BACKGROUND_HEIGHT 3000
+#define MAX_SAMPLES 100000
+
+typedef enum bench_mode_t
+{
+  BENCH_BUDGET,
+  BENCH_OPENMP
+} bench_mode_t;
+
+typedef struct bench_image_t
+{
+  float *in, *out;
+  size_t width, height;
+} bench_image_t;
+
+typedef struct bench_state_t
+{
+  dt_thread_budget_t *budget;
+  bench_mode_t mode;
+  int threads;
+  volatile gboolean running;
+  dt_atomic_int background_rows;
+} bench_state_t;
+
+// a 3x3 box blur of the rows [begin, end)
+static void _blur_rows(const bench_image_t *img, const size_t begin, const size_t end)
+{
+  const size_t w = img->width;
+  for(size_t j = MAX(begin, 1); j < MIN(end, img->height - 1); j++)
+    for(size_t i = 1; i < w - 1; i++)
+    {
+      float sum = 0.0f;
+      for(int dj = -1; dj <= 1; dj++)
+        for(int di = -1; di <= 1; di++)
+          sum += img->in[(j + dj) * w + i + di];
+      img->out[j * w + i] = sum / 9.0f;
+    }
+}
+
+static void _blur(bench_state_t *state, bench_image_t *img)
+{
+  // the budget as the pipe applies it before a module, or what every
+  // pipe did before: a full team of its own
+  DT_OMP_PRAGMA(parallel for schedule(static)
+                num_threads(state->mode == BENCH_BUDGET ? dt_thread_budget_available(state->budget) : state->threads))
+  for(size_t j = 0; j < img->height; j += 16)
+    _blur_rows(img, j, MIN(j + 16, img->height));
+}
+
+static bench_image_t _image_new(const size_t width, const size_t height)
+{
+  bench_image_t img = { .width = width, .height = height };
+  img.in = dt_alloc_align_float(width * height);
+  img.out = dt_alloc_align_float(width * height);
+  for(size_t k = 0; k < width * height; k++) img.in[k] = (float)(k % 251) / 251.0f;
+  return img;
+}
+
+static void _image_free(bench_image_t *img)
+{
+  dt_free_align(img->in);
+  dt_free_align(img->out);
+}
+
+static void *_background(void *data)
+{
+  bench_state_t *state = (bench_state_t *)data;
+  bench_image_t img = _image_new(BACKGROUND_WIDTH, BACKGROUND_HEIGHT);
+  dt_thread_budget_enter(state->budget, DT_THREAD_BUDGET_PRIORITY_BACKGROUND);
+  while(state->running)
+  {
+    _blur(state, &img);
+    dt_atomic_add_int(&state->background_rows, BACKGROUND_HEIGHT);
+  }
+  dt_thread_budget_leave(state->budget);
+  _image_free(&img);
+  return NULL;
+}
+
+static int _compare_double(const void *a, const void *b)
+{
+  const double da = *(const double *)a, db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+static void _run(bench_state_t *state, const char *name, const int background, const double seconds)
+{
+  state->running = TRUE;
+  dt_atomic_set_int(&state->background_rows, 0);
+  pthread_t *threads = calloc(MAX(1, background), sizeof(pthread_t));
+  int started = 0;
+  for(int k = 0; k < background; k++)
+    if(!pthread_create(&threads[started], NULL, _background, state)) started++;
+
+  bench_image_t img = _image_new(INTERACTIVE_WIDTH, INTERACTIVE_HEIGHT);
+  double *latency = calloc(MAX_SAMPLES, sizeof(double));
+  int n = 0;
+  dt_thread_budget_enter(state->budget, DT_THREAD_BUDGET_PRIORITY_INTERACTIVE);
+  const double start = dt_get_wtime();
+  while(n < MAX_SAMPLES && dt_get_wtime() - start < seconds)
+  {
+    const double t = dt_get_wtime();
+    _blur(state, &img);
+    latency[n++] = dt_get_wtime() - t;
+    // the user looks at the result for a moment
+    g_usleep(2000);
+  }
+  const double elapsed = dt_get_wtime() - start;
+  dt_thread_budget_leave(state->budget);
+
+  state->running = FALSE;
+  for(int k = 0; k < started; k++) pthread_join(threads[k], NULL);
+
+  qsort(latency, n, sizeof(double), _compare_double);
+  printf("%-22s %8.2f %8.2f %8.2f %14.2f\n", name,
+         1e3 * latency[n / 2], 1e3 * latency[(int)(0.99 * (n - 1))], 1e3 * latency[n - 1],
+         1e-6 * BACKGROUND_WIDTH * dt_atomic_get_int(&state->background_rows) / elapsed);
+
+  free(latency);
+  free(threads);
+  _image_free(&img);
+}
+
+int main(int argc, char *argv[])
+{
+  const int background = argc > 1 ? MAX(0, atoi(argv[1])) : 4;
+  const double seconds = argc > 2 ? MAX(0.5, atof(argv[2])) : 5.0;
+
+  bench_state_t state = { .threads = (int)dt_get_num_procs() };
+  state.budget = dt_thread_budget_new(state.threads);
+
+  printf("%d threads, %d background threads, interactive %dx%d, background %dx%d\n",
+         state.threads, background, INTERACTIVE_WIDTH, INTERACTIVE_HEIGHT,
+         BACKGROUND_WIDTH, BACKGROUND_HEIGHT);
+  printf("                       interactive latency ms  background Mpix/s\n");
+  printf("mode                        p50      p99      max\n");
+
+  state.mode = BENCH_BUDGET;
+  _run(&state, "idle", 0, seconds);
+  _run(&state, "core budget", background, seconds);
+  state.mode = BENCH_OPENMP;
+  _run(&state, "idle openmp", 0, seconds);
+  _run(&state, "openmp team per thread", background, seconds);
+
+  dt_thread_budget_free(state.budget);
+  return 0;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,168 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// micro-benchmark for the thumbnail codecs of the mipmap disk cache: all
+// jpg files of a directory are scaled to a thumbnail size and encoded with
+// each codec, reports the decode throughput and the disk footprint.
+//
+// usage: darktable-bench-thumbcodec <directory> [width] [height] [repeats]
+
+#include "common/darktable.h"
+#include "common/image.h"
+#include "common/mipmap_pack.h"
+#include "develop/imageop_math.h"
+#include "imageio/imageio_jpeg.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+typedef struct bench_thumb_t
+{
+  dt_mipmap_pack_record_t record[DT_MIPMAP_PACK_CODEC_LAST];
+  uint8_t *data[DT_MIPMAP_PACK_CODEC_LAST];
+} bench_thumb_t;
+
+static const char *_codec_name[DT_MIPMAP_PACK_CODEC_LAST] = { "jpeg", "qoi", "raw" };
+
+// load and downscale one image, returns NULL if it's not a readable jpeg
+static uint8_t *_load_thumb(const char *filename,
+                            const int max_width,
+                            const int max_height,
+                            uint32_t *width,
+                            uint32_t *height)
+{
+  dt_imageio_jpeg_t jpg;
+  if(dt_imageio_jpeg_read_header(filename, &jpg)) return NULL;
+  uint8_t *full = dt_alloc_align_uint8((size_t)jpg.width * jpg.height * 4);
+  if(!full || dt_imageio_jpeg_read(&jpg, full))
+  {
+    dt_free_align(full);
+    return NULL;
+  }
+  uint8_t *thumb = dt_alloc_align_uint8((size_t)max_width * max_height * 4);
+  dt_iop_flip_and_zoom_8(full, jpg.width, jpg.height, thumb, max_width, max_height,
+                         ORIENTATION_NONE, width, height);
+  dt_free_align(full);
+  return thumb;
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+  {
+    fprintf(stderr, "usage: %s <directory> [width] [height] [repeats]\n", argv[0]);
+    return 1;
+  }
+  const int max_width = argc > 2 ? MAX(16, atoi(argv[2])) : 720;
+  const int max_height = argc > 3 ? MAX(16, atoi(argv[3])) : 450;
+  const int repeats = argc > 4 ? MAX(1, atoi(argv[4])) : 5;
+
+  GDir *dir = g_dir_open(argv[1], 0, NULL);
+  if(!dir)
+  {
+    fprintf(stderr, "can't open directory `%s'\n", argv[1]);
+    return 1;
+  }
+
+  GArray *thumbs = g_array_new(FALSE, TRUE, sizeof(bench_thumb_t));
+  uint64_t pixels = 0;
+  double encode_time[DT_MIPMAP_PACK_CODEC_LAST] = { 0 };
+  const gchar *name;
+  while((name = g_dir_read_name(dir)))
+  {
+    if(!g_str_has_suffix(name, ".jpg") && !g_str_has_suffix(name, ".JPG")) continue;
+    gchar *filename = g_build_filename(argv[1], name, NULL);
+    uint32_t width = 0, height = 0;
+    uint8_t *pix = _load_thumb(filename, max_width, max_height, &width, &height);
+    g_free(filename);
+    if(!pix) continue;
+
+    bench_thumb_t thumb = { 0 };
+    gboolean ok = TRUE;
+    for(int c = 0; c < DT_MIPMAP_PACK_CODEC_LAST && ok; c++)
+    {
+      const double start = dt_get_wtime();
+      thumb.data[c] = dt_mipmap_pack_encode(c, pix, width, height, 89, &thumb.record[c].length);
+      encode_time[c] += dt_get_wtime() - start;
+      thumb.record[c].width = width;
+      thumb.record[c].height = height;
+      thumb.record[c].codec = c;
+      ok = thumb.data[c] != NULL;
+    }
+    dt_free_align(pix);
+    if(ok)
+    {
+      g_array_append_val(thumbs, thumb);
+      pixels += (uint64_t)width * height;
+    }
+    else
+      for(int c = 0; c < DT_MIPMAP_PACK_CODEC_LAST; c++) free(thumb.data[c]);
+  }
+  g_dir_close(dir);
+
+  if(!thumbs->len)
+  {
+    fprintf(stderr, "no jpg files found in `%s'\n", argv[1]);
+    return 1;
+  }
+
+  uint8_t *out = dt_alloc_align_uint8((size_t)max_width * max_height * 4);
+  printf("%u thumbnails up to %dx%d, %.1f Mpixels\n", thumbs->len, max_width, max_height, pixels * 1e-6);
+  printf("codec    size MB  ratio   encode ms/img  decode ms/img  decode Mpix/s\n");
+  double jpeg_decode = 0.0;
+  for(int c = 0; c < DT_MIPMAP_PACK_CODEC_LAST; c++)
+  {
+    uint64_t bytes = 0;
+    for(guint k = 0; k < thumbs->len; k++)
+      bytes += g_array_index(thumbs, bench_thumb_t, k).record[c].length;
+
+    int failed = 0;
+    const double start = dt_get_wtime();
+    for(int r = 0; r < repeats; r++)
+      for(guint k = 0; k < thumbs->len; k++)
+      {
+        const bench_thumb_t *t = &g_array_index(thumbs, bench_thumb_t, k);
+        failed += !dt_mipmap_pack_decode(&t->record[c], t->data[c], out);
+      }
+    const double decode = (dt_get_wtime() - start) / repeats;
+    if(c == DT_MIPMAP_PACK_CODEC_JPEG) jpeg_decode = decode;
+
+    printf("%-6s %9.2f %6.2f %15.3f %14.3f %14.1f  (%.1fx jpeg)%s\n",
+           _codec_name[c], bytes / (1024.0 * 1024.0), (double)bytes / (4.0 * pixels),
+           1e3 * encode_time[c] / thumbs->len, 1e3 * decode / thumbs->len,
+           pixels / decode * 1e-6, jpeg_decode / decode,
+           failed ? "  DECODE FAILURES" : "");
+  }
+
+  dt_free_align(out);
+  for(guint k = 0; k < thumbs->len; k++)
+    for(int c = 0; c < DT_MIPMAP_PACK_CODEC_LAST; c++)
+      free(g_array_index(thumbs, bench_thumb_t, k).data[c]);
+  g_array_free(thumbs, TRUE);
+  return 0;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
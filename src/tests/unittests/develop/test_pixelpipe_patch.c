@@ -0,0 +1,393 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the incremental processing of develop/pixelpipe_hb.c
+ *
+ * a stub module, a 3x3 box blur, is patched by _pixelpipe_patch_on_CPU(): the
+ * dirty area of its input is grown by the module's spread, a crop grown once
+ * more is processed and the dirty part of it is pasted into the old output.
+ * the result has to be the same as processing the whole new input.
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/tracing.h"
+
+#include "develop/pixelpipe_hb.c"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+/*
+ * DEFINITIONS
+ */
+
+#define WIDTH 61
+#define HEIGHT 47
+#define CH 4
+#define BPP (CH * sizeof(float))
+
+// a module computing each output pixel from the 3x3 neighbourhood of its input
+#define SPREAD 1
+
+/*
+ * HELPER FUNCTIONS
+ */
+
+static float *_image_new(void)
+{
+  float *img = dt_alloc_align_float((size_t)CH * WIDTH * HEIGHT);
+  for(int k = 0; k < CH * WIDTH * HEIGHT; k++)
+    img[k] = (float)((k * 37) % 101) / 101.0f;
+  return img;
+}
+
+// the 3x3 box blur, repeating the border pixels like modules do at the edge of their roi
+static void _blur(const float *in, float *out, const int width, const int height)
+{
+  for(int j = 0; j < height; j++)
+    for(int i = 0; i < width; i++)
+      for(int c = 0; c < CH; c++)
+      {
+        float sum = 0.0f;
+        for(int dj = -1; dj <= 1; dj++)
+          for(int di = -1; di <= 1; di++)
+          {
+            const int y = CLAMP(j + dj, 0, height - 1);
+            const int x = CLAMP(i + di, 0, width - 1);
+            sum += in[CH * (y * width + x) + c];
+          }
+        out[CH * (j * width + i) + c] = sum / 9.0f;
+      }
+}
+
+// changes the pixels of the rectangle, like a moved shape in an earlier module
+static void _change(float *img, const dt_dev_pixelpipe_dirty_t *rect)
+{
+  for(int j = rect->y; j < rect->y + rect->height; j++)
+    for(int i = rect->x; i < rect->x + rect->width; i++)
+      for(int c = 0; c < CH; c++)
+        img[CH * (j * WIDTH + i) + c] += 0.25f + 0.01f * c;
+}
+
+/*
+ * STUB MODULE
+ */
+
+// the pipe, develop and piece the stub module is processed in
+typedef struct _stub_t
+{
+  dt_dev_pixelpipe_t pipe;
+  dt_develop_t dev;
+  dt_iop_module_t module;
+  dt_dev_pixelpipe_iop_t piece;
+} _stub_t;
+
+static int _refresource[4] = { 1024, 0, 0, 0 };
+
+static void _stub_process(dt_iop_module_t *self,
+                          dt_dev_pixelpipe_iop_t *piece,
+                          const void *const i,
+                          void *const o,
+                          const dt_iop_roi_t *const roi_in,
+                          const dt_iop_roi_t *const roi_out)
+{
+  _blur(i, o, roi_out->width, roi_out->height);
+}
+
+static dt_iop_colorspace_type_t _stub_colorspace(dt_iop_module_t *self,
+                                                 dt_dev_pixelpipe_t *pipe,
+                                                 dt_dev_pixelpipe_iop_t *piece)
+{
+  return IOP_CS_RGB;
+}
+
+static const dt_iop_buffer_dsc_t _format = { .channels = CH,
+                                             .datatype = TYPE_FLOAT,
+                                             .cst = IOP_CS_RGB };
+
+// patches the stub module's old output with _pixelpipe_patch_on_CPU(),
+// returns the dirty area of the output for the next module
+static dt_dev_pixelpipe_dirty_t _patch(_stub_t *stub,
+                                       float *input,
+                                       const float *old_output,
+                                       const dt_iop_buffer_dsc_t *old_format,
+                                       float *output,
+                                       const dt_dev_pixelpipe_dirty_t *input_dirty)
+{
+  const dt_iop_roi_t roi = { .x = 0, .y = 0, .width = WIDTH, .height = HEIGHT, .scale = 1.0f };
+
+  // the module spreads the changes of its input, see _pixelpipe_process_rec()
+  dt_dev_pixelpipe_dirty_t dirty = *input_dirty;
+  _dirty_grow(&dirty, SPREAD, &roi);
+
+  dt_iop_buffer_dsc_t in_format = _format;
+  dt_iop_buffer_dsc_t out_dsc = _format;
+  dt_iop_buffer_dsc_t *out_format = &out_dsc;
+  dt_develop_tiling_t tiling = { .factor = 2.0f, .factor_cl = 2.0f, .overlap = SPREAD };
+  dt_pixelpipe_flow_t flow = PIXELPIPE_FLOW_NONE;
+  void *out = output;
+  stub->pipe.dsc = _format;
+
+  const gboolean stopped =
+    _pixelpipe_patch_on_CPU(&stub->pipe, &stub->dev, input, &in_format, &roi,
+                            &out, &out_format, &roi, &stub->module, &stub->piece,
+                            &tiling, &flow, 0, old_output, old_format, &dirty, SPREAD);
+  assert_false(stopped);
+  assert_ptr_equal(out, output);
+  return dirty;
+}
+
+static _inc_shape_t *_shape_new(const _inc_shape_t *shape)
+{
+  _inc_shape_t *copy = g_new(_inc_shape_t, 1);
+  *copy = *shape;
+  return copy;
+}
+
+static void _assert_images_equal(const float *a, const float *b)
+{
+  for(int k = 0; k < CH * WIDTH * HEIGHT; k++)
+  {
+    if(a[k] != b[k])
+      TR_DEBUG("pixel %d,%d channel %d: %e != %e",
+               (k / CH) % WIDTH, (k / CH) / WIDTH, k % CH, a[k], b[k]);
+    assert_true(a[k] == b[k]);
+  }
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_dirty_add(void **state)
+{
+  dt_dev_pixelpipe_dirty_t d = { 0 };
+  assert_true(_dirty_empty(&d));
+
+  _dirty_add(&d, 10, 12, 0, 5);
+  assert_true(_dirty_empty(&d));
+
+  _dirty_add(&d, 10, 12, 4, 5);
+  _dirty_add(&d, 2, 20, 3, 3);
+  assert_int_equal(d.x, 2);
+  assert_int_equal(d.y, 12);
+  assert_int_equal(d.width, 12);
+  assert_int_equal(d.height, 11);
+
+  TR_STEP("verify that growing stays inside the roi");
+  const dt_iop_roi_t roi = { .x = 0, .y = 0, .width = 16, .height = 24, .scale = 1.0f };
+  _dirty_grow(&d, 3, &roi);
+  assert_int_equal(d.x, 0);
+  assert_int_equal(d.y, 9);
+  assert_int_equal(d.width, 16);
+  assert_int_equal(d.height, 15);
+}
+
+static void test_changed_shapes(void **state)
+{
+  const dt_iop_roi_t roi = { .x = 8, .y = 4, .width = 100, .height = 80, .scale = 0.5f };
+  GHashTable *old_shapes = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+  GHashTable *new_shapes = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+
+  // shape 1 stays, shape 2 moves, shape 3 is removed
+  const _inc_shape_t shapes[] = { { 1, 20, 20, 10, 10 },
+                                  { 2, 40, 40, 20, 20 },
+                                  { 3, 100, 30, 10, 10 },
+                                  { 4, 60, 44, 20, 20 } };
+  g_hash_table_insert(old_shapes, GINT_TO_POINTER(1), _shape_new(&shapes[0]));
+  g_hash_table_insert(old_shapes, GINT_TO_POINTER(2), _shape_new(&shapes[1]));
+  g_hash_table_insert(old_shapes, GINT_TO_POINTER(3), _shape_new(&shapes[2]));
+  g_hash_table_insert(new_shapes, GINT_TO_POINTER(1), _shape_new(&shapes[0]));
+  g_hash_table_insert(new_shapes, GINT_TO_POINTER(2), _shape_new(&shapes[3]));
+
+  TR_STEP("verify that unchanged shapes are not dirty");
+  dt_dev_pixelpipe_dirty_t d = { 0 };
+  _dirty_add_changed_shapes(&d, new_shapes, new_shapes, &roi);
+  assert_true(_dirty_empty(&d));
+
+  TR_STEP("verify that old and new areas of moved and removed shapes are dirty");
+  _dirty_add_changed_shapes(&d, old_shapes, new_shapes, &roi);
+  // in pixels of the roi: from 40 * 0.5 - 8 = 12 to 110 * 0.5 - 8 = 47
+  // and from 30 * 0.5 - 4 = 11 to 64 * 0.5 - 4 = 28
+  assert_int_equal(d.x, 12);
+  assert_int_equal(d.y, 11);
+  assert_int_equal(d.width, 35);
+  assert_int_equal(d.height, 17);
+
+  g_hash_table_destroy(old_shapes);
+  g_hash_table_destroy(new_shapes);
+}
+
+static void test_patch_equals_full_process(void **state)
+{
+  _stub_t *stub = *state;
+  // inside, at the border and at a corner of the image
+  const dt_dev_pixelpipe_dirty_t rects[] = { { 0, 0, 20, 15, 9, 7 },
+                                             { 0, 0, 0, 30, 5, 11 },
+                                             { 0, 0, WIDTH - 4, HEIGHT - 3, 4, 3 },
+                                             { 0, 0, 0, 0, WIDTH, HEIGHT } };
+  float *old_in = _image_new();
+  float *new_in = _image_new();
+  float *old_out = dt_alloc_align_float((size_t)CH * WIDTH * HEIGHT);
+  float *full = dt_alloc_align_float((size_t)CH * WIDTH * HEIGHT);
+  float *patched = dt_alloc_align_float((size_t)CH * WIDTH * HEIGHT);
+
+  for(int r = 0; r < sizeof(rects) / sizeof(rects[0]); r++)
+  {
+    TR_STEP("verify the patch of a %dx%d change at %d,%d",
+            rects[r].width, rects[r].height, rects[r].x, rects[r].y);
+    memcpy(new_in, old_in, BPP * WIDTH * HEIGHT);
+    _change(new_in, &rects[r]);
+
+    _blur(old_in, old_out, WIDTH, HEIGHT);
+    _blur(new_in, full, WIDTH, HEIGHT);
+    _patch(stub, new_in, old_out, &_format, patched, &rects[r]);
+    _assert_images_equal(patched, full);
+  }
+
+  dt_free_align(old_in);
+  dt_free_align(new_in);
+  dt_free_align(old_out);
+  dt_free_align(full);
+  dt_free_align(patched);
+}
+
+static void test_patch_chain(void **state)
+{
+  _stub_t *stub = *state;
+  TR_STEP("verify that the dirty area passed on patches the next module");
+  const dt_dev_pixelpipe_dirty_t rect = { 0, 0, 30, 20, 6, 6 };
+  float *old_in = _image_new();
+  float *new_in = _image_new();
+  _change(new_in, &rect);
+
+  float *old_mid = dt_alloc_align_float((size_t)CH * WIDTH * HEIGHT);
+  float *old_out = dt_alloc_align_float((size_t)CH * WIDTH * HEIGHT);
+  float *mid = dt_alloc_align_float((size_t)CH * WIDTH * HEIGHT);
+  float *full = dt_alloc_align_float((size_t)CH * WIDTH * HEIGHT);
+  float *patched = dt_alloc_align_float((size_t)CH * WIDTH * HEIGHT);
+
+  _blur(old_in, old_mid, WIDTH, HEIGHT);
+  _blur(old_mid, old_out, WIDTH, HEIGHT);
+  _blur(new_in, mid, WIDTH, HEIGHT);
+  _blur(mid, full, WIDTH, HEIGHT);
+
+  const dt_dev_pixelpipe_dirty_t mid_dirty =
+    _patch(stub, new_in, old_mid, &_format, mid, &rect);
+  const dt_dev_pixelpipe_dirty_t out_dirty =
+    _patch(stub, mid, old_out, &_format, patched, &mid_dirty);
+  assert_int_equal(out_dirty.x, rect.x - 2 * SPREAD);
+  assert_int_equal(out_dirty.width, rect.width + 4 * SPREAD);
+  _assert_images_equal(patched, full);
+
+  dt_free_align(old_in);
+  dt_free_align(new_in);
+  dt_free_align(old_mid);
+  dt_free_align(old_out);
+  dt_free_align(mid);
+  dt_free_align(full);
+  dt_free_align(patched);
+}
+
+static void test_patch_fallback(void **state)
+{
+  TR_STEP("verify that an old output in another colorspace is processed in full");
+  _stub_t *stub = *state;
+  const dt_dev_pixelpipe_dirty_t rect = { 0, 0, 10, 10, 4, 4 };
+  const dt_iop_buffer_dsc_t lab_format = { .channels = CH,
+                                           .datatype = TYPE_FLOAT,
+                                           .cst = IOP_CS_LAB };
+  float *in = _image_new();
+  float *old_out = dt_alloc_align_float((size_t)CH * WIDTH * HEIGHT);
+  float *full = dt_alloc_align_float((size_t)CH * WIDTH * HEIGHT);
+  float *out = dt_alloc_align_float((size_t)CH * WIDTH * HEIGHT);
+
+  // nothing of the old output may show up
+  memset(old_out, 0, BPP * WIDTH * HEIGHT);
+  _blur(in, full, WIDTH, HEIGHT);
+  _patch(stub, in, old_out, &lab_format, out, &rect);
+  _assert_images_equal(out, full);
+
+  dt_free_align(in);
+  dt_free_align(old_out);
+  dt_free_align(full);
+  dt_free_align(out);
+}
+
+/*
+ * SETUP AND TEARDOWN
+ */
+
+static int _setup(void **state)
+{
+  // the memory budget deciding on tiling
+  darktable.dtresources.refresource = _refresource;
+  darktable.dtresources.level = -1;
+
+  _stub_t *stub = g_new0(_stub_t, 1);
+  stub->pipe.type = DT_DEV_PIXELPIPE_EXPORT;
+  dt_atomic_set_int(&stub->pipe.shutdown, DT_DEV_PIXELPIPE_STOP_NO);
+  g_strlcpy(stub->module.op, "blur", sizeof(stub->module.op));
+  stub->module.dev = &stub->dev;
+  stub->module.process = _stub_process;
+  stub->module.input_colorspace = _stub_colorspace;
+  stub->module.output_colorspace = _stub_colorspace;
+  stub->piece.module = &stub->module;
+  stub->piece.pipe = &stub->pipe;
+  stub->piece.enabled = TRUE;
+  stub->piece.dsc_in = stub->piece.dsc_out = _format;
+  *state = stub;
+  return 0;
+}
+
+static int _teardown(void **state)
+{
+  g_free(*state);
+  return 0;
+}
+
+/*
+ * MAIN FUNCTION
+ */
+int main(int argc, char* argv[])
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_dirty_add),
+    cmocka_unit_test(test_changed_shapes),
+    cmocka_unit_test(test_patch_equals_full_process),
+    cmocka_unit_test(test_patch_chain),
+    cmocka_unit_test(test_patch_fallback)
+  };
+
+  return cmocka_run_group_tests(tests, _setup, _teardown);
+}
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
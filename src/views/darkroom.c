@@ -31,6 +31,7 @@
 #include "common/overlay.h"
 #include "common/selection.h"
 #include "common/styles.h"
+#include "common/thread_budget.h"
 #include "common/tags.h"
 #include "common/undo.h"
 #include "common/utility.h"
@@ -78,6 +79,8 @@
 DT_MODULE(1)
 
 static void _update_softproof_gamut_checking(dt_develop_t *d);
+static void _speculative_init(void);
+static void _speculative_cleanup(void);
 
 /* signal handler for filmstrip image switching */
 
@@ -157,6 +160,8 @@ void init(dt_view_t *self)
 
   dt_dev_init(dev, TRUE);
 
+  _speculative_init();
+
   darktable.view_manager->proxy.darkroom.view = self;
 
 #ifdef USE_LUA
@@ -206,6 +211,8 @@ void cleanup(dt_view_t *self)
     dt_conf_set_bool("second_window/last_visible", FALSE);
   }
 
+  _speculative_cleanup();
+
   dt_dev_cleanup(dev);
   free(dev);
 }
@@ -476,6 +483,346 @@ static void _view_paint_surface(cairo_t *cr,
   dt_pthread_mutex_unlock(&p->backbuf_mutex);
 }
 
+/* speculative processing of the neighbouring images.
+
+   while an image is edited, a background job loads the previous and next
+   images of the collection and processes them at screen size. their raws
+   stay decoded in the full mipmap cache and the renditions are kept here,
+   so moving to one of them shows it at once while its own pipes run. the
+   job runs with background priority, starts only once the pipes of the
+   edited image are done and drops its pipe as soon as they need the cores
+   again.
+*/
+#define DT_SPECULATIVE_SLOTS 2
+
+typedef struct _speculative_slot_t
+{
+  dt_imgid_t imgid;
+  GTimeSpan change_timestamp; // of the image when it was processed
+  size_t display_width, display_height; // size it was processed for
+  uint8_t *buf;               // NULL if processing failed
+  size_t width, height;
+} _speculative_slot_t;
+
+typedef struct _speculative_t
+{
+  dt_pthread_mutex_t lock;
+  pthread_cond_t done;           // signalled when the job ends
+  _speculative_slot_t slot[DT_SPECULATIVE_SLOTS];
+  dt_imgid_t center;             // the edited image
+  dt_dev_viewport_t port;        // main view, copied by the gui thread
+  size_t width, height;          // main view size in device pixels
+  gboolean idle;                 // the pipes of the edited image are done
+  gboolean queued;               // the job is queued or running
+  int generation;                // changes when the running pipe gets dropped
+  dt_develop_t *dev;             // develop of the running pipe
+} _speculative_t;
+
+static _speculative_t _speculative;
+
+static dt_imgid_t _speculative_neighbour(const dt_imgid_t imgid,
+                                         const int diff)
+{
+  dt_imgid_t neighbour = NO_IMGID;
+  sqlite3_stmt *stmt;
+  // clang-format off
+  DT_DEBUG_SQLITE3_PREPARE_V2
+    (dt_database_get(darktable.db),
+     "SELECT imgid"
+     " FROM memory.collected_images"
+     " WHERE rowid=(SELECT rowid"
+     "              FROM memory.collected_images"
+     "              WHERE imgid=?1)+?2",
+     -1, &stmt, NULL);
+  // clang-format on
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, diff);
+  if(sqlite3_step(stmt) == SQLITE_ROW)
+    neighbour = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+  return neighbour;
+}
+
+// returns the change timestamp of the image and the rough memory its
+// pipe needs: the full input buffer and two cachelines in float4
+static GTimeSpan _speculative_image_info(const dt_imgid_t imgid,
+                                         size_t *mem)
+{
+  GTimeSpan timestamp = 0;
+  if(mem) *mem = 0;
+  const dt_image_t *image = dt_image_cache_get(imgid, 'r');
+  if(image)
+  {
+    timestamp = image->change_timestamp;
+    if(mem) *mem = (size_t)3 * image->width * image->height * 4 * sizeof(float);
+    dt_image_cache_read_release(image);
+  }
+  return timestamp;
+}
+
+// called with the lock held
+static _speculative_slot_t *_speculative_find(const dt_imgid_t imgid,
+                                              const GTimeSpan timestamp)
+{
+  for(int k = 0; k < DT_SPECULATIVE_SLOTS; k++)
+  {
+    _speculative_slot_t *slot = &_speculative.slot[k];
+    if(slot->imgid == imgid && slot->change_timestamp == timestamp)
+      return slot;
+  }
+  return NULL;
+}
+
+// drops the result of the running pipe and stops it
+static void _speculative_cancel(void)
+{
+  dt_pthread_mutex_lock(&_speculative.lock);
+  _speculative.idle = FALSE;
+  _speculative.generation++;
+  if(_speculative.dev)
+  {
+    // makes dt_dev_process_image_job() return instead of restarting
+    _speculative.dev->gui_leaving = TRUE;
+    dt_atomic_set_int(&_speculative.dev->full.pipe->shutdown, DT_DEV_PIXELPIPE_STOP_NODES);
+  }
+  dt_pthread_mutex_unlock(&_speculative.lock);
+}
+
+static void _speculative_clear(void)
+{
+  _speculative_cancel();
+  dt_pthread_mutex_lock(&_speculative.lock);
+  _speculative.center = NO_IMGID;
+  for(int k = 0; k < DT_SPECULATIVE_SLOTS; k++)
+  {
+    dt_free_align(_speculative.slot[k].buf);
+    memset(&_speculative.slot[k], 0, sizeof(_speculative_slot_t));
+    _speculative.slot[k].imgid = NO_IMGID;
+  }
+  dt_pthread_mutex_unlock(&_speculative.lock);
+}
+
+static void _speculative_init(void)
+{
+  dt_pthread_mutex_init(&_speculative.lock, NULL);
+  pthread_cond_init(&_speculative.done, NULL);
+  _speculative_clear();
+}
+
+static void _speculative_cleanup(void)
+{
+  _speculative_clear();
+
+  // the job must be gone before the lock
+  dt_pthread_mutex_lock(&_speculative.lock);
+  while(_speculative.queued && dt_control_running())
+    dt_pthread_cond_wait(&_speculative.done, &_speculative.lock);
+  dt_pthread_mutex_unlock(&_speculative.lock);
+
+  pthread_cond_destroy(&_speculative.done);
+  dt_pthread_mutex_destroy(&_speculative.lock);
+}
+
+// registers the develop of the running pipe so the gui thread can stop it
+static void _speculative_running(dt_develop_t *dev,
+                                 gpointer user_data)
+{
+  const int generation = GPOINTER_TO_INT(user_data);
+
+  if(dev)
+  {
+    dt_pthread_mutex_lock(&_speculative.lock);
+    _speculative.dev = dev;
+    if(generation != _speculative.generation) dev->gui_leaving = TRUE;
+    dt_pthread_mutex_unlock(&_speculative.lock);
+
+    // the pipe is of the darkroom kind but must not compete with it
+    dt_thread_budget_enter(darktable.thread_budget, DT_THREAD_BUDGET_PRIORITY_BACKGROUND);
+  }
+  else
+  {
+    dt_thread_budget_leave(darktable.thread_budget);
+
+    dt_pthread_mutex_lock(&_speculative.lock);
+    _speculative.dev = NULL;
+    dt_pthread_mutex_unlock(&_speculative.lock);
+  }
+}
+
+static int32_t _speculative_job_run(dt_job_t *job)
+{
+  const int diff[DT_SPECULATIVE_SLOTS] = { 1, -1 }; // next image first
+
+  while(TRUE)
+  {
+    dt_pthread_mutex_lock(&_speculative.lock);
+    const dt_imgid_t center = _speculative.center;
+    const dt_dev_viewport_t port = _speculative.port;
+    const size_t width = _speculative.width;
+    const size_t height = _speculative.height;
+    const int generation = _speculative.generation;
+    // only while the pipes of the edited image are done
+    const gboolean pipes_idle = _speculative.idle;
+    const gboolean idle =
+      pipes_idle
+      && dt_is_valid_imgid(center)
+      && dt_control_running()
+      && dt_conf_get_bool("darkroom/ui/speculative");
+    dt_pthread_mutex_unlock(&_speculative.lock);
+
+    dt_imgid_t neighbour[DT_SPECULATIVE_SLOTS] = { NO_IMGID, NO_IMGID };
+    GTimeSpan timestamp[DT_SPECULATIVE_SLOTS] = { 0 };
+    int next = -1;
+    if(idle)
+    {
+      size_t center_mem = 0;
+      _speculative_image_info(center, &center_mem);
+      for(int k = 0; k < DT_SPECULATIVE_SLOTS; k++)
+      {
+        neighbour[k] = _speculative_neighbour(center, diff[k]);
+        if(!dt_is_valid_imgid(neighbour[k])) continue;
+
+        size_t mem = 0;
+        timestamp[k] = _speculative_image_info(neighbour[k], &mem);
+
+        dt_pthread_mutex_lock(&_speculative.lock);
+        const _speculative_slot_t *slot = _speculative_find(neighbour[k], timestamp[k]);
+        const gboolean done = slot
+          && slot->display_width == width
+          && slot->display_height == height;
+        dt_pthread_mutex_unlock(&_speculative.lock);
+
+        // its pipe must fit into memory next to the one of the edited image
+        if(next < 0 && !done && mem + center_mem <= dt_get_available_mem())
+          next = k;
+      }
+    }
+
+    if(next < 0)
+    {
+      // nothing left to do for the edited image, unless it or its pipes changed meanwhile
+      dt_pthread_mutex_lock(&_speculative.lock);
+      const gboolean finished = center == _speculative.center
+        && pipes_idle == _speculative.idle;
+      if(finished)
+      {
+        _speculative.queued = FALSE;
+        pthread_cond_broadcast(&_speculative.done);
+      }
+      dt_pthread_mutex_unlock(&_speculative.lock);
+      if(finished) break;
+      continue;
+    }
+
+    const dt_imgid_t imgid = neighbour[next];
+    const double start = dt_get_wtime();
+    size_t buf_width = 0, buf_height = 0;
+    uint8_t *buf = NULL;
+    // rendered in one pass, as progressive runs are for darktable.develop only
+    dt_dev_image_ext(imgid, width, height, -1, &buf, NULL,
+                     &buf_width, &buf_height, NULL, NULL, -1, NULL,
+                     DT_DEVICE_NONE, FALSE, &port,
+                     _speculative_running, GINT_TO_POINTER(generation));
+    if(buf && (!buf_width || !buf_height))
+    {
+      // the image failed to load
+      dt_free_align(buf);
+      buf = NULL;
+    }
+
+    dt_pthread_mutex_lock(&_speculative.lock);
+    if(generation == _speculative.generation && center == _speculative.center)
+    {
+      // a failed image is recorded as well, not to try it over and over
+      _speculative_slot_t *slot = NULL;
+      for(int k = 0; k < DT_SPECULATIVE_SLOTS && !slot; k++)
+      {
+        const dt_imgid_t id = _speculative.slot[k].imgid;
+        if(id == imgid || (id != neighbour[0] && id != neighbour[1]))
+          slot = &_speculative.slot[k];
+      }
+      dt_free_align(slot->buf);
+      slot->imgid = imgid;
+      slot->change_timestamp = timestamp[next];
+      slot->display_width = width;
+      slot->display_height = height;
+      slot->buf = buf;
+      slot->width = buf_width;
+      slot->height = buf_height;
+      buf = NULL;
+      dt_print(DT_DEBUG_DEV | DT_DEBUG_PERF,
+               "[darkroom] processed ID=%d ahead in %.3fs%s",
+               imgid, dt_get_wtime() - start, slot->buf ? "" : ", failed");
+    }
+    dt_pthread_mutex_unlock(&_speculative.lock);
+    // outdated meanwhile
+    dt_free_align(buf);
+  }
+  return 0;
+}
+
+// starts processing the neighbours of the edited image once its pipes are done
+static void _speculative_schedule(dt_develop_t *dev)
+{
+  if(!dt_conf_get_bool("darkroom/ui/speculative")) return;
+
+  dt_pthread_mutex_lock(&_speculative.lock);
+  _speculative.center = dev->image_storage.id;
+  _speculative.port = dev->full;
+  _speculative.idle = dev->full.pipe->status == DT_DEV_PIXELPIPE_VALID
+                      && dev->preview_pipe->status == DT_DEV_PIXELPIPE_VALID;
+  _speculative.width = dev->full.width * dev->full.ppd;
+  _speculative.height = dev->full.height * dev->full.ppd;
+  const gboolean queue = !_speculative.queued;
+  _speculative.queued = TRUE;
+  dt_pthread_mutex_unlock(&_speculative.lock);
+
+  if(!queue) return;
+
+  dt_job_t *job = dt_control_job_create(&_speculative_job_run, "%s", N_("process neighbouring images"));
+  if(!job || dt_control_add_job(DT_JOB_QUEUE_USER_BG, job))
+  {
+    dt_pthread_mutex_lock(&_speculative.lock);
+    _speculative.queued = FALSE;
+    pthread_cond_broadcast(&_speculative.done);
+    dt_pthread_mutex_unlock(&_speculative.lock);
+  }
+}
+
+// paints the rendition of imgid processed ahead, if there is one
+static gboolean _speculative_paint(cairo_t *cr,
+                                   const int32_t width,
+                                   const int32_t height,
+                                   const dt_dev_viewport_t *port,
+                                   const dt_imgid_t imgid)
+{
+  const GTimeSpan timestamp = _speculative_image_info(imgid, NULL);
+
+  dt_pthread_mutex_lock(&_speculative.lock);
+  const _speculative_slot_t *slot = _speculative_find(imgid, timestamp);
+  const gboolean found = slot && slot->buf;
+  if(found)
+  {
+    cairo_save(cr);
+    dt_gui_gtk_set_source_rgb(cr, DT_GUI_COLOR_DARKROOM_BG);
+    cairo_paint(cr);
+
+    const double scale = MIN((double)port->width / slot->width,
+                             (double)port->height / slot->height);
+    cairo_translate(cr, 0.5 * width, 0.5 * height);
+    cairo_scale(cr, scale, scale);
+    cairo_surface_t *surface = dt_view_create_surface(slot->buf, slot->width, slot->height);
+    cairo_set_source_surface(cr, surface, -0.5 * slot->width, -0.5 * slot->height);
+    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+    cairo_paint(cr);
+    cairo_surface_destroy(surface);
+    cairo_restore(cr);
+  }
+  dt_pthread_mutex_unlock(&_speculative.lock);
+
+  return found;
+}
+
 void expose(dt_view_t *self,
             cairo_t *cri,
             const int32_t width,
@@ -552,6 +899,11 @@ void expose(dt_view_t *self,
       cairo_surface_reference(darktable.gui->surface);
     }
   }
+  else if(!dev->image_invalid_cnt
+          && _speculative_paint(cri, width, height, port, dev->image_storage.id))
+  {
+    // processed ahead, shown until the pipes of the image are done
+  }
   else if(dev->preview_pipe->output_imgid != dev->image_storage.id)
   {
     gchar *load_txt;
@@ -684,6 +1036,9 @@ void expose(dt_view_t *self,
     g_free(load_txt);
   }
 
+  // the edited image needs the cores
+  if(_full_request(dev) || _preview_request(dev)) _speculative_cancel();
+
   if(_full_request(dev)) dt_dev_process_image(dev);
   if(_preview_request(dev)) dt_dev_process_preview(dev);
   if(_preview2_request(dev)) dt_dev_process_preview2(dev);
@@ -1432,7 +1787,16 @@ static void skip_b_key_accel_callback(dt_action_t *action)
 static void _darkroom_ui_pipe_finish_signal_callback(gpointer instance,
                                                      gpointer data)
 {
+  dt_view_t *self = (dt_view_t *)data;
   dt_control_queue_redraw_center();
+  _speculative_schedule(self->data);
+}
+
+static void _darkroom_ui_preview_pipe_finish_signal_callback(gpointer instance,
+                                                             gpointer data)
+{
+  dt_view_t *self = (dt_view_t *)data;
+  _speculative_schedule(self->data);
 }
 
 static void _darkroom_ui_preview2_pipe_finish_signal_callback(gpointer instance,
@@ -2989,6 +3353,8 @@ void enter(dt_view_t *self)
   /* connect to ui pipe finished signal for redraw */
   DT_CONTROL_SIGNAL_HANDLE(DT_SIGNAL_DEVELOP_UI_PIPE_FINISHED,
                            _darkroom_ui_pipe_finish_signal_callback);
+  DT_CONTROL_SIGNAL_HANDLE(DT_SIGNAL_DEVELOP_PREVIEW_PIPE_FINISHED,
+                           _darkroom_ui_preview_pipe_finish_signal_callback);
   DT_CONTROL_SIGNAL_HANDLE(DT_SIGNAL_DEVELOP_PREVIEW2_PIPE_FINISHED,
                            _darkroom_ui_preview2_pipe_finish_signal_callback);
   DT_CONTROL_SIGNAL_HANDLE(DT_SIGNAL_TROUBLE_MESSAGE,
@@ -3129,6 +3495,9 @@ void leave(dt_view_t *self)
 
   DT_CONTROL_SIGNAL_DISCONNECT_ALL(self, "darkroom");
 
+  // the neighbours of the edited image are of no use outside
+  _speculative_clear();
+
   // store groups for next time:
   dt_conf_set_int("plugins/darkroom/groups", dt_dev_modulegroups_get(darktable.develop));
 
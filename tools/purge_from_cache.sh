@@ -38,6 +38,7 @@ cache_base="${HOME}/.cache/darktable"
 library="$configdir/library.db"
 dryrun=1
 LIBDB=""
+generate_cache="darktable-generate-cache"
 
 # remember the command line to show it in the end when not purging
 commandline="$0 $*"
@@ -57,6 +58,8 @@ while [ "$#" -ge 1 ] ; do
     echo "                           (default: '${configdir}')"
     echo "  -l|--library <path>      path to the library.db"
     echo "                           (default: '${library}')"
+    echo "  -g|--generate-cache <path> darktable-generate-cache binary, it purges the thumbnail packs"
+    echo "                           (default: '${generate_cache}')"
     echo "  -p|--purge               actually delete the files instead of just finding them"
     exit 0
     ;;
@@ -72,6 +75,10 @@ while [ "$#" -ge 1 ] ; do
     configdir="$2"
     shift
     ;;
+  -g|--generate-cache)
+    generate_cache="$2"
+    shift
+    ;;
   -p|--purge)
     dryrun=0
     ;;
@@ -114,8 +121,9 @@ fi
 id_list=$(mktemp -t darktable-tmp.XXXXXX)
 sqlite3 "${library}" "select id from images order by id" > "${id_list}"
 
-# iterate over cached mipmaps and check for each if the image is in the db
-find "${cache_dir}" -type f | while read -r mipmap; do
+# thumbnails of the old layout that weren't moved into the packs yet, one
+# <mip>/<id>.jpg per image. check for each if the image is in the db
+find "${cache_dir}" -mindepth 2 -type f -name '*.jpg' | while read -r mipmap; do
   # get the image id from the filename
   id=$(echo "${mipmap}" | sed 's,.*/\([0-9]*\).*,\1,')
   # ... and delete it if it's not in the library
@@ -124,6 +132,18 @@ done
 
 rm --force "${id_list}"
 
+# the packs (<mip>.pack) hold the thumbnails of all images of a mip size,
+# only darktable knows how to remove single ones from them
+if ! command -v "${generate_cache}" > /dev/null ; then
+  echo "error: '${generate_cache}' not found, can't purge the thumbnail packs"
+  exit 1
+fi
+pack_options="--purge"
+if [ ${dryrun} -eq 1 ]; then
+  pack_options="--purge --dry-run"
+fi
+"${generate_cache}" ${pack_options} --core --library "${library}" --configdir "${configdir}" --cachedir "${cache_base}"
+
 if [ $dryrun -eq 1 ]; then
     echo
     echo to really remove stale thumbnails from the cache call: